@@ -21,6 +21,13 @@ do
 	retValue=$?
 	echo "data_recorder program exited on $dt (count = $count, return value = $retValue)"
 	
+	#server socket was handed off to a newly started instance (which runs under its own copy of this script)
+	if [ $retValue -eq 11 ];
+	then
+		echo "Server socket was handed off to a new data_recorder instance; exiting"
+		exit 0
+	fi
+	
 	#create backup directory and move files if error occurred after startup
 	if [ $retValue -ne 10 ];
 	then
@@ -32,6 +39,6 @@ do
 	fi
 	
 
-	#sleep 5 minutes for port to be ready
-	sleep 300
+	#server socket is bound with SO_REUSEADDR, so the port is ready almost immediately
+	sleep 5
 done
@@ -6,21 +6,44 @@
 //Run in background and direct output to a file as follows
 //	./connection_test_program [IP] [port] [no_of_attempts] > file.txt &
 
+//Connection storm mode (many meters reconnecting at once, eg: after a service restart)
+//	./connection_test_program storm [IP] [port] [no_of_connections] [connections_per_second: 0=all at once] [first_device_ID]
+//Connections are opened without blocking at the given rate; time to connect (TCP handshake) and, when a first device ID is given,
+//time to the first ACK of a record sent on each connection (device IDs first_device_ID, first_device_ID + 1, ...) are reported
+//Connects taking more than a second were retried by the kernel (SYN dropped, usually by a full listen backlog);
+//for a local service the kernel's listen queue overflow and drop counters are reported as well
+//Connections closed by the service right after accept (eg: FDs beyond its select() limit) are reported as failures
+
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
 #include <netdb.h>
 #include <arpa/inet.h> //inet_ntop
 #include <unistd.h>
+#include <time.h>
 
 #include <cstring>	//memset
+#include <cerrno>
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
 
 //Functions are implemented below main
 int connectToServer(const char* remoteServerIP, const char* remoteServerPort);	//returns socketFD
 bool closeConnection(int socketFD);
 bool sendData(int socketFD, std::string data);
 
+int runConnectionStorm(const char* remoteServerIP, const char* remoteServerPort, int connectionCount, int connectionsPerSecond, int firstDeviceID);
+std::string createRecordFrame(int deviceID);
+std::string getPercentiles(std::vector<double> valuesMs);
+long getListenQueueCounter(const std::string& counterName);
+long long getMonotonicTimeNs();
+
 
 
 //*************************************************************************************************
@@ -31,6 +54,19 @@ int main(int argc, char** argv)
 	const char* remoteServerIP = "localhost";
 	const char* remoteServerPort = "5000";
 
+	if (argc > 1 && std::string(argv[1]) == "storm")
+	{
+		if (argc < 6)
+		{
+			std::cout << "Usage: ./connection_test_program storm <remote_server_IP> <remote_server_port> <no_of_connections>"
+						<< " <connections_per_second: 0=all at once> [first_device_ID]" << std::endl;
+			return -1;
+		}
+
+		int firstDeviceID = (argc > 6) ? atoi(argv[6]) : -1;
+		return runConnectionStorm(argv[2], argv[3], atoi(argv[4]), atoi(argv[5]), firstDeviceID);
+	}
+
 	if (argc < 4)
 	{
 		std::cout << "Usage: ./connection_test_program <remote_server_IP> <remote_server_port> <no_of_connection_attempts>" << std::endl;
@@ -142,3 +178,289 @@ bool sendData(int socketFD, std::string data)
 	}
 	return true;
 }
+
+
+//*************************************************************************************************
+int runConnectionStorm(const char* remoteServerIP, const char* remoteServerPort, int connectionCount, int connectionsPerSecond, int firstDeviceID)
+{
+	enum ConnectionState { NOT_STARTED, CONNECTING, WAITING_ACK, CONNECTED, FAILED, CLOSED_BY_SERVER };
+
+	struct StormConnection
+	{
+		int m_socketFD;
+		ConnectionState m_state;
+		long long m_startTimeNs;
+		long long m_connectedTimeNs;
+	};
+
+	//Each connection needs a file descriptor
+	struct rlimit fileLimit;
+	if (getrlimit(RLIMIT_NOFILE, &fileLimit) == 0 && fileLimit.rlim_cur < fileLimit.rlim_max)
+	{
+		fileLimit.rlim_cur = fileLimit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &fileLimit);
+	}
+
+	struct addrinfo addr, *info;
+	memset(&addr, 0, sizeof(addrinfo));
+	addr.ai_family = AF_UNSPEC;
+	addr.ai_socktype = SOCK_STREAM;
+
+	if (getaddrinfo(remoteServerIP, remoteServerPort, &addr, &info) != 0)
+	{
+		std::cout << "Unable to get address info" << std::endl;
+		return -1;
+	}
+
+	int epollFD = epoll_create1(0);
+	std::vector<StormConnection> connections(connectionCount, StormConnection{-1, NOT_STARTED, 0, 0});
+	std::vector<double> connectTimesMs;
+	std::vector<double> firstACKTimesMs;
+	std::map<std::string, int> failureReasons;
+	int slowConnectCount = 0;
+	int finishedCount = 0;
+	int startedCount = 0;
+
+	long listenOverflowsBefore = getListenQueueCounter("ListenOverflows");
+	long listenDropsBefore = getListenQueueCounter("ListenDrops");
+
+	std::cout << "Connection storm: " << connectionCount << " connections to " << remoteServerIP << ":" << remoteServerPort << " at "
+				<< (connectionsPerSecond > 0 ? std::to_string(connectionsPerSecond) + " connections/s" : std::string("once")) << std::endl;
+
+	long long stormStartTimeNs = getMonotonicTimeNs();
+	long long timeoutNs = 60LL * 1000000000;	//for the slowest connection, after the last one is started
+
+	while (finishedCount < connectionCount)
+	{
+		long long nowNs = getMonotonicTimeNs();
+
+		//Start the connections that are due at the configured rate
+		int dueCount = connectionCount;
+		if (connectionsPerSecond > 0)
+			dueCount = std::min((long long) connectionCount, (nowNs - stormStartTimeNs) * connectionsPerSecond / 1000000000 + 1);
+
+		while (startedCount < dueCount)
+		{
+			StormConnection& connection = connections[startedCount];
+			connection.m_startTimeNs = getMonotonicTimeNs();
+			connection.m_socketFD = socket(info->ai_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+
+			if (connection.m_socketFD == -1 || (::connect(connection.m_socketFD, info->ai_addr, info->ai_addrlen) == -1 && errno != EINPROGRESS))
+			{
+				++failureReasons[std::string("connect: ") + strerror(errno)];
+				connection.m_state = FAILED;
+				++finishedCount;
+			}
+			else
+			{
+				struct epoll_event event;
+				event.events = EPOLLOUT;
+				event.data.u32 = startedCount;
+				epoll_ctl(epollFD, EPOLL_CTL_ADD, connection.m_socketFD, &event);
+				connection.m_state = CONNECTING;
+			}
+
+			++startedCount;
+		}
+
+		if (startedCount == connectionCount && nowNs - connections[connectionCount - 1].m_startTimeNs > timeoutNs)
+			break;
+
+		struct epoll_event events[256];
+		int eventCount = epoll_wait(epollFD, events, 256, 1);
+
+		for (int i = 0; i < eventCount; ++i)
+		{
+			StormConnection& connection = connections[events[i].data.u32];
+			long long eventTimeNs = getMonotonicTimeNs();
+
+			if (connection.m_state == CONNECTING)
+			{
+				int socketError = 0;
+				socklen_t length = sizeof(socketError);
+				getsockopt(connection.m_socketFD, SOL_SOCKET, SO_ERROR, &socketError, &length);
+
+				if (socketError != 0)
+				{
+					++failureReasons[std::string("connect: ") + strerror(socketError)];
+					connection.m_state = FAILED;
+					epoll_ctl(epollFD, EPOLL_CTL_DEL, connection.m_socketFD, NULL);
+					++finishedCount;
+					continue;
+				}
+
+				connection.m_connectedTimeNs = eventTimeNs;
+				double connectTimeMs = (eventTimeNs - connection.m_startTimeNs) / 1e6;
+				connectTimesMs.push_back(connectTimeMs);
+
+				if (connectTimeMs > 1000)	//The kernel retransmits a SYN after 1 s
+					++slowConnectCount;
+
+				if (firstDeviceID < 0)
+				{
+					connection.m_state = CONNECTED;
+					epoll_ctl(epollFD, EPOLL_CTL_DEL, connection.m_socketFD, NULL);
+					++finishedCount;
+					continue;
+				}
+
+				//Send one record and wait for its ACK
+				std::string frame = createRecordFrame(firstDeviceID + events[i].data.u32);
+				if (::send(connection.m_socketFD, frame.data(), frame.size(), MSG_NOSIGNAL) != (int) frame.size())
+				{
+					++failureReasons[std::string("send: ") + strerror(errno)];
+					connection.m_state = FAILED;
+					epoll_ctl(epollFD, EPOLL_CTL_DEL, connection.m_socketFD, NULL);
+					++finishedCount;
+					continue;
+				}
+
+				struct epoll_event event;
+				event.events = EPOLLIN;
+				event.data.u32 = events[i].data.u32;
+				epoll_ctl(epollFD, EPOLL_CTL_MOD, connection.m_socketFD, &event);
+				connection.m_state = WAITING_ACK;
+			}
+			else if (connection.m_state == WAITING_ACK)
+			{
+				char buffer[256];
+				ssize_t result = recv(connection.m_socketFD, buffer, sizeof(buffer), 0);
+
+				if (result > 0)
+				{
+					firstACKTimesMs.push_back((eventTimeNs - connection.m_connectedTimeNs) / 1e6);
+					connection.m_state = CONNECTED;
+				}
+				else if (result == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+				{
+					++failureReasons["closed by service before ACK (unknown device ID, or FD limit of the service?)"];
+					connection.m_state = CLOSED_BY_SERVER;
+				}
+				else
+				{
+					continue;
+				}
+
+				epoll_ctl(epollFD, EPOLL_CTL_DEL, connection.m_socketFD, NULL);
+				++finishedCount;
+			}
+		}
+	}
+
+	double stormSeconds = (getMonotonicTimeNs() - stormStartTimeNs) / 1e9;
+
+	long listenOverflows = getListenQueueCounter("ListenOverflows") - listenOverflowsBefore;
+	long listenDrops = getListenQueueCounter("ListenDrops") - listenDropsBefore;
+
+	std::cout << "\n***********************************************" << std::endl;
+	std::cout << "Finished in " << stormSeconds << " s; connections: " << connectionCount << ", connected: " << connectTimesMs.size()
+				<< ", ACKed: " << firstACKTimesMs.size() << ", unfinished (timed out): " << connectionCount - finishedCount << std::endl;
+	std::cout << "Time to connect (ms): " << getPercentiles(connectTimesMs) << std::endl;
+	std::cout << "Connects slower than 1 s (SYN retransmitted, usually due to a full listen backlog): " << slowConnectCount << std::endl;
+
+	if (firstDeviceID >= 0)
+		std::cout << "Time from connect to first ACK (ms): " << getPercentiles(firstACKTimesMs) << std::endl;
+
+	if (listenOverflowsBefore >= 0)
+		std::cout << "Kernel listen queue overflows: " << listenOverflows << ", listen drops: " << listenDrops << " (all listening sockets on this host)" << std::endl;
+
+	//Connections that are not waiting for an ACK are not watched; the service may have closed them right after accept
+	//(eg: when it runs out of FDs usable with select())
+	for (auto& connection: connections)
+	{
+		char byte;
+		if (connection.m_state == CONNECTED && firstDeviceID < 0 && recv(connection.m_socketFD, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == 0)
+		{
+			++failureReasons["closed by service after connect (FD limit of the service?)"];
+			connection.m_state = CLOSED_BY_SERVER;
+		}
+	}
+
+	for (auto& entry: failureReasons)
+		std::cout << "Failure: " << entry.first << ": " << entry.second << std::endl;
+
+	for (auto& connection: connections)
+	{
+		if (connection.m_socketFD != -1)
+			close(connection.m_socketFD);
+	}
+
+	close(epollFD);
+	freeaddrinfo(info);
+	return 0;
+}
+
+
+//*************************************************************************************************
+std::string createRecordFrame(int deviceID)
+{
+	//Default data recorder frame layout (128 bytes): int counter, date_time, int device ID, floats and chars,
+	//XOR checksum of the preceding bytes, end marker 0xFF
+	std::string frame(128, '\0');
+
+	int counter = 1;
+	int timestamp = time(0) + 5*3600 + 30*60;	//devices send local time (UTC+05:30)
+	memcpy(&frame[0], &counter, sizeof(counter));
+	memcpy(&frame[4], &timestamp, sizeof(timestamp));
+	memcpy(&frame[8], &deviceID, sizeof(deviceID));
+
+	unsigned char checksum = 0;
+	for (int k = 0; k < 126; ++k)
+		checksum ^= (unsigned char) frame[k];
+
+	frame[126] = checksum;
+	frame[127] = (char) 0xFF;
+	return frame;
+}
+
+
+//*************************************************************************************************
+std::string getPercentiles(std::vector<double> valuesMs)
+{
+	if (valuesMs.empty())
+		return "no samples";
+
+	std::sort(valuesMs.begin(), valuesMs.end());
+
+	auto percentile = [&valuesMs](double p) { return valuesMs[std::min(valuesMs.size() - 1, (size_t) (p / 100 * valuesMs.size()))]; };
+
+	std::ostringstream result;
+	result << "min = " << valuesMs.front() << ", p50 = " << percentile(50) << ", p90 = " << percentile(90)
+			<< ", p99 = " << percentile(99) << ", max = " << valuesMs.back();
+	return result.str();
+}
+
+
+//*************************************************************************************************
+long getListenQueueCounter(const std::string& counterName)
+{
+	//TcpExt section of /proc/net/netstat: a line of names followed by a line of values
+	std::ifstream netstatFile("/proc/net/netstat");
+	std::string namesLine, valuesLine;
+
+	while (std::getline(netstatFile, namesLine) && std::getline(netstatFile, valuesLine))
+	{
+		if (namesLine.compare(0, 7, "TcpExt:") != 0)
+			continue;
+
+		std::istringstream names(namesLine), values(valuesLine);
+		std::string name, value;
+
+		while (names >> name && values >> value)
+		{
+			if (name == counterName)
+				return std::stol(value);
+		}
+	}
+
+	return -1;
+}
+
+
+//*************************************************************************************************
+long long getMonotonicTimeNs()
+{
+	struct timespec timeSpec;
+	clock_gettime(CLOCK_MONOTONIC, &timeSpec);
+	return (long long) timeSpec.tv_sec * 1000000000 + timeSpec.tv_nsec;
+}
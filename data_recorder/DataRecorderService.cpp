@@ -1,12 +1,14 @@
 #include <cstring> //strncpy
 #include <exception>
 #include <fstream>	//for dumping service info to file
+#include <iostream>
 
 #include <DataRecorderService.h>
 #include <DataStorage.h>
 #include <ConfigurationHandler.h>
 #include <Logger.h>
 #include <Forwarder.h>
+#include <MemoryAccounting.h>
 
 
 //*************************************************************************************************
@@ -15,8 +17,12 @@ DataRecorderService::DataRecorderService():
 	m_heartbeatTimer{nullptr},
 	m_cacheFlushTimer{nullptr},
 	m_deviceLoadTimer{nullptr},
+	m_backpressureTimer{nullptr},
 	m_dataStorage{nullptr},
-	m_rejectionCount{0}
+	m_rejectionCount{0},
+	m_backpressureHighWatermark{0},
+	m_backpressureLowWatermark{0},
+	m_backpressureActivationCount{0}
 {
 }
 
@@ -36,6 +42,7 @@ bool DataRecorderService::initialize()
 	int deviceLoadTimerInterval;
 	int nullRecordGenerationTimerInterval;
 	int FDCheckTimerInterval;
+	long rawFrameCaptureSizeMB;
 	try
 	{
 		receiveBufferSize = std::stoi(configHandler.getConfig("ReceiveBufferSize"));
@@ -45,8 +52,21 @@ bool DataRecorderService::initialize()
 		deviceLoadTimerInterval = std::stoi(configHandler.getConfig("DeviceLoadTimerInterval"));
 		nullRecordGenerationTimerInterval = std::stoi(configHandler.getConfig("NullRecordGenerationTimerInterval"));
 		FDCheckTimerInterval = std::stoi(configHandler.getConfig("FDCheckTimerInterval"));
+		rawFrameCaptureSizeMB = std::stol(configHandler.getConfig("RawFrameCaptureSizeMB"));
 		m_deviceInactiveTimeThreshold = std::stoi(configHandler.getConfig("DeviceInactiveTimeThreshold"));
 
+		m_backpressureHighWatermark = std::stoi(configHandler.getConfig("BackpressureHighWatermark"));
+		m_backpressureLowWatermark = std::stoi(configHandler.getConfig("BackpressureLowWatermark"));
+
+		MemoryAccounting::getInstance().setBudget(std::stol(configHandler.getConfig("MemoryBudgetMB")) * 1024 * 1024);
+
+		m_socketMan.setConnectionQuotas(std::stol(configHandler.getConfig("ConnectionBytesPerSecondQuota")),
+						std::stol(configHandler.getConfig("ConnectionRecordsPerSecondQuota")),
+						std::stoi(configHandler.getConfig("ConnectionQuotaBurstSeconds")));
+
+		m_socketMan.setAcceptParameters(std::stoi(configHandler.getConfig("ListenBacklog")),
+						std::stoi(configHandler.getConfig("AcceptBatchSize")));
+
 		m_forwarder = new Forwarder();
         m_forwardingClient = m_socketMan.createClient((char *) m_configHandler.getConfig("ForwardIP").c_str(),(char *) m_configHandler.getConfig("ForwardPort").c_str(),m_forwarder);
 
@@ -58,16 +78,35 @@ bool DataRecorderService::initialize()
 		return false;
 	}
 
+	//With low >= high, reading would be resumed right after each pause (or never paused again)
+	if (m_backpressureHighWatermark > 0 && m_backpressureLowWatermark >= m_backpressureHighWatermark)
+	{
+		BOOST_LOG_TRIVIAL(error) << "BackpressureLowWatermark (" << m_backpressureLowWatermark << ") must be below BackpressureHighWatermark ("
+					<< m_backpressureHighWatermark << "); backpressure is disabled";
+		m_backpressureHighWatermark = 0;
+	}
+
 
 	char terminationCharacter = configHandler.getTerminationCharacter();
 
 	m_socketMan.setReceiveBufferSize(receiveBufferSize);
 	m_socketMan.setBufferedMessageHardLimit(bufferedMessageHardLimit);
+	m_socketMan.setBufferedMessageLimitPolicy(configHandler.getConfig("BufferedMessageLimitPolicy") == "disconnect");
+	m_socketMan.configureRawFrameCapture(configHandler.getConfig("RawFrameCaptureFilename"), rawFrameCaptureSizeMB * 1024 * 1024,
+						configHandler.getConfig("RawFrameCaptureMode") == "stream", configHandler.getConfig("RawFrameCaptureEnabled") == "1");
 	m_socketMan.setMsgTerminationCharacter(terminationCharacter);
 
 	m_msgTerminationCharacter = terminationCharacter;
 
-	m_dataRecorderServer = m_socketMan.createServer(m_servicePort, this);
+	bool isServerHandoffEnabled = (configHandler.getConfig("ServerHandoffEnabled") == "1");
+	std::string handoffSocketPath = configHandler.getConfig("ServerHandoffSocketPath");
+
+	//Take over the listening socket of a running instance if there is one (it exits after flushing its state)
+	if (isServerHandoffEnabled)
+		m_dataRecorderServer = m_socketMan.inheritServer(handoffSocketPath.c_str(), this);
+
+	if (m_dataRecorderServer == nullptr)
+		m_dataRecorderServer = m_socketMan.createServer(m_servicePort, this);
 
 	if (m_dataRecorderServer == nullptr)
 	{
@@ -75,6 +114,12 @@ bool DataRecorderService::initialize()
 		return false;
 	}
 
+	if (isServerHandoffEnabled && m_socketMan.enableServerHandoff(handoffSocketPath.c_str()) == false)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed to enable server socket handoff at: " << handoffSocketPath;
+		return false;
+	}
+
 	m_heartbeatTimer = m_socketMan.createTimer(heartbeatTimerInterval, "Heartbeat Timer", this);
 
 	if (m_heartbeatTimer == nullptr)
@@ -115,6 +160,18 @@ bool DataRecorderService::initialize()
 		return false;
 	}
 
+	if (m_backpressureHighWatermark > 0)
+	{
+		//Drains the caches while reading is paused (other timers may be minutes apart)
+		m_backpressureTimer = m_socketMan.createTimer(1, "Backpressure Timer", this);
+
+		if (m_backpressureTimer == nullptr)
+		{
+			BOOST_LOG_TRIVIAL(error) << "Failed to create backpressure timer" << m_servicePort;
+			return false;
+		}
+	}
+
 	return true;
 }
 
@@ -143,7 +200,11 @@ void DataRecorderService::OnDisconnect(ServerSocket* server, ClientSocket* clien
 	BOOST_LOG_TRIVIAL(info) << "Client disconnected; FD: " << client->getSocketFD()
 					<< ", remoteIP:port: " << client->getRemoteIP() << ":" << client->getRemoteClientPort();
 
-	m_lastActiveTimestamp.erase(client->getSocketFD());
+	int clientFD = client->getSocketFD();
+
+	m_lastActiveTimestamp.erase(clientFD);
+	m_pendingACKs.erase(clientFD);
+	eraseWaitingRecords(clientFD);
 }
 
 
@@ -165,11 +226,20 @@ void DataRecorderService::OnData(ServerSocket* server, ClientSocket* client, std
         m_forwardingClient = m_socketMan.createClient((char *) m_configHandler.getConfig("ForwardIP").c_str(),(char *) m_configHandler.getConfig("ForwardPort").c_str(),m_forwarder);
     }
 
-	int clientFD = client->getSocketFD();
-	m_lastActiveTimestamp[clientFD] = getTimestamp();	//Update last active timestamp
+	m_lastActiveTimestamp[client->getSocketFD()] = getTimestamp();	//Update last active timestamp
 
 	BOOST_LOG_TRIVIAL(debug) << "--------------------------------------------------------------------------------------------- \n";
-	BOOST_LOG_TRIVIAL(trace) << "Client FD: " << clientFD << "\tData: " << message;
+	BOOST_LOG_TRIVIAL(trace) << "Client FD: " << client->getSocketFD() << "\tData: " << message;
+
+	if (processRecord(client, message) == 2)	//Device state not loaded yet
+		m_waitingRecords.push_back(WaitingRecord{client->getSocketFD(), client, message});
+}
+
+
+//*************************************************************************************************
+int DataRecorderService::processRecord(ClientSocket* client, const std::string& message)
+{
+	int clientFD = client->getSocketFD();
 
 	int result = m_dataStorage->validateAndWriteRecord(message, m_ackContent);
 
@@ -180,15 +250,165 @@ void DataRecorderService::OnData(ServerSocket* server, ClientSocket* client, std
 	{
 		//Send ACK to device
 		std::string data = "SERVER:" + std::to_string(m_ackContent.first) + "," + std::to_string(m_ackContent.second) + "\r\n";
-		client->sendData(data);
+
+		if (m_dataStorage->isJournalActive())	//ACK is sent after the journal is synced at the end of the poll cycle
+		{
+			std::pair<ClientSocket*, std::string>& pendingACK = m_pendingACKs[clientFD];
+			pendingACK.first = client;
+			pendingACK.second += data;
+		}
+		else
+		{
+			client->sendData(data);
+		}
 	}
 	else if (result == -1)	//Unknown device; disconnect
 	{
-		m_socketMan.closeClientSocket(clientFD);
-		m_lastActiveTimestamp.erase(clientFD);
+		closeClient(clientFD);
 		++m_rejectionCount;
 	}
 
+	return result;
+}
+
+
+//*************************************************************************************************
+void DataRecorderService::processWaitingRecords()
+{
+	if (m_waitingRecords.size() == 0)
+		return;
+
+	//State of all devices that sent data in this poll cycle is loaded in one batch
+	bool isLoaded = m_dataStorage->hydrateDevices();
+
+	std::vector<WaitingRecord> waitingRecords;
+	waitingRecords.swap(m_waitingRecords);
+
+	if (!isLoaded)
+	{
+		//Records are not ACKed, so devices send them again
+		BOOST_LOG_TRIVIAL(warning) << "Dropping " << waitingRecords.size() << " records of devices whose state could not be loaded";
+		return;
+	}
+
+	std::set<int> closedFDs;	//Remaining records of a client closed while processing must not be touched
+
+	for (auto& waitingRecord: waitingRecords)
+	{
+		if (closedFDs.count(waitingRecord.m_clientFD) != 0)
+			continue;
+
+		int result = processRecord(waitingRecord.m_client, waitingRecord.m_message);
+
+		if (result == -1)
+			closedFDs.insert(waitingRecord.m_clientFD);
+		else if (result == 2)	//Not expected after loading; retried in the next poll cycle
+			m_waitingRecords.push_back(waitingRecord);
+	}
+}
+
+
+//*************************************************************************************************
+void DataRecorderService::closeClient(int clientFD)
+{
+	m_socketMan.closeClientSocket(clientFD);
+	m_lastActiveTimestamp.erase(clientFD);
+	m_pendingACKs.erase(clientFD);
+	eraseWaitingRecords(clientFD);
+}
+
+
+//*************************************************************************************************
+void DataRecorderService::eraseWaitingRecords(int clientFD)
+{
+	auto iter = m_waitingRecords.begin();
+	while (iter != m_waitingRecords.end())
+	{
+		if (iter->m_clientFD == clientFD)
+			iter = m_waitingRecords.erase(iter);
+		else
+			++iter;
+	}
+}
+
+
+//*************************************************************************************************
+void DataRecorderService::OnPollCycleEnd(ServerSocket* server)
+{
+	m_dataStorage->processCompletedWrites();
+	m_dataStorage->applyDeviceReload();
+	processWaitingRecords();
+	sendPendingACKs();
+
+	//Report usage; the pressure level is re-evaluated by SocketManager before the next poll cycle
+	MemoryAccounting& memoryAccounting = MemoryAccounting::getInstance();
+
+	if (memoryAccounting.getPressureLevel() >= MemoryAccounting::PRESSURE_SPILL)
+		m_dataStorage->flushCaches(true);
+
+	m_dataStorage->updateMemoryAccounting();
+	memoryAccounting.set(MemoryAccounting::FORWARD_QUEUE, (m_forwardingClient != nullptr) ? m_forwardingClient->getSendQueueBytes() : 0);
+
+	updateBackpressure();
+}
+
+
+//*************************************************************************************************
+void DataRecorderService::updateBackpressure()
+{
+	if (m_backpressureHighWatermark <= 0)
+		return;
+
+	int pendingRecordCount = m_dataStorage->getPendingRecordCount();
+
+	if (!m_socketMan.isPeerReadingPaused() && pendingRecordCount >= m_backpressureHighWatermark)
+	{
+		BOOST_LOG_TRIVIAL(warning) << "Pending record count (" << pendingRecordCount << ") reached high watermark; pausing reading from devices";
+		m_socketMan.pausePeerReading();
+		++m_backpressureActivationCount;
+	}
+	else if (m_socketMan.isPeerReadingPaused() && pendingRecordCount <= m_backpressureLowWatermark)
+	{
+		BOOST_LOG_TRIVIAL(info) << "Pending record count (" << pendingRecordCount << ") reached low watermark; resuming reading from devices";
+		m_socketMan.resumePeerReading();
+	}
+}
+
+
+//*************************************************************************************************
+void DataRecorderService::OnServerHandoff(ServerSocket* server)
+{
+	BOOST_LOG_TRIVIAL(info) << "Handing off server socket to a new process; flushing state before exiting";
+
+	//The new process loads its state from the database, snapshot and journal after this returns
+	processWaitingRecords();
+	sendPendingACKs();
+	m_dataStorage->flushCaches(true);
+	m_dataStorage->waitForPendingWrites();
+	m_dataStorage->writeDeviceStateSnapshot();
+	m_dataStorage->syncJournal();
+}
+
+
+//*************************************************************************************************
+void DataRecorderService::sendPendingACKs()
+{
+	if (m_pendingACKs.size() == 0)
+		return;
+
+	//One disk flush for all records received in this poll cycle
+	//Records are ACKed only once they are durable; if the sync fails, devices send the unACKed records again
+	if (m_dataStorage->syncJournal() == false)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Record journal sync failed; withholding ACKs of " << m_pendingACKs.size() << " devices";
+		m_pendingACKs.clear();
+		return;
+	}
+
+	for (auto& entry: m_pendingACKs)
+		entry.second.first->sendData(entry.second.second);
+
+	m_pendingACKs.clear();
 }
 
 
@@ -206,7 +426,11 @@ void DataRecorderService::OnTimer(Timer* timer)
 	else if (timer == m_cacheFlushTimer)
 	{
 		BOOST_LOG_TRIVIAL(info) << "Cache flush timer fired";
-		m_dataStorage->flushCaches(true);
+
+		if (m_dataStorage->flushCaches(true))
+			m_dataStorage->writeDeviceStateSnapshot();
+
+		m_dataStorage->evictIdleDevices();
 	}
 	else if (timer == m_FDCheckTimer)
 	{
@@ -216,7 +440,14 @@ void DataRecorderService::OnTimer(Timer* timer)
 	else if (timer == m_deviceLoadTimer)
 	{
 		BOOST_LOG_TRIVIAL(info) << "Device load timer fired";
-		m_dataStorage->initializeDevices(true);
+		m_dataStorage->startDeviceReload();	//Applied at the end of a later poll cycle
+	}
+	else if (timer == m_backpressureTimer)
+	{
+		if (m_socketMan.isPeerReadingPaused())
+			m_dataStorage->flushCaches(true);
+
+		updateBackpressure();
 	}
 	else if (timer == m_nullRecordGenerationTimer)
 	{
@@ -241,6 +472,8 @@ void DataRecorderService::removeInactiveDevices()
 		if (difference > m_deviceInactiveTimeThreshold)
 		{
 			m_socketMan.closeClientSocket(clientFD);
+			m_pendingACKs.erase(clientFD);
+			eraseWaitingRecords(clientFD);
 			m_lastActiveTimestamp.erase(iter++);
 			BOOST_LOG_TRIVIAL(debug) << "inactive FD: " << clientFD;
 		}
@@ -301,7 +534,8 @@ void DataRecorderService::dumpServiceInformation()
 	fileStream << "Dumping data recorder service information at " << getCurrentDatetime() << '\n' << std::endl;
 
 	fileStream << "------------- Information from class DataRecorderService -------------\n" << std::endl;
-	fileStream << "m_rejectionCount = " << m_rejectionCount << '\n' << std::endl;
+	fileStream << "m_rejectionCount = " << m_rejectionCount << std::endl;
+	fileStream << "m_backpressureActivationCount = " << m_backpressureActivationCount << '\n' << std::endl;
 
 	fileStream << "### Map m_lastActiveTimestamp" << std::endl;
 	for (auto& entry: m_lastActiveTimestamp)
@@ -311,6 +545,8 @@ void DataRecorderService::dumpServiceInformation()
 	fileStream << std::endl;
 
 	m_dataStorage->dumpDataStorageInformation(fileStream);
+	m_socketMan.dumpSocketInformation(fileStream);
+	MemoryAccounting::getInstance().dumpMemoryInformation(fileStream);
 
 	fileStream.close();
 }
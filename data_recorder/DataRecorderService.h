@@ -2,6 +2,8 @@
 
 #include <utility>
 #include <map>
+#include <vector>
+#include <set>
 #include <ConfigurationHandler.h>
 #include <SocketCommunication.h>
 
@@ -20,11 +22,14 @@ public:
 	void setDataStorage(DataStorage* dataStorage);
 
 	void enterRunLoop();
+	bool isHandedOff() { return m_socketMan.isServerHandedOff(); }
 
 	//Server side callbacks
 	virtual void OnConnect(ServerSocket* server, ClientSocket* client);
 	virtual void OnDisconnect(ServerSocket* server, ClientSocket* client);
 	virtual void OnData(ServerSocket* server, ClientSocket* client, std::string message);
+	virtual void OnPollCycleEnd(ServerSocket* server);
+	virtual void OnServerHandoff(ServerSocket* server);
 
 	//Timer callback
 	virtual void OnTimer(Timer* timer);
@@ -35,6 +40,13 @@ private:
 	void dumpServiceInformation();
 
 	void removeInactiveDevices();
+	void sendPendingACKs();
+
+	int processRecord(ClientSocket* client, const std::string& message);
+	void processWaitingRecords();
+	void closeClient(int clientFD);
+	void updateBackpressure();
+	void eraseWaitingRecords(int clientFD);
 
 	SocketManager m_socketMan;
 	ServerSocket* m_dataRecorderServer;
@@ -47,6 +59,7 @@ private:
 	Timer* m_deviceLoadTimer;
 	Timer* m_nullRecordGenerationTimer;
 	Timer* m_FDCheckTimer;
+	Timer* m_backpressureTimer;
 
 	unsigned long m_deviceInactiveTimeThreshold;
 
@@ -61,5 +74,23 @@ private:
 	//key=FD, value=timestamp
 	std::map<int, unsigned long> m_lastActiveTimestamp;
 
+	//ACKs held back until the journal is synced at the end of a poll cycle (group commit)
+	//key=FD, value=(client, concatenated ACK messages)
+	std::map<int, std::pair<ClientSocket*, std::string> > m_pendingACKs;
+
+	//Records of devices whose state is not loaded yet (lazy loading); processed after loading at the end of the poll cycle
+	struct WaitingRecord
+	{
+		int m_clientFD;
+		ClientSocket* m_client;
+		std::string m_message;
+	};
+	std::vector<WaitingRecord> m_waitingRecords;
+
 	unsigned long m_rejectionCount;
+
+	//Reading from devices is paused when pending records reach the high watermark, and resumed at the low watermark (0 = disabled)
+	int m_backpressureHighWatermark;
+	int m_backpressureLowWatermark;
+	unsigned long m_backpressureActivationCount;
 };
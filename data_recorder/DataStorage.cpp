@@ -3,14 +3,26 @@
 #include <sstream>
 #include <set>
 #include <exception>
+#include <iterator>
 
 #include <DataStorage.h>
 #include <ConfigurationHandler.h>
+#include <MemoryAccounting.h>
 #include <Logger.h>
 
+//Approximate heap usage of cached state, including container node overheads
+static const long DEVICE_ENTRY_BYTES = 160;	//LRU list & position, loaded device set and last counter map entries
+static const long NULL_ENTRY_BYTES = 80;
+static const long RECORD_BYTES_PER_FIELD = 48;
+
 
 //*************************************************************************************************
 DataStorage::DataStorage():
+	m_recordWriterCount{0},
+	m_recordWriterMaxQueuedBatches{0},
+	m_isUnitOfWorkEnabled{false},
+	m_committedUnitOfWorkCount{0},
+	m_failedUnitOfWorkCount{0},
 	m_isDatabaseActive{false},
 	m_isFileActive{false},
 	m_dbInactiveCount{0},
@@ -18,6 +30,20 @@ DataStorage::DataStorage():
 	m_failedBatchWriteCount{0},
 	m_failedBatchUpdateCount{0},
 	m_bactchWriteFailCountThreshold{10},
+	m_isJournalEnabled{false},
+	m_isReplayingJournal{false},
+	m_journalCompactionSizeBytes{0},
+	m_isSnapshotEnabled{false},
+	m_isSnapshotLoaded{false},
+	m_isLazyLoadingEnabled{false},
+	m_hydratedDeviceCount{0},
+	m_hydrationBatchCount{0},
+	m_deviceTableFingerprint{-1, 0, 0},
+	m_deviceReloadCount{0},
+	m_deviceReloadChangedCount{0},
+	m_deviceStateMemoryBudgetBytes{0},
+	m_evictedDeviceCount{0},
+	m_evictionRunCount{0},
 	m_dbWriteCount{0},
 	m_cachedRecordCount{0},
 	m_cachedNullUpdateCount{0},
@@ -29,7 +55,7 @@ DataStorage::DataStorage():
 
 
 //*************************************************************************************************
-bool DataStorage::initialize()
+bool DataStorage::initialize(bool isStorageEnabled /*= true*/)
 {
 	ConfigurationHandler& configHandler = ConfigurationHandler::getInstance();
 
@@ -38,6 +64,9 @@ bool DataStorage::initialize()
 		m_nullWriteThreshold = std::stoi(configHandler.getConfig("NullWriteThreshold"));
 		m_cacheWriteThreshold = std::stoi(configHandler.getConfig("CacheWriteThreshold"));
 		m_cacheSizeHardLimit = std::stoi(configHandler.getConfig("CacheSizeHardLimit"));
+		m_recordWriterCount = std::stoi(configHandler.getConfig("RecordWriterCount"));
+		m_recordWriterMaxQueuedBatches = std::stoi(configHandler.getConfig("RecordWriterMaxQueuedBatches"));
+		m_isUnitOfWorkEnabled = (std::stoi(configHandler.getConfig("StorageUnitOfWorkEnabled")) == 1);
 		m_updateCacheThreshold = std::stoi(configHandler.getConfig("UpdateCacheThreshold"));
 		m_nullEntryDeleteCacheThreshold = std::stoi(configHandler.getConfig("NullEntryDeleteCacheThreshold"));
 
@@ -47,6 +76,15 @@ bool DataStorage::initialize()
 		m_counterPosition = std::stoi(configHandler.getConfig("CounterRecordPosition"));
 
 		m_maxNullCountPerDevice = std::stoi(configHandler.getConfig("MaxNullRecordCountPerDevice"));
+		m_nullRecordLoadDevicesPerQuery = std::stoi(configHandler.getConfig("NullRecordLoadDevicesPerQuery"));
+		m_nullRecordLoadConnections = std::stoi(configHandler.getConfig("NullRecordLoadConnections"));
+
+		m_isJournalEnabled = (std::stoi(configHandler.getConfig("JournalEnabled")) == 1);
+		m_journalCompactionSizeBytes = std::stol(configHandler.getConfig("JournalCompactionSizeMB")) * 1024 * 1024;
+
+		m_isSnapshotEnabled = (std::stoi(configHandler.getConfig("DeviceStateSnapshotEnabled")) == 1);
+		m_isLazyLoadingEnabled = (std::stoi(configHandler.getConfig("LazyDeviceStateLoading")) == 1);
+		m_deviceStateMemoryBudgetBytes = std::stol(configHandler.getConfig("DeviceStateMemoryBudgetMB")) * 1024 * 1024;
 	}
 	catch (std::exception &e)
 	{
@@ -55,27 +93,35 @@ bool DataStorage::initialize()
 		return false;
 	}
 	
-	//Get storage parameters
-	std::string mySqlServer = configHandler.getConfig("MySQLServer");
-	std::string username = configHandler.getConfig("Username");
-	std::string password = configHandler.getConfig("Password");
-	std::string database = configHandler.getConfig("DatabaseName");
-	std::string table = configHandler.getConfig("TableName");
-	std::string primaryKeyColumn = configHandler.getConfig("PrimaryKeyColumnNameInMainTable");
-	std::string recordCounterColumn = configHandler.getConfig("RecordCounterColumnNameInMainTable");
-	std::string deviceIDColumnInMainTable = configHandler.getConfig("DeviceIDColumnNameInMainTable");
-	std::string dateTimeColumn = configHandler.getConfig("DateTimeColumnNameInMainTable");
+	//A snapshot of partially loaded state would record unloaded devices with zero last counters
+	if (m_isLazyLoadingEnabled && m_isSnapshotEnabled)
+	{
+		BOOST_LOG_TRIVIAL(warning) << "Device state snapshot is not used with lazy device state loading; disabling it";
+		m_isSnapshotEnabled = false;
+	}
 
-	std::string nullRecordsTable = configHandler.getConfig("NullRecordsTableName");
-	std::string nullRecTablePrimaryKeyColumn = configHandler.getConfig("NullRecordsTablePrimaryKeyColumn");
-	std::string nullRecInsertedPrimaryKeyColumn = configHandler.getConfig("NullRecInsertedPrimaryKeyColumn");
-	std::string nullRecDeviceIDColumn = configHandler.getConfig("NullRecDeviceIDColumn");
-	std::string nullRecRecordCounterColumn = configHandler.getConfig("NullRecCounterColumn");
-	std::string nullRecRequestCountColumn = configHandler.getConfig("NullRecRequestCountColumn");
+	if (!m_isLazyLoadingEnabled && m_deviceStateMemoryBudgetBytes > 0)
+		BOOST_LOG_TRIVIAL(warning) << "Device state memory budget is used only with lazy device state loading; ignoring it";
+
+	//Get storage parameters
+	std::string storageBackendName = configHandler.getConfig("StorageBackend");
+
+	m_storageSchema.m_table = configHandler.getConfig("TableName");
+	m_storageSchema.m_primaryKeyColumn = configHandler.getConfig("PrimaryKeyColumnNameInMainTable");
+	m_storageSchema.m_recordCounterColumn = configHandler.getConfig("RecordCounterColumnNameInMainTable");
+	m_storageSchema.m_deviceIDColumn = configHandler.getConfig("DeviceIDColumnNameInMainTable");
+	m_storageSchema.m_dateTimeColumn = configHandler.getConfig("DateTimeColumnNameInMainTable");
+
+	m_storageSchema.m_nullRecordsTable = configHandler.getConfig("NullRecordsTableName");
+	m_storageSchema.m_nullRecTablePrimaryKeyColumn = configHandler.getConfig("NullRecordsTablePrimaryKeyColumn");
+	m_storageSchema.m_nullRecInsertedPrimaryKeyColumn = configHandler.getConfig("NullRecInsertedPrimaryKeyColumn");
+	m_storageSchema.m_nullRecDeviceIDColumn = configHandler.getConfig("NullRecDeviceIDColumn");
+	m_storageSchema.m_nullRecRecordCounterColumn = configHandler.getConfig("NullRecCounterColumn");
+	m_storageSchema.m_nullRecRequestCountColumn = configHandler.getConfig("NullRecRequestCountColumn");
+	m_storageSchema.m_nullEntriesMaxCount = m_maxNullCountPerDevice;
 
-	
-	
 	std::string filenamePrefix = configHandler.getConfig("FilenamePrefix");
+	m_snapshotFilename = configHandler.getConfig("DeviceStateSnapshotFilename");
 
 	//Get current date
 	time_t t = time(0);
@@ -94,24 +140,62 @@ bool DataStorage::initialize()
 	if (initializeRecordStructure() == false)
 		return false;
 
+	m_storageSchema.m_columnCount = m_columnCount;
+	m_storageSchema.m_columnNames = m_columnNamesVec;
+	m_storageSchema.m_columnTypes = m_columnTypesVec;
+	m_storageSchema.m_recordPositions = m_recordPositionsVec;
+
+	if (!isStorageEnabled)
+		return true;
+
+	//Backend is created once (initialize() is also called to re-initialize the database)
+	if (!m_storageBackend)
+	{
+		m_storageBackend = createStorageBackend(storageBackendName);
+
+		if (!m_storageBackend)
+			return false;
+	}
+
 	//Initialize database
-	BOOST_LOG_TRIVIAL(info) << "===Initializing database storage===";
-	if (m_dbStorage.initialize(mySqlServer, username, password, database, table, primaryKeyColumn, recordCounterColumn, 
-							deviceIDColumnInMainTable, dateTimeColumn , m_columnCount, m_columnNamesVec, m_columnTypesVec, 
-							m_recordPositionsVec, nullRecordsTable, nullRecTablePrimaryKeyColumn, nullRecInsertedPrimaryKeyColumn, 
-							nullRecDeviceIDColumn, nullRecRecordCounterColumn, nullRecRequestCountColumn, m_maxNullCountPerDevice))
+	BOOST_LOG_TRIVIAL(info) << "===Initializing database storage (backend: " << storageBackendName << ")===";
+	if (m_storageBackend->initialize(m_storageSchema))
 	{
 		m_isDatabaseActive = true;
 
+		if (m_recordWriterCount > 0)
+		{
+			BOOST_LOG_TRIVIAL(info) << "===Starting pipelined record writer===";
+			if (startRecordWriter() == false)
+				return false;
+		}
+
+		//Snapshot is used only on startup (i.e. not when re-initializing the database)
+		if (m_isSnapshotEnabled && m_deviceLastCounterInDBMap.size() == 0)
+		{
+			BOOST_LOG_TRIVIAL(info) << "===Loading device state snapshot===";
+			m_isSnapshotLoaded = m_snapshot.load(m_snapshotFilename);
+
+			if (!m_isSnapshotLoaded)
+				BOOST_LOG_TRIVIAL(warning) << "Device state snapshot could not be loaded; loading full device state from database";
+		}
+
 		//Initialize device IDs
 		BOOST_LOG_TRIVIAL(info) << "===Initializing devices===";
 		if (initializeDevices() == false)
 			return false;
 
 		//Initialize null-written records information
-		BOOST_LOG_TRIVIAL(info) << "===Initializing null-written records information===";
-		if (initializeNullRecords() == false)
-			return false;
+		if (m_isLazyLoadingEnabled)
+		{
+			BOOST_LOG_TRIVIAL(info) << "Lazy device state loading enabled; last counters and null entries are loaded when a device first sends data";
+		}
+		else
+		{
+			BOOST_LOG_TRIVIAL(info) << "===Initializing null-written records information===";
+			if (initializeNullRecords() == false)
+				return false;
+		}
 	}
 
 	//Initialize file
@@ -119,6 +203,14 @@ bool DataStorage::initialize()
 	if (m_fileStorage.initialize(filename))
 		m_isFileActive = true;
 
+	//Journal is opened and replayed only once (initialize() is also called to re-initialize the database)
+	if (m_isDatabaseActive && m_isJournalEnabled && !m_journal.isActive())
+	{
+		BOOST_LOG_TRIVIAL(info) << "===Initializing record journal===";
+		if (initializeJournal() == false)
+			return false;
+	}
+
 
 	//Log and return
 	if (m_isDatabaseActive) //Even if file storage fails at startup, it is ok
@@ -203,11 +295,37 @@ bool DataStorage::initializeDevices(bool isReinitialize /*= false*/)
 	
 	//std::vector<int> deviceIDs;
 
-	if (m_dbStorage.getDeviceIDs(deviceTableName, deviceIDColumnName, m_deviceLastCounterInDBMap, isReinitialize) == false)
+	//Last counters are not scanned from the main table when they can be taken from the snapshot
+	bool isDeviceTableOnly = isReinitialize || m_isSnapshotLoaded || m_isLazyLoadingEnabled;
+
+	//Baseline for detecting changes in later reloads (if this fails, the first reload fetches the full list)
+	//Taken before the device IDs are read, so that a device added in between shows up as a change in the next reload
+	if (m_storageBackend->getDeviceTableFingerprint(deviceTableName, deviceIDColumnName, m_deviceTableFingerprint) == false)
+		m_deviceTableFingerprint.m_count = -1;
+
+	if (m_storageBackend->getDeviceIDs(deviceTableName, deviceIDColumnName, m_deviceLastCounterInDBMap, isDeviceTableOnly) == false)
 	{
 		BOOST_LOG_TRIVIAL(error) << "Retrieving device IDs from database failed";
 		return false;
 	}
+
+	if (m_isSnapshotLoaded && !isReinitialize)
+	{
+		for (auto& entry: m_snapshot.getDeviceLastCounters())
+		{
+			auto iter = m_deviceLastCounterInDBMap.find(entry.first);
+
+			if (iter != m_deviceLastCounterInDBMap.end())	//Device is still in the devices table
+				iter->second = entry.second;
+		}
+
+		//Reconcile with records written after the snapshot was taken
+		if (m_storageBackend->getLastCountersSince(m_snapshot.getMainTableWatermark(), m_deviceLastCounterInDBMap) == false)
+		{
+			BOOST_LOG_TRIVIAL(error) << "Reconciling device state snapshot with database failed";
+			return false;
+		}
+	}
 	
 	BOOST_LOG_TRIVIAL(info) << "Devices loaded from table: " << deviceTableName << " successfully";
 
@@ -225,6 +343,107 @@ bool DataStorage::initializeDevices(bool isReinitialize /*= false*/)
 }
 
 
+//*************************************************************************************************
+void DataStorage::startDeviceReload()
+{
+	if (!m_isDatabaseActive)
+		return;
+
+	if (m_deviceTableScan.valid())
+	{
+		BOOST_LOG_TRIVIAL(debug) << "Previous devices table reload has not been applied yet; skipping";
+		return;
+	}
+
+	ConfigurationHandler& configHandler = ConfigurationHandler::getInstance();
+
+	m_deviceTableScan = std::async(std::launch::async, &StorageBackend::scanDeviceTable, m_storageBackend.get(),
+							configHandler.getConfig("DevicesTableName"), configHandler.getConfig("DeviceIDColumnName"), m_deviceTableFingerprint);
+}
+
+
+//*************************************************************************************************
+bool DataStorage::applyDeviceReload()
+{
+	if (!m_deviceTableScan.valid() || m_deviceTableScan.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		return false;
+
+	DeviceTableScan scan = m_deviceTableScan.get();
+	++m_deviceReloadCount;
+
+	if (!scan.m_isSuccessful)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Retrieving device IDs from database failed";
+		return false;
+	}
+
+	m_deviceTableFingerprint = scan.m_fingerprint;
+
+	if (!scan.m_isChanged)
+	{
+		BOOST_LOG_TRIVIAL(debug) << "Devices table unchanged, device count: " << m_deviceLastCounterInDBMap.size();
+		return true;
+	}
+
+	++m_deviceReloadChangedCount;
+	int addedCount = 0;
+	int removedCount = 0;
+
+	for (int deviceID: scan.m_deviceIDs)
+	{
+		if (m_deviceLastCounterInDBMap.emplace(deviceID, 0).second)	//New device; added with zero last counter
+			++addedCount;
+	}
+
+	if (scan.m_isFullList)
+	{
+		std::unordered_set<int> currentDevices(scan.m_deviceIDs.begin(), scan.m_deviceIDs.end());
+		std::vector<int> removedDevices;
+
+		for (auto& entry: m_deviceLastCounterInDBMap)
+		{
+			if (currentDevices.count(entry.first) == 0)
+				removedDevices.push_back(entry.first);
+		}
+
+		for (int deviceID: removedDevices)
+			removeDevice(deviceID);
+
+		removedCount = removedDevices.size();
+	}
+
+	BOOST_LOG_TRIVIAL(info) << "Devices table changed; added devices: " << addedCount << ", removed devices: " << removedCount
+				<< ", device count: " << m_deviceLastCounterInDBMap.size();
+	return true;
+}
+
+
+//*************************************************************************************************
+void DataStorage::removeDevice(int deviceID)
+{
+	//Records of the device already in the in-order caches are still written
+	auto outOfOrderIter = m_deviceOutOfOrderStore.find(deviceID);
+	if (outOfOrderIter != m_deviceOutOfOrderStore.end())
+	{
+		if (outOfOrderIter->second.size() != 0)
+			BOOST_LOG_TRIVIAL(warning) << "Dropping " << outOfOrderIter->second.size() << " out-of-order records of removed device " << deviceID;
+
+		m_deviceOutOfOrderStore.erase(outOfOrderIter);
+	}
+
+	m_deviceLastCounterInDBMap.erase(deviceID);
+	m_deviceNullRecordKeys.erase(deviceID);
+	m_hydratedDevices.erase(deviceID);
+
+	auto positionIter = m_deviceLRUPosition.find(deviceID);
+	if (positionIter != m_deviceLRUPosition.end())
+	{
+		m_deviceLRU.erase(positionIter->second);
+		m_deviceLRUPosition.erase(positionIter);
+	}
+}
+
+
 //*************************************************************************************************
 bool DataStorage::initializeNullRecords()
 {
@@ -232,7 +451,34 @@ bool DataStorage::initializeNullRecords()
 
 	std::string nullRecordsTable = configHandler.getConfig("NullRecordsTableName");
 	
-	if (m_dbStorage.getInitialNullRecordInfo(m_deviceLastCounterInDBMap, m_deviceNullRecordKeys) == false)
+	if (m_isSnapshotLoaded)
+	{
+		//Null entries deleted after the snapshot may be restored here; they are removed again when the
+		//corresponding record is received or the request count is exceeded
+		for (const NullEntry& nullEntry: m_snapshot.getNullEntries())
+		{
+			if (m_deviceLastCounterInDBMap.count(nullEntry.m_deviceID) == 0)
+				continue;	//Skip devices removed from the devices table
+
+			std::map<long, NullEntry>& nullEntryMap = m_deviceNullRecordKeys[nullEntry.m_deviceID];
+
+			if ((int) nullEntryMap.size() < m_maxNullCountPerDevice)
+				nullEntryMap.emplace(nullEntry.m_SDCounter, nullEntry);
+		}
+
+		bool isReconciled = m_storageBackend->getNullRecordInfoSince(m_snapshot.getNullTableWatermark(), m_deviceLastCounterInDBMap, m_deviceNullRecordKeys);
+
+		m_snapshot.clear();
+		m_isSnapshotLoaded = false;
+
+		if (isReconciled == false)
+		{
+			BOOST_LOG_TRIVIAL(error) << "Reconciling null record information of device state snapshot with database failed";
+			return false;
+		}
+	}
+	else if (m_storageBackend->getInitialNullRecordInfo(m_deviceLastCounterInDBMap, m_deviceNullRecordKeys,
+												m_nullRecordLoadDevicesPerQuery, m_nullRecordLoadConnections) == false)
 	{
 		BOOST_LOG_TRIVIAL(error) << "Retrieving null record information from database failed";
 		return false;
@@ -261,11 +507,104 @@ bool DataStorage::initializeNullRecords()
 }
 
 
+//*************************************************************************************************
+bool DataStorage::initializeJournal()
+{
+	ConfigurationHandler& configHandler = ConfigurationHandler::getInstance();
+
+	if (m_journal.initialize(configHandler.getConfig("JournalFilename"), m_journalCompactionSizeBytes) == false)
+		return false;
+
+	//Rebuild in-memory caches by replaying the records that were accepted (and ACKed) before the last exit
+	//Records that had already reached the database are detected as past records and are not cached again
+	std::vector<std::string> journaledRecords;
+	if (m_journal.loadRecords(journaledRecords) == false)
+		return false;
+
+	//Load state of all journaled devices in one batch before replaying
+	if (m_isLazyLoadingEnabled)
+	{
+		for (auto& recordString: journaledRecords)
+		{
+			std::vector<std::string> fieldValues = splitString(recordString, ',');
+
+			try
+			{
+				if (m_deviceIDPosition < (int) fieldValues.size())
+					m_devicesToHydrate.insert(std::stoi(fieldValues[m_deviceIDPosition]));
+			}
+			catch (std::exception &e)
+			{
+				//Invalid records are rejected when replaying
+			}
+		}
+
+		if (hydrateDevices() == false)
+			return false;
+	}
+
+	BOOST_LOG_TRIVIAL(info) << "Replaying " << journaledRecords.size() << " records from record journal";
+
+	std::pair<long, int> ackContent;
+	m_isReplayingJournal = true;
+
+	for (auto& recordString: journaledRecords)
+		validateAndWriteRecord(recordString, ackContent);
+
+	m_isReplayingJournal = false;
+
+	BOOST_LOG_TRIVIAL(info) << "Record journal replayed; in-order record cache size: " << m_cachedRecordCount
+				<< ", null update cache size: " << m_cachedNullUpdateCount;
+
+	//Drop records that are already in the database from the journal
+	std::vector<std::string> pendingRecords;
+	collectPendingRecords(pendingRecords);
+	return m_journal.compact(pendingRecords);
+}
+
+
+//*************************************************************************************************
+bool DataStorage::startRecordWriter()
+{
+	//Re-initialization: writers finish their batches (failed records return to the record cache) before they reconnect
+	m_recordWriter.stop();
+	m_recordWriter.dispatchCompletions();
+
+	if (m_failedWriteRecords.size() != 0)
+	{
+		m_recordCache.insert(m_recordCache.begin(), std::make_move_iterator(m_failedWriteRecords.begin()),
+								std::make_move_iterator(m_failedWriteRecords.end()));
+		m_failedWriteRecords.clear();
+		m_cachedRecordCount = m_recordCache.size();
+	}
+
+	std::vector< std::unique_ptr<StorageBackend> > writers;
+
+	for (int i = 0; i < m_recordWriterCount; ++i)
+	{
+		std::unique_ptr<StorageBackend> writer = m_storageBackend->createRecordWriter();
+
+		if (!writer || writer->initialize(m_storageSchema) == false)
+		{
+			//Records are written on the event loop thread until the next re-initialization
+			BOOST_LOG_TRIVIAL(error) << "Failed to initialize record writer " << i << " of pipelined record writer";
+			return false;
+		}
+
+		writers.push_back(std::move(writer));
+	}
+
+	m_recordWriter.start(writers, m_deviceIDPosition, m_recordWriterMaxQueuedBatches, this);
+	return true;
+}
+
+
 //*************************************************************************************************
 //Return values
 //-1 = unknown device so disconnect
 //0 = do not send ACK
 //1 = send ACK
+//2 = device state not loaded yet (lazy loading); call hydrateDevices() and retry the record
 int DataStorage::validateAndWriteRecord(std::string recordString, std::pair<long, int>& ackContent)
 {
 	m_fieldValues = splitString(recordString, ',');
@@ -287,13 +626,26 @@ int DataStorage::validateAndWriteRecord(std::string recordString, std::pair<long
 	}
 
 	//Verify that the record is coming from a known device
-	if (m_deviceLastCounterInDBMap.count(deviceID) == 0)
+	auto deviceIter = m_deviceLastCounterInDBMap.find(deviceID);
+	if (deviceIter == m_deviceLastCounterInDBMap.end())
 	{
 		BOOST_LOG_TRIVIAL(warning) << "Data received by unknown device. Device ID = " << deviceID;
 		return -1;	//Disconnect device
 	}
 
-	long lastCounter = m_deviceLastCounterInDBMap[deviceID];
+	//Device state is loaded at the end of the poll cycle, together with other devices that connected meanwhile
+	if (m_isLazyLoadingEnabled)
+	{
+		if (m_hydratedDevices.count(deviceID) == 0)
+		{
+			m_devicesToHydrate.insert(deviceID);
+			return 2;
+		}
+
+		touchDevice(deviceID);
+	}
+
+	long lastCounter = deviceIter->second;
 	long currentCounter;
 	try
 	{
@@ -306,7 +658,8 @@ int DataStorage::validateAndWriteRecord(std::string recordString, std::pair<long
 		return -1;	//Disconnect device
 	}
 
-	int outOfOrderCount = m_deviceOutOfOrderStore[deviceID].size();
+	auto outOfOrderIter = m_deviceOutOfOrderStore.find(deviceID);
+	int outOfOrderCount = (outOfOrderIter != m_deviceOutOfOrderStore.end()) ? outOfOrderIter->second.size() : 0;
 	BOOST_LOG_TRIVIAL(debug) << "deviceID: " << deviceID << ", lastCounter: " << lastCounter << ", currentCounter: " << currentCounter;
 	BOOST_LOG_TRIVIAL(debug) << "in-order record cache size: " << m_cachedRecordCount << ", out-of order record count for device: " << outOfOrderCount <<
 				", null update cache size: " << m_cachedNullUpdateCount << ", null entry delete cache size: " << m_cachedNullEntryDeleteCount;
@@ -329,11 +682,17 @@ int DataStorage::validateAndWriteRecord(std::string recordString, std::pair<long
 	//We can do further validations (eg: whether each field has the correct type, required fields are set...)
 	//But it may be costly to do it for every message. We assume that the devices send proper messages
 
+	//Journal the accepted record before it is cached (and ACKed)
+	//If it cannot be journaled, it is dropped without an ACK (state is not changed yet), so the device sends it again
+	if (m_journal.isActive() && !m_isReplayingJournal && m_journal.appendRecord(recordString) == false)
+	{
+		BOOST_LOG_TRIVIAL(warning) << "Record of device " << deviceID << " with counter " << currentCounter << " could not be journaled; not ACKing it";
+		return 0;	//Do not send ACK
+	}
+
 	//*******************************************************************
 	//Check whether the received record is maintaining order, or a previous null-written record, and maintain internal state
 
-	std::map< long, std::vector<std::string> >& outOfOrderRecordStore = m_deviceOutOfOrderStore[deviceID];
-
 	if (currentCounter == lastCounter + 1)	//Correct next record
 	{
 		BOOST_LOG_TRIVIAL(debug) << "Correct next record in-order (currentCounter == lastCounter + 1)";
@@ -342,8 +701,9 @@ int DataStorage::validateAndWriteRecord(std::string recordString, std::pair<long
 		++m_cachedRecordCount;
 		m_deviceLastCounterInDBMap[deviceID] = currentCounter;
 
-		if (outOfOrderRecordStore.size() != 0)	//Check whether the current record filled the gap between in-order and out-of-order records
+		if (outOfOrderCount != 0)	//Check whether the current record filled the gap between in-order and out-of-order records
 		{
+			std::map< long, std::vector<std::string> >& outOfOrderRecordStore = outOfOrderIter->second;
 			long smallestOutOfOrderRecordCounter = outOfOrderRecordStore.begin()->first;
 
 			if (currentCounter == smallestOutOfOrderRecordCounter - 1)	//Gap filled; write consecutive out-of order records to cache
@@ -381,6 +741,9 @@ int DataStorage::validateAndWriteRecord(std::string recordString, std::pair<long
 				BOOST_LOG_TRIVIAL(debug) << "Moving finished" ;
 				outOfOrderRecordStore.erase(outOfOrderRecordStore.begin(), iter);	//Remove moved record block from out-of-order store
 				m_cachedRecordCount = m_recordCache.size();	//Unnecessary; m_cachedRecordCount is already the correct size
+
+				if (outOfOrderRecordStore.size() == 0)
+					m_deviceOutOfOrderStore.erase(outOfOrderIter);
 			}
 
 			return 0; //Do not send ACK (since this record was sent while there were out-of-order records, this is most likely a requested record; no need to ACK)
@@ -395,6 +758,7 @@ int DataStorage::validateAndWriteRecord(std::string recordString, std::pair<long
 	{
 		BOOST_LOG_TRIVIAL(debug) << "Out-of-order record (currentCounter > lastCounter + 1)";
 
+		std::map< long, std::vector<std::string> >& outOfOrderRecordStore = m_deviceOutOfOrderStore[deviceID];
 		outOfOrderRecordStore[currentCounter] = m_fieldValues;
 
 		if (outOfOrderRecordStore.size() >= m_nullWriteThreshold)	//Move records to cache with NULL records generated for missing records
@@ -407,15 +771,16 @@ int DataStorage::validateAndWriteRecord(std::string recordString, std::pair<long
 	{
 		BOOST_LOG_TRIVIAL(debug) << "Past record (currentCounter <= lastCounter): (this record could be a previously null-written record)";
 
-		//key=sd_counter
-		std::map<long, NullEntry>& nullRecordKeys = m_deviceNullRecordKeys[deviceID];
+		//key=deviceID, nested key=sd_counter
+		auto nullKeysIter = m_deviceNullRecordKeys.find(deviceID);
+		std::map<long, NullEntry>::iterator nullEntryIter;
 
-		if (nullRecordKeys.count(currentCounter) != 0)	//Previous null-written record exists; add to update cache
+		if (nullKeysIter != m_deviceNullRecordKeys.end()
+			&& (nullEntryIter = nullKeysIter->second.find(currentCounter)) != nullKeysIter->second.end())	//Previous null-written record exists; add to update cache
 		{
 			BOOST_LOG_TRIVIAL(debug) << "Previously null-written record exists for this record; adding it to null-update cache";
 
-			NullEntry& nullEntry = nullRecordKeys[currentCounter];
-			long insertedPrimaryKey = nullEntry.m_recordInsertedPrimaryKey;
+			long insertedPrimaryKey = nullEntryIter->second.m_recordInsertedPrimaryKey;
 
 			m_nullUpdateCache[insertedPrimaryKey] = m_fieldValues;
 			++m_cachedNullUpdateCount;
@@ -440,10 +805,11 @@ void DataStorage::generateACK(int deviceID, long lastCounter, long currentCounte
 	updateNullCache();
 
 	//key=sd_counter
-	std::map<long, NullEntry>& nullEntriesMap = m_deviceNullRecordKeys[deviceID];
+	auto nullKeysIter = m_deviceNullRecordKeys.find(deviceID);
 
-	if (nullEntriesMap.size() !=0 )	//Null entries exist
+	if (nullKeysIter != m_deviceNullRecordKeys.end() && nullKeysIter->second.size() != 0)	//Null entries exist
 	{
+		std::map<long, NullEntry>& nullEntriesMap = nullKeysIter->second;
 		auto iter = nullEntriesMap.begin();
 		long tempCounter = iter->first;
 		long startSDCounter = tempCounter;
@@ -491,7 +857,7 @@ void DataStorage::generateACK(int deviceID, long lastCounter, long currentCounte
 			std::set<int> tempSetForDevice;
 			tempSetForDevice.insert(deviceID);
 			flushNullEntryDeleteCache();
-			m_dbStorage.loadEntriesFromNullTable(tempSetForDevice, m_deviceNullRecordKeys);
+			m_storageBackend->loadEntriesFromNullTable(tempSetForDevice, m_deviceNullRecordKeys);
 		}
 
 		return;
@@ -499,12 +865,12 @@ void DataStorage::generateACK(int deviceID, long lastCounter, long currentCounte
 
 	//No previous null entries; check gap between in-order cache and out-of-order store
 
-	std::map< long, std::vector<std::string> >& outOfOrderRecordStore = m_deviceOutOfOrderStore[deviceID];
+	auto outOfOrderIter = m_deviceOutOfOrderStore.find(deviceID);
 
-	if (outOfOrderRecordStore.size() != 0)	//Out-of-order records exist
+	if (outOfOrderIter != m_deviceOutOfOrderStore.end() && outOfOrderIter->second.size() != 0)	//Out-of-order records exist
 	{
 		ackContent.first = lastCounter + 1;	//The +1 is important as device will send records starting from that number
-		ackContent.second = outOfOrderRecordStore.begin()->first - lastCounter - 1;
+		ackContent.second = outOfOrderIter->second.begin()->first - lastCounter - 1;
 		BOOST_LOG_TRIVIAL(debug) << "ACK generated by gap between in-order cache and out-of-order store: SERVER:" << ackContent.first << "," << ackContent.second;
 		return;
 	}
@@ -522,18 +888,48 @@ void DataStorage::generateACK(int deviceID, long lastCounter, long currentCounte
 //*************************************************************************************************
 bool DataStorage::writeRecordCache()
 {
+	if (m_recordWriter.isActive())
+		processCompletedWrites();	//Failed records return to the record cache, ahead of newer records
+
 	if (m_recordCache.size() == 0)
 		return true;
 
+	if (m_recordWriter.isActive())
+	{
+		BOOST_LOG_TRIVIAL(debug) << "Queuing record batch to pipelined record writer, batch size: " << m_recordCache.size();
+
+		m_recordWriter.submit(m_recordCache);	//Moves the records out of the cache
+		m_cachedRecordCount = 0;
+		return true;
+	}
+
 	BOOST_LOG_TRIVIAL(debug) << "Writing record batch to database, batch size: " << m_recordCache.size();
 
-	if (m_dbStorage.writeRecordBatch(m_recordCache))
+	if (m_storageBackend->writeRecordBatch(m_recordCache))
 	{
-		m_recordCache.clear();	//clear the record cache
-		m_cachedRecordCount = 0;
+		clearWrittenRecordCache();
 		return true;
 	}
 	
+	handleFailedRecordCacheWrite();
+	return false;
+}
+
+
+//*************************************************************************************************
+void DataStorage::clearWrittenRecordCache()
+{
+	m_recordCache.clear();	//clear the record cache
+	m_cachedRecordCount = 0;
+	compactJournalIfNeeded();
+}
+
+
+//*************************************************************************************************
+void DataStorage::handleFailedRecordCacheWrite()
+{
+	m_cachedRecordCount = m_recordCache.size();	//Records committed before the failure are removed by the backend
+
 	//Database write failed --> re-initialize after a fail count threshold is reached
 	
 	//TODO: This checking of database connection and re-initialization can be done on a timer --> lightweight querry or other check $$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$
@@ -544,19 +940,80 @@ bool DataStorage::writeRecordCache()
 		BOOST_LOG_TRIVIAL(warning) << "Re-initializing database as failed write count threshold reached";
 		m_failedBatchWriteCount = 0;
 		if (initialize())
-			return false;	//False, because writing failed
+			return;
 	}
 
-	//Check whether cache size has reached hard limit and flush to file
+	//Check whether cache size has reached hard limit (or memory is under pressure) and flush to file
 
-	if (m_cachedRecordCount >= m_cacheSizeHardLimit)
+	if (m_cachedRecordCount >= m_cacheSizeHardLimit || MemoryAccounting::getInstance().getPressureLevel() >= MemoryAccounting::PRESSURE_SPILL)
 	{
 		m_fileStorage.writeRecordBatch(m_recordCache);
 		m_recordCache.clear();
 		m_cachedRecordCount = m_recordCache.size();
 	}
+}
 
-	return false;
+
+//*************************************************************************************************
+void DataStorage::OnRecordBatchWritten(std::vector< std::vector<std::string> >& records, bool isSuccessful)
+{
+	if (isSuccessful)
+		return;
+
+	//Completions of a device's batches are dispatched in order, so the failed records keep their order
+	for (auto& record: records)
+		m_failedWriteRecords.push_back(std::move(record));
+}
+
+
+//*************************************************************************************************
+void DataStorage::processCompletedWrites()
+{
+	if (m_recordWriter.dispatchCompletions() == 0)
+		return;
+
+	if (m_failedWriteRecords.size() != 0)
+	{
+		BOOST_LOG_TRIVIAL(warning) << "Pipelined write of " << m_failedWriteRecords.size() << " records failed; returning them to the record cache";
+
+		//Counted once per call (like a failed synchronous write of the cache), as one storage failure fails the batches of all writers
+		++m_failedBatchWriteCount;
+
+		//Failed records are older than all cached records
+		m_recordCache.insert(m_recordCache.begin(), std::make_move_iterator(m_failedWriteRecords.begin()),
+								std::make_move_iterator(m_failedWriteRecords.end()));
+		m_failedWriteRecords.clear();
+		m_cachedRecordCount = m_recordCache.size();
+
+		if (m_failedBatchWriteCount > m_bactchWriteFailCountThreshold)
+		{
+			BOOST_LOG_TRIVIAL(warning) << "Re-initializing database as failed write count threshold reached";
+			m_failedBatchWriteCount = 0;
+			initialize();	//Also restarts the record writer
+		}
+
+		if (m_cachedRecordCount >= m_cacheSizeHardLimit || MemoryAccounting::getInstance().getPressureLevel() >= MemoryAccounting::PRESSURE_SPILL)
+		{
+			m_fileStorage.writeRecordBatch(m_recordCache);
+			m_recordCache.clear();
+			m_cachedRecordCount = m_recordCache.size();
+		}
+	}
+
+	compactJournalIfNeeded();
+}
+
+
+//*************************************************************************************************
+bool DataStorage::waitForPendingWrites()
+{
+	if (!m_recordWriter.isActive())
+		return true;
+
+	m_recordWriter.drain();
+	processCompletedWrites();
+
+	return m_recordWriter.getPendingRecordCount() == 0 && m_recordCache.size() == 0;
 }
 
 
@@ -567,8 +1024,11 @@ bool DataStorage::FlushOutOfOrderRecordsWithNulls(int deviceID, long lastCounter
 	if (outOfOrderRecordStore.size() == 0)	//Possible when triggered by timer
 		return true;
 
-	//Flush cached in-order records first
-	if (writeRecordCache() == false)
+	//Flush cached in-order records first (NULL records of the gap are written after them)
+	//In a unit of work, they are written in the same transaction as the NULL records (except pipelined writes, on their own connections)
+	bool isRecordCacheInUnitOfWork = m_isUnitOfWorkEnabled && !m_recordWriter.isActive() && m_recordCache.size() != 0;
+
+	if (!isRecordCacheInUnitOfWork && (writeRecordCache() == false || waitForPendingWrites() == false))
 		return false;
 
 	//Generate NULL records and insert them to main table
@@ -581,19 +1041,46 @@ bool DataStorage::FlushOutOfOrderRecordsWithNulls(int deviceID, long lastCounter
 	//Vector to hold information about inserted null records
 	std::vector<NullEntry> insertedRecordInfoVec;
 
-	if (m_dbStorage.insertNullRecords(deviceID, lastCounter, smallestOutOfOrderRecordCounter, insertedRecordInfoVec) == false)
+	if (m_isUnitOfWorkEnabled)
 	{
-		if (insertedRecordInfoVec.size() == 0)	//No NULL records were inserted to main table
+		if (!m_storageBackend->beginUnitOfWork()
+			|| (isRecordCacheInUnitOfWork && !m_storageBackend->writeRecordBatch(m_recordCache))
+			|| !m_storageBackend->insertNullRecords(deviceID, lastCounter, smallestOutOfOrderRecordCounter, insertedRecordInfoVec)
+			|| !m_storageBackend->insertEntriesToNullTable(insertedRecordInfoVec)
+			|| !m_storageBackend->commitUnitOfWork())
+		{
+			BOOST_LOG_TRIVIAL(warning) << "Unit of work with NULL records of device " << deviceID << " failed; rolling back";
+
+			m_storageBackend->rollbackUnitOfWork();	//None of the records are written, so all caches are kept
+			++m_failedUnitOfWorkCount;
+
+			if (isRecordCacheInUnitOfWork)
+				handleFailedRecordCacheWrite();
+
 			return false;
-	}
+		}
 
-	BOOST_LOG_TRIVIAL(debug) << "Inserting corresponding null entries to null_records table";
+		++m_committedUnitOfWorkCount;
 
-	//Insert corresponding null entries to null records table
-	if (m_dbStorage.insertEntriesToNullTable(insertedRecordInfoVec) == false)
+		if (isRecordCacheInUnitOfWork)
+			clearWrittenRecordCache();
+	}
+	else
 	{
-		//We assume that if the above NULL record insertion to main table was successful, there is no reason for this insertion to fail
-		return false;
+		if (m_storageBackend->insertNullRecords(deviceID, lastCounter, smallestOutOfOrderRecordCounter, insertedRecordInfoVec) == false)
+		{
+			if (insertedRecordInfoVec.size() == 0)	//No NULL records were inserted to main table
+				return false;
+		}
+
+		BOOST_LOG_TRIVIAL(debug) << "Inserting corresponding null entries to null_records table";
+
+		//Insert corresponding null entries to null records table
+		if (m_storageBackend->insertEntriesToNullTable(insertedRecordInfoVec) == false)
+		{
+			//We assume that if the above NULL record insertion to main table was successful, there is no reason for this insertion to fail
+			return false;
+		}
 	}
 
 	//Update in-memory null records information map
@@ -647,21 +1134,29 @@ bool DataStorage::FlushOutOfOrderRecordsWithNulls(int deviceID, long lastCounter
 	BOOST_LOG_TRIVIAL(debug) << "Moving finished" ;
 	outOfOrderRecordStore.erase(outOfOrderRecordStore.begin(), iter);	//Remove in-order record block
 	m_cachedRecordCount = m_recordCache.size();
+	return true;
 }
 
 
 //*************************************************************************************************
 bool DataStorage::FlushAllOutOfOrderRecordsWithNulls()
 {
-	for (auto& device: m_deviceLastCounterInDBMap)
+	//Only devices that have out-of-order records (stores are not created for other devices)
+	auto iter = m_deviceOutOfOrderStore.begin();
+	while (iter != m_deviceOutOfOrderStore.end())
 	{
-		int deviceID = device.first;
-		long lastCounter = device.second;
+		int deviceID = iter->first;
+		long lastCounter = m_deviceLastCounterInDBMap[deviceID];
 
-		std::map< long, std::vector<std::string> >& outOfOrderRecordStore = m_deviceOutOfOrderStore[deviceID];
+		FlushOutOfOrderRecordsWithNulls(deviceID, lastCounter, iter->second);
 
-		FlushOutOfOrderRecordsWithNulls(deviceID, lastCounter, outOfOrderRecordStore);
+		if (iter->second.size() == 0)
+			iter = m_deviceOutOfOrderStore.erase(iter);
+		else
+			++iter;
 	}
+
+	return true;
 }
 
 
@@ -671,50 +1166,59 @@ bool DataStorage::updateNullCache()
 	if (m_nullUpdateCache.size() == 0)
 		return true;
 
-	if (m_dbStorage.updateRecordBatch(m_nullUpdateCache))
+	//The null entries of the updated records are deleted in the same transaction
+	if (m_isUnitOfWorkEnabled)
+		return writeCachesInUnitOfWork(false, true, true);
+
+	if (m_storageBackend->updateRecordBatch(m_nullUpdateCache))
 	{
 		BOOST_LOG_TRIVIAL(debug) << "Null update cache was written to database, update batch size: " << m_nullUpdateCache.size();
-		BOOST_LOG_TRIVIAL(trace) << "Removing following updated null entries from in-memory map and adding them to delete cache";
-		
+
 		std::set<int> deletedEntriesDevices;
+		removeUpdatedNullEntries(deletedEntriesDevices);
 
-		for (auto& updatedRecord: m_nullUpdateCache)
-		{
-			long insertedPrimaryKey = updatedRecord.first;
-			int deviceID = std::stoi((updatedRecord.second)[m_deviceIDPosition]);	//We assume stoi will not fail here as they have been verified before this point
-			long SDCounter = std::stoi((updatedRecord.second)[m_counterPosition]);
+		//Flush delete cache
+		//this is needed because all null entries for a device could be deleted and it will be impossible to fine lastInsertedPrimaryKey in loadEntriesFromNullTable
+		flushNullEntryDeleteCache();
 
-//			BOOST_LOG_TRIVIAL(trace) << "Device ID: " << deviceID << ", SDCounter: " << SDCounter;
+		//Load new elements up to m_maxNullCountPerDevice for each device in deletedEntriesMap
+		m_storageBackend->loadEntriesFromNullTable(deletedEntriesDevices, m_deviceNullRecordKeys);
+		return true;
+	}
 
-			m_nullEntryDeleteCache.push_back(insertedPrimaryKey);	//Add to delete cache
+	return false;
+}
 
-			//Delete written elements from in-memory map (after marking devices that require reloading of null entries from table)
 
-			//key=sd_counter
-			std::map<long, NullEntry>& deviceNullKeysMap = m_deviceNullRecordKeys[deviceID];
+//*************************************************************************************************
+void DataStorage::removeUpdatedNullEntries(std::set<int>& deletedEntriesDevices)
+{
+	BOOST_LOG_TRIVIAL(trace) << "Removing following updated null entries from in-memory map and adding them to delete cache";
 
-			//Loading new elements is necessary only if the in-memory map previously had entries up to the allowed limit
-			if (deviceNullKeysMap.size() >= m_maxNullCountPerDevice)
-				deletedEntriesDevices.insert(deviceID);
+	for (auto& updatedRecord: m_nullUpdateCache)
+	{
+		long insertedPrimaryKey = updatedRecord.first;
+		int deviceID = std::stoi((updatedRecord.second)[m_deviceIDPosition]);	//We assume stoi will not fail here as they have been verified before this point
+		long SDCounter = std::stoi((updatedRecord.second)[m_counterPosition]);
 
-			deviceNullKeysMap.erase(SDCounter);
-		}
+//		BOOST_LOG_TRIVIAL(trace) << "Device ID: " << deviceID << ", SDCounter: " << SDCounter;
 
-		//Flush delete cache
-		//this is needed because all null entries for a device could be deleted and it will be impossible to fine lastInsertedPrimaryKey in loadEntriesFromNullTable
-		flushNullEntryDeleteCache();
+		m_nullEntryDeleteCache.push_back(insertedPrimaryKey);	//Add to delete cache
 
-		//Load new elements up to m_maxNullCountPerDevice for each device in deletedEntriesMap
-		m_dbStorage.loadEntriesFromNullTable(deletedEntriesDevices, m_deviceNullRecordKeys);
+		//Delete written elements from in-memory map (after marking devices that require reloading of null entries from table)
 
-		m_nullUpdateCache.clear();	//clear the record cache
-		m_cachedNullUpdateCount = m_nullUpdateCache.size();
-		return true;
-		
-		
+		//key=sd_counter
+		std::map<long, NullEntry>& deviceNullKeysMap = m_deviceNullRecordKeys[deviceID];
+
+		//Loading new elements is necessary only if the in-memory map previously had entries up to the allowed limit
+		if ((int) deviceNullKeysMap.size() >= m_maxNullCountPerDevice)
+			deletedEntriesDevices.insert(deviceID);
+
+		deviceNullKeysMap.erase(SDCounter);
 	}
 
-	return false;
+	m_nullUpdateCache.clear();	//clear the record cache
+	m_cachedNullUpdateCount = m_nullUpdateCache.size();
 }
 
 
@@ -724,7 +1228,7 @@ bool DataStorage::flushNullEntryDeleteCache()
 	if (m_nullEntryDeleteCache.size() == 0)
 		return true;
 
-	if (m_dbStorage.deleteNullEntryBatch(m_nullEntryDeleteCache))
+	if (m_storageBackend->deleteNullEntryBatch(m_nullEntryDeleteCache))
 	{
 		BOOST_LOG_TRIVIAL(debug) << "Null entry delete cache was written to database, delete batch size: " << m_nullEntryDeleteCache.size();
 		m_nullEntryDeleteCache.clear();
@@ -736,9 +1240,95 @@ bool DataStorage::flushNullEntryDeleteCache()
 }
 
 
+//*************************************************************************************************
+bool DataStorage::writeCachesInUnitOfWork(bool isRecordCacheIncluded, bool isNullUpdateCacheIncluded, bool isDeleteCacheIncluded)
+{
+	bool isSuccessful = true;
+
+	//Pipelined record writes are made on the record writers' own connections, outside the unit of work
+	if (isRecordCacheIncluded && m_recordWriter.isActive())
+	{
+		isSuccessful = writeRecordCache();
+		isRecordCacheIncluded = false;
+	}
+
+	isRecordCacheIncluded = isRecordCacheIncluded && m_recordCache.size() != 0;
+	isNullUpdateCacheIncluded = isNullUpdateCacheIncluded && m_nullUpdateCache.size() != 0;
+	isDeleteCacheIncluded = isDeleteCacheIncluded || isNullUpdateCacheIncluded;	//Null entries of updated records are deleted with it
+
+	std::vector<long> deleteBatch;
+
+	if (isDeleteCacheIncluded)
+		deleteBatch = m_nullEntryDeleteCache;
+
+	if (isNullUpdateCacheIncluded)
+	{
+		for (auto& updatedRecord: m_nullUpdateCache)
+			deleteBatch.push_back(updatedRecord.first);
+	}
+
+	if (!isRecordCacheIncluded && deleteBatch.size() == 0)
+		return isSuccessful;
+
+	BOOST_LOG_TRIVIAL(debug) << "Writing unit of work to database, record batch size: " << (isRecordCacheIncluded ? m_recordCache.size() : 0)
+							<< ", update batch size: " << (isNullUpdateCacheIncluded ? m_nullUpdateCache.size() : 0)
+							<< ", delete batch size: " << deleteBatch.size();
+
+	if (!m_storageBackend->beginUnitOfWork()
+		|| (isRecordCacheIncluded && !m_storageBackend->writeRecordBatch(m_recordCache))
+		|| (isNullUpdateCacheIncluded && !m_storageBackend->updateRecordBatch(m_nullUpdateCache))
+		|| (deleteBatch.size() != 0 && !m_storageBackend->deleteNullEntryBatch(deleteBatch))
+		|| !m_storageBackend->commitUnitOfWork())
+	{
+		BOOST_LOG_TRIVIAL(warning) << "Unit of work failed; rolling back (caches are kept for the next write)";
+
+		m_storageBackend->rollbackUnitOfWork();
+		++m_failedUnitOfWorkCount;
+
+		if (isRecordCacheIncluded)
+			handleFailedRecordCacheWrite();
+
+		return false;
+	}
+
+	++m_committedUnitOfWorkCount;
+
+	if (isRecordCacheIncluded)
+		clearWrittenRecordCache();
+
+	std::set<int> deletedEntriesDevices;
+
+	if (isNullUpdateCacheIncluded)
+		removeUpdatedNullEntries(deletedEntriesDevices);	//Adds the deleted null entries to the delete cache
+
+	if (isDeleteCacheIncluded)
+	{
+		m_nullEntryDeleteCache.clear();
+		m_cachedNullEntryDeleteCount = 0;
+	}
+
+	//Load new elements up to m_maxNullCountPerDevice for each device in deletedEntriesDevices (after the deletes are committed)
+	m_storageBackend->loadEntriesFromNullTable(deletedEntriesDevices, m_deviceNullRecordKeys);
+	return isSuccessful;
+}
+
+
 //*************************************************************************************************
 bool DataStorage::flushCaches(bool timerFired /*= false*/)
 {
+	//Under memory pressure, caches are written out instead of waiting for their thresholds
+	if (MemoryAccounting::getInstance().getPressureLevel() >= MemoryAccounting::PRESSURE_SPILL)
+		timerFired = true;
+
+	if (m_isUnitOfWorkEnabled)	//Caches due in this cycle are written in one transaction
+	{
+		bool writeCache = (m_cachedRecordCount >= m_cacheWriteThreshold || timerFired);
+		bool updateCache = (m_cachedNullUpdateCount >= m_updateCacheThreshold || timerFired);
+		bool deleteCache = (m_cachedNullEntryDeleteCount >= m_nullEntryDeleteCacheThreshold || timerFired);
+
+		return writeCachesInUnitOfWork(writeCache, updateCache, deleteCache) && writeCache && updateCache && deleteCache;
+	}
+
 	bool writeCache = false;
 	bool updateCache = false;
 	bool deleteCache = false;
@@ -765,6 +1355,254 @@ bool DataStorage::flushCaches(bool timerFired /*= false*/)
 }
 
 
+//*************************************************************************************************
+void DataStorage::updateMemoryAccounting()
+{
+	MemoryAccounting& memoryAccounting = MemoryAccounting::getInstance();
+	long recordBytes = m_columnCount * RECORD_BYTES_PER_FIELD;
+
+	long outOfOrderRecordCount = 0;
+	for (auto& entry: m_deviceOutOfOrderStore)	//Stores exist only for devices with out-of-order records
+		outOfOrderRecordCount += entry.second.size();
+
+	long nullEntryCount = 0;
+	for (auto& entry: m_deviceNullRecordKeys)
+		nullEntryCount += entry.second.size();
+
+	memoryAccounting.set(MemoryAccounting::RECORD_CACHE, (m_recordCache.size() + m_recordWriter.getPendingRecordCount()) * recordBytes);
+	memoryAccounting.set(MemoryAccounting::OUT_OF_ORDER_STORE, outOfOrderRecordCount * recordBytes);
+	memoryAccounting.set(MemoryAccounting::NULL_CACHES, m_nullUpdateCache.size() * recordBytes + m_nullEntryDeleteCache.size() * sizeof(long)
+											+ nullEntryCount * NULL_ENTRY_BYTES);
+}
+
+
+//*************************************************************************************************
+bool DataStorage::syncJournal()
+{
+	return m_journal.sync();
+}
+
+
+//*************************************************************************************************
+bool DataStorage::hydrateDevices()
+{
+	if (m_devicesToHydrate.size() == 0)
+		return true;
+
+	//Only known devices that are not loaded yet
+	std::unordered_map<int, long> deviceLastCounterMap;
+	for (int deviceID: m_devicesToHydrate)
+	{
+		if (m_deviceLastCounterInDBMap.count(deviceID) != 0 && m_hydratedDevices.count(deviceID) == 0)
+			deviceLastCounterMap[deviceID] = 0;
+	}
+
+	m_devicesToHydrate.clear();
+
+	if (deviceLastCounterMap.size() == 0)
+		return true;
+
+	if (!m_isDatabaseActive)
+	{
+		BOOST_LOG_TRIVIAL(warning) << "Cannot load state of " << deviceLastCounterMap.size() << " devices as database is inactive";
+		return false;
+	}
+
+	std::unordered_map< int, std::map<long, NullEntry> > deviceNullRecordKeys;
+
+	if (m_storageBackend->getLastCounters(deviceLastCounterMap) == false
+		|| m_storageBackend->getInitialNullRecordInfo(deviceLastCounterMap, deviceNullRecordKeys, m_nullRecordLoadDevicesPerQuery, 1) == false)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Loading state of " << deviceLastCounterMap.size() << " devices from database failed";
+		return false;
+	}
+
+	for (auto& entry: deviceLastCounterMap)
+	{
+		m_deviceLastCounterInDBMap[entry.first] = entry.second;
+		m_hydratedDevices.insert(entry.first);
+
+		m_deviceLRU.push_front(entry.first);
+		m_deviceLRUPosition[entry.first] = m_deviceLRU.begin();
+	}
+
+	for (auto& entry: deviceNullRecordKeys)
+		m_deviceNullRecordKeys[entry.first] = std::move(entry.second);
+
+	m_hydratedDeviceCount += deviceLastCounterMap.size();
+	++m_hydrationBatchCount;
+
+	BOOST_LOG_TRIVIAL(debug) << "Loaded state of " << deviceLastCounterMap.size() << " devices, total loaded devices: " << m_hydratedDevices.size();
+	return true;
+}
+
+
+//*************************************************************************************************
+void DataStorage::touchDevice(int deviceID)
+{
+	auto iter = m_deviceLRUPosition.find(deviceID);
+
+	if (iter != m_deviceLRUPosition.end() && iter->second != m_deviceLRU.begin())
+		m_deviceLRU.splice(m_deviceLRU.begin(), m_deviceLRU, iter->second);
+}
+
+
+//*************************************************************************************************
+bool DataStorage::evictIdleDevices()
+{
+	if (!m_isLazyLoadingEnabled || m_deviceStateMemoryBudgetBytes <= 0)
+		return true;
+
+	long stateBytes = estimateDeviceStateBytes();
+
+	if (stateBytes <= m_deviceStateMemoryBudgetBytes)
+		return true;
+
+	//Evict down to 90% of the budget, so that eviction does not run on every call
+	long targetBytes = m_deviceStateMemoryBudgetBytes / 10 * 9;
+	std::vector<int> evictedDevices;
+
+	for (auto iter = m_deviceLRU.rbegin(); iter != m_deviceLRU.rend() && stateBytes > targetBytes; ++iter)
+	{
+		int deviceID = *iter;
+		stateBytes -= estimateDeviceStateBytes(deviceID);
+
+		//Out-of-order records are written with NULLs for missing ones (as done by the null record generation timer)
+		auto outOfOrderIter = m_deviceOutOfOrderStore.find(deviceID);
+		while (outOfOrderIter != m_deviceOutOfOrderStore.end() && outOfOrderIter->second.size() != 0)
+		{
+			if (FlushOutOfOrderRecordsWithNulls(deviceID, m_deviceLastCounterInDBMap[deviceID], outOfOrderIter->second) == false)
+			{
+				BOOST_LOG_TRIVIAL(warning) << "Device state eviction stopped as out-of-order records of device " << deviceID << " could not be written";
+				return false;
+			}
+		}
+
+		evictedDevices.push_back(deviceID);
+	}
+
+	//State of evicted devices is reloaded from the database, so all their pending writes must reach it first
+	//(including pipelined record writes, which are only submitted by writeRecordCache())
+	bool isWritten = m_isUnitOfWorkEnabled ? writeCachesInUnitOfWork(true, true, true)
+								: (writeRecordCache() && updateNullCache() && flushNullEntryDeleteCache());
+	isWritten = isWritten && waitForPendingWrites();
+
+	if (isWritten == false)
+	{
+		BOOST_LOG_TRIVIAL(warning) << "Device state eviction stopped as caches could not be written to database";
+		return false;
+	}
+
+	for (int deviceID: evictedDevices)
+	{
+		m_deviceLRU.erase(m_deviceLRUPosition[deviceID]);
+		m_deviceLRUPosition.erase(deviceID);
+		m_hydratedDevices.erase(deviceID);
+		m_deviceOutOfOrderStore.erase(deviceID);
+		m_deviceNullRecordKeys.erase(deviceID);
+		m_deviceLastCounterInDBMap[deviceID] = 0;	//Device stays known; last counter is reloaded with its state
+	}
+
+	m_evictedDeviceCount += evictedDevices.size();
+	++m_evictionRunCount;
+
+	BOOST_LOG_TRIVIAL(info) << "Evicted state of " << evictedDevices.size() << " least recently used devices; loaded devices: "
+				<< m_hydratedDevices.size() << ", estimated device state size: " << stateBytes << " bytes";
+	return true;
+}
+
+
+//*************************************************************************************************
+long DataStorage::estimateDeviceStateBytes()
+{
+	long stateBytes = m_hydratedDevices.size() * DEVICE_ENTRY_BYTES;
+
+	for (auto& entry: m_deviceNullRecordKeys)
+		stateBytes += entry.second.size() * NULL_ENTRY_BYTES;
+
+	for (auto& entry: m_deviceOutOfOrderStore)
+		stateBytes += entry.second.size() * m_columnCount * RECORD_BYTES_PER_FIELD;
+
+	return stateBytes;
+}
+
+
+//*************************************************************************************************
+long DataStorage::estimateDeviceStateBytes(int deviceID)
+{
+	long stateBytes = DEVICE_ENTRY_BYTES;
+
+	auto nullKeysIter = m_deviceNullRecordKeys.find(deviceID);
+	if (nullKeysIter != m_deviceNullRecordKeys.end())
+		stateBytes += nullKeysIter->second.size() * NULL_ENTRY_BYTES;
+
+	auto outOfOrderIter = m_deviceOutOfOrderStore.find(deviceID);
+	if (outOfOrderIter != m_deviceOutOfOrderStore.end())
+		stateBytes += outOfOrderIter->second.size() * m_columnCount * RECORD_BYTES_PER_FIELD;
+
+	return stateBytes;
+}
+
+
+//*************************************************************************************************
+bool DataStorage::writeDeviceStateSnapshot()
+{
+	if (!m_isSnapshotEnabled || !m_isDatabaseActive)
+		return true;
+
+	//In-memory last counters match the database only when no written state is waiting in a cache
+	//(out-of-order records do not advance the last counter)
+	if (m_recordCache.size() != 0 || m_recordWriter.getPendingRecordCount() != 0 || m_nullUpdateCache.size() != 0 || m_nullEntryDeleteCache.size() != 0)
+	{
+		BOOST_LOG_TRIVIAL(debug) << "Skipping device state snapshot as caches are not empty";
+		return false;
+	}
+
+	long mainTableWatermark, nullTableWatermark;
+
+	if (m_storageBackend->getTableWatermarks(mainTableWatermark, nullTableWatermark) == false)
+		return false;
+
+	return m_snapshot.write(m_snapshotFilename, m_deviceLastCounterInDBMap, m_deviceNullRecordKeys, mainTableWatermark, nullTableWatermark);
+}
+
+
+//*************************************************************************************************
+void DataStorage::collectPendingRecords(std::vector<std::string>& pendingRecords)
+{
+	//Records that are held only in memory (i.e. not yet written to the database); records of the record writer are the oldest
+	std::vector< std::vector<std::string> > writerRecords;
+	m_recordWriter.copyPendingRecords(writerRecords);
+
+	for (auto& record: writerRecords)
+		pendingRecords.push_back(convertVectorToString(record));
+
+	for (auto& record: m_recordCache)
+		pendingRecords.push_back(convertVectorToString(record));
+
+	for (auto& entry: m_deviceOutOfOrderStore)
+	{
+		for (auto& nestedEntry: entry.second)
+			pendingRecords.push_back(convertVectorToString(nestedEntry.second));
+	}
+
+	for (auto& entry: m_nullUpdateCache)
+		pendingRecords.push_back(convertVectorToString(entry.second));
+}
+
+
+//*************************************************************************************************
+void DataStorage::compactJournalIfNeeded()
+{
+	if (m_isReplayingJournal || !m_journal.needsCompaction())
+		return;
+
+	std::vector<std::string> pendingRecords;
+	collectPendingRecords(pendingRecords);
+	m_journal.compact(pendingRecords);
+}
+
+
 //*************************************************************************************************
 std::vector<std::string> DataStorage::splitString(std::string input, char delimeter)
 {
@@ -886,6 +1724,27 @@ void DataStorage::dumpDataStorageInformation(std::ofstream& fileStream)
 	fileStream << "m_cachedRecordCount = " << m_cachedRecordCount << ", m_recordCache.size() = " << m_recordCache.size() << std::endl;
 	fileStream << "m_cachedNullUpdateCount = " << m_cachedNullUpdateCount << ", m_nullUpdateCache.size() = " << m_nullUpdateCache.size() << std::endl;
 	fileStream << "m_cachedNullEntryDeleteCount = " << m_cachedNullEntryDeleteCount << ", m_nullEntryDeleteCache.size() = " << m_nullEntryDeleteCache.size() << std::endl;
+	if (m_isUnitOfWorkEnabled)
+	{
+		fileStream << "m_committedUnitOfWorkCount = " << m_committedUnitOfWorkCount << ", m_failedUnitOfWorkCount = " << m_failedUnitOfWorkCount << std::endl;
+	}
+	fileStream << "m_deviceReloadCount = " << m_deviceReloadCount << ", m_deviceReloadChangedCount = " << m_deviceReloadChangedCount
+				<< ", devices table fingerprint (count, xor, max) = " << m_deviceTableFingerprint.m_count << ", "
+				<< m_deviceTableFingerprint.m_idXor << ", " << m_deviceTableFingerprint.m_maxID << std::endl;
+	if (m_isLazyLoadingEnabled)
+	{
+		fileStream << "m_hydratedDevices.size() = " << m_hydratedDevices.size() << ", m_hydratedDeviceCount = " << m_hydratedDeviceCount
+					<< ", m_hydrationBatchCount = " << m_hydrationBatchCount << std::endl;
+		fileStream << "estimated device state bytes = " << estimateDeviceStateBytes() << ", m_deviceStateMemoryBudgetBytes = " << m_deviceStateMemoryBudgetBytes
+					<< ", m_evictedDeviceCount = " << m_evictedDeviceCount << ", m_evictionRunCount = " << m_evictionRunCount << std::endl;
+	}
+	fileStream << std::endl;
+
+	if (m_journal.isActive())
+		m_journal.dumpJournalInformation(fileStream);
+
+	if (m_recordWriter.isActive())
+		m_recordWriter.dumpRecordWriterInformation(fileStream);
 }
 
 
@@ -1,29 +1,45 @@
 #pragma once
 
 #include <string>
+#include <memory>
 #include <unordered_map>
+#include <unordered_set>
 #include <map>
+#include <set>
+#include <list>
+#include <future>
 #include <vector>
 #include <utility>
 #include <fstream>	//for dumping service info to file
 
-#include <DatabaseStorage.h>
+#include <StorageBackend.h>
+#include <PipelinedRecordWriter.h>
 #include <FileBasedStorage.h>
+#include <RecordJournal.h>
+#include <DeviceStateSnapshot.h>
 #include <NullEntry.h>
 
 
 /*
 This class is acts as an interface to the user for a primary and secondary data storage
 */
-class DataStorage
+class DataStorage: public RecordWriterCallback
 {
+	friend class IngestBenchmark;	//benchmarks the record validation path without storage
+
 public:
 
 	DataStorage();
 	~DataStorage() {}
-	bool initialize();
+
+	//isStorageEnabled=false: only the record structure and storage schema are prepared (no storage backend, file or journal), eg: for benchmarks
+	bool initialize(bool isStorageEnabled = true);
 	bool initializeDevices(bool isReinitialize = false);
 
+	//Devices table reload: the table is scanned for changes on a worker thread and the result is applied on the calling thread
+	void startDeviceReload();
+	bool applyDeviceReload();	//Returns true if a completed reload was applied
+
 	int validateAndWriteRecord(std::string recordString, std::pair<long, int>& ackContent);
 	
 	//per device (on threashold reached)
@@ -32,12 +48,41 @@ public:
 	//all devices (on timer)
 	bool FlushAllOutOfOrderRecordsWithNulls();
 
+	//With pipelined record writes (config RecordWriterCount > 0), returns once the records are queued to the record writer
 	bool writeRecordCache();
 	bool updateNullCache();
 	bool flushNullEntryDeleteCache();
 	
+	//With config StorageUnitOfWorkEnabled, caches due in one flush are written in one storage transaction (see writeCachesInUnitOfWork())
 	bool flushCaches(bool timerFired = false);
 
+	//Pipelined record writes: handle batches finished by the record writer (failed records return to the record cache)
+	void processCompletedWrites();
+	bool waitForPendingWrites();	//Returns false if some records could not be written
+
+	virtual void OnRecordBatchWritten(std::vector< std::vector<std::string> >& records, bool isSuccessful);
+
+	//Records waiting to be written to storage (in-order record cache, record writer and null update cache), for read-side backpressure
+	int getPendingRecordCount() { return m_recordCache.size() + m_recordWriter.getPendingRecordCount() + m_nullUpdateCache.size(); }
+
+	//Report bytes held in caches to MemoryAccounting
+	void updateMemoryAccounting();
+
+	//Group commit of journaled records (called before sending the ACKs of a poll cycle)
+	bool isJournalActive() { return m_journal.isActive(); }
+	bool syncJournal();
+
+	//Lazy device state loading: state of devices for which validateAndWriteRecord() returned 2 is loaded in one batch
+	bool hasDevicesToHydrate() { return m_devicesToHydrate.size() != 0; }
+	bool hydrateDevices();
+
+	//Drop state of least recently used devices when device state exceeds its memory budget (lazy loading only)
+	//Evicted devices are loaded again from the database when they next send data
+	bool evictIdleDevices();
+
+	//Persist per-device state for a fast warm restart (only when all caches have been written to the database)
+	bool writeDeviceStateSnapshot();
+
 	void dumpDataStorageInformation(std::ofstream& fileStream);
 
 private:
@@ -48,12 +93,47 @@ private:
 
 	bool initializeRecordStructure();
 	bool initializeNullRecords();
+	bool initializeJournal();
+	bool startRecordWriter();
+
+	void removeDevice(int deviceID);
+	void touchDevice(int deviceID);
+	long estimateDeviceStateBytes();
+	long estimateDeviceStateBytes(int deviceID);
+
+	//Record cache write results (the record cache is kept after a failure, and spilled to file at its hard limit)
+	void clearWrittenRecordCache();
+	void handleFailedRecordCacheWrite();
+
+	//Removes entries of the (written) null update cache from in-memory null entries and adds them to the delete cache
+	void removeUpdatedNullEntries(std::set<int>& deletedEntriesDevices);
+
+	//Unit of work: the selected caches (the null update cache with the delete cache) are written in one storage transaction
+	//Caches are cleared only after the commit; on failure, nothing is written and all of them are kept
+	bool writeCachesInUnitOfWork(bool isRecordCacheIncluded, bool isNullUpdateCacheIncluded, bool isDeleteCacheIncluded);
+
+	void collectPendingRecords(std::vector<std::string>& pendingRecords);
+	void compactJournalIfNeeded();
 
 	void generateACK(int deviceID, long lastCounter, long currentCounter, std::pair<long, int>& ackContent);
 
 
-	DatabaseStorage m_dbStorage;
+	std::unique_ptr<StorageBackend> m_storageBackend;	//config StorageBackend
+	StorageSchema m_storageSchema;
+
+	//Pipelined record writes (writers have their own connections to the storage)
+	PipelinedRecordWriter m_recordWriter;
+	int m_recordWriterCount;	//0 = records are written on the event loop thread
+	int m_recordWriterMaxQueuedBatches;
+	std::vector< std::vector<std::string> > m_failedWriteRecords;	//returned to the record cache after the completions are handled
+
+	//Unit of work: record, NULL record, null table and null update writes of a flush in one transaction
+	bool m_isUnitOfWorkEnabled;
+	unsigned long m_committedUnitOfWorkCount;
+	unsigned long m_failedUnitOfWorkCount;
 	FileBasedStorage m_fileStorage;
+	RecordJournal m_journal;
+	DeviceStateSnapshot m_snapshot;
 
 	bool m_isDatabaseActive;
 	bool m_isFileActive;
@@ -67,6 +147,33 @@ private:
 	int m_failedBatchUpdateCount;
 	int m_bactchUpdateFailCountThreshold;
 
+	bool m_isJournalEnabled;
+	bool m_isReplayingJournal;	//records replayed from the journal must not be journaled again
+	long m_journalCompactionSizeBytes;
+
+	bool m_isSnapshotEnabled;
+	bool m_isSnapshotLoaded;	//true from loading the snapshot at startup until its state has been applied
+	std::string m_snapshotFilename;
+
+	bool m_isLazyLoadingEnabled;
+	std::unordered_set<int> m_hydratedDevices;	//devices whose last counter and null entries are loaded (lazy loading only)
+	std::set<int> m_devicesToHydrate;	//devices that sent records in the current poll cycle before being loaded
+	unsigned long m_hydratedDeviceCount;
+	unsigned long m_hydrationBatchCount;
+
+	//Devices table change detection
+	DeviceTableFingerprint m_deviceTableFingerprint;
+	std::future<DeviceTableScan> m_deviceTableScan;	//valid() while a reload is running or waiting to be applied
+	unsigned long m_deviceReloadCount;
+	unsigned long m_deviceReloadChangedCount;
+
+	//Loaded devices in least recently used order (front = most recent)
+	std::list<int> m_deviceLRU;
+	std::unordered_map<int, std::list<int>::iterator> m_deviceLRUPosition;
+	long m_deviceStateMemoryBudgetBytes;	//0 = unlimited
+	unsigned long m_evictedDeviceCount;
+	unsigned long m_evictionRunCount;
+
 	unsigned long m_dbWriteCount;
 	unsigned long m_fileWriteCount;
 	
@@ -85,6 +192,8 @@ private:
 	//nested map's key=sd_counter
 	std::unordered_map< int, std::map<long, NullEntry> > m_deviceNullRecordKeys;
 	int m_maxNullCountPerDevice;
+	int m_nullRecordLoadDevicesPerQuery;	//Loading null records at startup
+	int m_nullRecordLoadConnections;
 
 	//Cache to store in-order records for batch writing
 	std::vector< std::vector<std::string> > m_recordCache;
@@ -0,0 +1,161 @@
+#include <exception>
+#include <stdexcept>
+#include <DatabaseConnectionPool.h>
+#include <Logger.h>
+
+
+//*************************************************************************************************
+DatabaseConnectionPool::DatabaseConnectionPool():
+	m_driver{nullptr},
+	m_tasks{nullptr},
+	m_taskResults{nullptr},
+	m_round{0},
+	m_runningTaskCount{0},
+	m_isStopping{false}
+{
+}
+
+
+//*************************************************************************************************
+DatabaseConnectionPool::~DatabaseConnectionPool()
+{
+	stop();
+}
+
+
+//*************************************************************************************************
+bool DatabaseConnectionPool::start(sql::Driver* driver, const ConnectionSettings& settings, int connectionCount)
+{
+	stop();
+
+	m_driver = driver;
+
+	try
+	{
+		for (int i = 0; i < connectionCount; ++i)
+		{
+			std::unique_ptr<sql::Connection> connection(m_driver->connect(settings.m_server, settings.m_username, settings.m_password));
+			connection->setSchema(settings.m_database);
+			m_connections.push_back(std::move(connection));
+		}
+	}
+	catch (sql::SQLException &e)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed to open pooled connection to MySQL server: " << settings.m_server;
+		BOOST_LOG_TRIVIAL(error) << "Error: " << e.what();
+		m_connections.clear();
+		return false;
+	}
+	catch (std::exception &e)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed when opening pooled connection to MySQL";
+		BOOST_LOG_TRIVIAL(error) << "Error: " << e.what();
+		m_connections.clear();
+		return false;
+	}
+
+	for (int i = 0; i < connectionCount; ++i)
+		m_workers.push_back(std::thread(&DatabaseConnectionPool::workerLoop, this, i));
+
+	BOOST_LOG_TRIVIAL(info) << "Database connection pool started with " << connectionCount << " connections";
+	return true;
+}
+
+
+//*************************************************************************************************
+void DatabaseConnectionPool::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_isStopping = true;
+	}
+	m_taskCondition.notify_all();
+
+	for (std::thread& worker: m_workers)
+		worker.join();
+
+	m_workers.clear();
+	m_connections.clear();
+
+	//Workers started by the next start() begin with round 0
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_isStopping = false;
+	m_round = 0;
+	m_runningTaskCount = 0;
+}
+
+
+//*************************************************************************************************
+void DatabaseConnectionPool::run(const std::vector<Task>& tasks, std::vector<char>& taskResults)
+{
+	taskResults.assign(tasks.size(), true);
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	m_tasks = &tasks;
+	m_taskResults = &taskResults;
+	m_runningTaskCount = m_workers.size();
+	++m_round;
+
+	m_taskCondition.notify_all();
+	m_doneCondition.wait(lock, [this]{ return m_runningTaskCount == 0; });
+
+	m_tasks = nullptr;
+	m_taskResults = nullptr;
+}
+
+
+//*************************************************************************************************
+void DatabaseConnectionPool::workerLoop(int index)
+{
+	m_driver->threadInit();	//Connector/C++ requires per-thread initialization of the client library
+
+	unsigned long lastRound = 0;
+
+	while (true)
+	{
+		const Task* task = nullptr;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_taskCondition.wait(lock, [this, lastRound]{ return m_isStopping || m_round != lastRound; });
+
+			if (m_isStopping)
+				break;
+
+			lastRound = m_round;
+
+			if (m_tasks == nullptr)	//No round in progress
+				continue;
+
+			if (index < (int)m_tasks->size())
+				task = &(*m_tasks)[index];
+		}
+
+		bool isSuccessful = true;
+
+		if (task != nullptr && *task)
+		{
+			try
+			{
+				isSuccessful = (*task)(m_connections[index].get());
+			}
+			catch (std::exception &e)
+			{
+				BOOST_LOG_TRIVIAL(error) << "Task failed on pooled database connection " << index;
+				BOOST_LOG_TRIVIAL(error) << "Error: " << e.what();
+				isSuccessful = false;
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (index < (int)m_taskResults->size())
+			(*m_taskResults)[index] = isSuccessful;
+
+		if (--m_runningTaskCount == 0)
+			m_doneCondition.notify_one();
+	}
+
+	m_driver->threadEnd();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//MySQL Connector/C++ headers
+#include <cppconn/driver.h>
+#include <cppconn/connection.h>
+#include <cppconn/exception.h>
+
+struct ConnectionSettings
+{
+	std::string m_server;
+	std::string m_username;
+	std::string m_password;
+	std::string m_database;
+};
+
+/*
+This class keeps a fixed set of MySQL connections, each used only by its own worker thread
+run() executes one task per connection in parallel and returns when all of them are done, so that the caller (event loop thread)
+decides which queries go to which connection (eg: all queries of a device to the same connection, to keep its commits in order)
+*/
+class DatabaseConnectionPool
+{
+public:
+	typedef std::function<bool(sql::Connection* connection)> Task;
+
+	DatabaseConnectionPool();
+	~DatabaseConnectionPool();
+
+	//Opens connectionCount connections and starts a worker thread for each
+	bool start(sql::Driver* driver, const ConnectionSettings& settings, int connectionCount);
+
+	//Closes connections after workers finish their current task
+	void stop();
+
+	int getConnectionCount() { return m_connections.size(); }
+
+	//tasks[i] is run on connection i (tasks.size() == getConnectionCount(); empty tasks are skipped)
+	//taskResults[i] = return value of tasks[i] (true for skipped tasks; false if it threw)
+	void run(const std::vector<Task>& tasks, std::vector<char>& taskResults);
+
+private:
+	void workerLoop(int index);
+
+	sql::Driver* m_driver;
+	std::vector< std::unique_ptr<sql::Connection> > m_connections;
+	std::vector<std::thread> m_workers;
+
+	std::mutex m_mutex;
+	std::condition_variable m_taskCondition;	//new round of tasks, or stopping
+	std::condition_variable m_doneCondition;	//all tasks of the round are done
+
+	const std::vector<Task>* m_tasks;	//tasks of the current round (owned by the caller of run())
+	std::vector<char>* m_taskResults;
+	unsigned long m_round;	//incremented by each run()
+	int m_runningTaskCount;
+	bool m_isStopping;
+};
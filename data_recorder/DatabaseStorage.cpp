@@ -1,40 +1,54 @@
 #include <exception>
+#include <stdexcept>
 #include <sstream>
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+#include <mutex>
+#include <atomic>
 #include <DatabaseStorage.h>
+#include <ConfigurationHandler.h>
 #include <Logger.h>
 
 
 //*************************************************************************************************
-bool DatabaseStorage::initialize(std::string server, std::string user, std::string password, std::string database, std::string table,
-		std::string primaryKeyColumn, std::string recordCounterColumn, std::string deviceIDColumn, std::string dateTimeColumn,
-		int columnCount, std::vector<std::string> columnNames, std::vector<std::string> columnTypes, std::vector<int> recordPositions,
-		std::string nullRecordsTable, std::string nullRecTablePrimaryKeyColumn, std::string nullRecInsertedPrimaryKeyColumn,
-		std::string nullRecDeviceIDColumn, std::string nullRecRecordCounterColumn, std::string nullRecRequestCountColumn, int nullEntriesMaxCount)
+bool DatabaseStorage::initialize(const StorageSchema& schema, bool isConnect /*= true*/)
 {
+	ConfigurationHandler& configHandler = ConfigurationHandler::getInstance();
+
 	//Set parameters
-	m_mySqlServer = server;
-	m_username = user;
-	m_password = password;
-	m_database = database;
-	m_table = table;
-	m_primaryKeyColumn = primaryKeyColumn;
-	m_recordCounterColumn = recordCounterColumn;
-	m_deviceIDColumn = deviceIDColumn;
-	m_dateTimeColumn = dateTimeColumn;
-
-	m_nullRecordsTable = nullRecordsTable;
-	m_nullRecTablePrimaryKeyColumn = nullRecTablePrimaryKeyColumn;
-	m_nullRecInsertedPrimaryKeyColumn = nullRecInsertedPrimaryKeyColumn;
-	m_nullRecDeviceIDColumn = nullRecDeviceIDColumn;
-	m_nullRecRecordCounterColumn = nullRecRecordCounterColumn;
-	m_nullRecRequestCountColumn = nullRecRequestCountColumn;
-
-	m_nullEntriesMaxCount = nullEntriesMaxCount;
-
-	m_columnCount = columnCount;
-	m_columnNamesVec = columnNames;
-	m_columnTypesVec = columnTypes;
-	m_recordPositionsVec = recordPositions;
+	m_mySqlServer = configHandler.getConfig("MySQLServer");
+	m_username = configHandler.getConfig("Username");
+	m_password = configHandler.getConfig("Password");
+	m_database = configHandler.getConfig("DatabaseName");
+	m_table = schema.m_table;
+	m_primaryKeyColumn = schema.m_primaryKeyColumn;
+	m_recordCounterColumn = schema.m_recordCounterColumn;
+	m_deviceIDColumn = schema.m_deviceIDColumn;
+	m_dateTimeColumn = schema.m_dateTimeColumn;
+
+	m_nullRecordsTable = schema.m_nullRecordsTable;
+	m_nullRecTablePrimaryKeyColumn = schema.m_nullRecTablePrimaryKeyColumn;
+	m_nullRecInsertedPrimaryKeyColumn = schema.m_nullRecInsertedPrimaryKeyColumn;
+	m_nullRecDeviceIDColumn = schema.m_nullRecDeviceIDColumn;
+	m_nullRecRecordCounterColumn = schema.m_nullRecRecordCounterColumn;
+	m_nullRecRequestCountColumn = schema.m_nullRecRequestCountColumn;
+
+	m_nullEntriesMaxCount = schema.m_nullEntriesMaxCount;
+
+	m_columnCount = schema.m_columnCount;
+	m_columnNamesVec = schema.m_columnNames;
+	m_columnTypesVec = schema.m_columnTypes;
+	m_recordPositionsVec = schema.m_recordPositions;
+
+	m_connectionPoolSize = m_isRecordWriter ? 1 : std::max(1, std::stoi(configHandler.getConfig("DatabaseConnectionPoolSize")));
+
+	m_deviceIDRecordPosition = 0;
+	for (int i = 0; i < m_columnCount; ++i)
+	{
+		if (m_columnNamesVec[i] == m_deviceIDColumn)
+			m_deviceIDRecordPosition = m_recordPositionsVec[i];
+	}
 
 	//Prepare first part of insert query based on above record structure data
 	std::string fields("");
@@ -82,21 +96,30 @@ bool DatabaseStorage::initialize(std::string server, std::string user, std::stri
 	BOOST_LOG_TRIVIAL(info) << "First part of insert query: " << m_mainInsertQuery;
 	BOOST_LOG_TRIVIAL(info) << " ";
 
+	if (!isConnect)
+		return true;
+
 	//Connect to MySQL server and select database
 	try
 	{
-		BOOST_LOG_TRIVIAL(info) << "Connecting to MySQL server: " << server;
+		BOOST_LOG_TRIVIAL(info) << "Connecting to MySQL server: " << m_mySqlServer;
 
 		m_driver = get_driver_instance();
 		m_dbConnection = std::unique_ptr<sql::Connection>
 							(m_driver->connect(m_mySqlServer, m_username, m_password));
+		m_isInUnitOfWork = false;	//New connection (autocommit on)
 
 		BOOST_LOG_TRIVIAL(info) << "Connected to MySQL server successfully";
 
-		BOOST_LOG_TRIVIAL(info) << "Selecting database: " << database;
+		BOOST_LOG_TRIVIAL(info) << "Selecting database: " << m_database;
 		m_dbConnection->setSchema(m_database);
 		BOOST_LOG_TRIVIAL(info) << "Database selected successfully";
 
+		m_connectionPool.stop();	//Re-initialization; connections of the previous pool may be broken
+
+		if (m_connectionPoolSize > 1)
+			return m_connectionPool.start(m_driver, getConnectionSettings(), m_connectionPoolSize);
+
 		return true;
 	}
 	catch (sql::SQLException &e)
@@ -115,54 +138,66 @@ bool DatabaseStorage::initialize(std::string server, std::string user, std::stri
 
 
 //************************************************************************************************
-bool DatabaseStorage::writeRecordBatch(const std::vector< std::vector<std::string> >& recordBatch)
+bool DatabaseStorage::writeRecordBatch(std::vector< std::vector<std::string> >& recordBatch)
 {
 	int recordCount = recordBatch.size();
 
 	if (recordCount == 0)
 		return true;
 
-	std::string batchInsertQuery = m_mainInsertQuery + ' ';
-
-	for (int j = 0; j < recordCount; ++j)
+	if (m_connectionPool.getConnectionCount() > 0 && !m_isInUnitOfWork)
 	{
-		batchInsertQuery += '(';
+		//One insert query per device shard, executed in parallel
+		int shardCount = m_connectionPool.getConnectionCount();
+		std::vector<std::string> shardQueries(shardCount);
+		std::vector<int> recordShards(recordCount);
 
-		const std::vector<std::string>& record = recordBatch[j];
+		for (int j = 0; j < recordCount; ++j)
+		{
+			int shard = getShard(recordBatch[j]);
+			recordShards[j] = shard;
 
-		for (int i = 0; i < m_columnCount; ++i)
+			std::string& shardQuery = shardQueries[shard];
+			shardQuery += shardQuery.empty() ? m_mainInsertQuery + ' ' : ", ";
+			appendInsertValues(shardQuery, recordBatch[j]);
+		}
+
+		for (std::string& shardQuery: shardQueries)
 		{
-			if (i > 0)
-				batchInsertQuery += ",";
+			if (!shardQuery.empty())
+				shardQuery += ";";
+		}
 
-			if (record[m_recordPositionsVec[i]] == "NAN" || record[m_recordPositionsVec[i]] == "NULL" || record[m_recordPositionsVec[i]] == "INF" || record[m_recordPositionsVec[i]] == "OVF")
-			{
-				batchInsertQuery += "NULL";
-				continue;
-			}
+		std::vector<char> shardResults;
+		executeShardQueries(shardQueries, "insert batch of records into table " + m_table, shardResults);
 
-			if (m_columnTypesVec[i] == "varchar" || m_columnTypesVec[i] == "datetime")	//single quotes around these types
-			{
-				batchInsertQuery += '\'';
-				batchInsertQuery += record[m_recordPositionsVec[i]];
-				batchInsertQuery += '\'';
-			}
-			else
+		//Keep only the records of failed shards, so that committed records are not inserted again when the batch is retried
+		int remainingCount = 0;
+		for (int j = 0; j < recordCount; ++j)
+		{
+			if (!shardResults[recordShards[j]])
 			{
-				batchInsertQuery += record[m_recordPositionsVec[i]];
+				if (remainingCount != j)
+					recordBatch[remainingCount] = std::move(recordBatch[j]);
+				++remainingCount;
 			}
 		}
 
-		if (j != recordCount - 1)
-		{
-			batchInsertQuery += "), " ;
-		}
-		else
+		if (remainingCount == 0)
 		{
-			batchInsertQuery += ");" ;
+			BOOST_LOG_TRIVIAL(debug) << "record batch size: " << recordCount << ", inserted over " << shardCount << " pooled connections";
+			return true;
 		}
+
+		recordBatch.resize(remainingCount);
+
+		BOOST_LOG_TRIVIAL(error) << "Failed to insert " << remainingCount << " of " << recordCount << " records into table " << m_table
+									<< "; they are kept for the next batch";
+		return false;
 	}
 
+	std::string batchInsertQuery = buildInsertQuery(recordBatch);
+
 	BOOST_LOG_TRIVIAL(trace) << "Batch insert query: " << batchInsertQuery;
 
 	try
@@ -192,6 +227,59 @@ bool DatabaseStorage::writeRecordBatch(const std::vector< std::vector<std::strin
 }
 
 
+//************************************************************************************************
+std::string DatabaseStorage::buildInsertQuery(const std::vector< std::vector<std::string> >& recordBatch)
+{
+	int recordCount = recordBatch.size();
+
+	std::string batchInsertQuery = m_mainInsertQuery + ' ';
+
+	for (int j = 0; j < recordCount; ++j)
+	{
+		if (j > 0)
+			batchInsertQuery += ", ";
+
+		appendInsertValues(batchInsertQuery, recordBatch[j]);
+	}
+
+	batchInsertQuery += ";";
+
+	return batchInsertQuery;
+}
+
+
+//************************************************************************************************
+void DatabaseStorage::appendInsertValues(std::string& query, const std::vector<std::string>& record)
+{
+	query += '(';
+
+	for (int i = 0; i < m_columnCount; ++i)
+	{
+		if (i > 0)
+			query += ",";
+
+		if (record[m_recordPositionsVec[i]] == "NAN" || record[m_recordPositionsVec[i]] == "NULL" || record[m_recordPositionsVec[i]] == "INF" || record[m_recordPositionsVec[i]] == "OVF")
+		{
+			query += "NULL";
+			continue;
+		}
+
+		if (m_columnTypesVec[i] == "varchar" || m_columnTypesVec[i] == "datetime")	//single quotes around these types
+		{
+			query += '\'';
+			query += record[m_recordPositionsVec[i]];
+			query += '\'';
+		}
+		else
+		{
+			query += record[m_recordPositionsVec[i]];
+		}
+	}
+
+	query += ')';
+}
+
+
 //************************************************************************************************
 bool DatabaseStorage::insertNullRecords(int deviceID, long start, long end, std::vector<NullEntry>& insertedRecordInfoVec)
 {
@@ -307,54 +395,42 @@ bool DatabaseStorage::updateRecordBatch(const std::unordered_map< long, std::vec
 	if (recordCount == 0)
 		return true;
 
-	std::string batchUpdateQuery = m_nullUpdateQueryBeginning;
-
-	int count = 0;	//To keep track of the number of records in map
-	for (auto iter = recordBatch.begin(); iter != recordBatch.end(); ++iter)
+	if (m_connectionPool.getConnectionCount() > 0 && !m_isInUnitOfWork)
 	{
-		batchUpdateQuery += '(';
-
-		long primaryKey = iter->first;
-		const std::vector<std::string>& record = iter->second;
+		//One update query per device shard, executed in parallel
+		//Updates are idempotent (by primary key), so the whole batch is simply retried if a shard fails
+		std::vector<std::string> shardQueries(m_connectionPool.getConnectionCount());
 
-		for (int i = -1; i < m_columnCount; ++i)	//Starts from -1 to accommodate the additional primary key column
+		for (auto iter = recordBatch.begin(); iter != recordBatch.end(); ++iter)
 		{
-			if (i == -1)	//Primary key
-			{
-				batchUpdateQuery += std::to_string(primaryKey);
-				continue;
-			}
-
-			if (i > -1)
-				batchUpdateQuery += ",";
+			std::string& shardQuery = shardQueries[getShard(iter->second)];
 
-			if (record[m_recordPositionsVec[i]] == "NAN")
-			{
-				batchUpdateQuery += "NULL";
-				continue;
-			}
-
-			if (m_columnTypesVec[i] == "varchar" || m_columnTypesVec[i] == "datetime")	//single quotes around these types
-			{
-				batchUpdateQuery += '\'';
-				batchUpdateQuery += record[m_recordPositionsVec[i]];
-				batchUpdateQuery += '\'';
-			}
+			if (shardQuery.empty())
+				shardQuery = m_nullUpdateQueryBeginning;
 			else
-			{
-				batchUpdateQuery += record[m_recordPositionsVec[i]];
-			}
+				shardQuery += "), ";
+
+			appendUpdateValues(shardQuery, iter->first, iter->second);
 		}
 
-		if (count != recordCount - 1)
+		for (std::string& shardQuery: shardQueries)
 		{
-			batchUpdateQuery += "), " ;
+			if (!shardQuery.empty())
+				shardQuery += m_nullUpdateQueryEnding;
 		}
 
-		++count;
+		std::vector<char> shardResults;
+		executeShardQueries(shardQueries, "update batch of previously-null records in main table " + m_table, shardResults);
+
+		bool isSuccessful = std::find(shardResults.begin(), shardResults.end(), false) == shardResults.end();
+
+		if (isSuccessful)
+			BOOST_LOG_TRIVIAL(debug) << "Record batch size: " << recordCount << ", updated over " << shardQueries.size() << " pooled connections";
+
+		return isSuccessful;
 	}
 
-	batchUpdateQuery += m_nullUpdateQueryEnding;
+	std::string batchUpdateQuery = buildUpdateQuery(recordBatch);
 
 	BOOST_LOG_TRIVIAL(trace) << "Batch update query: " << batchUpdateQuery;
 
@@ -385,6 +461,55 @@ bool DatabaseStorage::updateRecordBatch(const std::unordered_map< long, std::vec
 }
 
 
+//************************************************************************************************
+std::string DatabaseStorage::buildUpdateQuery(const std::unordered_map< long, std::vector<std::string> >& recordBatch)
+{
+	std::string batchUpdateQuery = m_nullUpdateQueryBeginning;
+
+	for (auto iter = recordBatch.begin(); iter != recordBatch.end(); ++iter)
+	{
+		if (iter != recordBatch.begin())
+			batchUpdateQuery += "), " ;
+
+		appendUpdateValues(batchUpdateQuery, iter->first, iter->second);
+	}
+
+	batchUpdateQuery += m_nullUpdateQueryEnding;	//Closes the last record's values
+
+	return batchUpdateQuery;
+}
+
+
+//************************************************************************************************
+void DatabaseStorage::appendUpdateValues(std::string& query, long primaryKey, const std::vector<std::string>& record)
+{
+	query += '(';
+	query += std::to_string(primaryKey);	//Additional primary key column
+
+	for (int i = 0; i < m_columnCount; ++i)
+	{
+		query += ",";
+
+		if (record[m_recordPositionsVec[i]] == "NAN")
+		{
+			query += "NULL";
+			continue;
+		}
+
+		if (m_columnTypesVec[i] == "varchar" || m_columnTypesVec[i] == "datetime")	//single quotes around these types
+		{
+			query += '\'';
+			query += record[m_recordPositionsVec[i]];
+			query += '\'';
+		}
+		else
+		{
+			query += record[m_recordPositionsVec[i]];
+		}
+	}
+}
+
+
 //************************************************************************************************
 bool DatabaseStorage::deleteNullEntryBatch(const std::vector<long>& nullEntryBatch)
 {
@@ -393,6 +518,30 @@ bool DatabaseStorage::deleteNullEntryBatch(const std::vector<long>& nullEntryBat
 	if (recordCount == 0)
 		return true;
 
+	if (m_connectionPool.getConnectionCount() > 0 && !m_isInUnitOfWork)
+	{
+		//Entries belong to no particular device order (deletes are idempotent), so they are spread by primary key
+		std::vector<std::string> shardQueries(m_connectionPool.getConnectionCount());
+
+		for (long insertedPrimaryKey: nullEntryBatch)
+		{
+			std::string& shardQuery = shardQueries[insertedPrimaryKey % shardQueries.size()];
+			shardQuery += shardQuery.empty() ? m_nullTableEntryDeleteQuery : ",";
+			shardQuery += std::to_string(insertedPrimaryKey);
+		}
+
+		for (std::string& shardQuery: shardQueries)
+		{
+			if (!shardQuery.empty())
+				shardQuery += ");";
+		}
+
+		std::vector<char> shardResults;
+		executeShardQueries(shardQueries, "delete batch of null entries from table " + m_nullRecordsTable, shardResults);
+
+		return std::find(shardResults.begin(), shardResults.end(), false) == shardResults.end();
+	}
+
 	std::string batchDeleteQuery = m_nullTableEntryDeleteQuery;
 
 	int count = 0;	//To keep track of the number of records in map
@@ -566,42 +715,503 @@ bool DatabaseStorage::getDeviceIDs(std::string tableName, std::string deviceIDCo
 }
 
 
+//************************************************************************************************
+bool DatabaseStorage::getLastCounters(std::unordered_map<int, long>& deviceLastCounterMap)
+{
+	if (deviceLastCounterMap.size() == 0)
+		return true;
+
+	std::string deviceList;
+	for (auto& entry: deviceLastCounterMap)
+	{
+		if (deviceList.size() != 0)
+			deviceList += ",";
+
+		deviceList += std::to_string(entry.first);
+	}
+
+	std::string maxQuery = "SELECT " + m_deviceIDColumn + ", MAX(" + m_recordCounterColumn + ") FROM " + m_table +
+								" WHERE " + m_deviceIDColumn + " IN (" + deviceList + ") GROUP BY " + m_deviceIDColumn + ";";
+
+	try
+	{
+		std::unique_ptr<sql::Statement> statement(m_dbConnection->createStatement());
+		std::unique_ptr<sql::ResultSet> resultSet(statement->executeQuery(maxQuery));
+
+		while (resultSet->next())
+		{
+			auto iter = deviceLastCounterMap.find(resultSet->getUInt(1));
+
+			if (iter != deviceLastCounterMap.end() && !resultSet->isNull(2))
+				iter->second = resultSet->getUInt(2);
+		}
+
+		return true;
+	}
+	catch (sql::SQLException &e)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed to get last counters of " << deviceLastCounterMap.size() << " devices from table: " << m_table;
+		BOOST_LOG_TRIVIAL(error) << "Error: " << e.what();
+		return false;
+	}
+	catch (std::exception &e)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed when getting last counters of " << deviceLastCounterMap.size() << " devices from table: " << m_table;
+		BOOST_LOG_TRIVIAL(error) << "Error: " << e.what();
+		return false;
+	}
+}
+
+
 //************************************************************************************************
 bool DatabaseStorage::getInitialNullRecordInfo(const std::unordered_map<int, long>& validDevicesMap,
+									std::unordered_map< int, std::map<long, NullEntry> >& deviceNullRecordKeys,
+									int devicesPerQuery, int connectionCount)
+{
+	//Devices are loaded in batches (one query per batch), each query returning at most m_nullEntriesMaxCount rows per device
+	std::vector<int> deviceIDs;
+	deviceIDs.reserve(validDevicesMap.size());
+
+	for (auto& entry: validDevicesMap)
+		deviceIDs.push_back(entry.first);
+
+	std::sort(deviceIDs.begin(), deviceIDs.end());	//Neighbouring devices in a query touch neighbouring index pages
+
+	if (devicesPerQuery < 1)
+		devicesPerQuery = 1;
+
+	int batchCount = (deviceIDs.size() + devicesPerQuery - 1) / devicesPerQuery;
+
+	if (connectionCount > batchCount)
+		connectionCount = batchCount;
+
+	BOOST_LOG_TRIVIAL(info) << "Retrieving null record information from table: " << m_nullRecordsTable << " for " << deviceIDs.size()
+				<< " devices in " << batchCount << " queries over " << (connectionCount > 1 ? connectionCount : 1) << " connections";
+
+	if (connectionCount <= 1)
+	{
+		for (int batch = 0; batch < batchCount; ++batch)
+		{
+			if (loadNullRecordBatch(m_dbConnection.get(), deviceIDs, batch * devicesPerQuery, devicesPerQuery, deviceNullRecordKeys) == false)
+				return false;
+		}
+
+		BOOST_LOG_TRIVIAL(info) << "Null record information read from table " << m_nullRecordsTable << " successfully";
+		return true;
+	}
+
+	//Parallel load: each worker thread has its own connection and takes the next unloaded batch
+	//Batches partition the device set, so workers' results never overlap
+	std::atomic<int> nextBatch{0};
+	std::atomic<bool> isFailed{false};
+	std::mutex resultMutex;
+	std::vector<std::thread> workers;
+
+	for (int i = 0; i < connectionCount; ++i)
+	{
+		workers.emplace_back([&]()
+		{
+			m_driver->threadInit();
+
+			try
+			{
+				std::unique_ptr<sql::Connection> connection(createConnection(m_driver, getConnectionSettings()));
+				std::unordered_map< int, std::map<long, NullEntry> > workerResult;
+
+				int batch;
+				while (isFailed == false && (batch = nextBatch++) < batchCount)
+				{
+					if (loadNullRecordBatch(connection.get(), deviceIDs, batch * devicesPerQuery, devicesPerQuery, workerResult) == false)
+						isFailed = true;
+				}
+
+				std::lock_guard<std::mutex> lock(resultMutex);
+				for (auto& entry: workerResult)
+					deviceNullRecordKeys[entry.first] = std::move(entry.second);
+			}
+			catch (sql::SQLException &e)
+			{
+				BOOST_LOG_TRIVIAL(error) << "Failed to open a connection for loading null record information";
+				BOOST_LOG_TRIVIAL(error) << "Error: " << e.what();
+				isFailed = true;
+			}
+			catch (std::exception &e)
+			{
+				BOOST_LOG_TRIVIAL(error) << "Failed when opening a connection for loading null record information";
+				BOOST_LOG_TRIVIAL(error) << "Error: " << e.what();
+				isFailed = true;
+			}
+
+			m_driver->threadEnd();
+		});
+	}
+
+	for (auto& worker: workers)
+		worker.join();
+
+	if (isFailed)
+		return false;
+
+	BOOST_LOG_TRIVIAL(info) << "Null record information read from table " << m_nullRecordsTable << " successfully";
+	return true;
+}
+
+
+//************************************************************************************************
+bool DatabaseStorage::loadNullRecordBatch(sql::Connection* connection, const std::vector<int>& deviceIDs, int first, int count,
 									std::unordered_map< int, std::map<long, NullEntry> >& deviceNullRecordKeys)
 {
-	std::string selectQuery = "SELECT * FROM " + m_nullRecordsTable + " ORDER BY " + m_nullRecTablePrimaryKeyColumn + " ASC;";
+	int last = std::min(first + count, (int) deviceIDs.size());
+
+	//Per-device LIMIT subqueries joined with UNION ALL; each is an index range scan on (DeviceID, NullRecID)
+	//Column order of the select list is fixed, so that columns are read by index
+	std::string selectQuery;
+	for (int i = first; i < last; ++i)
+	{
+		if (i != first)
+			selectQuery += " UNION ALL ";
+
+		selectQuery = selectQuery + "(SELECT " + m_nullRecTablePrimaryKeyColumn + ", " + m_nullRecDeviceIDColumn + ", " + m_nullRecRecordCounterColumn
+						+ ", " + m_nullRecInsertedPrimaryKeyColumn + ", " + m_nullRecRequestCountColumn + " FROM " + m_nullRecordsTable
+						+ " WHERE " + m_nullRecDeviceIDColumn + "=" + std::to_string(deviceIDs[i])
+						+ " ORDER BY " + m_nullRecTablePrimaryKeyColumn + " ASC LIMIT " + std::to_string(m_nullEntriesMaxCount) + ")";
+	}
+	selectQuery += ";";
+
 	try
 	{
-		BOOST_LOG_TRIVIAL(info) << "Retrieving null record information from table: " << m_nullRecordsTable;
+		std::unique_ptr<sql::Statement> statement(connection->createStatement());
+		statement->setResultSetType(sql::ResultSet::TYPE_FORWARD_ONLY);	//Stream rows instead of buffering the whole result in the client
+
+		std::unique_ptr<sql::ResultSet> resultSet(statement->executeQuery(selectQuery));
+
+		while (resultSet->next())
+		{
+			unsigned int entryPrimaryKey = resultSet->getUInt(1);
+			int deviceID = resultSet->getUInt(2);
+			unsigned int SDCounter = resultSet->getUInt(3);
+			unsigned int insertedPrimaryKey = resultSet->getUInt(4);
+			unsigned int requestCount = resultSet->getUInt(5);
+
+			deviceNullRecordKeys[deviceID].emplace(SDCounter, NullEntry(entryPrimaryKey, deviceID, SDCounter, insertedPrimaryKey, requestCount));
+		}
+
+		return true;
+	}
+	catch (sql::SQLException &e)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed to get null record information from table: " << m_nullRecordsTable;
+		BOOST_LOG_TRIVIAL(error) << "Error: " << e.what();
+		return false;
+	}
+	catch (std::exception &e)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed when getting null record information from table: " << m_nullRecordsTable;
+		BOOST_LOG_TRIVIAL(error) << "Error: " << e.what();
+		return false;
+	}
+}
+
+
+//************************************************************************************************
+sql::Connection* DatabaseStorage::createConnection(sql::Driver* driver, const ConnectionSettings& settings)
+{
+	//Throws sql::SQLException on failure
+	std::unique_ptr<sql::Connection> connection(driver->connect(settings.m_server, settings.m_username, settings.m_password));
+	connection->setSchema(settings.m_database);
+	return connection.release();
+}
+
+
+//************************************************************************************************
+int DatabaseStorage::getShard(const std::vector<std::string>& record)
+{
+	//Device IDs are validated (numeric) before records are cached
+	long deviceID = std::strtol(record[m_deviceIDRecordPosition].c_str(), nullptr, 10);
+	return std::abs(deviceID) % m_connectionPool.getConnectionCount();
+}
+
+
+//************************************************************************************************
+void DatabaseStorage::executeShardQueries(const std::vector<std::string>& shardQueries, const std::string& operation, std::vector<char>& shardResults)
+{
+	std::vector<DatabaseConnectionPool::Task> tasks(shardQueries.size());
+
+	for (int i = 0; i < (int)shardQueries.size(); ++i)
+	{
+		if (shardQueries[i].empty())
+			continue;
+
+		const std::string& query = shardQueries[i];
+
+		BOOST_LOG_TRIVIAL(trace) << "Shard " << i << " query: " << query;
+
+		tasks[i] = [&query, &operation, i](sql::Connection* connection)
+		{
+			try
+			{
+				std::unique_ptr<sql::Statement> statement(connection->createStatement());
+				statement->executeUpdate(query);
+				return true;
+			}
+			catch (sql::SQLException &e)
+			{
+				BOOST_LOG_TRIVIAL(error) << "Failed to " << operation << " on pooled connection " << i << " with following query: ";
+				BOOST_LOG_TRIVIAL(error) << query;
+				BOOST_LOG_TRIVIAL(error) << "Error: " << e.what();
+				return false;
+			}
+		};
+	}
+
+	m_connectionPool.run(tasks, shardResults);
+}
+
+
+//************************************************************************************************
+void DatabaseStorage::queryDeviceTableFingerprint(sql::Statement* statement, std::string tableName, std::string deviceIDColumnName,
+							DeviceTableFingerprint& fingerprint)
+{
+	//Aggregated on the server; a single row is transferred regardless of the number of devices
+	std::string fingerprintQuery = "SELECT COUNT(*), COALESCE(BIT_XOR(" + deviceIDColumnName + "), 0), COALESCE(MAX(" + deviceIDColumnName
+									+ "), 0) FROM " + tableName + ";";
+
+	std::unique_ptr<sql::ResultSet> resultSet(statement->executeQuery(fingerprintQuery));
+
+	if (resultSet->next() == false)
+		throw std::runtime_error("No result for devices table fingerprint query");
+
+	fingerprint.m_count = resultSet->getInt64(1);
+	fingerprint.m_idXor = resultSet->getInt64(2);
+	fingerprint.m_maxID = resultSet->getInt64(3);
+}
+
+
+//************************************************************************************************
+bool DatabaseStorage::getDeviceTableFingerprint(std::string tableName, std::string deviceIDColumnName, DeviceTableFingerprint& fingerprint)
+{
+	try
+	{
+		std::unique_ptr<sql::Statement> statement(m_dbConnection->createStatement());
+		queryDeviceTableFingerprint(statement.get(), tableName, deviceIDColumnName, fingerprint);
+		return true;
+	}
+	catch (sql::SQLException &e)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed to get fingerprint of devices table: " << tableName;
+		BOOST_LOG_TRIVIAL(error) << "Error: " << e.what();
+		return false;
+	}
+	catch (std::exception &e)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed when getting fingerprint of devices table: " << tableName;
+		BOOST_LOG_TRIVIAL(error) << "Error: " << e.what();
+		return false;
+	}
+}
+
+
+//************************************************************************************************
+DeviceTableScan DatabaseStorage::scanDeviceTable(std::string tableName, std::string deviceIDColumnName, DeviceTableFingerprint previousFingerprint)
+{
+	//Driver and connection settings are not changed after initialize()
+	return scanDeviceTable(m_driver, getConnectionSettings(), tableName, deviceIDColumnName, previousFingerprint);
+}
+
+
+//************************************************************************************************
+DeviceTableScan DatabaseStorage::scanDeviceTable(sql::Driver* driver, ConnectionSettings settings, std::string tableName,
+							std::string deviceIDColumnName, DeviceTableFingerprint previousFingerprint)
+{
+	DeviceTableScan scan{false, false, false, previousFingerprint, std::vector<int>()};
+
+	driver->threadInit();
+
+	try
+	{
+		std::unique_ptr<sql::Connection> connection(createConnection(driver, settings));
+		std::unique_ptr<sql::Statement> statement(connection->createStatement());
+
+		queryDeviceTableFingerprint(statement.get(), tableName, deviceIDColumnName, scan.m_fingerprint);
+
+		const DeviceTableFingerprint& fingerprint = scan.m_fingerprint;
+
+		if (fingerprint.m_count == previousFingerprint.m_count && fingerprint.m_idXor == previousFingerprint.m_idXor
+			&& fingerprint.m_maxID == previousFingerprint.m_maxID)
+		{
+			scan.m_isSuccessful = true;	//Unchanged
+		}
+		else
+		{
+			scan.m_isChanged = true;
+			statement->setResultSetType(sql::ResultSet::TYPE_FORWARD_ONLY);
+
+			//Usually devices are only added; fetch the IDs above the previous largest ID and check that they explain the change
+			std::string addedQuery = "SELECT " + deviceIDColumnName + " FROM " + tableName + " WHERE " + deviceIDColumnName + " > "
+										+ std::to_string(previousFingerprint.m_maxID) + ";";
+
+			std::unique_ptr<sql::ResultSet> addedResultSet(statement->executeQuery(addedQuery));
+			long addedXor = 0;
+
+			while (addedResultSet->next())
+			{
+				int deviceID = addedResultSet->getInt(1);
+				scan.m_deviceIDs.push_back(deviceID);
+				addedXor ^= deviceID;
+			}
+
+			if (previousFingerprint.m_count < 0 || previousFingerprint.m_count + (long) scan.m_deviceIDs.size() != fingerprint.m_count
+				|| (previousFingerprint.m_idXor ^ addedXor) != fingerprint.m_idXor)
+			{
+				//Devices were removed (or IDs reused); fetch the full list
+				scan.m_isFullList = true;
+				scan.m_deviceIDs.clear();
+
+				std::unique_ptr<sql::ResultSet> resultSet(statement->executeQuery("SELECT " + deviceIDColumnName + " FROM " + tableName + ";"));
+
+				while (resultSet->next())
+					scan.m_deviceIDs.push_back(resultSet->getInt(1));
+			}
+
+			scan.m_isSuccessful = true;
+		}
+	}
+	catch (sql::SQLException &e)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed to scan devices table: " << tableName;
+		BOOST_LOG_TRIVIAL(error) << "Error: " << e.what();
+	}
+	catch (std::exception &e)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed when scanning devices table: " << tableName;
+		BOOST_LOG_TRIVIAL(error) << "Error: " << e.what();
+	}
+
+	driver->threadEnd();
+	return scan;
+}
+
+
+//************************************************************************************************
+bool DatabaseStorage::getTableWatermarks(long& mainTableWatermark, long& nullTableWatermark)
+{
+	//MAX() of a primary key is resolved from the index, independent of table size
+	std::string mainQuery = "SELECT MAX(" + m_primaryKeyColumn + ") FROM " + m_table + ";";
+	std::string nullQuery = "SELECT MAX(" + m_nullRecTablePrimaryKeyColumn + ") FROM " + m_nullRecordsTable + ";";
+
+	try
+	{
+		std::unique_ptr<sql::Statement> statement(m_dbConnection->createStatement());
+
+		std::unique_ptr<sql::ResultSet> mainResultSet(statement->executeQuery(mainQuery));
+		mainTableWatermark = (mainResultSet->next() && !mainResultSet->isNull(1)) ? mainResultSet->getUInt64(1) : 0;
+
+		std::unique_ptr<sql::ResultSet> nullResultSet(statement->executeQuery(nullQuery));
+		nullTableWatermark = (nullResultSet->next() && !nullResultSet->isNull(1)) ? nullResultSet->getUInt64(1) : 0;
+
+		return true;
+	}
+	catch (sql::SQLException &e)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed to get watermarks of tables: " << m_table << ", " << m_nullRecordsTable;
+		BOOST_LOG_TRIVIAL(error) << "Error: " << e.what();
+		return false;
+	}
+	catch (std::exception &e)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed when getting watermarks of tables: " << m_table << ", " << m_nullRecordsTable;
+		BOOST_LOG_TRIVIAL(error) << "Error: " << e.what();
+		return false;
+	}
+}
+
+
+//************************************************************************************************
+bool DatabaseStorage::getLastCountersSince(long mainTableWatermark, std::unordered_map<int, long>& deviceLastCounterMap)
+{
+	//Primary key range scan over rows inserted after the watermark only
+	std::string maxQuery = "SELECT " + m_deviceIDColumn + ", MAX(" + m_recordCounterColumn + ") FROM " + m_table +
+					" WHERE " + m_primaryKeyColumn + ">" + std::to_string(mainTableWatermark) + " GROUP BY " + m_deviceIDColumn + ";";
+
+	try
+	{
+		BOOST_LOG_TRIVIAL(info) << "Reading last counter of devices from rows of table " << m_table << " written after primary key " << mainTableWatermark;
+		BOOST_LOG_TRIVIAL(trace) << "Query: " << maxQuery;
+
+		std::unique_ptr<sql::Statement> statement(m_dbConnection->createStatement());
+		std::unique_ptr<sql::ResultSet> resultSet(statement->executeQuery(maxQuery));
+
+		int updatedCount = 0;
+
+		while (resultSet->next())
+		{
+			int deviceID = resultSet->getUInt(1);
+			long lastCounter = resultSet->getUInt(2);
+
+			auto iter = deviceLastCounterMap.find(deviceID);
+
+			if (iter != deviceLastCounterMap.end() && lastCounter > iter->second)	//Device was loaded from devices table
+			{
+				iter->second = lastCounter;
+				++updatedCount;
+			}
+		}
+
+		BOOST_LOG_TRIVIAL(info) << "Last counter updated for " << updatedCount << " devices from table " << m_table;
+		return true;
+	}
+	catch (sql::SQLException &e)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed to get last counter of devices from table: " << m_table;
+		BOOST_LOG_TRIVIAL(error) << "Error: " << e.what();
+		return false;
+	}
+	catch (std::exception &e)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed when getting last counter of devices from table: " << m_table;
+		BOOST_LOG_TRIVIAL(error) << "Error: " << e.what();
+		return false;
+	}
+}
+
+
+//************************************************************************************************
+bool DatabaseStorage::getNullRecordInfoSince(long nullTableWatermark, const std::unordered_map<int, long>& validDevicesMap,
+									std::unordered_map< int, std::map<long, NullEntry> >& deviceNullRecordKeys)
+{
+	std::string selectQuery = "SELECT " + m_nullRecTablePrimaryKeyColumn + "," + m_nullRecDeviceIDColumn + "," + m_nullRecRecordCounterColumn +
+					"," + m_nullRecInsertedPrimaryKeyColumn + "," + m_nullRecRequestCountColumn + " FROM " + m_nullRecordsTable +
+					" WHERE " + m_nullRecTablePrimaryKeyColumn + ">" + std::to_string(nullTableWatermark) +
+					" ORDER BY " + m_nullRecTablePrimaryKeyColumn + " ASC;";
+
+	try
+	{
+		BOOST_LOG_TRIVIAL(info) << "Retrieving null record information from table " << m_nullRecordsTable << " written after primary key " << nullTableWatermark;
 
 		std::unique_ptr<sql::Statement> statement(m_dbConnection->createStatement());
 		std::unique_ptr<sql::ResultSet> resultSet(statement->executeQuery(selectQuery));
 
 		while (resultSet->next())
 		{
-			int deviceID = resultSet->getUInt(m_nullRecDeviceIDColumn);
+			int deviceID = resultSet->getUInt(2);
 
 			if (validDevicesMap.count(deviceID) == 0)
 				continue;	//Skip this device
 
-			//Ensure that the device is a valid device (in the devices table)
-
 			std::map<long, NullEntry>& nullEntryMap = deviceNullRecordKeys[deviceID];
 
-			if (nullEntryMap.size() < m_nullEntriesMaxCount)
+			if ((int) nullEntryMap.size() < m_nullEntriesMaxCount)
 			{
-				unsigned int entryPrimaryKey = resultSet->getUInt(m_nullRecTablePrimaryKeyColumn);
-				unsigned int SDCounter = resultSet->getUInt(m_nullRecRecordCounterColumn);
-				unsigned int insertedPrimaryKey = resultSet->getUInt(m_nullRecInsertedPrimaryKeyColumn);
-				unsigned int requestCount = resultSet->getUInt(m_nullRecRequestCountColumn);
+				unsigned int entryPrimaryKey = resultSet->getUInt(1);
+				unsigned int SDCounter = resultSet->getUInt(3);
+				unsigned int insertedPrimaryKey = resultSet->getUInt(4);
+				unsigned int requestCount = resultSet->getUInt(5);
 
 				nullEntryMap.emplace(SDCounter, NullEntry(entryPrimaryKey, deviceID, SDCounter, insertedPrimaryKey, requestCount));
 			}
 		}
 
-		BOOST_LOG_TRIVIAL(info) << "Null record information read from table " << m_nullRecordsTable << " successfully";
-
+		BOOST_LOG_TRIVIAL(info) << "Null record information written after the snapshot read from table " << m_nullRecordsTable << " successfully";
 		return true;
 	}
 	catch (sql::SQLException &e)
@@ -617,3 +1227,81 @@ bool DatabaseStorage::getInitialNullRecordInfo(const std::unordered_map<int, lon
 		return false;
 	}
 }
+
+
+//************************************************************************************************
+std::unique_ptr<StorageBackend> DatabaseStorage::createRecordWriter()
+{
+	DatabaseStorage* recordWriter = new DatabaseStorage();
+	recordWriter->m_isRecordWriter = true;
+	return std::unique_ptr<StorageBackend>(recordWriter);
+}
+
+
+//************************************************************************************************
+void DatabaseStorage::initializeThread()
+{
+	get_driver_instance()->threadInit();
+}
+
+
+//************************************************************************************************
+void DatabaseStorage::finalizeThread()
+{
+	get_driver_instance()->threadEnd();
+}
+
+
+//************************************************************************************************
+bool DatabaseStorage::beginUnitOfWork()
+{
+	try
+	{
+		m_dbConnection->setAutoCommit(false);	//The next statement starts the transaction
+		m_isInUnitOfWork = true;
+		return true;
+	}
+	catch (std::exception &e)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed to start transaction on MySQL connection";
+		BOOST_LOG_TRIVIAL(error) << "Error: " << e.what();
+		return false;
+	}
+}
+
+
+//************************************************************************************************
+bool DatabaseStorage::commitUnitOfWork()
+{
+	try
+	{
+		m_dbConnection->commit();
+		m_dbConnection->setAutoCommit(true);
+		m_isInUnitOfWork = false;
+		return true;
+	}
+	catch (std::exception &e)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed to commit transaction on MySQL connection";
+		BOOST_LOG_TRIVIAL(error) << "Error: " << e.what();
+		return false;
+	}
+}
+
+
+//************************************************************************************************
+void DatabaseStorage::rollbackUnitOfWork()
+{
+	m_isInUnitOfWork = false;
+
+	try
+	{
+		m_dbConnection->rollback();
+		m_dbConnection->setAutoCommit(true);
+	}
+	catch (std::exception &e)	//Eg: connection lost (the server rolls back the transaction); the connection is replaced on re-initialization
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed to roll back transaction on MySQL connection";
+		BOOST_LOG_TRIVIAL(error) << "Error: " << e.what();
+	}
+}
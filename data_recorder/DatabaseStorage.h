@@ -7,6 +7,8 @@
 #include <set>
 
 #include <NullEntry.h>
+#include <StorageBackend.h>
+#include <DatabaseConnectionPool.h>
 
 //MySQL Connector/C++ headers
 #include <cppconn/driver.h>
@@ -21,41 +23,100 @@
 
 /*
 This class manages MySQL database I/O
+With config DatabaseConnectionPoolSize > 1, batch writes are split into device shards (device ID modulo pool size) that are executed
+in parallel, each on its own pooled connection; a device's records always go to the same connection, in the order given
+A unit of work is a transaction on the main connection, so the pool is not used for writes within it
+Record writers (see createRecordWriter()) already write in parallel, so they use their single connection only (no pool)
 */
-class DatabaseStorage
+class DatabaseStorage: public StorageBackend
 {
 public:
-	DatabaseStorage() {}
+	DatabaseStorage(): m_driver{nullptr}, m_connectionPoolSize{1}, m_isRecordWriter{false}, m_deviceIDRecordPosition{0}, m_isInUnitOfWork{false} {}
 	~DatabaseStorage() {}
 
-	bool initialize(std::string server, std::string user, std::string password, std::string database, std::string table,
-		std::string primaryKeyColumn, std::string recordCounterColumn, std::string deviceIDColumn, std::string dateTimeColumn,
-		int columnCount, std::vector<std::string> columnNames, std::vector<std::string> columnTypes, std::vector<int> recordPositions, 
-		std::string nullRecordsTable, std::string nullRecTablePrimaryKeyColumn, std::string nullRecInsertedPrimaryKeyColumn, 
-		std::string nullRecDeviceIDColumn, std::string nullRecRecordCounterColumn, std::string nullRecRequestCountColumn, int nullEntriesMaxCount);
+	//Connection parameters are read from configs MySQLServer, Username, Password and DatabaseName
+	virtual bool initialize(const StorageSchema& schema, bool isConnect = true);
 
-	bool writeRecordBatch(const std::vector< std::vector<std::string> >& recordBatch);
+	//If only some device shards are committed, their records are removed from recordBatch and false is returned
+	virtual bool writeRecordBatch(std::vector< std::vector<std::string> >& recordBatch);
 
-	bool insertNullRecords(int deviceID, long start, long end, std::vector<NullEntry>& insertedRecordInfoVec);
+	//Batch queries of writeRecordBatch() and updateRecordBatch()
+	std::string buildInsertQuery(const std::vector< std::vector<std::string> >& recordBatch);
+	std::string buildUpdateQuery(const std::unordered_map< long, std::vector<std::string> >& recordBatch);
 
-	bool insertEntriesToNullTable(std::vector<NullEntry>& insertedRecordInfoVec);
+	virtual bool insertNullRecords(int deviceID, long start, long end, std::vector<NullEntry>& insertedRecordInfoVec);
 
-	bool updateRecordBatch(const std::unordered_map< long, std::vector<std::string> >& recordBatch);
+	virtual bool insertEntriesToNullTable(std::vector<NullEntry>& insertedRecordInfoVec);
 
-	bool deleteNullEntryBatch(const std::vector<long>& nullEntryBatch);
+	virtual bool updateRecordBatch(const std::unordered_map< long, std::vector<std::string> >& recordBatch);
 
-	bool loadEntriesFromNullTable(std::set<int>& deviceSet, 
+	virtual bool deleteNullEntryBatch(const std::vector<long>& nullEntryBatch);
+
+	virtual bool loadEntriesFromNullTable(std::set<int>& deviceSet, 
 										std::unordered_map< int, std::map<long, NullEntry> >& deviceNullRecordKeys);
 
-	bool getDeviceIDs(std::string tableName, std::string deviceIDColumnName, std::unordered_map<int, long>& deviceLastCounterMap, bool isReinitialize = false);
+	virtual bool getDeviceIDs(std::string tableName, std::string deviceIDColumnName, std::unordered_map<int, long>& deviceLastCounterMap,
+										bool isReinitialize = false);
+
+	virtual bool getDeviceTableFingerprint(std::string tableName, std::string deviceIDColumnName, DeviceTableFingerprint& fingerprint);
+
+	//Opens its own connection, so that it can run on a thread other than the event loop thread
+	virtual DeviceTableScan scanDeviceTable(std::string tableName, std::string deviceIDColumnName, DeviceTableFingerprint previousFingerprint);
+
+	sql::Driver* getDriver() { return m_driver; }
+	ConnectionSettings getConnectionSettings() { return ConnectionSettings{m_mySqlServer, m_username, m_password, m_database}; }
+
+	//Last counters of the given devices only (map keys), from the (device ID, counter) index
+	virtual bool getLastCounters(std::unordered_map<int, long>& deviceLastCounterMap);
 
-	bool getInitialNullRecordInfo(const std::unordered_map<int, long>& validDevicesMap, 
+	//Loads at most nullEntriesMaxCount entries per device, devicesPerQuery devices per query, over connectionCount connections in parallel
+	virtual bool getInitialNullRecordInfo(const std::unordered_map<int, long>& validDevicesMap, 
+							std::unordered_map< int, std::map<long, NullEntry> >& deviceNullRecordKeys,
+							int devicesPerQuery, int connectionCount);
+
+	virtual bool getTableWatermarks(long& mainTableWatermark, long& nullTableWatermark);
+
+	virtual bool getLastCountersSince(long mainTableWatermark, std::unordered_map<int, long>& deviceLastCounterMap);
+
+	virtual bool getNullRecordInfoSince(long nullTableWatermark, const std::unordered_map<int, long>& validDevicesMap,
 							std::unordered_map< int, std::map<long, NullEntry> >& deviceNullRecordKeys);
 
+	//Writers open their own connection (and connection pool) in initialize()
+	virtual std::unique_ptr<StorageBackend> createRecordWriter();
+
+	virtual void initializeThread();
+	virtual void finalizeThread();
+
+	virtual bool beginUnitOfWork();
+	virtual bool commitUnitOfWork();
+	virtual void rollbackUnitOfWork();
+
 private:
 	//Helper functions
 	int splitString(std::string input, char delimeter, std::vector<std::string>& result);
 
+	//Additional connection to the same server & database
+	static sql::Connection* createConnection(sql::Driver* driver, const ConnectionSettings& settings);
+
+	static DeviceTableScan scanDeviceTable(sql::Driver* driver, ConnectionSettings settings, std::string tableName,
+							std::string deviceIDColumnName, DeviceTableFingerprint previousFingerprint);
+
+	static void queryDeviceTableFingerprint(sql::Statement* statement, std::string tableName, std::string deviceIDColumnName,
+							DeviceTableFingerprint& fingerprint);
+
+	bool loadNullRecordBatch(sql::Connection* connection, const std::vector<int>& deviceIDs, int first, int count,
+							std::unordered_map< int, std::map<long, NullEntry> >& deviceNullRecordKeys);
+
+	//Query building blocks: "(values of record)" and "(primary key,values of record" (closed by the caller)
+	void appendInsertValues(std::string& query, const std::vector<std::string>& record);
+	void appendUpdateValues(std::string& query, long primaryKey, const std::vector<std::string>& record);
+
+	//Connection pool shard of a record (by its device ID)
+	int getShard(const std::vector<std::string>& record);
+
+	//Executes the non-empty shard queries in parallel on the pooled connections; shardResults[i] = whether shardQueries[i] succeeded
+	void executeShardQueries(const std::vector<std::string>& shardQueries, const std::string& operation, std::vector<char>& shardResults);
+
 	//Parameters
 	std::string m_mySqlServer;
 	std::string m_username;
@@ -77,6 +138,11 @@ private:
 	//For connectivity to MySQL server & database
 	sql::Driver* m_driver;
 	std::unique_ptr<sql::Connection> m_dbConnection; //unique_ptr for exception handling
+	DatabaseConnectionPool m_connectionPool;	//For parallel batch writes (not started if pool size is 1)
+	int m_connectionPoolSize;
+	bool m_isRecordWriter;	//Instance of createRecordWriter(); does not start a connection pool
+	int m_deviceIDRecordPosition;	//Position of device ID in records (for sharding)
+	bool m_isInUnitOfWork;	//Autocommit is off on m_dbConnection
 
 	//SQL query stubs for generating frequently occuring queries
 	int m_columnCount;
@@ -0,0 +1,180 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring> //memcpy, strerror
+#include <cstdio> //rename
+#include <ctime>
+
+#include <DeviceStateSnapshot.h>
+#include <Logger.h>
+
+static const char SNAPSHOT_MAGIC[8] = {'E', 'P', 'R', 'O', 'S', 'N', 'A', 'P'};
+static const uint32_t SNAPSHOT_VERSION = 1;
+
+
+//*************************************************************************************************
+bool DeviceStateSnapshot::write(std::string filename, const std::unordered_map<int, long>& deviceLastCounterMap,
+				const std::unordered_map< int, std::map<long, NullEntry> >& deviceNullRecordKeys,
+				long mainTableWatermark, long nullTableWatermark)
+{
+	uint32_t nullEntryCount = 0;
+	for (auto& entry: deviceNullRecordKeys)
+		nullEntryCount += entry.second.size();
+
+	FileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.m_magic, SNAPSHOT_MAGIC, sizeof(header.m_magic));
+	header.m_version = SNAPSHOT_VERSION;
+	header.m_headerSize = sizeof(FileHeader);
+	header.m_deviceCount = deviceLastCounterMap.size();
+	header.m_nullEntryCount = nullEntryCount;
+	header.m_mainTableWatermark = mainTableWatermark;
+	header.m_nullTableWatermark = nullTableWatermark;
+	header.m_createdTime = time(0);
+
+	//Build the whole image in memory and write it with a single write()
+	std::vector<char> image(sizeof(FileHeader) + header.m_deviceCount * sizeof(DeviceEntry) + nullEntryCount * sizeof(NullRecordEntry));
+	char* position = image.data();
+
+	memcpy(position, &header, sizeof(header));
+	position += sizeof(header);
+
+	for (auto& entry: deviceLastCounterMap)
+	{
+		DeviceEntry deviceEntry{entry.first, 0, entry.second};
+		memcpy(position, &deviceEntry, sizeof(deviceEntry));
+		position += sizeof(deviceEntry);
+	}
+
+	for (auto& entry: deviceNullRecordKeys)
+	{
+		for (auto& nestedEntry: entry.second)
+		{
+			const NullEntry& nullEntry = nestedEntry.second;
+			NullRecordEntry nullRecordEntry{nullEntry.m_entryPrimaryKey, nullEntry.m_deviceID, nullEntry.m_SDCounter,
+												nullEntry.m_recordInsertedPrimaryKey, nullEntry.m_requestCount};
+			memcpy(position, &nullRecordEntry, sizeof(nullRecordEntry));
+			position += sizeof(nullRecordEntry);
+		}
+	}
+
+	//Write to a temporary file and rename, so that a crash never leaves a partially written snapshot
+	std::string tempFilename = filename + ".tmp";
+	int fileFD = open(tempFilename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (fileFD == -1)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Unable to open device state snapshot file: " << tempFilename;
+		BOOST_LOG_TRIVIAL(error) << "errno: " << errno << ", error string: " << strerror(errno);
+		return false;
+	}
+
+	if (::write(fileFD, image.data(), image.size()) != (ssize_t)image.size() || fdatasync(fileFD) == -1)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed to write device state snapshot file: " << tempFilename;
+		BOOST_LOG_TRIVIAL(error) << "errno: " << errno << ", error string: " << strerror(errno);
+		close(fileFD);
+		return false;
+	}
+
+	close(fileFD);
+
+	if (rename(tempFilename.c_str(), filename.c_str()) == -1)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed to replace device state snapshot file: " << filename;
+		BOOST_LOG_TRIVIAL(error) << "errno: " << errno << ", error string: " << strerror(errno);
+		return false;
+	}
+
+	BOOST_LOG_TRIVIAL(info) << "Device state snapshot written to " << filename << ", device count: " << header.m_deviceCount
+				<< ", null entry count: " << nullEntryCount << ", size: " << image.size() << " bytes";
+	return true;
+}
+
+
+//*************************************************************************************************
+bool DeviceStateSnapshot::load(std::string filename)
+{
+	clear();
+
+	int fileFD = open(filename.c_str(), O_RDONLY);
+
+	if (fileFD == -1)
+	{
+		BOOST_LOG_TRIVIAL(warning) << "Unable to open device state snapshot file: " << filename;
+		BOOST_LOG_TRIVIAL(warning) << "errno: " << errno << ", error string: " << strerror(errno);
+		return false;
+	}
+
+	struct stat fileStat;
+	if (fstat(fileFD, &fileStat) == -1 || fileStat.st_size < (off_t)sizeof(FileHeader))
+	{
+		BOOST_LOG_TRIVIAL(warning) << "Device state snapshot file is too small: " << filename;
+		close(fileFD);
+		return false;
+	}
+
+	size_t fileSize = fileStat.st_size;
+	void* mapping = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fileFD, 0);
+	close(fileFD);
+
+	if (mapping == MAP_FAILED)
+	{
+		BOOST_LOG_TRIVIAL(warning) << "Unable to mmap device state snapshot file: " << filename;
+		BOOST_LOG_TRIVIAL(warning) << "errno: " << errno << ", error string: " << strerror(errno);
+		return false;
+	}
+
+	const char* base = static_cast<const char*>(mapping);
+	const FileHeader* header = reinterpret_cast<const FileHeader*>(base);
+
+	size_t expectedSize = sizeof(FileHeader) + (size_t)header->m_deviceCount * sizeof(DeviceEntry)
+							+ (size_t)header->m_nullEntryCount * sizeof(NullRecordEntry);
+
+	if (memcmp(header->m_magic, SNAPSHOT_MAGIC, sizeof(header->m_magic)) != 0 || header->m_version != SNAPSHOT_VERSION
+			|| header->m_headerSize != sizeof(FileHeader) || fileSize != expectedSize)
+	{
+		BOOST_LOG_TRIVIAL(warning) << "Device state snapshot file is invalid or of an unsupported version: " << filename;
+		munmap(mapping, fileSize);
+		return false;
+	}
+
+	const DeviceEntry* deviceEntries = reinterpret_cast<const DeviceEntry*>(base + sizeof(FileHeader));
+	m_deviceLastCounterMap.reserve(header->m_deviceCount);
+
+	for (uint32_t i = 0; i < header->m_deviceCount; ++i)
+		m_deviceLastCounterMap[deviceEntries[i].m_deviceID] = deviceEntries[i].m_lastCounter;
+
+	const NullRecordEntry* nullRecordEntries = reinterpret_cast<const NullRecordEntry*>(deviceEntries + header->m_deviceCount);
+	m_nullEntries.reserve(header->m_nullEntryCount);
+
+	for (uint32_t i = 0; i < header->m_nullEntryCount; ++i)
+	{
+		const NullRecordEntry& entry = nullRecordEntries[i];
+		m_nullEntries.emplace_back(entry.m_entryPrimaryKey, entry.m_deviceID, entry.m_SDCounter,
+										entry.m_recordInsertedPrimaryKey, entry.m_requestCount);
+	}
+
+	m_mainTableWatermark = header->m_mainTableWatermark;
+	m_nullTableWatermark = header->m_nullTableWatermark;
+	long snapshotAge = time(0) - header->m_createdTime;
+
+	munmap(mapping, fileSize);
+
+	BOOST_LOG_TRIVIAL(info) << "Device state snapshot loaded from " << filename << ", device count: " << m_deviceLastCounterMap.size()
+				<< ", null entry count: " << m_nullEntries.size() << ", age: " << snapshotAge << " seconds";
+	return true;
+}
+
+
+//*************************************************************************************************
+void DeviceStateSnapshot::clear()
+{
+	m_deviceLastCounterMap.clear();
+	m_nullEntries.clear();
+	m_mainTableWatermark = 0;
+	m_nullTableWatermark = 0;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <map>
+#include <vector>
+#include <stdint.h>
+
+#include <NullEntry.h>
+
+/*
+This class writes and loads a compact snapshot of per-device state (last counters and null entries)
+The file is a fixed-layout binary image (header followed by arrays of fixed size entries) which is mmap'd when loading
+Watermarks (largest primary keys of main and null records tables at snapshot time) allow reconciling only the delta with the database
+*/
+class DeviceStateSnapshot
+{
+public:
+	DeviceStateSnapshot():
+		m_mainTableWatermark{0},
+		m_nullTableWatermark{0}
+	{}
+	~DeviceStateSnapshot() {}
+
+	bool write(std::string filename, const std::unordered_map<int, long>& deviceLastCounterMap,
+				const std::unordered_map< int, std::map<long, NullEntry> >& deviceNullRecordKeys,
+				long mainTableWatermark, long nullTableWatermark);
+
+	bool load(std::string filename);
+	void clear();
+
+	const std::unordered_map<int, long>& getDeviceLastCounters() { return m_deviceLastCounterMap; }
+	const std::vector<NullEntry>& getNullEntries() { return m_nullEntries; }
+	long getMainTableWatermark() { return m_mainTableWatermark; }
+	long getNullTableWatermark() { return m_nullTableWatermark; }
+
+private:
+	//On-disk layout (all entries are naturally aligned)
+	struct FileHeader
+	{
+		char m_magic[8];
+		uint32_t m_version;
+		uint32_t m_headerSize;
+		uint32_t m_deviceCount;
+		uint32_t m_nullEntryCount;
+		int64_t m_mainTableWatermark;
+		int64_t m_nullTableWatermark;
+		int64_t m_createdTime;
+	};
+
+	struct DeviceEntry
+	{
+		int32_t m_deviceID;
+		int32_t m_reserved;
+		int64_t m_lastCounter;
+	};
+
+	struct NullRecordEntry
+	{
+		uint32_t m_entryPrimaryKey;
+		uint32_t m_deviceID;
+		uint32_t m_SDCounter;
+		uint32_t m_recordInsertedPrimaryKey;
+		uint32_t m_requestCount;
+	};
+
+	//Loaded state
+	std::unordered_map<int, long> m_deviceLastCounterMap;
+	std::vector<NullEntry> m_nullEntries;
+	long m_mainTableWatermark;
+	long m_nullTableWatermark;
+};
@@ -0,0 +1,560 @@
+#include <exception>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include <InMemoryStorage.h>
+#include <ConfigurationHandler.h>
+#include <Logger.h>
+
+
+//*************************************************************************************************
+InMemoryStorage::InMemoryStorage():
+	m_counterPosition{-1},
+	m_deviceIDPosition{-1},
+	m_nullEntriesMaxCount{0},
+	m_operationLatencyUs{0},
+	m_rowLatencyUs{0},
+	m_failurePercent{0},
+	m_randomEngine{std::random_device{}()},
+	m_percentDistribution{0, 100},
+	m_mainTable{std::make_shared<MainTable>()},
+	m_nullTablePrimaryKey{0},
+	m_isInUnitOfWork{false},
+	m_operationCount{0},
+	m_injectedFailureCount{0}
+{
+	m_mainTable->m_primaryKey = 0;
+}
+
+
+//*************************************************************************************************
+bool InMemoryStorage::initialize(const StorageSchema& schema, bool isConnect /*= true*/)
+{
+	ConfigurationHandler& configHandler = ConfigurationHandler::getInstance();
+
+	int firstDeviceID;
+	int deviceCount;
+
+	try
+	{
+		firstDeviceID = std::stoi(configHandler.getConfig("InMemoryStorageFirstDeviceID"));
+		deviceCount = std::stoi(configHandler.getConfig("InMemoryStorageDeviceCount"));
+		m_operationLatencyUs = std::stol(configHandler.getConfig("InMemoryStorageOperationLatencyMicroseconds"));
+		m_rowLatencyUs = std::stol(configHandler.getConfig("InMemoryStorageRowLatencyMicroseconds"));
+		m_failurePercent = std::stod(configHandler.getConfig("InMemoryStorageFailurePercent"));
+	}
+	catch (std::exception &e)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Exception thrown by std::stoi() in InMemoryStorage::initialize() when reading integer configs";
+		BOOST_LOG_TRIVIAL(error) << "Error: " << e.what();
+		return false;
+	}
+
+	m_nullEntriesMaxCount = schema.m_nullEntriesMaxCount;
+
+	//Records hold fields in device order; find the fields of the counter and device ID columns
+	for (int i = 0; i < schema.m_columnCount; ++i)
+	{
+		if (schema.m_columnNames[i] == schema.m_recordCounterColumn)
+			m_counterPosition = schema.m_recordPositions[i];
+
+		if (schema.m_columnNames[i] == schema.m_deviceIDColumn)
+			m_deviceIDPosition = schema.m_recordPositions[i];
+	}
+
+	if (m_counterPosition < 0 || m_deviceIDPosition < 0)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Record counter column: " << schema.m_recordCounterColumn << " or device ID column: " << schema.m_deviceIDColumn
+								<< " is not in the main table structure (config DBTableColumnNames)";
+		return false;
+	}
+
+	if (!isConnect)
+		return true;
+
+	//State is kept when re-initializing (like a database that was temporarily unreachable)
+	for (int i = 0; i < deviceCount; ++i)
+		m_deviceIDs.insert(firstDeviceID + i);
+
+	BOOST_LOG_TRIVIAL(info) << "In-memory storage initialized; devices: [" << firstDeviceID << "," << firstDeviceID + deviceCount - 1
+							<< "], latency per operation: " << m_operationLatencyUs << " us, latency per row: " << m_rowLatencyUs
+							<< " us, failure rate: " << m_failurePercent << "%";
+	return true;
+}
+
+
+//*************************************************************************************************
+bool InMemoryStorage::simulateOperation(const char* operationName, long rowCount)
+{
+	long latencyUs = m_operationLatencyUs + m_rowLatencyUs * rowCount;
+
+	if (latencyUs > 0)
+		std::this_thread::sleep_for(std::chrono::microseconds(latencyUs));
+
+	if (isInjectedFailure())
+	{
+		BOOST_LOG_TRIVIAL(error) << "Injected failure of in-memory storage operation: " << operationName << ", rows: " << rowCount
+								<< " (injected failures: " << m_injectedFailureCount << " of " << m_operationCount << " operations)";
+		return false;
+	}
+
+	return true;
+}
+
+
+//*************************************************************************************************
+bool InMemoryStorage::isInjectedFailure()
+{
+	std::lock_guard<std::mutex> lock(m_randomMutex);
+
+	++m_operationCount;
+
+	if (m_failurePercent <= 0 || m_percentDistribution(m_randomEngine) >= m_failurePercent)
+		return false;
+
+	++m_injectedFailureCount;
+	return true;
+}
+
+
+//*************************************************************************************************
+void InMemoryStorage::applyChange(std::function<void()> change)
+{
+	if (m_isInUnitOfWork)
+		m_unitOfWorkChanges.push_back(std::move(change));
+	else
+		change();
+}
+
+
+//*************************************************************************************************
+bool InMemoryStorage::beginUnitOfWork()
+{
+	m_unitOfWorkChanges.clear();
+	m_isInUnitOfWork = true;
+	return true;
+}
+
+
+//*************************************************************************************************
+bool InMemoryStorage::commitUnitOfWork()
+{
+	//A commit is one more round trip (and can fail, like any other operation)
+	if (simulateOperation("commitUnitOfWork", 0) == false)
+		return false;
+
+	for (auto& change: m_unitOfWorkChanges)
+		change();
+
+	BOOST_LOG_TRIVIAL(debug) << "Unit of work committed to in-memory storage, changes: " << m_unitOfWorkChanges.size();
+
+	m_unitOfWorkChanges.clear();
+	m_isInUnitOfWork = false;
+	return true;
+}
+
+
+//*************************************************************************************************
+void InMemoryStorage::rollbackUnitOfWork()
+{
+	m_unitOfWorkChanges.clear();
+	m_isInUnitOfWork = false;
+}
+
+
+//*************************************************************************************************
+bool InMemoryStorage::writeRecordBatch(std::vector< std::vector<std::string> >& recordBatch)
+{
+	if (recordBatch.size() == 0)
+		return true;
+
+	if (simulateOperation("writeRecordBatch", recordBatch.size()) == false)
+		return false;
+
+	std::vector< std::pair<int, long> > deviceCounters;	//(device ID, counter) of each record
+
+	try
+	{
+		for (const std::vector<std::string>& record: recordBatch)
+			deviceCounters.push_back(std::make_pair(std::stoi(record[m_deviceIDPosition]), std::stol(record[m_counterPosition])));
+	}
+	catch (std::exception &e)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed when writing batch of records to in-memory storage";
+		BOOST_LOG_TRIVIAL(error) << "Error: " << e.what();
+		return false;
+	}
+
+	std::shared_ptr<MainTable> mainTable = m_mainTable;
+
+	applyChange([mainTable, deviceCounters]
+	{
+		std::lock_guard<std::mutex> lock(mainTable->m_mutex);
+
+		for (auto& deviceCounter: deviceCounters)
+		{
+			DeviceState& state = mainTable->m_deviceStates[deviceCounter.first];
+
+			state.m_lastCounter = std::max(state.m_lastCounter, deviceCounter.second);
+			state.m_lastPrimaryKey = ++mainTable->m_primaryKey;
+		}
+	});
+
+	BOOST_LOG_TRIVIAL(debug) << "Batch of records written to in-memory storage, batch size: " << recordBatch.size();
+	return true;
+}
+
+
+//*************************************************************************************************
+bool InMemoryStorage::insertNullRecords(int deviceID, long start, long end, std::vector<NullEntry>& insertedRecordInfoVec)
+{
+	//One statement per NULL record in DatabaseStorage; a failure leaves the earlier records inserted
+	for (long SDCounter = start; SDCounter < end; ++SDCounter)
+	{
+		if (simulateOperation("insertNullRecords", 1) == false)
+			return false;
+
+		long primaryKey;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mainTable->m_mutex);
+			primaryKey = ++m_mainTable->m_primaryKey;	//Assigned at once (not reused after a rollback), like AUTO_INCREMENT
+		}
+
+		std::shared_ptr<MainTable> mainTable = m_mainTable;
+
+		applyChange([mainTable, deviceID, SDCounter, primaryKey]
+		{
+			std::lock_guard<std::mutex> lock(mainTable->m_mutex);
+			DeviceState& state = mainTable->m_deviceStates[deviceID];
+
+			state.m_lastCounter = std::max(state.m_lastCounter, SDCounter);
+			state.m_lastPrimaryKey = std::max(state.m_lastPrimaryKey, primaryKey);
+		});
+
+		insertedRecordInfoVec.push_back(NullEntry(deviceID, SDCounter, primaryKey, 0));
+	}
+
+	BOOST_LOG_TRIVIAL(debug) << "Generated NULL records inserted to in-memory storage, SDCounters: [" << start << "," << end - 1 << "]";
+	return true;
+}
+
+
+//*************************************************************************************************
+bool InMemoryStorage::insertEntriesToNullTable(std::vector<NullEntry>& insertedRecordInfoVec)
+{
+	if (simulateOperation("insertEntriesToNullTable", insertedRecordInfoVec.size()) == false)
+		return false;
+
+	for (NullEntry& entry: insertedRecordInfoVec)
+	{
+		NullEntry tableEntry(++m_nullTablePrimaryKey, entry.m_deviceID, entry.m_SDCounter, entry.m_recordInsertedPrimaryKey, 0);
+
+		applyChange([this, tableEntry]
+		{
+			m_nullTable[tableEntry.m_deviceID].emplace(tableEntry.m_entryPrimaryKey, tableEntry);
+			m_nullTableIndex[tableEntry.m_recordInsertedPrimaryKey] = std::make_pair(tableEntry.m_deviceID, tableEntry.m_entryPrimaryKey);
+		});
+	}
+
+	return true;
+}
+
+
+//*************************************************************************************************
+bool InMemoryStorage::updateRecordBatch(const std::unordered_map< long, std::vector<std::string> >& recordBatch)
+{
+	if (recordBatch.size() == 0)
+		return true;
+
+	//Records are not kept, so there is nothing to overwrite
+	return simulateOperation("updateRecordBatch", recordBatch.size());
+}
+
+
+//*************************************************************************************************
+bool InMemoryStorage::deleteNullEntryBatch(const std::vector<long>& nullEntryBatch)
+{
+	if (nullEntryBatch.size() == 0)
+		return true;
+
+	if (simulateOperation("deleteNullEntryBatch", nullEntryBatch.size()) == false)
+		return false;
+
+	applyChange([this, nullEntryBatch]
+	{
+		for (long insertedPrimaryKey: nullEntryBatch)
+		{
+			auto indexIter = m_nullTableIndex.find(insertedPrimaryKey);
+
+			if (indexIter == m_nullTableIndex.end())
+				continue;
+
+			auto deviceIter = m_nullTable.find(indexIter->second.first);
+			deviceIter->second.erase(indexIter->second.second);
+
+			if (deviceIter->second.size() == 0)
+				m_nullTable.erase(deviceIter);
+
+			m_nullTableIndex.erase(indexIter);
+		}
+	});
+
+	return true;
+}
+
+
+//*************************************************************************************************
+bool InMemoryStorage::loadEntriesFromNullTable(std::set<int>& deviceSet,
+					std::unordered_map< int, std::map<long, NullEntry> >& deviceNullRecordKeys)
+{
+	if (deviceSet.size() == 0)
+		return true;
+
+	if (simulateOperation("loadEntriesFromNullTable", deviceSet.size()) == false)
+		return false;
+
+	for (int deviceID: deviceSet)
+	{
+		std::map<long, NullEntry>& nullEntryMap = deviceNullRecordKeys[deviceID];
+
+		long loadAmount = m_nullEntriesMaxCount - nullEntryMap.size();
+
+		auto deviceIter = m_nullTable.find(deviceID);
+
+		if (loadAmount <= 0 || deviceIter == m_nullTable.end())
+			continue;
+
+		long lastInsertedPrimaryKey = 0;	//Default 0 if map is empty
+
+		if (nullEntryMap.size() > 0)
+			lastInsertedPrimaryKey = nullEntryMap.rbegin()->second.m_recordInsertedPrimaryKey;
+
+		for (auto& entry: deviceIter->second)
+		{
+			if (loadAmount == 0)
+				break;
+
+			if (entry.second.m_recordInsertedPrimaryKey <= lastInsertedPrimaryKey)
+				continue;
+
+			nullEntryMap.emplace(entry.second.m_SDCounter, entry.second);
+			--loadAmount;
+		}
+	}
+
+	return true;
+}
+
+
+//*************************************************************************************************
+bool InMemoryStorage::getDeviceIDs(std::string tableName, std::string deviceIDColumnName, std::unordered_map<int, long>& deviceLastCounterMap,
+										bool isReinitialize /*= false*/)
+{
+	if (simulateOperation("getDeviceIDs", m_deviceIDs.size()) == false)
+		return false;
+
+	for (int deviceID: m_deviceIDs)
+		deviceLastCounterMap.emplace(deviceID, 0);	//Add with zero last counter if not already in the map
+
+	if (isReinitialize)
+		return true;
+
+	std::lock_guard<std::mutex> lock(m_mainTable->m_mutex);
+
+	for (auto& entry: m_mainTable->m_deviceStates)
+	{
+		auto iter = deviceLastCounterMap.find(entry.first);
+
+		if (iter != deviceLastCounterMap.end())	//Device is in the devices table
+			iter->second = entry.second.m_lastCounter;
+	}
+
+	return true;
+}
+
+
+//*************************************************************************************************
+DeviceTableFingerprint InMemoryStorage::computeFingerprint()
+{
+	DeviceTableFingerprint fingerprint{(long) m_deviceIDs.size(), 0, 0};
+
+	for (int deviceID: m_deviceIDs)
+		fingerprint.m_idXor ^= deviceID;
+
+	if (m_deviceIDs.size() != 0)
+		fingerprint.m_maxID = *m_deviceIDs.rbegin();
+
+	return fingerprint;
+}
+
+
+//*************************************************************************************************
+bool InMemoryStorage::getDeviceTableFingerprint(std::string tableName, std::string deviceIDColumnName, DeviceTableFingerprint& fingerprint)
+{
+	if (simulateOperation("getDeviceTableFingerprint", 1) == false)
+		return false;
+
+	fingerprint = computeFingerprint();
+	return true;
+}
+
+
+//*************************************************************************************************
+DeviceTableScan InMemoryStorage::scanDeviceTable(std::string tableName, std::string deviceIDColumnName, DeviceTableFingerprint previousFingerprint)
+{
+	DeviceTableScan scan{false, false, false, previousFingerprint, std::vector<int>()};
+
+	if (simulateOperation("scanDeviceTable", 1) == false)
+		return scan;
+
+	scan.m_fingerprint = computeFingerprint();
+	scan.m_isSuccessful = true;
+
+	const DeviceTableFingerprint& fingerprint = scan.m_fingerprint;
+
+	if (fingerprint.m_count != previousFingerprint.m_count || fingerprint.m_idXor != previousFingerprint.m_idXor
+		|| fingerprint.m_maxID != previousFingerprint.m_maxID)
+	{
+		scan.m_isChanged = true;
+		scan.m_isFullList = true;
+		scan.m_deviceIDs.assign(m_deviceIDs.begin(), m_deviceIDs.end());
+	}
+
+	return scan;
+}
+
+
+//*************************************************************************************************
+bool InMemoryStorage::getLastCounters(std::unordered_map<int, long>& deviceLastCounterMap)
+{
+	if (deviceLastCounterMap.size() == 0)
+		return true;
+
+	if (simulateOperation("getLastCounters", deviceLastCounterMap.size()) == false)
+		return false;
+
+	std::lock_guard<std::mutex> lock(m_mainTable->m_mutex);
+
+	for (auto& entry: deviceLastCounterMap)
+	{
+		auto stateIter = m_mainTable->m_deviceStates.find(entry.first);
+
+		if (stateIter != m_mainTable->m_deviceStates.end())
+			entry.second = stateIter->second.m_lastCounter;
+	}
+
+	return true;
+}
+
+
+//*************************************************************************************************
+bool InMemoryStorage::getInitialNullRecordInfo(const std::unordered_map<int, long>& validDevicesMap,
+									std::unordered_map< int, std::map<long, NullEntry> >& deviceNullRecordKeys,
+									int devicesPerQuery, int connectionCount)
+{
+	if (simulateOperation("getInitialNullRecordInfo", validDevicesMap.size()) == false)
+		return false;
+
+	for (auto& entry: validDevicesMap)
+	{
+		auto deviceIter = m_nullTable.find(entry.first);
+
+		if (deviceIter == m_nullTable.end())
+			continue;
+
+		std::map<long, NullEntry>& nullEntryMap = deviceNullRecordKeys[entry.first];
+
+		for (auto& nullEntry: deviceIter->second)
+		{
+			if ((int) nullEntryMap.size() >= m_nullEntriesMaxCount)
+				break;
+
+			nullEntryMap.emplace(nullEntry.second.m_SDCounter, nullEntry.second);
+		}
+	}
+
+	return true;
+}
+
+
+//*************************************************************************************************
+bool InMemoryStorage::getTableWatermarks(long& mainTableWatermark, long& nullTableWatermark)
+{
+	if (simulateOperation("getTableWatermarks", 1) == false)
+		return false;
+
+	std::lock_guard<std::mutex> lock(m_mainTable->m_mutex);
+
+	mainTableWatermark = m_mainTable->m_primaryKey;
+	nullTableWatermark = m_nullTablePrimaryKey;
+	return true;
+}
+
+
+//*************************************************************************************************
+bool InMemoryStorage::getLastCountersSince(long mainTableWatermark, std::unordered_map<int, long>& deviceLastCounterMap)
+{
+	long rowCount;
+	{
+		std::lock_guard<std::mutex> lock(m_mainTable->m_mutex);
+		rowCount = m_mainTable->m_deviceStates.size();
+	}
+
+	if (simulateOperation("getLastCountersSince", rowCount) == false)
+		return false;
+
+	std::lock_guard<std::mutex> lock(m_mainTable->m_mutex);
+
+	//The device's largest counter stands in for its largest counter after the watermark (the caller keeps the larger counter)
+	for (auto& entry: m_mainTable->m_deviceStates)
+	{
+		if (entry.second.m_lastPrimaryKey <= mainTableWatermark)
+			continue;
+
+		auto iter = deviceLastCounterMap.find(entry.first);
+
+		if (iter != deviceLastCounterMap.end() && entry.second.m_lastCounter > iter->second)
+			iter->second = entry.second.m_lastCounter;
+	}
+
+	return true;
+}
+
+
+//*************************************************************************************************
+bool InMemoryStorage::getNullRecordInfoSince(long nullTableWatermark, const std::unordered_map<int, long>& validDevicesMap,
+									std::unordered_map< int, std::map<long, NullEntry> >& deviceNullRecordKeys)
+{
+	if (simulateOperation("getNullRecordInfoSince", m_nullTableIndex.size()) == false)
+		return false;
+
+	for (auto& deviceEntry: m_nullTable)
+	{
+		if (validDevicesMap.count(deviceEntry.first) == 0)
+			continue;	//Skip this device
+
+		std::map<long, NullEntry>& nullEntryMap = deviceNullRecordKeys[deviceEntry.first];
+
+		for (auto iter = deviceEntry.second.upper_bound(nullTableWatermark); iter != deviceEntry.second.end(); ++iter)
+		{
+			if ((int) nullEntryMap.size() >= m_nullEntriesMaxCount)
+				break;
+
+			nullEntryMap.emplace(iter->second.m_SDCounter, iter->second);
+		}
+	}
+
+	return true;
+}
+
+
+//*************************************************************************************************
+std::unique_ptr<StorageBackend> InMemoryStorage::createRecordWriter()
+{
+	InMemoryStorage* writer = new InMemoryStorage();
+	writer->m_mainTable = m_mainTable;
+
+	return std::unique_ptr<StorageBackend>(writer);
+}
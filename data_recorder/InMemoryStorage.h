@@ -0,0 +1,125 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <map>
+#include <set>
+#include <mutex>
+#include <memory>
+#include <random>
+#include <functional>
+
+#include <StorageBackend.h>
+#include <NullEntry.h>
+
+/*
+This class is a storage backend held in memory, for load testing and profiling the data recorder without a database
+Devices are InMemoryStorageFirstDeviceID, InMemoryStorageFirstDeviceID + 1, ... (InMemoryStorageDeviceCount devices)
+Only what the data recorder reads back is kept (last counter and primary key per device, null records table), not the records
+Each call takes InMemoryStorageOperationLatencyMicroseconds plus InMemoryStorageRowLatencyMicroseconds per row (blocking the caller,
+like a database round trip) and fails with probability InMemoryStorageFailurePercent (before any change; per row for NULL record inserts)
+Within a unit of work, changes are kept aside and applied on commit (primary keys are assigned at once, like AUTO_INCREMENT)
+*/
+class InMemoryStorage: public StorageBackend
+{
+public:
+	InMemoryStorage();
+	~InMemoryStorage() {}
+
+	virtual bool initialize(const StorageSchema& schema, bool isConnect = true);
+
+	virtual bool writeRecordBatch(std::vector< std::vector<std::string> >& recordBatch);
+
+	virtual bool insertNullRecords(int deviceID, long start, long end, std::vector<NullEntry>& insertedRecordInfoVec);
+
+	virtual bool insertEntriesToNullTable(std::vector<NullEntry>& insertedRecordInfoVec);
+
+	virtual bool updateRecordBatch(const std::unordered_map< long, std::vector<std::string> >& recordBatch);
+
+	virtual bool deleteNullEntryBatch(const std::vector<long>& nullEntryBatch);
+
+	virtual bool loadEntriesFromNullTable(std::set<int>& deviceSet,
+										std::unordered_map< int, std::map<long, NullEntry> >& deviceNullRecordKeys);
+
+	virtual bool getDeviceIDs(std::string tableName, std::string deviceIDColumnName, std::unordered_map<int, long>& deviceLastCounterMap,
+										bool isReinitialize = false);
+
+	virtual bool getDeviceTableFingerprint(std::string tableName, std::string deviceIDColumnName, DeviceTableFingerprint& fingerprint);
+
+	//Devices do not change after initialize(), so only the fingerprint is compared
+	virtual DeviceTableScan scanDeviceTable(std::string tableName, std::string deviceIDColumnName, DeviceTableFingerprint previousFingerprint);
+
+	virtual bool getLastCounters(std::unordered_map<int, long>& deviceLastCounterMap);
+
+	virtual bool getInitialNullRecordInfo(const std::unordered_map<int, long>& validDevicesMap,
+							std::unordered_map< int, std::map<long, NullEntry> >& deviceNullRecordKeys,
+							int devicesPerQuery, int connectionCount);
+
+	virtual bool getTableWatermarks(long& mainTableWatermark, long& nullTableWatermark);
+
+	virtual bool getLastCountersSince(long mainTableWatermark, std::unordered_map<int, long>& deviceLastCounterMap);
+
+	virtual bool getNullRecordInfoSince(long nullTableWatermark, const std::unordered_map<int, long>& validDevicesMap,
+							std::unordered_map< int, std::map<long, NullEntry> >& deviceNullRecordKeys);
+
+	//Writers share this instance's main table (with their own injected latency and failures)
+	virtual std::unique_ptr<StorageBackend> createRecordWriter();
+
+	virtual bool beginUnitOfWork();
+	virtual bool commitUnitOfWork();
+	virtual void rollbackUnitOfWork();
+
+private:
+	//Injected latency for a call handling rowCount rows, followed by an injected failure (returns false if the call must fail)
+	bool simulateOperation(const char* operationName, long rowCount);
+	bool isInjectedFailure();
+
+	DeviceTableFingerprint computeFingerprint();
+
+	//Applies a change to the tables now, or on commit within a unit of work
+	void applyChange(std::function<void()> change);
+
+	//Last written record of a device in the main table
+	struct DeviceState
+	{
+		long m_lastCounter;
+		long m_lastPrimaryKey;
+	};
+
+	//Positions of the record counter and device ID in a record (from the main table structure)
+	int m_counterPosition;
+	int m_deviceIDPosition;
+	int m_nullEntriesMaxCount;
+
+	long m_operationLatencyUs;
+	long m_rowLatencyUs;
+	double m_failurePercent;
+
+	std::mutex m_randomMutex;	//scanDeviceTable() runs on a worker thread
+	std::mt19937 m_randomEngine;
+	std::uniform_real_distribution<double> m_percentDistribution;
+
+	std::set<int> m_deviceIDs;	//Devices table (not changed after initialize())
+
+	//Main table; primary keys are assigned in insert order like AUTO_INCREMENT
+	struct MainTable
+	{
+		std::mutex m_mutex;	//Record writers write on their own threads
+		std::unordered_map<int, DeviceState> m_deviceStates;	//key = device ID
+		long m_primaryKey;
+	};
+
+	std::shared_ptr<MainTable> m_mainTable;	//Shared with record writers
+
+	//Null records table (key = device ID, nested map's key = entry primary key)
+	std::unordered_map< int, std::map<long, NullEntry> > m_nullTable;
+	std::unordered_map<long, std::pair<int, long>> m_nullTableIndex;	//key = inserted primary key, value = (device ID, entry primary key)
+	long m_nullTablePrimaryKey;
+
+	bool m_isInUnitOfWork;
+	std::vector< std::function<void()> > m_unitOfWorkChanges;	//applied in order on commit
+
+	unsigned long m_operationCount;
+	unsigned long m_injectedFailureCount;
+};
@@ -0,0 +1,274 @@
+#include <cstdlib>
+#include <algorithm>
+#include <PipelinedRecordWriter.h>
+#include <Logger.h>
+
+
+//*************************************************************************************************
+PipelinedRecordWriter::PipelinedRecordWriter():
+	m_deviceIDPosition{0},
+	m_maxQueuedBatches{1},
+	m_callback{nullptr},
+	m_pendingRecordCount{0},
+	m_queuedBatchCount{0},
+	m_isStopping{false},
+	m_submittedBatchCount{0},
+	m_failedBatchCount{0},
+	m_fullQueueWaitCount{0}
+{
+}
+
+
+//*************************************************************************************************
+PipelinedRecordWriter::~PipelinedRecordWriter()
+{
+	stop();
+}
+
+
+//*************************************************************************************************
+void PipelinedRecordWriter::start(std::vector< std::unique_ptr<StorageBackend> >& writers, int deviceIDPosition, int maxQueuedBatches,
+									RecordWriterCallback* callback)
+{
+	stop();
+
+	m_deviceIDPosition = deviceIDPosition;
+	m_maxQueuedBatches = std::max(1, maxQueuedBatches);
+	m_callback = callback;
+
+	for (auto& backend: writers)
+	{
+		std::unique_ptr<Writer> writer(new Writer());
+		writer->m_backend = std::move(backend);
+		writer->m_isFailed = false;
+		m_writers.push_back(std::move(writer));
+	}
+
+	writers.clear();
+
+	for (auto& writer: m_writers)
+		writer->m_thread = std::thread(&PipelinedRecordWriter::writerLoop, this, writer.get());
+
+	BOOST_LOG_TRIVIAL(info) << "Pipelined record writer started with " << m_writers.size() << " writers, max. queued batches per writer: "
+							<< m_maxQueuedBatches;
+}
+
+
+//*************************************************************************************************
+void PipelinedRecordWriter::stop()
+{
+	if (m_writers.size() == 0)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_isStopping = true;
+
+		for (auto& writer: m_writers)
+			writer->m_batchCondition.notify_one();
+	}
+
+	for (auto& writer: m_writers)
+		writer->m_thread.join();
+
+	m_writers.clear();	//Completions are kept for dispatchCompletions()
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_isStopping = false;
+}
+
+
+//*************************************************************************************************
+void PipelinedRecordWriter::submit(std::vector< std::vector<std::string> >& records)
+{
+	if (records.size() == 0)
+		return;
+
+	int writerCount = m_writers.size();
+	std::vector<RecordBatch> shardBatches(writerCount);
+
+	for (auto& record: records)
+	{
+		//Device IDs are validated (numeric) before records are cached
+		long deviceID = std::strtol(record[m_deviceIDPosition].c_str(), nullptr, 10);
+		shardBatches[std::abs(deviceID) % writerCount].push_back(std::move(record));
+	}
+
+	long recordCount = records.size();
+	records.clear();
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	//A failed writer does not queue batches (they are failed immediately), so it is never full
+	auto hasRoom = [this, &shardBatches, writerCount]
+	{
+		for (int i = 0; i < writerCount; ++i)
+		{
+			if (shardBatches[i].size() != 0 && !m_writers[i]->m_isFailed && (int)m_writers[i]->m_queue.size() >= m_maxQueuedBatches)
+				return false;
+		}
+		return true;
+	};
+
+	if (!hasRoom())
+	{
+		++m_fullQueueWaitCount;
+		m_batchDoneCondition.wait(lock, hasRoom);
+	}
+
+	for (int i = 0; i < writerCount; ++i)
+	{
+		if (shardBatches[i].size() == 0)
+			continue;
+
+		Writer* writer = m_writers[i].get();
+		++m_submittedBatchCount;
+
+		if (writer->m_isFailed)	//Returned with the writer's failed batches, in order
+		{
+			++m_failedBatchCount;
+			m_completions.push_back(Completion{std::move(shardBatches[i]), false});
+			continue;
+		}
+
+		writer->m_queue.push_back(std::move(shardBatches[i]));
+		++m_queuedBatchCount;
+		writer->m_batchCondition.notify_one();
+	}
+
+	m_pendingRecordCount += recordCount;
+}
+
+
+//*************************************************************************************************
+void PipelinedRecordWriter::writerLoop(Writer* writer)
+{
+	writer->m_backend->initializeThread();
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (true)
+	{
+		writer->m_batchCondition.wait(lock, [this, writer]{ return m_isStopping || writer->m_queue.size() != 0; });
+
+		if (writer->m_queue.size() == 0)	//Stopping, after all queued batches are written
+			break;
+
+		const RecordBatch& batch = writer->m_queue.front();	//References to deque elements stay valid while others are added
+
+		lock.unlock();
+
+		//Written from a copy, as the backend may remove records from it and queued batches are read by copyPendingRecords()
+		RecordBatch remainingRecords(batch);
+		bool isSuccessful = writer->m_backend->writeRecordBatch(remainingRecords);
+
+		lock.lock();
+
+		long batchSize = batch.size();
+		writer->m_queue.pop_front();
+		--m_queuedBatchCount;
+
+		if (isSuccessful)
+		{
+			m_pendingRecordCount -= batchSize;
+			m_completions.push_back(Completion{RecordBatch(), true});
+		}
+		else
+		{
+			m_pendingRecordCount -= batchSize - remainingRecords.size();
+			++m_failedBatchCount;
+			m_completions.push_back(Completion{std::move(remainingRecords), false});
+
+			//Queued batches are returned unwritten, so that none of them is written before the failed batch is retried
+			writer->m_isFailed = true;
+
+			for (RecordBatch& queuedBatch: writer->m_queue)
+			{
+				++m_failedBatchCount;
+				m_completions.push_back(Completion{std::move(queuedBatch), false});
+			}
+
+			m_queuedBatchCount -= writer->m_queue.size();
+			writer->m_queue.clear();
+		}
+
+		m_batchDoneCondition.notify_all();
+	}
+
+	lock.unlock();
+
+	writer->m_backend->finalizeThread();
+}
+
+
+//*************************************************************************************************
+int PipelinedRecordWriter::dispatchCompletions()
+{
+	std::vector<Completion> completions;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (m_completions.size() == 0)
+			return 0;
+
+		completions.swap(m_completions);
+
+		//All failed batches of a failed writer are in completions, so it can accept batches again
+		for (auto& writer: m_writers)
+			writer->m_isFailed = false;
+
+		for (Completion& completion: completions)
+			m_pendingRecordCount -= completion.m_records.size();
+	}
+
+	for (Completion& completion: completions)
+		m_callback->OnRecordBatchWritten(completion.m_records, completion.m_isSuccessful);
+
+	return completions.size();
+}
+
+
+//*************************************************************************************************
+void PipelinedRecordWriter::drain()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_batchDoneCondition.wait(lock, [this]{ return m_queuedBatchCount == 0; });
+}
+
+
+//*************************************************************************************************
+long PipelinedRecordWriter::getPendingRecordCount()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_pendingRecordCount;
+}
+
+
+//*************************************************************************************************
+void PipelinedRecordWriter::copyPendingRecords(std::vector< std::vector<std::string> >& records)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (auto& writer: m_writers)
+	{
+		for (RecordBatch& batch: writer->m_queue)
+			records.insert(records.end(), batch.begin(), batch.end());
+	}
+
+	for (Completion& completion: m_completions)
+		records.insert(records.end(), completion.m_records.begin(), completion.m_records.end());
+}
+
+
+//*************************************************************************************************
+void PipelinedRecordWriter::dumpRecordWriterInformation(std::ofstream& fileStream)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	fileStream << "------------- From class PipelinedRecordWriter -------------\n" << std::endl;
+	fileStream << "writer count = " << m_writers.size() << ", m_maxQueuedBatches = " << m_maxQueuedBatches
+				<< ", m_queuedBatchCount = " << m_queuedBatchCount << ", m_pendingRecordCount = " << m_pendingRecordCount << std::endl;
+	fileStream << "m_submittedBatchCount = " << m_submittedBatchCount << ", m_failedBatchCount = " << m_failedBatchCount
+				<< ", m_fullQueueWaitCount = " << m_fullQueueWaitCount << '\n' << std::endl;
+}
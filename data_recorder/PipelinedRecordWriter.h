@@ -0,0 +1,97 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+
+#include <StorageBackend.h>
+
+//Receives the results of pipelined record batch writes (on the thread calling PipelinedRecordWriter::dispatchCompletions())
+class RecordWriterCallback
+{
+public:
+	virtual ~RecordWriterCallback() {}
+
+	//On failure, records holds the records of the batch that were not written
+	virtual void OnRecordBatchWritten(std::vector< std::vector<std::string> >& records, bool isSuccessful) = 0;
+};
+
+/*
+This class keeps record batches in flight over several storage connections, so that the event loop thread does not wait a storage
+round trip per batch: submit() queues a batch and returns, and results are reported to the callback by dispatchCompletions()
+Up to maxQueuedBatches batches per writer are in flight; submit() waits when storage falls further behind (like a synchronous write)
+Each writer (a storage backend instance with its own connection, see StorageBackend::createRecordWriter()) runs on its own thread and
+writes a fixed shard of devices (device ID modulo writer count), so a device's records are written in the order they were submitted
+After a failed write, a writer fails its queued batches without writing them until the failure is dispatched, so that the caller
+gets all of them back (in order) to retry
+*/
+class PipelinedRecordWriter
+{
+public:
+	PipelinedRecordWriter();
+	~PipelinedRecordWriter();
+
+	//writers: initialized backend instances (one thread each); maxQueuedBatches: per writer, including the batch being written
+	void start(std::vector< std::unique_ptr<StorageBackend> >& writers, int deviceIDPosition, int maxQueuedBatches, RecordWriterCallback* callback);
+
+	//Waits for queued batches to be written; their results are dispatched by the next dispatchCompletions()
+	void stop();
+
+	bool isActive() { return m_writers.size() != 0; }
+
+	//Splits records into device shards and queues them (records are moved out); waits while a shard's writer queue is full
+	void submit(std::vector< std::vector<std::string> >& records);
+
+	//Calls the callback for each batch finished since the last call; returns the no. of batches
+	int dispatchCompletions();
+
+	//Waits until all submitted batches are finished (not dispatched)
+	void drain();
+
+	//Records submitted but not yet written, including failed records that are not dispatched yet
+	long getPendingRecordCount();
+	void copyPendingRecords(std::vector< std::vector<std::string> >& records);
+
+	void dumpRecordWriterInformation(std::ofstream& fileStream);
+
+private:
+	typedef std::vector< std::vector<std::string> > RecordBatch;
+
+	struct Writer
+	{
+		std::unique_ptr<StorageBackend> m_backend;
+		std::thread m_thread;
+		std::condition_variable m_batchCondition;	//batch queued, or stopping
+		std::deque<RecordBatch> m_queue;	//front = batch being written
+		bool m_isFailed;	//until its failed batches are dispatched
+	};
+
+	struct Completion
+	{
+		RecordBatch m_records;	//not kept for successful batches
+		bool m_isSuccessful;
+	};
+
+	void writerLoop(Writer* writer);
+
+	std::vector< std::unique_ptr<Writer> > m_writers;
+	int m_deviceIDPosition;
+	int m_maxQueuedBatches;
+	RecordWriterCallback* m_callback;
+
+	std::mutex m_mutex;
+	std::condition_variable m_batchDoneCondition;	//a writer finished a batch
+	std::vector<Completion> m_completions;
+	long m_pendingRecordCount;
+	int m_queuedBatchCount;
+	bool m_isStopping;
+
+	unsigned long m_submittedBatchCount;
+	unsigned long m_failedBatchCount;
+	unsigned long m_fullQueueWaitCount;	//submit() calls that waited for a full writer queue
+};
@@ -0,0 +1,240 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring> //strerror
+#include <cstdio> //rename
+#include <fstream>
+
+#include <RecordJournal.h>
+#include <Logger.h>
+
+
+//*************************************************************************************************
+RecordJournal::RecordJournal():
+	m_fileFD{-1},
+	m_compactionSizeBytes{0},
+	m_currentSizeBytes{0},
+	m_unsyncedRecordCount{0},
+	m_appendCount{0},
+	m_syncCount{0},
+	m_compactionCount{0}
+{
+}
+
+
+//*************************************************************************************************
+RecordJournal::~RecordJournal()
+{
+	if (m_fileFD != -1)
+	{
+		sync();
+		close(m_fileFD);
+	}
+}
+
+
+//*************************************************************************************************
+bool RecordJournal::initialize(std::string filename, long compactionSizeBytes)
+{
+	m_filename = filename;
+	m_compactionSizeBytes = compactionSizeBytes;
+
+	BOOST_LOG_TRIVIAL(info) << "Opening record journal: " << m_filename;
+
+	if (openForAppend() == false)
+		return false;
+
+	BOOST_LOG_TRIVIAL(info) << "Record journal opened successfully, current size: " << m_currentSizeBytes << " bytes";
+	return true;
+}
+
+
+//*************************************************************************************************
+bool RecordJournal::openForAppend()
+{
+	m_fileFD = open(m_filename.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+
+	if (m_fileFD == -1)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Unable to open record journal: " << m_filename;
+		BOOST_LOG_TRIVIAL(error) << "errno: " << errno << ", error string: " << strerror(errno);
+		return false;
+	}
+
+	struct stat fileStat;
+	if (fstat(m_fileFD, &fileStat) == 0)
+		m_currentSizeBytes = fileStat.st_size;
+
+	return true;
+}
+
+
+//*************************************************************************************************
+bool RecordJournal::loadRecords(std::vector<std::string>& records)
+{
+	std::ifstream fileStream(m_filename.c_str());
+
+	if (!fileStream.is_open())
+	{
+		BOOST_LOG_TRIVIAL(error) << "Unable to open record journal for reading: " << m_filename;
+		return false;
+	}
+
+	std::string line;
+
+	while (std::getline(fileStream, line))
+	{
+		//A last line without the terminating newline was torn by a crash during write(); it was never ACKed
+		if (fileStream.eof())
+		{
+			BOOST_LOG_TRIVIAL(warning) << "Ignoring incomplete last record in record journal: " << line;
+			break;
+		}
+
+		if (line.empty())
+			continue;
+
+		records.push_back(line);
+	}
+
+	BOOST_LOG_TRIVIAL(info) << "Loaded " << records.size() << " records from record journal: " << m_filename;
+	return true;
+}
+
+
+//*************************************************************************************************
+bool RecordJournal::appendRecord(const std::string& recordString)
+{
+	if (m_fileFD == -1)
+		return false;
+
+	std::string line = recordString + '\n';
+
+	if (writeFully(m_fileFD, line.c_str(), line.size()) == false)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed to append record to record journal: " << m_filename;
+		return false;
+	}
+
+	m_currentSizeBytes += line.size();
+	++m_unsyncedRecordCount;
+	++m_appendCount;
+	return true;
+}
+
+
+//*************************************************************************************************
+bool RecordJournal::sync()
+{
+	if (m_fileFD == -1 || m_unsyncedRecordCount == 0)
+		return true;
+
+	if (fdatasync(m_fileFD) == -1)
+	{
+		BOOST_LOG_TRIVIAL(error) << "fdatasync() failed on record journal: " << m_filename;
+		BOOST_LOG_TRIVIAL(error) << "errno: " << errno << ", error string: " << strerror(errno);
+		return false;
+	}
+
+	m_unsyncedRecordCount = 0;
+	++m_syncCount;
+	return true;
+}
+
+
+//*************************************************************************************************
+bool RecordJournal::needsCompaction()
+{
+	return (m_fileFD != -1 && m_currentSizeBytes >= m_compactionSizeBytes);
+}
+
+
+//*************************************************************************************************
+bool RecordJournal::compact(const std::vector<std::string>& pendingRecords)
+{
+	if (m_fileFD == -1)
+		return false;
+
+	//Write pending records to a temporary file and atomically replace the journal with it
+	std::string tempFilename = m_filename + ".tmp";
+
+	int tempFD = open(tempFilename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (tempFD == -1)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Unable to open temporary file for record journal compaction: " << tempFilename;
+		BOOST_LOG_TRIVIAL(error) << "errno: " << errno << ", error string: " << strerror(errno);
+		return false;
+	}
+
+	std::string content;
+	for (auto& record: pendingRecords)
+	{
+		content += record;
+		content += '\n';
+	}
+
+	if (writeFully(tempFD, content.c_str(), content.size()) == false || fdatasync(tempFD) == -1)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed to write temporary file for record journal compaction: " << tempFilename;
+		close(tempFD);
+		return false;
+	}
+
+	close(tempFD);
+
+	if (rename(tempFilename.c_str(), m_filename.c_str()) == -1)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed to replace record journal with compacted file: " << tempFilename;
+		BOOST_LOG_TRIVIAL(error) << "errno: " << errno << ", error string: " << strerror(errno);
+		return false;
+	}
+
+	close(m_fileFD);
+	m_unsyncedRecordCount = 0;
+
+	if (openForAppend() == false)
+		return false;
+
+	++m_compactionCount;
+	BOOST_LOG_TRIVIAL(info) << "Record journal compacted, pending record count: " << pendingRecords.size() << ", new size: " << m_currentSizeBytes << " bytes";
+	return true;
+}
+
+
+//*************************************************************************************************
+bool RecordJournal::writeFully(int fileFD, const char* data, size_t length)
+{
+	size_t written = 0;
+
+	while (written < length)
+	{
+		ssize_t result = write(fileFD, data + written, length - written);
+
+		if (result == -1)
+		{
+			if (errno == EINTR)
+				continue;
+
+			BOOST_LOG_TRIVIAL(error) << "write() failed on file descriptor: " << fileFD;
+			BOOST_LOG_TRIVIAL(error) << "errno: " << errno << ", error string: " << strerror(errno);
+			return false;
+		}
+
+		written += result;
+	}
+
+	return true;
+}
+
+
+//*************************************************************************************************
+void RecordJournal::dumpJournalInformation(std::ofstream& fileStream)
+{
+	fileStream << "------------- From class RecordJournal -------------\n" << std::endl;
+	fileStream << "m_filename = " << m_filename << ", m_currentSizeBytes = " << m_currentSizeBytes << std::endl;
+	fileStream << "m_appendCount = " << m_appendCount << ", m_syncCount = " << m_syncCount
+				<< ", m_compactionCount = " << m_compactionCount << '\n' << std::endl;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+
+/*
+This class manages an append-only write-ahead journal (WAL) of accepted records
+Every accepted record is appended before it is ACKed, so that the in-memory caches can be rebuilt after a crash
+Appends are written immediately but synced to disk in groups (group commit) by calling sync()
+*/
+class RecordJournal
+{
+public:
+	RecordJournal();
+	~RecordJournal();
+
+	bool initialize(std::string filename, long compactionSizeBytes);
+	bool isActive() { return m_fileFD != -1; }
+
+	//Read all complete records in the journal (used for replaying on restart)
+	bool loadRecords(std::vector<std::string>& records);
+
+	bool appendRecord(const std::string& recordString);
+
+	//fdatasync() all appends since the last sync (one disk flush for a group of records)
+	bool sync();
+
+	//Rewrite the journal with only the records that are still pending (not yet written to storage)
+	bool needsCompaction();
+	bool compact(const std::vector<std::string>& pendingRecords);
+
+	void dumpJournalInformation(std::ofstream& fileStream);
+
+private:
+	bool openForAppend();
+	bool writeFully(int fileFD, const char* data, size_t length);
+
+	std::string m_filename;
+	int m_fileFD;
+
+	long m_compactionSizeBytes;	//compact when the journal grows beyond this size
+	long m_currentSizeBytes;
+
+	int m_unsyncedRecordCount;
+
+	unsigned long m_appendCount;
+	unsigned long m_syncCount;
+	unsigned long m_compactionCount;
+};
@@ -0,0 +1,887 @@
+#include <exception>
+#include <memory>
+#include <algorithm>
+
+#include <SQLiteStorage.h>
+#include <ConfigurationHandler.h>
+#include <Logger.h>
+
+//Statements prepared for a single call are finalized when they go out of scope
+typedef std::unique_ptr<sqlite3_stmt, int(*)(sqlite3_stmt*)> StatementPtr;
+
+
+//*************************************************************************************************
+SQLiteStorage::SQLiteStorage():
+	m_rowsPerInsertStatement{1},
+	m_nullEntriesMaxCount{0},
+	m_columnCount{0},
+	m_database{nullptr},
+	m_multiRowInsertStatement{nullptr},
+	m_insertStatement{nullptr},
+	m_nullInsertStatement{nullptr},
+	m_nullUpdateStatement{nullptr},
+	m_nullTableEntryInsertStatement{nullptr},
+	m_nullTableEntryDeleteStatement{nullptr},
+	m_nullTableEntryLoadStatement{nullptr},
+	m_lastCounterStatement{nullptr},
+	m_isInUnitOfWork{false}
+{
+}
+
+
+//*************************************************************************************************
+SQLiteStorage::~SQLiteStorage()
+{
+	closeDatabase();
+}
+
+
+//*************************************************************************************************
+bool SQLiteStorage::initialize(const StorageSchema& schema, bool isConnect /*= true*/)
+{
+	ConfigurationHandler& configHandler = ConfigurationHandler::getInstance();
+
+	try
+	{
+		m_rowsPerInsertStatement = std::stoi(configHandler.getConfig("SQLiteRowsPerInsertStatement"));
+	}
+	catch (std::exception &e)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Exception thrown by std::stoi() in SQLiteStorage::initialize() when reading integer configs";
+		BOOST_LOG_TRIVIAL(error) << "Error: " << e.what();
+		return false;
+	}
+
+	//Set parameters
+	m_filename = configHandler.getConfig("SQLiteDatabaseFilename");
+	m_synchronousMode = configHandler.getConfig("SQLiteSynchronous");
+	m_devicesTable = configHandler.getConfig("DevicesTableName");
+	m_devicesTableIDColumn = configHandler.getConfig("DeviceIDColumnName");
+
+	m_table = schema.m_table;
+	m_primaryKeyColumn = schema.m_primaryKeyColumn;
+	m_recordCounterColumn = schema.m_recordCounterColumn;
+	m_deviceIDColumn = schema.m_deviceIDColumn;
+	m_dateTimeColumn = schema.m_dateTimeColumn;
+
+	m_nullRecordsTable = schema.m_nullRecordsTable;
+	m_nullRecTablePrimaryKeyColumn = schema.m_nullRecTablePrimaryKeyColumn;
+	m_nullRecInsertedPrimaryKeyColumn = schema.m_nullRecInsertedPrimaryKeyColumn;
+	m_nullRecDeviceIDColumn = schema.m_nullRecDeviceIDColumn;
+	m_nullRecRecordCounterColumn = schema.m_nullRecRecordCounterColumn;
+	m_nullRecRequestCountColumn = schema.m_nullRecRequestCountColumn;
+
+	m_nullEntriesMaxCount = schema.m_nullEntriesMaxCount;
+
+	m_columnCount = schema.m_columnCount;
+	m_columnNamesVec = schema.m_columnNames;
+	m_columnTypesVec = schema.m_columnTypes;
+	m_recordPositionsVec = schema.m_recordPositions;
+
+	if (!isConnect)
+		return true;
+
+	closeDatabase();	//When re-initializing
+
+	BOOST_LOG_TRIVIAL(info) << "Opening SQLite database: " << m_filename;
+
+	if (sqlite3_open_v2(m_filename.c_str(), &m_database, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL) != SQLITE_OK)
+	{
+		logError("open database");
+		closeDatabase();
+		return false;
+	}
+
+	//Device table scans read on another connection while records are written
+	sqlite3_busy_timeout(m_database, 5000);
+
+	//WAL: readers do not block the writer, and a commit appends to the log instead of rewriting pages
+	//synchronous=NORMAL: the log is synced at checkpoints only (a power loss may lose the last transactions, but does not corrupt the database)
+	StatementPtr journalModeStatement(prepare("PRAGMA journal_mode=WAL;"), sqlite3_finalize);
+
+	if (!journalModeStatement || sqlite3_step(journalModeStatement.get()) != SQLITE_ROW)
+	{
+		logError("set journal mode");
+		closeDatabase();
+		return false;
+	}
+
+	std::string journalMode = (const char*) sqlite3_column_text(journalModeStatement.get(), 0);
+	journalModeStatement.reset();
+
+	if (journalMode != "wal")
+		BOOST_LOG_TRIVIAL(warning) << "SQLite database: " << m_filename << " is not in WAL journal mode (journal mode: " << journalMode << ")";
+
+	if (execute("PRAGMA synchronous=" + m_synchronousMode + ";") == false || createTables() == false || prepareStatements() == false)
+	{
+		closeDatabase();
+		return false;
+	}
+
+	BOOST_LOG_TRIVIAL(info) << "SQLite database opened successfully; journal mode: " << journalMode << ", synchronous: " << m_synchronousMode
+							<< ", records per insert statement: " << m_rowsPerInsertStatement;
+	return true;
+}
+
+
+//*************************************************************************************************
+bool SQLiteStorage::createTables()
+{
+	std::string mainColumns = m_primaryKeyColumn + " INTEGER PRIMARY KEY AUTOINCREMENT";
+
+	for (int i = 0; i < m_columnCount; ++i)
+		mainColumns += ", " + m_columnNamesVec[i] + " " + getColumnType(m_columnTypesVec[i]);
+
+	//AUTOINCREMENT: primary keys of deleted null records table entries are not reused (watermarks rely on increasing keys)
+	std::string nullColumns = m_nullRecTablePrimaryKeyColumn + " INTEGER PRIMARY KEY AUTOINCREMENT, " + m_nullRecDeviceIDColumn
+					+ " INTEGER NOT NULL, " + m_nullRecRecordCounterColumn + " INTEGER NOT NULL, " + m_nullRecInsertedPrimaryKeyColumn
+					+ " INTEGER NOT NULL, " + m_nullRecRequestCountColumn + " INTEGER NOT NULL DEFAULT 0";
+
+	return execute("CREATE TABLE IF NOT EXISTS " + m_table + " (" + mainColumns + ");")
+		&& execute("CREATE INDEX IF NOT EXISTS " + m_table + "_device_counter ON " + m_table + " (" + m_deviceIDColumn + ", " + m_recordCounterColumn + ");")
+		&& execute("CREATE TABLE IF NOT EXISTS " + m_nullRecordsTable + " (" + nullColumns + ");")
+		&& execute("CREATE INDEX IF NOT EXISTS " + m_nullRecordsTable + "_device ON " + m_nullRecordsTable + " (" + m_nullRecDeviceIDColumn
+					+ ", " + m_nullRecTablePrimaryKeyColumn + ");")
+		&& execute("CREATE INDEX IF NOT EXISTS " + m_nullRecordsTable + "_inserted ON " + m_nullRecordsTable + " (" + m_nullRecInsertedPrimaryKeyColumn + ");")
+		&& execute("CREATE TABLE IF NOT EXISTS " + m_devicesTable + " (" + m_devicesTableIDColumn + " INTEGER PRIMARY KEY);");
+}
+
+
+//*************************************************************************************************
+bool SQLiteStorage::prepareStatements()
+{
+	//A statement has at most SQLITE_LIMIT_VARIABLE_NUMBER parameters
+	int maxRows = sqlite3_limit(m_database, SQLITE_LIMIT_VARIABLE_NUMBER, -1) / m_columnCount;
+
+	if (m_rowsPerInsertStatement > maxRows)
+		m_rowsPerInsertStatement = maxRows;
+
+	if (m_rowsPerInsertStatement < 1)
+		m_rowsPerInsertStatement = 1;
+
+	std::string fields("");
+	std::string parameters("(");
+
+	for (int i = 0; i < m_columnCount; ++i)
+	{
+		if (i != 0)
+		{
+			fields += ", ";
+			parameters += ",";
+		}
+
+		fields += m_columnNamesVec[i];
+		parameters += "?";
+	}
+
+	parameters += ")";
+
+	std::string insertQuery = "INSERT INTO " + m_table + " (" + fields + ") VALUES " + parameters;
+	std::string multiRowInsertQuery = insertQuery;
+
+	for (int i = 1; i < m_rowsPerInsertStatement; ++i)
+		multiRowInsertQuery += "," + parameters;
+
+	m_multiRowInsertStatement = prepare(multiRowInsertQuery + ";");
+	m_insertStatement = prepare(insertQuery + ";");
+
+	m_nullInsertStatement = prepare("INSERT INTO " + m_table + " (" + m_recordCounterColumn + "," + m_deviceIDColumn + "," + m_dateTimeColumn
+									+ ") VALUES (?,?,'0000/00/00 00:00:00');");
+
+	//All columns are given, so replacing the NULL record is the same as MySQL's ON DUPLICATE KEY UPDATE
+	m_nullUpdateStatement = prepare("INSERT OR REPLACE INTO " + m_table + " (" + m_primaryKeyColumn + ", " + fields + ") VALUES (?,"
+									+ parameters.substr(1) + ";");
+
+	m_nullTableEntryInsertStatement = prepare("INSERT INTO " + m_nullRecordsTable + " (" + m_nullRecDeviceIDColumn + "," + m_nullRecRecordCounterColumn
+									+ "," + m_nullRecInsertedPrimaryKeyColumn + ") VALUES (?,?,?);");
+
+	m_nullTableEntryDeleteStatement = prepare("DELETE FROM " + m_nullRecordsTable + " WHERE " + m_nullRecInsertedPrimaryKeyColumn + "=?;");
+
+	m_nullTableEntryLoadStatement = prepare("SELECT " + m_nullRecTablePrimaryKeyColumn + "," + m_nullRecDeviceIDColumn + "," + m_nullRecRecordCounterColumn
+									+ "," + m_nullRecInsertedPrimaryKeyColumn + "," + m_nullRecRequestCountColumn + " FROM " + m_nullRecordsTable
+									+ " WHERE " + m_nullRecDeviceIDColumn + "=? AND " + m_nullRecInsertedPrimaryKeyColumn + ">?"
+									+ " ORDER BY " + m_nullRecTablePrimaryKeyColumn + " LIMIT ?;");
+
+	m_lastCounterStatement = prepare("SELECT MAX(" + m_recordCounterColumn + ") FROM " + m_table + " WHERE " + m_deviceIDColumn + "=?;");
+
+	return m_multiRowInsertStatement && m_insertStatement && m_nullInsertStatement && m_nullUpdateStatement && m_nullTableEntryInsertStatement
+		&& m_nullTableEntryDeleteStatement && m_nullTableEntryLoadStatement && m_lastCounterStatement;
+}
+
+
+//*************************************************************************************************
+void SQLiteStorage::closeDatabase()
+{
+	for (sqlite3_stmt** statement: {&m_multiRowInsertStatement, &m_insertStatement, &m_nullInsertStatement, &m_nullUpdateStatement,
+						&m_nullTableEntryInsertStatement, &m_nullTableEntryDeleteStatement, &m_nullTableEntryLoadStatement, &m_lastCounterStatement})
+	{
+		sqlite3_finalize(*statement);	//No-op for nullptr
+		*statement = nullptr;
+	}
+
+	if (m_database != nullptr)
+	{
+		sqlite3_close(m_database);
+		m_database = nullptr;
+	}
+
+	m_isInUnitOfWork = false;
+}
+
+
+//*************************************************************************************************
+bool SQLiteStorage::execute(const std::string& query)
+{
+	if (sqlite3_exec(m_database, query.c_str(), NULL, NULL, NULL) != SQLITE_OK)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed to execute query: " << query;
+		return logError("execute query");
+	}
+
+	return true;
+}
+
+
+//*************************************************************************************************
+sqlite3_stmt* SQLiteStorage::prepare(const std::string& query)
+{
+	sqlite3_stmt* statement = nullptr;
+
+	if (sqlite3_prepare_v2(m_database, query.c_str(), -1, &statement, NULL) != SQLITE_OK)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed to prepare query: " << query;
+		logError("prepare query");
+		return nullptr;
+	}
+
+	return statement;
+}
+
+
+//*************************************************************************************************
+bool SQLiteStorage::logError(const std::string& operation)
+{
+	BOOST_LOG_TRIVIAL(error) << "Failed to " << operation << " in SQLite database: " << m_filename;
+	BOOST_LOG_TRIVIAL(error) << "Error: " << (m_database != nullptr ? sqlite3_errmsg(m_database) : "out of memory");
+	return false;
+}
+
+
+//*************************************************************************************************
+bool SQLiteStorage::beginTransaction()
+{
+	if (m_database == nullptr)
+		return false;
+
+	if (m_isInUnitOfWork)	//Statements join the unit of work's transaction
+		return true;
+
+	//IMMEDIATE: the write lock is taken at the start, so that the transaction cannot fail later on a lock upgrade
+	return execute("BEGIN IMMEDIATE;");
+}
+
+
+//*************************************************************************************************
+bool SQLiteStorage::commitTransaction()
+{
+	if (m_isInUnitOfWork)
+		return true;
+
+	if (execute("COMMIT;"))
+		return true;
+
+	rollbackTransaction();
+	return false;
+}
+
+
+//*************************************************************************************************
+void SQLiteStorage::rollbackTransaction()
+{
+	if (m_isInUnitOfWork)	//Left to rollbackUnitOfWork(), so that later statements do not run outside the transaction
+		return;
+
+	sqlite3_exec(m_database, "ROLLBACK;", NULL, NULL, NULL);	//Fails harmlessly if SQLite already rolled back
+}
+
+
+//*************************************************************************************************
+bool SQLiteStorage::beginUnitOfWork()
+{
+	if (beginTransaction() == false)
+		return false;
+
+	m_isInUnitOfWork = true;
+	return true;
+}
+
+
+//*************************************************************************************************
+bool SQLiteStorage::commitUnitOfWork()
+{
+	m_isInUnitOfWork = false;
+	return commitTransaction();
+}
+
+
+//*************************************************************************************************
+void SQLiteStorage::rollbackUnitOfWork()
+{
+	m_isInUnitOfWork = false;
+	rollbackTransaction();
+}
+
+
+//*************************************************************************************************
+void SQLiteStorage::bindRecord(sqlite3_stmt* statement, const std::vector<std::string>& record, int firstIndex)
+{
+	for (int i = 0; i < m_columnCount; ++i)
+	{
+		const std::string& value = record[m_recordPositionsVec[i]];
+
+		if (value == "NAN" || value == "NULL" || value == "INF" || value == "OVF")
+			sqlite3_bind_null(statement, firstIndex + i);
+		else	//Converted by the column's type affinity; the record outlives the statement execution
+			sqlite3_bind_text(statement, firstIndex + i, value.c_str(), value.size(), SQLITE_STATIC);
+	}
+}
+
+
+//*************************************************************************************************
+bool SQLiteStorage::writeRecordBatch(std::vector< std::vector<std::string> >& recordBatch)
+{
+	int recordCount = recordBatch.size();
+
+	if (recordCount == 0)
+		return true;
+
+	if (beginTransaction() == false)
+		return false;
+
+	int written = 0;
+
+	while (written < recordCount)
+	{
+		//Full multi-row statements first, then the remaining records one by one
+		bool isMultiRow = (recordCount - written >= m_rowsPerInsertStatement);
+		sqlite3_stmt* statement = isMultiRow ? m_multiRowInsertStatement : m_insertStatement;
+		int rowCount = isMultiRow ? m_rowsPerInsertStatement : 1;
+
+		for (int row = 0; row < rowCount; ++row)
+			bindRecord(statement, recordBatch[written + row], row * m_columnCount + 1);
+
+		int result = sqlite3_step(statement);
+		sqlite3_reset(statement);
+
+		if (result != SQLITE_DONE)
+		{
+			logError("insert batch of records into table " + m_table);
+			rollbackTransaction();
+			return false;
+		}
+
+		written += rowCount;
+	}
+
+	if (commitTransaction() == false)
+		return false;
+
+	BOOST_LOG_TRIVIAL(debug) << "Batch of records inserted to table: " << m_table << ", batch size: " << recordCount;
+	return true;
+}
+
+
+//*************************************************************************************************
+bool SQLiteStorage::insertNullRecords(int deviceID, long start, long end, std::vector<NullEntry>& insertedRecordInfoVec)
+{
+	//All NULL records of the gap are inserted in one transaction (none are inserted if it fails)
+	size_t initialSize = insertedRecordInfoVec.size();
+
+	if (beginTransaction() == false)
+		return false;
+
+	for (long SDCounter = start; SDCounter < end; ++SDCounter)
+	{
+		sqlite3_bind_int64(m_nullInsertStatement, 1, SDCounter);
+		sqlite3_bind_int(m_nullInsertStatement, 2, deviceID);
+
+		int result = sqlite3_step(m_nullInsertStatement);
+		sqlite3_reset(m_nullInsertStatement);
+
+		if (result != SQLITE_DONE)
+		{
+			logError("insert NULL record into table " + m_table);
+			rollbackTransaction();
+			insertedRecordInfoVec.resize(initialSize);
+			return false;
+		}
+
+		insertedRecordInfoVec.push_back(NullEntry(deviceID, SDCounter, sqlite3_last_insert_rowid(m_database), 0));
+	}
+
+	if (commitTransaction() == false)
+	{
+		insertedRecordInfoVec.resize(initialSize);
+		return false;
+	}
+
+	BOOST_LOG_TRIVIAL(debug) << "Generated NULL records inserted to table " << m_table << ", SDCounters: [" << start << "," << end - 1 << "]"
+							<< ", no. of NULL records: " << insertedRecordInfoVec.size() - initialSize;
+	return true;
+}
+
+
+//*************************************************************************************************
+bool SQLiteStorage::insertEntriesToNullTable(std::vector<NullEntry>& insertedRecordInfoVec)
+{
+	if (insertedRecordInfoVec.size() == 0)
+		return true;
+
+	if (beginTransaction() == false)
+		return false;
+
+	for (NullEntry& entry: insertedRecordInfoVec)
+	{
+		sqlite3_bind_int(m_nullTableEntryInsertStatement, 1, entry.m_deviceID);
+		sqlite3_bind_int64(m_nullTableEntryInsertStatement, 2, entry.m_SDCounter);
+		sqlite3_bind_int64(m_nullTableEntryInsertStatement, 3, entry.m_recordInsertedPrimaryKey);
+
+		int result = sqlite3_step(m_nullTableEntryInsertStatement);
+		sqlite3_reset(m_nullTableEntryInsertStatement);
+
+		if (result != SQLITE_DONE)
+		{
+			logError("insert null entries into table " + m_nullRecordsTable);
+			rollbackTransaction();
+			return false;
+		}
+	}
+
+	if (commitTransaction() == false)
+		return false;
+
+	BOOST_LOG_TRIVIAL(debug) << "Entries inserted to table: " << m_nullRecordsTable << ", null entry batch size: " << insertedRecordInfoVec.size();
+	return true;
+}
+
+
+//*************************************************************************************************
+bool SQLiteStorage::updateRecordBatch(const std::unordered_map< long, std::vector<std::string> >& recordBatch)
+{
+	if (recordBatch.size() == 0)
+		return true;
+
+	if (beginTransaction() == false)
+		return false;
+
+	for (auto& entry: recordBatch)
+	{
+		sqlite3_bind_int64(m_nullUpdateStatement, 1, entry.first);
+		bindRecord(m_nullUpdateStatement, entry.second, 2);
+
+		int result = sqlite3_step(m_nullUpdateStatement);
+		sqlite3_reset(m_nullUpdateStatement);
+
+		if (result != SQLITE_DONE)
+		{
+			logError("update batch of NULL records in table " + m_table);
+			rollbackTransaction();
+			return false;
+		}
+	}
+
+	if (commitTransaction() == false)
+		return false;
+
+	BOOST_LOG_TRIVIAL(debug) << "Batch of NULL records updated in table: " << m_table << ", batch size: " << recordBatch.size();
+	return true;
+}
+
+
+//*************************************************************************************************
+bool SQLiteStorage::deleteNullEntryBatch(const std::vector<long>& nullEntryBatch)
+{
+	if (nullEntryBatch.size() == 0)
+		return true;
+
+	if (beginTransaction() == false)
+		return false;
+
+	for (long insertedPrimaryKey: nullEntryBatch)
+	{
+		sqlite3_bind_int64(m_nullTableEntryDeleteStatement, 1, insertedPrimaryKey);
+
+		int result = sqlite3_step(m_nullTableEntryDeleteStatement);
+		sqlite3_reset(m_nullTableEntryDeleteStatement);
+
+		if (result != SQLITE_DONE)
+		{
+			logError("delete null entries from table " + m_nullRecordsTable);
+			rollbackTransaction();
+			return false;
+		}
+	}
+
+	if (commitTransaction() == false)
+		return false;
+
+	BOOST_LOG_TRIVIAL(debug) << "Null entries deleted from table: " << m_nullRecordsTable << ", batch size: " << nullEntryBatch.size();
+	return true;
+}
+
+
+//*************************************************************************************************
+bool SQLiteStorage::readNullEntries(sqlite3_stmt* statement, const std::unordered_map<int, long>* validDevicesMap,
+									std::unordered_map< int, std::map<long, NullEntry> >& deviceNullRecordKeys)
+{
+	int result;
+
+	while ((result = sqlite3_step(statement)) == SQLITE_ROW)
+	{
+		int deviceID = sqlite3_column_int(statement, 1);
+
+		if (validDevicesMap != nullptr && validDevicesMap->count(deviceID) == 0)
+			continue;	//Skip this device
+
+		std::map<long, NullEntry>& nullEntryMap = deviceNullRecordKeys[deviceID];
+
+		if ((int) nullEntryMap.size() >= m_nullEntriesMaxCount)
+			continue;
+
+		unsigned int entryPrimaryKey = sqlite3_column_int64(statement, 0);
+		unsigned int SDCounter = sqlite3_column_int64(statement, 2);
+		unsigned int insertedPrimaryKey = sqlite3_column_int64(statement, 3);
+		unsigned int requestCount = sqlite3_column_int64(statement, 4);
+
+		nullEntryMap.emplace(SDCounter, NullEntry(entryPrimaryKey, deviceID, SDCounter, insertedPrimaryKey, requestCount));
+	}
+
+	sqlite3_reset(statement);
+
+	if (result != SQLITE_DONE)
+		return logError("load null record information from table " + m_nullRecordsTable);
+
+	return true;
+}
+
+
+//*************************************************************************************************
+bool SQLiteStorage::loadEntriesFromNullTable(std::set<int>& deviceSet,
+					std::unordered_map< int, std::map<long, NullEntry> >& deviceNullRecordKeys)
+{
+	if (deviceSet.size() == 0)
+		return true;
+
+	if (m_database == nullptr)
+		return false;
+
+	BOOST_LOG_TRIVIAL(debug) << "Reloading null entries for following devices to in-memory map from table: " << m_nullRecordsTable;
+
+	for (int deviceID: deviceSet)
+	{
+		std::map<long, NullEntry>& nullEntryMap = deviceNullRecordKeys[deviceID];
+
+		long loadAmount = m_nullEntriesMaxCount - nullEntryMap.size();
+
+		if (loadAmount <= 0)
+			continue;
+
+		long lastInsertedPrimaryKey = 0;	//Default 0 if map is empty
+
+		if (nullEntryMap.size() > 0)
+			lastInsertedPrimaryKey = nullEntryMap.rbegin()->second.m_recordInsertedPrimaryKey;
+
+		sqlite3_bind_int(m_nullTableEntryLoadStatement, 1, deviceID);
+		sqlite3_bind_int64(m_nullTableEntryLoadStatement, 2, lastInsertedPrimaryKey);
+		sqlite3_bind_int64(m_nullTableEntryLoadStatement, 3, loadAmount);
+
+		if (readNullEntries(m_nullTableEntryLoadStatement, nullptr, deviceNullRecordKeys) == false)
+			return false;
+	}
+
+	return true;
+}
+
+
+//*************************************************************************************************
+bool SQLiteStorage::getDeviceIDs(std::string tableName, std::string deviceIDColumnName, std::unordered_map<int, long>& deviceLastCounterMap,
+										bool isReinitialize /*= false*/)
+{
+	BOOST_LOG_TRIVIAL(info) << "Reading device IDs from table: " << tableName << ", column: " << deviceIDColumnName;
+
+	StatementPtr statement(prepare("SELECT " + deviceIDColumnName + " FROM " + tableName + ";"), sqlite3_finalize);
+
+	if (!statement)
+		return false;
+
+	int result;
+
+	while ((result = sqlite3_step(statement.get())) == SQLITE_ROW)
+		deviceLastCounterMap.emplace(sqlite3_column_int(statement.get(), 0), 0);	//Add with zero last counter if not already in the map
+
+	if (result != SQLITE_DONE)
+		return logError("get device IDs from table " + tableName);
+
+	BOOST_LOG_TRIVIAL(info) << "Device IDs read from table " << tableName << " successfully";
+
+	if (isReinitialize)	//Return without retrieving max from main table
+		return true;
+
+	BOOST_LOG_TRIVIAL(info) << "Reading last counter of devices from table: " << m_table;
+
+	StatementPtr maxStatement(prepare("SELECT " + m_deviceIDColumn + ", MAX(" + m_recordCounterColumn + ") FROM " + m_table
+										+ " GROUP BY " + m_deviceIDColumn + ";"), sqlite3_finalize);
+
+	if (!maxStatement)
+		return false;
+
+	while ((result = sqlite3_step(maxStatement.get())) == SQLITE_ROW)
+	{
+		auto iter = deviceLastCounterMap.find(sqlite3_column_int(maxStatement.get(), 0));
+
+		if (iter != deviceLastCounterMap.end())	//Device was loaded from devices table
+			iter->second = sqlite3_column_int64(maxStatement.get(), 1);
+	}
+
+	if (result != SQLITE_DONE)
+		return logError("get last counter of devices from table " + m_table);
+
+	BOOST_LOG_TRIVIAL(info) << "Last counter of each device read from table " << m_table << " successfully";
+	return true;
+}
+
+
+//*************************************************************************************************
+bool SQLiteStorage::queryDeviceTableFingerprint(sqlite3* database, std::string tableName, std::string deviceIDColumnName,
+							DeviceTableFingerprint& fingerprint, std::vector<int>* deviceIDs)
+{
+	//SQLite has no BIT_XOR aggregate; the (local) table is read instead
+	sqlite3_stmt* statement = nullptr;
+
+	if (sqlite3_prepare_v2(database, ("SELECT " + deviceIDColumnName + " FROM " + tableName + ";").c_str(), -1, &statement, NULL) != SQLITE_OK)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed to get fingerprint of devices table: " << tableName;
+		BOOST_LOG_TRIVIAL(error) << "Error: " << sqlite3_errmsg(database);
+		return false;
+	}
+
+	StatementPtr statementPtr(statement, sqlite3_finalize);
+	DeviceTableFingerprint result{0, 0, 0};
+	int stepResult;
+
+	while ((stepResult = sqlite3_step(statement)) == SQLITE_ROW)
+	{
+		int deviceID = sqlite3_column_int(statement, 0);
+
+		++result.m_count;
+		result.m_idXor ^= deviceID;
+		result.m_maxID = std::max(result.m_maxID, (long) deviceID);
+
+		if (deviceIDs != nullptr)
+			deviceIDs->push_back(deviceID);
+	}
+
+	if (stepResult != SQLITE_DONE)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed when getting fingerprint of devices table: " << tableName;
+		BOOST_LOG_TRIVIAL(error) << "Error: " << sqlite3_errmsg(database);
+		return false;
+	}
+
+	fingerprint = result;
+	return true;
+}
+
+
+//*************************************************************************************************
+bool SQLiteStorage::getDeviceTableFingerprint(std::string tableName, std::string deviceIDColumnName, DeviceTableFingerprint& fingerprint)
+{
+	if (m_database == nullptr)
+		return false;
+
+	return queryDeviceTableFingerprint(m_database, tableName, deviceIDColumnName, fingerprint, nullptr);
+}
+
+
+//*************************************************************************************************
+DeviceTableScan SQLiteStorage::scanDeviceTable(std::string tableName, std::string deviceIDColumnName, DeviceTableFingerprint previousFingerprint)
+{
+	DeviceTableScan scan{false, false, false, previousFingerprint, std::vector<int>()};
+
+	//m_filename is not changed after initialize()
+	sqlite3* database = nullptr;
+
+	if (sqlite3_open_v2(m_filename.c_str(), &database, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed to open SQLite database: " << m_filename << " for scanning devices table: " << tableName;
+		BOOST_LOG_TRIVIAL(error) << "Error: " << (database != nullptr ? sqlite3_errmsg(database) : "out of memory");
+		sqlite3_close(database);
+		return scan;
+	}
+
+	sqlite3_busy_timeout(database, 5000);
+
+	std::vector<int> deviceIDs;
+
+	if (queryDeviceTableFingerprint(database, tableName, deviceIDColumnName, scan.m_fingerprint, &deviceIDs))
+	{
+		const DeviceTableFingerprint& fingerprint = scan.m_fingerprint;
+
+		//The full list is read anyway, so changes are always applied as a full list
+		if (fingerprint.m_count != previousFingerprint.m_count || fingerprint.m_idXor != previousFingerprint.m_idXor
+			|| fingerprint.m_maxID != previousFingerprint.m_maxID)
+		{
+			scan.m_isChanged = true;
+			scan.m_isFullList = true;
+			scan.m_deviceIDs = std::move(deviceIDs);
+		}
+
+		scan.m_isSuccessful = true;
+	}
+
+	sqlite3_close(database);
+	return scan;
+}
+
+
+//*************************************************************************************************
+bool SQLiteStorage::getLastCounters(std::unordered_map<int, long>& deviceLastCounterMap)
+{
+	if (m_database == nullptr)
+		return false;
+
+	//One index lookup per device on (device ID, counter)
+	for (auto& entry: deviceLastCounterMap)
+	{
+		sqlite3_bind_int(m_lastCounterStatement, 1, entry.first);
+
+		int result = sqlite3_step(m_lastCounterStatement);
+
+		if (result == SQLITE_ROW && sqlite3_column_type(m_lastCounterStatement, 0) != SQLITE_NULL)
+			entry.second = sqlite3_column_int64(m_lastCounterStatement, 0);
+
+		sqlite3_reset(m_lastCounterStatement);
+
+		if (result != SQLITE_ROW)
+			return logError("get last counters of " + std::to_string(deviceLastCounterMap.size()) + " devices from table " + m_table);
+	}
+
+	return true;
+}
+
+
+//*************************************************************************************************
+bool SQLiteStorage::getInitialNullRecordInfo(const std::unordered_map<int, long>& validDevicesMap,
+									std::unordered_map< int, std::map<long, NullEntry> >& deviceNullRecordKeys,
+									int devicesPerQuery, int connectionCount)
+{
+	BOOST_LOG_TRIVIAL(info) << "Retrieving null record information from table: " << m_nullRecordsTable << " for " << validDevicesMap.size() << " devices";
+
+	StatementPtr statement(prepare("SELECT " + m_nullRecTablePrimaryKeyColumn + "," + m_nullRecDeviceIDColumn + "," + m_nullRecRecordCounterColumn
+								+ "," + m_nullRecInsertedPrimaryKeyColumn + "," + m_nullRecRequestCountColumn + " FROM " + m_nullRecordsTable
+								+ " ORDER BY " + m_nullRecTablePrimaryKeyColumn + " ASC;"), sqlite3_finalize);
+
+	if (!statement || readNullEntries(statement.get(), &validDevicesMap, deviceNullRecordKeys) == false)
+		return false;
+
+	BOOST_LOG_TRIVIAL(info) << "Null record information read from table " << m_nullRecordsTable << " successfully";
+	return true;
+}
+
+
+//*************************************************************************************************
+bool SQLiteStorage::getTableWatermarks(long& mainTableWatermark, long& nullTableWatermark)
+{
+	StatementPtr mainStatement(prepare("SELECT MAX(" + m_primaryKeyColumn + ") FROM " + m_table + ";"), sqlite3_finalize);
+	StatementPtr nullStatement(prepare("SELECT MAX(" + m_nullRecTablePrimaryKeyColumn + ") FROM " + m_nullRecordsTable + ";"), sqlite3_finalize);
+
+	if (!mainStatement || !nullStatement)
+		return false;
+
+	if (sqlite3_step(mainStatement.get()) != SQLITE_ROW || sqlite3_step(nullStatement.get()) != SQLITE_ROW)
+		return logError("get watermarks of tables " + m_table + ", " + m_nullRecordsTable);
+
+	mainTableWatermark = sqlite3_column_int64(mainStatement.get(), 0);	//0 for NULL (empty table)
+	nullTableWatermark = sqlite3_column_int64(nullStatement.get(), 0);
+	return true;
+}
+
+
+//*************************************************************************************************
+bool SQLiteStorage::getLastCountersSince(long mainTableWatermark, std::unordered_map<int, long>& deviceLastCounterMap)
+{
+	BOOST_LOG_TRIVIAL(info) << "Reading last counter of devices from rows of table " << m_table << " written after primary key " << mainTableWatermark;
+
+	StatementPtr statement(prepare("SELECT " + m_deviceIDColumn + ", MAX(" + m_recordCounterColumn + ") FROM " + m_table + " WHERE "
+								+ m_primaryKeyColumn + ">? GROUP BY " + m_deviceIDColumn + ";"), sqlite3_finalize);
+
+	if (!statement)
+		return false;
+
+	sqlite3_bind_int64(statement.get(), 1, mainTableWatermark);
+
+	int updatedCount = 0;
+	int result;
+
+	while ((result = sqlite3_step(statement.get())) == SQLITE_ROW)
+	{
+		auto iter = deviceLastCounterMap.find(sqlite3_column_int(statement.get(), 0));
+		long lastCounter = sqlite3_column_int64(statement.get(), 1);
+
+		if (iter != deviceLastCounterMap.end() && lastCounter > iter->second)	//Device was loaded from devices table
+		{
+			iter->second = lastCounter;
+			++updatedCount;
+		}
+	}
+
+	if (result != SQLITE_DONE)
+		return logError("get last counter of devices from table " + m_table);
+
+	BOOST_LOG_TRIVIAL(info) << "Last counter updated for " << updatedCount << " devices from table " << m_table;
+	return true;
+}
+
+
+//*************************************************************************************************
+bool SQLiteStorage::getNullRecordInfoSince(long nullTableWatermark, const std::unordered_map<int, long>& validDevicesMap,
+									std::unordered_map< int, std::map<long, NullEntry> >& deviceNullRecordKeys)
+{
+	BOOST_LOG_TRIVIAL(info) << "Retrieving null record information from table " << m_nullRecordsTable << " written after primary key " << nullTableWatermark;
+
+	StatementPtr statement(prepare("SELECT " + m_nullRecTablePrimaryKeyColumn + "," + m_nullRecDeviceIDColumn + "," + m_nullRecRecordCounterColumn
+								+ "," + m_nullRecInsertedPrimaryKeyColumn + "," + m_nullRecRequestCountColumn + " FROM " + m_nullRecordsTable
+								+ " WHERE " + m_nullRecTablePrimaryKeyColumn + ">? ORDER BY " + m_nullRecTablePrimaryKeyColumn + " ASC;"), sqlite3_finalize);
+
+	if (!statement)
+		return false;
+
+	sqlite3_bind_int64(statement.get(), 1, nullTableWatermark);
+
+	if (readNullEntries(statement.get(), &validDevicesMap, deviceNullRecordKeys) == false)
+		return false;
+
+	BOOST_LOG_TRIVIAL(info) << "Null record information written after the snapshot read from table " << m_nullRecordsTable << " successfully";
+	return true;
+}
+
+
+//*************************************************************************************************
+std::string SQLiteStorage::getColumnType(const std::string& configType)
+{
+	//Column types of config DBTableColumnTypes as SQLite type affinities
+	if (configType == "int")
+		return "INTEGER";
+
+	if (configType == "float")
+		return "REAL";
+
+	return "TEXT";	//datetime, varchar
+}
+
+
+//*************************************************************************************************
+std::unique_ptr<StorageBackend> SQLiteStorage::createRecordWriter()
+{
+	return std::unique_ptr<StorageBackend>(new SQLiteStorage());
+}
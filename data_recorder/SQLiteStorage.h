@@ -0,0 +1,141 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <map>
+#include <set>
+
+#include <sqlite3.h>
+
+#include <StorageBackend.h>
+#include <NullEntry.h>
+
+/*
+This class manages an embedded SQLite database (config SQLiteDatabaseFilename), for sites where running a MySQL server is too heavy
+Tables (main, null records and devices tables with the configured names) are created if they do not exist; devices are provisioned
+by inserting their IDs into the devices table
+The database runs in WAL journal mode; each call is one transaction (or part of the unit of work's transaction), and records are
+written with prepared multi-row inserts
+*/
+class SQLiteStorage: public StorageBackend
+{
+public:
+	SQLiteStorage();
+	~SQLiteStorage();
+
+	virtual bool initialize(const StorageSchema& schema, bool isConnect = true);
+
+	virtual bool writeRecordBatch(std::vector< std::vector<std::string> >& recordBatch);
+
+	virtual bool insertNullRecords(int deviceID, long start, long end, std::vector<NullEntry>& insertedRecordInfoVec);
+
+	virtual bool insertEntriesToNullTable(std::vector<NullEntry>& insertedRecordInfoVec);
+
+	virtual bool updateRecordBatch(const std::unordered_map< long, std::vector<std::string> >& recordBatch);
+
+	virtual bool deleteNullEntryBatch(const std::vector<long>& nullEntryBatch);
+
+	virtual bool loadEntriesFromNullTable(std::set<int>& deviceSet,
+										std::unordered_map< int, std::map<long, NullEntry> >& deviceNullRecordKeys);
+
+	virtual bool getDeviceIDs(std::string tableName, std::string deviceIDColumnName, std::unordered_map<int, long>& deviceLastCounterMap,
+										bool isReinitialize = false);
+
+	virtual bool getDeviceTableFingerprint(std::string tableName, std::string deviceIDColumnName, DeviceTableFingerprint& fingerprint);
+
+	//Opens its own (read-only) connection; WAL mode lets it read while the event loop thread writes
+	virtual DeviceTableScan scanDeviceTable(std::string tableName, std::string deviceIDColumnName, DeviceTableFingerprint previousFingerprint);
+
+	virtual bool getLastCounters(std::unordered_map<int, long>& deviceLastCounterMap);
+
+	//Local database: all entries are read in one pass over the null records table (devicesPerQuery and connectionCount are not used)
+	virtual bool getInitialNullRecordInfo(const std::unordered_map<int, long>& validDevicesMap,
+							std::unordered_map< int, std::map<long, NullEntry> >& deviceNullRecordKeys,
+							int devicesPerQuery, int connectionCount);
+
+	virtual bool getTableWatermarks(long& mainTableWatermark, long& nullTableWatermark);
+
+	virtual bool getLastCountersSince(long mainTableWatermark, std::unordered_map<int, long>& deviceLastCounterMap);
+
+	virtual bool getNullRecordInfoSince(long nullTableWatermark, const std::unordered_map<int, long>& validDevicesMap,
+							std::unordered_map< int, std::map<long, NullEntry> >& deviceNullRecordKeys);
+
+	//Writers open their own connection to the database file; SQLite allows one writer at a time, so writers and the
+	//event loop thread wait for each other (busy timeout) and pipelining mainly overlaps the commit (sync) with other work
+	virtual std::unique_ptr<StorageBackend> createRecordWriter();
+
+	virtual bool beginUnitOfWork();
+	virtual bool commitUnitOfWork();
+	virtual void rollbackUnitOfWork();
+
+private:
+	//Helper functions
+	bool createTables();
+	bool prepareStatements();
+	void closeDatabase();
+
+	bool execute(const std::string& query);
+	sqlite3_stmt* prepare(const std::string& query);
+	bool logError(const std::string& operation);	//Always returns false
+
+	//BEGIN ... COMMIT around a call's statements; rollback on failure (no-ops within a unit of work)
+	bool beginTransaction();
+	bool commitTransaction();
+	void rollbackTransaction();
+
+	//Binds fields of a record (in column order) starting at parameter firstIndex; "NAN", "NULL", "INF" and "OVF" are bound as NULL
+	void bindRecord(sqlite3_stmt* statement, const std::vector<std::string>& record, int firstIndex);
+
+	//Reads rows of (entry primary key, device ID, counter, inserted primary key, request count) into the devices' maps,
+	//keeping at most m_nullEntriesMaxCount entries per device (devices not in validDevicesMap are skipped, if it is given)
+	bool readNullEntries(sqlite3_stmt* statement, const std::unordered_map<int, long>* validDevicesMap,
+							std::unordered_map< int, std::map<long, NullEntry> >& deviceNullRecordKeys);
+
+	static bool queryDeviceTableFingerprint(sqlite3* database, std::string tableName, std::string deviceIDColumnName,
+							DeviceTableFingerprint& fingerprint, std::vector<int>* deviceIDs);
+
+	static std::string getColumnType(const std::string& configType);
+
+	//Parameters
+	std::string m_filename;
+	std::string m_synchronousMode;
+	int m_rowsPerInsertStatement;
+
+	std::string m_table;	//Main data table
+	std::string m_primaryKeyColumn;
+	std::string m_recordCounterColumn;
+	std::string m_deviceIDColumn;
+	std::string m_dateTimeColumn;
+
+	std::string m_nullRecordsTable;
+	std::string m_nullRecTablePrimaryKeyColumn;
+	std::string m_nullRecInsertedPrimaryKeyColumn;
+	std::string m_nullRecDeviceIDColumn;
+	std::string m_nullRecRecordCounterColumn;
+	std::string m_nullRecRequestCountColumn;
+
+	std::string m_devicesTable;
+	std::string m_devicesTableIDColumn;
+
+	int m_nullEntriesMaxCount; //max. no. of null entries per device to keep in memory
+
+	int m_columnCount;
+	std::vector<std::string> m_columnNamesVec;
+	std::vector<std::string> m_columnTypesVec;
+	std::vector<int> m_recordPositionsVec;
+
+	sqlite3* m_database;
+
+	//Prepared statements (finalized in closeDatabase())
+	sqlite3_stmt* m_multiRowInsertStatement;	//m_rowsPerInsertStatement records
+	sqlite3_stmt* m_insertStatement;	//one record
+	sqlite3_stmt* m_nullInsertStatement;
+	sqlite3_stmt* m_nullUpdateStatement;
+	sqlite3_stmt* m_nullTableEntryInsertStatement;
+	sqlite3_stmt* m_nullTableEntryDeleteStatement;
+	sqlite3_stmt* m_nullTableEntryLoadStatement;
+	sqlite3_stmt* m_lastCounterStatement;
+
+	bool m_isInUnitOfWork;	//Between BEGIN and COMMIT of a unit of work
+};
@@ -0,0 +1,42 @@
+#include <StorageBackend.h>
+#include <InMemoryStorage.h>
+#include <Logger.h>
+
+#ifdef WITH_MYSQL
+#include <DatabaseStorage.h>
+#endif
+
+#ifdef WITH_SQLITE
+#include <SQLiteStorage.h>
+#endif
+
+
+//*************************************************************************************************
+std::unique_ptr<StorageBackend> createStorageBackend(const std::string& backendName)
+{
+	if (backendName == "mysql")
+	{
+#ifdef WITH_MYSQL
+		return std::unique_ptr<StorageBackend>(new DatabaseStorage());
+#else
+		BOOST_LOG_TRIVIAL(error) << "MySQL storage backend is not built (CMake option WITH_MYSQL is OFF)";
+		return nullptr;
+#endif
+	}
+
+	if (backendName == "sqlite")
+	{
+#ifdef WITH_SQLITE
+		return std::unique_ptr<StorageBackend>(new SQLiteStorage());
+#else
+		BOOST_LOG_TRIVIAL(error) << "SQLite storage backend is not built (CMake option WITH_SQLITE is OFF)";
+		return nullptr;
+#endif
+	}
+
+	if (backendName == "memory")
+		return std::unique_ptr<StorageBackend>(new InMemoryStorage());
+
+	BOOST_LOG_TRIVIAL(error) << "Unknown storage backend: " << backendName;
+	return nullptr;
+}
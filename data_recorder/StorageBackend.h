@@ -0,0 +1,129 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <map>
+#include <set>
+
+#include <NullEntry.h>
+
+//Summary of the devices table, used to detect changes without transferring device IDs
+struct DeviceTableFingerprint
+{
+	long m_count;	//-1 = unknown
+	long m_idXor;
+	long m_maxID;
+};
+
+//Result of scanning the devices table for changes
+struct DeviceTableScan
+{
+	bool m_isSuccessful;
+	bool m_isChanged;
+	bool m_isFullList;	//true: m_deviceIDs holds all devices, false: only devices added after the previous scan
+	DeviceTableFingerprint m_fingerprint;
+	std::vector<int> m_deviceIDs;
+};
+
+//Main table and null records table structure (from DBTable* and NullRec* configs)
+struct StorageSchema
+{
+	std::string m_table;	//Main data table
+	std::string m_primaryKeyColumn;
+	std::string m_recordCounterColumn;
+	std::string m_deviceIDColumn;
+	std::string m_dateTimeColumn;
+
+	int m_columnCount;
+	std::vector<std::string> m_columnNames;
+	std::vector<std::string> m_columnTypes;
+	std::vector<int> m_recordPositions;
+
+	std::string m_nullRecordsTable;
+	std::string m_nullRecTablePrimaryKeyColumn;
+	std::string m_nullRecInsertedPrimaryKeyColumn;
+	std::string m_nullRecDeviceIDColumn;
+	std::string m_nullRecRecordCounterColumn;
+	std::string m_nullRecRequestCountColumn;
+
+	int m_nullEntriesMaxCount;	//max. no. of null entries per device to keep in memory
+};
+
+/*
+This class is the interface of the storage behind DataStorage: the main table (records and the NULL records of gaps),
+the null records table (one entry per NULL record that is yet to be received) and the devices table
+Backends are selected by config StorageBackend (see createStorageBackend()); all functions except scanDeviceTable() are called on the event loop thread
+*/
+class StorageBackend
+{
+public:
+	virtual ~StorageBackend() {}
+
+	//isConnect=false: only queries are prepared (no connection to the storage), eg: for benchmarks
+	virtual bool initialize(const StorageSchema& schema, bool isConnect = true) = 0;
+
+	//On failure, recordBatch holds the records that were not written (a backend that commits parts of the batch separately
+	//removes the committed records, so that they are not written again when the remaining records are retried)
+	virtual bool writeRecordBatch(std::vector< std::vector<std::string> >& recordBatch) = 0;
+
+	//Inserts NULL records for counters [start, end) of the device; an entry (with the inserted primary key) is added to
+	//insertedRecordInfoVec for each, also when a later insert fails
+	virtual bool insertNullRecords(int deviceID, long start, long end, std::vector<NullEntry>& insertedRecordInfoVec) = 0;
+
+	virtual bool insertEntriesToNullTable(std::vector<NullEntry>& insertedRecordInfoVec) = 0;
+
+	//Overwrites NULL records with received records (key = NULL record's primary key)
+	virtual bool updateRecordBatch(const std::unordered_map< long, std::vector<std::string> >& recordBatch) = 0;
+
+	//Deletes null records table entries by the NULL record's primary key
+	virtual bool deleteNullEntryBatch(const std::vector<long>& nullEntryBatch) = 0;
+
+	//Tops up each given device's in-memory null entries to the max. count, with entries after the last loaded one
+	virtual bool loadEntriesFromNullTable(std::set<int>& deviceSet,
+										std::unordered_map< int, std::map<long, NullEntry> >& deviceNullRecordKeys) = 0;
+
+	//Adds devices of the devices table with zero last counter; then (unless isReinitialize) sets each device's largest counter in the main table
+	virtual bool getDeviceIDs(std::string tableName, std::string deviceIDColumnName, std::unordered_map<int, long>& deviceLastCounterMap,
+										bool isReinitialize = false) = 0;
+
+	virtual bool getDeviceTableFingerprint(std::string tableName, std::string deviceIDColumnName, DeviceTableFingerprint& fingerprint) = 0;
+
+	//Called on a worker thread (while the event loop thread keeps using the backend)
+	virtual DeviceTableScan scanDeviceTable(std::string tableName, std::string deviceIDColumnName, DeviceTableFingerprint previousFingerprint) = 0;
+
+	//Last counters of the given devices only (map keys)
+	virtual bool getLastCounters(std::unordered_map<int, long>& deviceLastCounterMap) = 0;
+
+	//Loads at most the max. no. of null entries per device; devicesPerQuery and connectionCount are hints for parallel loading
+	virtual bool getInitialNullRecordInfo(const std::unordered_map<int, long>& validDevicesMap,
+							std::unordered_map< int, std::map<long, NullEntry> >& deviceNullRecordKeys,
+							int devicesPerQuery, int connectionCount) = 0;
+
+	//For reconciling a device state snapshot with rows written after it (watermark = largest primary key at snapshot time)
+	virtual bool getTableWatermarks(long& mainTableWatermark, long& nullTableWatermark) = 0;
+
+	virtual bool getLastCountersSince(long mainTableWatermark, std::unordered_map<int, long>& deviceLastCounterMap) = 0;
+
+	virtual bool getNullRecordInfoSince(long nullTableWatermark, const std::unordered_map<int, long>& validDevicesMap,
+							std::unordered_map< int, std::map<long, NullEntry> >& deviceNullRecordKeys) = 0;
+
+	//Pipelined record writes (see PipelinedRecordWriter): a new, uninitialized instance over the same storage, whose
+	//writeRecordBatch() is called on a writer thread while this instance is used on the event loop thread
+	virtual std::unique_ptr<StorageBackend> createRecordWriter() = 0;
+
+	//Called on a writer thread before its first and after its last call to the backend (eg: per-thread client library state)
+	virtual void initializeThread() {}
+	virtual void finalizeThread() {}
+
+	//Unit of work: the writes between beginUnitOfWork() and commitUnitOfWork() are committed together, in one transaction
+	//After a failed write or commit, rollbackUnitOfWork() discards all of them (so a failed writeRecordBatch() in a unit of work
+	//leaves recordBatch unchanged, and entries that insertNullRecords() added before failing must be dropped by the caller)
+	virtual bool beginUnitOfWork() = 0;
+	virtual bool commitUnitOfWork() = 0;
+	virtual void rollbackUnitOfWork() = 0;
+};
+
+//backendName: "mysql" (DatabaseStorage), "sqlite" (SQLiteStorage) or "memory" (InMemoryStorage); nullptr if unknown (or not built)
+std::unique_ptr<StorageBackend> createStorageBackend(const std::string& backendName);
@@ -0,0 +1,496 @@
+#include <time.h>
+#include <cstdlib>
+#include <climits>
+#include <new>
+#include <iostream>
+#include <iomanip>
+#include <unordered_map>
+
+#include <IngestBenchmark.h>
+#include <ConfigurationHandler.h>
+#include <Logger.h>
+
+#ifdef WITH_MYSQL
+#include <DatabaseStorage.h>
+#endif
+
+//Heap allocations of the whole program are counted (the benchmarks run on a single thread)
+static unsigned long s_allocationCount = 0;
+
+
+//*************************************************************************************************
+void* operator new(size_t size)
+{
+	++s_allocationCount;
+
+	void* memory = malloc(size == 0 ? 1 : size);
+	if (memory == NULL)
+		throw std::bad_alloc();
+
+	return memory;
+}
+
+
+//*************************************************************************************************
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+
+//*************************************************************************************************
+void operator delete(void* memory) noexcept
+{
+	free(memory);
+}
+
+
+//*************************************************************************************************
+void operator delete[](void* memory) noexcept
+{
+	free(memory);
+}
+
+
+//*************************************************************************************************
+static long long getMonotonicTimeNs()
+{
+	struct timespec timeSpec;
+	clock_gettime(CLOCK_MONOTONIC, &timeSpec);
+	return (long long) timeSpec.tv_sec * 1000000000 + timeSpec.tv_nsec;
+}
+
+
+//*************************************************************************************************
+IngestBenchmark::IngestBenchmark():
+	m_recordCount{0},
+	m_deviceCount{0},
+	m_firstDeviceID{100000},
+	m_firstCounter{1000},
+	m_receivedRecordCount{0},
+	m_startTimeNs{0},
+	m_startAllocationCount{0}
+{
+}
+
+
+//*************************************************************************************************
+unsigned long IngestBenchmark::getAllocationCount()
+{
+	return s_allocationCount;
+}
+
+
+//*************************************************************************************************
+bool IngestBenchmark::initialize(int recordCount, int deviceCount)
+{
+	ConfigurationHandler& configHandler = ConfigurationHandler::getInstance();
+
+	m_deviceCount = deviceCount;
+	m_recordCount = recordCount - recordCount % deviceCount;	//Same no. of records for each device
+
+	if (m_recordCount == 0)
+	{
+		std::cout << "Record count must be at least the device count" << std::endl;
+		return false;
+	}
+
+	//Record structure and queries only (no database or file)
+	if (m_dataStorage.initialize(false) == false)
+	{
+		std::cout << "Error initializing data storage (record structure configs)" << std::endl;
+		return false;
+	}
+
+	try
+	{
+		if (!m_encoder.initialize(configHandler.getConfig("DataRecordType"), std::stoi(configHandler.getConfig("BinaryDataSize"))))
+		{
+			std::cout << "Invalid DataRecordType or BinaryDataSize config" << std::endl;
+			return false;
+		}
+
+		m_socketMan.setReceiveBufferSize(std::stoi(configHandler.getConfig("ReceiveBufferSize")));
+		m_socketMan.setBufferedMessageHardLimit(std::stoi(configHandler.getConfig("BufferedMessageHardLimit")));
+	}
+	catch (std::exception &e)
+	{
+		std::cout << "Error reading integer configs: " << e.what() << std::endl;
+		return false;
+	}
+
+	m_socketMan.setMsgTerminationCharacter(configHandler.getTerminationCharacter());
+
+	//Frames with plausible, varying values (record n of each device has counter first counter + n)
+	int frameSize = m_encoder.getFrameSize();
+	int recordsPerDevice = m_recordCount / m_deviceCount;
+	time_t startTime = time(0) - recordsPerDevice * 60;
+
+	m_frameStream.resize((size_t) m_recordCount * frameSize);
+
+	for (int n = 0; n < recordsPerDevice; ++n)
+	{
+		for (int i = 0; i < m_deviceCount; ++i)
+		{
+			unsigned char* frame = reinterpret_cast<unsigned char*>(&m_frameStream[((size_t) n * m_deviceCount + i) * frameSize]);
+			m_encoder.clearFrame(frame);
+
+			for (auto& field: m_encoder.getLayout().getFields())
+			{
+				int position = field.m_valuePosition;
+
+				if (field.m_type == FrameLayout::FIELD_FLOAT)
+					m_encoder.setValue(frame, position, 100 + (i + position) % 150 + n * 0.125 + position * 0.01);
+				else if (field.m_type == FrameLayout::FIELD_DATE_TIME)
+					m_encoder.setValue(frame, position, startTime + n * 60);
+				else if (field.m_type != FrameLayout::FIELD_SKIP)
+					m_encoder.setValue(frame, position, (i + position) % 100);
+			}
+
+			m_encoder.setValue(frame, m_dataStorage.m_deviceIDPosition, m_firstDeviceID + i);
+			m_encoder.setValue(frame, m_dataStorage.m_counterPosition, m_firstCounter + n);
+			m_encoder.finalizeFrame(frame);
+		}
+	}
+
+	//Decoded records with sender IP and received time amended, as passed to DataStorage::validateAndWriteRecord() by the service
+	std::vector<char> buffer(m_frameStream);
+	std::string decodedData = m_socketMan.decodeMsg(-1, &buffer);
+	char terminationCharacter = configHandler.getTerminationCharacter();
+	char receivedTime[32];
+	time_t now = time(0);
+	strftime(receivedTime, sizeof(receivedTime), "%Y/%m/%d %H:%M:%S", localtime(&now));
+	std::string amendedFields = std::string(", 127.0.0.1, ") + receivedTime;
+
+	size_t recordStart = 0;
+	size_t recordEnd;
+	while ((recordEnd = decodedData.find(terminationCharacter, recordStart)) != std::string::npos)
+	{
+		m_records.push_back(decodedData.substr(recordStart, recordEnd - recordStart) + amendedFields);
+		recordStart = recordEnd + 1;
+	}
+
+	if ((int) m_records.size() != m_recordCount)
+	{
+		std::cout << "Generated frames did not decode (" << m_records.size() << " of " << m_recordCount << " records)" << std::endl;
+		return false;
+	}
+
+	//Records must take the write path (not rejection) for the benchmarks to be meaningful
+	std::pair<long, int> ackContent;
+	resetDeviceState(m_firstCounter - 1);
+
+	if (m_dataStorage.validateAndWriteRecord(m_records[0], ackContent) != 1)
+	{
+		std::cout << "Generated records are rejected; check DeviceRecordPositions, DeviceIDRecordPosition and CounterRecordPosition" << std::endl;
+		return false;
+	}
+
+	resetDeviceState(m_firstCounter - 1);
+
+	std::cout << "Records: " << m_recordCount << ", devices: " << m_deviceCount << ", frame size: " << frameSize << " bytes" << std::endl;
+	std::cout << "Sample record: " << m_records[0] << std::endl << std::endl;
+	return true;
+}
+
+
+//*************************************************************************************************
+void IngestBenchmark::run()
+{
+	benchmarkDecodeMsg();
+	benchmarkParseReceivedData();
+	benchmarkSplitString();
+	benchmarkInOrderRecords();
+	benchmarkOutOfOrderRecords();
+	benchmarkPastRecords();
+	benchmarkGenerateACK();
+#ifdef WITH_MYSQL
+	benchmarkQueryBuilding();
+#endif
+}
+
+
+//*************************************************************************************************
+void IngestBenchmark::OnData(ServerSocket* server, ClientSocket* client, std::string message)
+{
+	++m_receivedRecordCount;
+}
+
+
+//*************************************************************************************************
+void IngestBenchmark::benchmarkDecodeMsg()
+{
+	//As many frames per call as fit in the receive buffer
+	size_t frameSize = m_encoder.getFrameSize();
+	size_t chunkSize = std::max((size_t) m_socketMan.m_receiveBufferSize / frameSize, (size_t) 1) * frameSize;
+
+	std::vector<char> buffer;
+	buffer.reserve(chunkSize);
+	long recordCount = 0;
+
+	startMeasurement();
+
+	for (size_t offset = 0; offset + chunkSize <= m_frameStream.size(); offset += chunkSize)
+	{
+		buffer.assign(m_frameStream.begin() + offset, m_frameStream.begin() + offset + chunkSize);
+		std::string decodedData = m_socketMan.decodeMsg(-1, &buffer);
+		recordCount += chunkSize / frameSize;
+	}
+
+	stopMeasurement("SocketManager::decodeMsg (" + std::to_string(chunkSize / frameSize) + " frames per call)", recordCount);
+}
+
+
+//*************************************************************************************************
+void IngestBenchmark::benchmarkParseReceivedData()
+{
+	//A peer connection without a socket (parseReceivedData() does not read or write the FD)
+	const int socketFD = INT_MAX;
+	char remoteIP[] = "127.0.0.1";
+	m_socketMan.m_peerClientSockets[socketFD] = new ClientSocket(2, socketFD, &m_socketMan, this, remoteIP, -1, 0, 0, nullptr);
+
+	//Reads of the receive buffer size, and reads that split frames (reassembled from the connection's buffer)
+	int readSize = m_socketMan.m_receiveBufferSize;
+
+	for (int size: {readSize, readSize * 3 / 4 + 1})
+	{
+		m_receivedRecordCount = 0;
+
+		startMeasurement();
+
+		for (size_t offset = 0; offset < m_frameStream.size(); offset += size)
+		{
+			int length = std::min((size_t) size, m_frameStream.size() - offset);
+			m_socketMan.parseReceivedData(socketFD, &m_frameStream[offset], length);
+		}
+
+		stopMeasurement("SocketManager::parseReceivedData (" + std::to_string(size) + " byte reads)", m_receivedRecordCount);
+	}
+
+	m_socketMan.removeClientSocket(socketFD);
+}
+
+
+//*************************************************************************************************
+void IngestBenchmark::benchmarkSplitString()
+{
+	startMeasurement();
+
+	for (auto& record: m_records)
+		std::vector<std::string> values = m_dataStorage.splitString(record, ',');
+
+	stopMeasurement("DataStorage::splitString", m_records.size());
+}
+
+
+//*************************************************************************************************
+void IngestBenchmark::benchmarkInOrderRecords()
+{
+	resetDeviceState(m_firstCounter - 1);
+	std::pair<long, int> ackContent;
+
+	startMeasurement();
+
+	for (auto& record: m_records)
+	{
+		m_dataStorage.validateAndWriteRecord(record, ackContent);
+
+		//The service writes the cache at this size (emulated without the database)
+		if (m_dataStorage.m_cachedRecordCount >= m_dataStorage.m_cacheWriteThreshold)
+		{
+			m_dataStorage.m_recordCache.clear();
+			m_dataStorage.m_cachedRecordCount = 0;
+		}
+	}
+
+	stopMeasurement("DataStorage::validateAndWriteRecord (in-order)", m_records.size());
+}
+
+
+//*************************************************************************************************
+void IngestBenchmark::benchmarkOutOfOrderRecords()
+{
+	//First record of each device is missing, so all others are out-of-order; they are not written with nulls
+	//(that needs the database), so each device's out-of-order store grows to (records per device - 1)
+	resetDeviceState(m_firstCounter - 1);
+	int nullWriteThreshold = m_dataStorage.m_nullWriteThreshold;
+	m_dataStorage.m_nullWriteThreshold = INT_MAX;
+	std::pair<long, int> ackContent;
+
+	startMeasurement();
+
+	for (size_t i = m_deviceCount; i < m_records.size(); ++i)
+		m_dataStorage.validateAndWriteRecord(m_records[i], ackContent);
+
+	stopMeasurement("DataStorage::validateAndWriteRecord (out-of-order)", m_records.size() - m_deviceCount);
+
+	m_dataStorage.m_nullWriteThreshold = nullWriteThreshold;
+}
+
+
+//*************************************************************************************************
+void IngestBenchmark::benchmarkPastRecords()
+{
+	//All records were written as nulls before; each one is added to the null update cache
+	resetDeviceState(m_firstCounter + m_recordCount / m_deviceCount);
+	unsigned int primaryKey = 1;
+
+	for (int i = 0; i < m_deviceCount; ++i)
+	{
+		std::map<long, NullEntry>& nullEntries = m_dataStorage.m_deviceNullRecordKeys[m_firstDeviceID + i];
+
+		for (long counter = m_firstCounter; counter < m_firstCounter + m_recordCount / m_deviceCount; ++counter)
+			nullEntries[counter] = NullEntry(m_firstDeviceID + i, counter, primaryKey++, 0);
+	}
+
+	std::pair<long, int> ackContent;
+
+	startMeasurement();
+
+	for (auto& record: m_records)
+	{
+		m_dataStorage.validateAndWriteRecord(record, ackContent);
+
+		//The service writes the update cache at this size (emulated without the database)
+		if (m_dataStorage.m_cachedNullUpdateCount >= m_dataStorage.m_updateCacheThreshold)
+		{
+			m_dataStorage.m_nullUpdateCache.clear();
+			m_dataStorage.m_cachedNullUpdateCount = 0;
+		}
+	}
+
+	stopMeasurement("DataStorage::validateAndWriteRecord (past, null-written)", m_records.size());
+
+	resetDeviceState(m_firstCounter - 1);
+}
+
+
+//*************************************************************************************************
+void IngestBenchmark::benchmarkGenerateACK()
+{
+	long lastCounter = m_firstCounter + m_recordCount / m_deviceCount;
+	std::pair<long, int> ackContent;
+
+	//Simple ACK (no records to request)
+	resetDeviceState(lastCounter);
+
+	startMeasurement();
+
+	for (int n = 0; n < m_recordCount; ++n)
+	{
+		int deviceID = m_firstDeviceID + n % m_deviceCount;
+		m_dataStorage.generateACK(deviceID, lastCounter, lastCounter, ackContent);
+	}
+
+	stopMeasurement("DataStorage::generateACK (simple)", m_recordCount);
+
+	//Each device has a range of null entries to request (request counts are not limited, so entries are not deleted)
+	const int nullEntryCount = 10;
+	int maxNullRecordRequestCount = m_dataStorage.m_maxNullRecordRequestCount;
+	m_dataStorage.m_maxNullRecordRequestCount = INT_MAX;
+
+	for (int i = 0; i < m_deviceCount; ++i)
+	{
+		for (int k = 0; k < nullEntryCount; ++k)
+			m_dataStorage.m_deviceNullRecordKeys[m_firstDeviceID + i][m_firstCounter + k] = NullEntry(m_firstDeviceID + i, m_firstCounter + k, k + 1, 0);
+	}
+
+	startMeasurement();
+
+	for (int n = 0; n < m_recordCount; ++n)
+	{
+		int deviceID = m_firstDeviceID + n % m_deviceCount;
+		m_dataStorage.generateACK(deviceID, lastCounter, lastCounter, ackContent);
+	}
+
+	stopMeasurement("DataStorage::generateACK (" + std::to_string(nullEntryCount) + " null entries requested)", m_recordCount);
+
+	m_dataStorage.m_maxNullRecordRequestCount = maxNullRecordRequestCount;
+	resetDeviceState(m_firstCounter - 1);
+}
+
+
+#ifdef WITH_MYSQL
+//*************************************************************************************************
+void IngestBenchmark::benchmarkQueryBuilding()
+{
+	//Queries are prepared from the data recorder's storage schema (no database connection)
+	DatabaseStorage dbStorage;
+	if (dbStorage.initialize(m_dataStorage.m_storageSchema, false) == false)
+		return;
+
+	//Batches of the sizes the service writes, built from the first records (reused in turn)
+	int insertBatchSize = std::max(m_dataStorage.m_cacheWriteThreshold, 1);
+	int updateBatchSize = std::max(m_dataStorage.m_updateCacheThreshold, 1);
+	const int batchPoolSize = 64;
+
+	std::vector< std::vector< std::vector<std::string> > > insertBatches(batchPoolSize);
+	std::vector< std::unordered_map< long, std::vector<std::string> > > updateBatches(batchPoolSize);
+	size_t recordIndex = 0;
+
+	for (int b = 0; b < batchPoolSize; ++b)
+	{
+		for (int k = 0; k < insertBatchSize; ++k, ++recordIndex)
+			insertBatches[b].push_back(m_dataStorage.splitString(m_records[recordIndex % m_records.size()], ','));
+
+		for (int k = 0; k < updateBatchSize; ++k, ++recordIndex)
+			updateBatches[b][recordIndex] = m_dataStorage.splitString(m_records[recordIndex % m_records.size()], ',');
+	}
+
+	long recordCount = 0;
+	startMeasurement();
+
+	for (int n = 0; recordCount < m_recordCount; ++n, recordCount += insertBatchSize)
+		std::string query = dbStorage.buildInsertQuery(insertBatches[n % batchPoolSize]);
+
+	stopMeasurement("DatabaseStorage::buildInsertQuery (" + std::to_string(insertBatchSize) + " records per batch)", recordCount);
+
+	recordCount = 0;
+	startMeasurement();
+
+	for (int n = 0; recordCount < m_recordCount; ++n, recordCount += updateBatchSize)
+		std::string query = dbStorage.buildUpdateQuery(updateBatches[n % batchPoolSize]);
+
+	stopMeasurement("DatabaseStorage::buildUpdateQuery (" + std::to_string(updateBatchSize) + " records per batch)", recordCount);
+}
+#endif
+
+
+//*************************************************************************************************
+void IngestBenchmark::resetDeviceState(long lastCounter)
+{
+	m_dataStorage.m_deviceLastCounterInDBMap.clear();
+
+	for (int i = 0; i < m_deviceCount; ++i)
+		m_dataStorage.m_deviceLastCounterInDBMap[m_firstDeviceID + i] = lastCounter;
+
+	m_dataStorage.m_deviceOutOfOrderStore.clear();
+	m_dataStorage.m_deviceNullRecordKeys.clear();
+	m_dataStorage.m_recordCache.clear();
+	m_dataStorage.m_cachedRecordCount = 0;
+	m_dataStorage.m_nullUpdateCache.clear();
+	m_dataStorage.m_cachedNullUpdateCount = 0;
+}
+
+
+//*************************************************************************************************
+void IngestBenchmark::startMeasurement()
+{
+	m_startAllocationCount = s_allocationCount;
+	m_startTimeNs = getMonotonicTimeNs();
+}
+
+
+//*************************************************************************************************
+void IngestBenchmark::stopMeasurement(const std::string& name, long recordCount)
+{
+	long long elapsedNs = getMonotonicTimeNs() - m_startTimeNs;
+	unsigned long allocationCount = s_allocationCount - m_startAllocationCount;
+
+	if (recordCount == 0)
+		recordCount = 1;
+
+	std::cout << std::left << std::setw(70) << name << std::right << std::fixed << std::setprecision(1)
+				<< std::setw(10) << (double) elapsedNs / recordCount << " ns/record"
+				<< std::setw(10) << std::setprecision(2) << (double) allocationCount / recordCount << " allocations/record" << std::endl;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <SocketCommunication.h>
+#include <DataStorage.h>
+#include <FrameEncoder.h>
+
+/*
+This class runs microbenchmarks of the ingest hot path (frame decoding and reassembly, record validation, ACK generation
+and batch query building) in process, without sockets or a database
+Frames and records are generated for a set of devices from the data recorder configuration (DataRecordType, DBTable* configs, ...)
+Each benchmark reports time and heap allocations (operator new calls) per record
+*/
+class IngestBenchmark: public SocketCallback
+{
+public:
+	IngestBenchmark();
+	~IngestBenchmark() {}
+
+	bool initialize(int recordCount, int deviceCount);
+	void run();
+
+	//Server side OnData of parseReceivedData()
+	void OnData(ServerSocket* server, ClientSocket* client, std::string message) override;
+
+	static unsigned long getAllocationCount();
+
+private:
+	void benchmarkDecodeMsg();
+	void benchmarkParseReceivedData();
+	void benchmarkSplitString();
+	void benchmarkInOrderRecords();
+	void benchmarkOutOfOrderRecords();
+	void benchmarkPastRecords();
+	void benchmarkGenerateACK();
+	void benchmarkQueryBuilding();
+
+	//Sets every device's last counter (clears all other device state)
+	void resetDeviceState(long lastCounter);
+
+	void startMeasurement();
+	void stopMeasurement(const std::string& name, long recordCount);
+
+	SocketManager m_socketMan;
+	DataStorage m_dataStorage;
+	FrameEncoder m_encoder;
+
+	int m_recordCount;
+	int m_deviceCount;
+	int m_firstDeviceID;
+	long m_firstCounter;
+
+	//Frames of all records (device i's n-th record is record n * device count + i), their decoded records and split values
+	std::vector<char> m_frameStream;
+	std::vector<std::string> m_records;
+	std::vector< std::vector<std::string> > m_splitRecords;
+
+	long m_receivedRecordCount;
+
+	long long m_startTimeNs;
+	unsigned long m_startAllocationCount;
+};
@@ -0,0 +1,53 @@
+//Standard C++ headers
+#include <iostream>
+#include <string>
+
+//Project headers
+#include <IngestBenchmark.h>
+#include <ConfigurationHandler.h>
+#include <Logger.h>
+
+
+int main(int argc, char* argv[])
+{
+	int recordCount = 100000;
+	int deviceCount = 1000;
+
+	if (argc < 2)
+	{
+		std::cout << "Usage: ingest_benchmark <config_filename> [record_count] [device_count]" << std::endl;
+		return -1;
+	}
+
+	if (argc > 2)
+	{
+		recordCount = std::stoi(argv[2]);
+	}
+
+	if (argc > 3)
+	{
+		deviceCount = std::stoi(argv[3]);
+	}
+
+	//Data recorder configuration (record structure, frame layout, cache thresholds)
+	ConfigurationHandler& configHandler = ConfigurationHandler::getInstance();
+	if (configHandler.loadConfigurations(argv[1]) == false || configHandler.verifyConfigurations() == false)
+	{
+		std::cout << "Error loading configurations; exiting..." << std::endl;
+		return -1;
+	}
+
+	//Warnings only: debug and trace statements cost their severity check, as in production
+	initializeLog(2, 10, 2, "ingest_benchmark_log");
+
+	IngestBenchmark benchmark;
+
+	if (benchmark.initialize(recordCount, deviceCount) == false)
+	{
+		std::cout << "Error initializing benchmark; exiting..." << std::endl;
+		return -1;
+	}
+
+	benchmark.run();
+	return 0;
+}
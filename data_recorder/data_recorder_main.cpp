@@ -56,27 +56,33 @@ int main(int argc, char* argv[])
 	BOOST_LOG_TRIVIAL(info) << "======================================================================";
 
 
-	//Initialize storage
-	DataStorage dataStorage;
-	if (dataStorage.initialize() == false)
-	{
-		BOOST_LOG_TRIVIAL(error) << "Error initializing storage media; exiting ePro data recording program";
-		return 10;
-	}
-	
-
 	//Initialize data recorder service
+	//This is done before initializing storage since a running instance flushes its state when handing off its server socket
 	DataRecorderService dataRecorder;
 	if (dataRecorder.initialize() == false)
 	{
 		BOOST_LOG_TRIVIAL(error) << "Error initializing data recorder service; exiting ePro data recording program";
 		return 10;
 	}
+
+	//Initialize storage
+	DataStorage dataStorage;
+	if (dataStorage.initialize() == false)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Error initializing storage media; exiting ePro data recording program";
+		return 10;
+	}
 	dataRecorder.setDataStorage(&dataStorage);
 
 	//Run data recorder service
 	dataRecorder.enterRunLoop();
 
+	if (dataRecorder.isHandedOff())
+	{
+		BOOST_LOG_TRIVIAL(info) << "Exiting ePro data recording program (server socket was handed off to a new process)";
+		return 11;
+	}
+
 	BOOST_LOG_TRIVIAL(warning) << "Exiting ePro data recording program (which shouldn't happen!)";
 
 	return 0;
@@ -0,0 +1,128 @@
+#include <sstream>
+#include <algorithm>
+
+#include <LatencyHistogram.h>
+
+
+//*************************************************************************************************
+LatencyHistogram::LatencyHistogram():
+	m_counts(SUB_BUCKET_COUNT + (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT, 0),
+	m_count{0},
+	m_sum{0},
+	m_min{0},
+	m_max{0}
+{
+}
+
+
+//*************************************************************************************************
+void LatencyHistogram::record(int64_t valueUs)
+{
+	if (valueUs < 0)
+		valueUs = 0;
+
+	++m_counts[getBucketIndex(valueUs)];
+
+	if (m_count == 0 || valueUs < m_min)
+		m_min = valueUs;
+
+	if (valueUs > m_max)
+		m_max = valueUs;
+
+	++m_count;
+	m_sum += valueUs;
+}
+
+
+//*************************************************************************************************
+void LatencyHistogram::add(const LatencyHistogram& other)
+{
+	if (other.m_count == 0)
+		return;
+
+	for (size_t i = 0; i < m_counts.size(); ++i)
+		m_counts[i] += other.m_counts[i];
+
+	if (m_count == 0 || other.m_min < m_min)
+		m_min = other.m_min;
+
+	m_max = std::max(m_max, other.m_max);
+	m_count += other.m_count;
+	m_sum += other.m_sum;
+}
+
+
+//*************************************************************************************************
+void LatencyHistogram::reset()
+{
+	std::fill(m_counts.begin(), m_counts.end(), 0);
+	m_count = 0;
+	m_sum = 0;
+	m_min = 0;
+	m_max = 0;
+}
+
+
+//*************************************************************************************************
+int64_t LatencyHistogram::getPercentile(double percentile) const
+{
+	if (m_count == 0)
+		return 0;
+
+	//Rank of the value at the percentile (1 based)
+	unsigned long long rank = std::max(1ULL, (unsigned long long) (percentile / 100 * m_count + 0.5));
+	unsigned long long cumulativeCount = 0;
+
+	for (size_t i = 0; i < m_counts.size(); ++i)
+	{
+		cumulativeCount += m_counts[i];
+
+		if (cumulativeCount >= rank)
+			return std::min(getBucketUpperValue(i), m_max);
+	}
+
+	return m_max;
+}
+
+
+//*************************************************************************************************
+std::string LatencyHistogram::getSummary() const
+{
+	std::ostringstream summary;
+	summary << "count = " << m_count << ", mean = " << (int64_t) getMean() << " us, p50 = " << getPercentile(50)
+			<< " us, p99 = " << getPercentile(99) << " us, p99.9 = " << getPercentile(99.9) << " us, max = " << m_max << " us";
+	return summary.str();
+}
+
+
+//*************************************************************************************************
+int LatencyHistogram::getBucketIndex(int64_t value)
+{
+	if (value < SUB_BUCKET_COUNT)
+		return value;
+
+	int64_t maxValue = ((int64_t) 1 << MAX_VALUE_BITS) - 1;
+	if (value > maxValue)
+		value = maxValue;
+
+	//Power of two range of the value, then the sub-bucket within it
+	int exponent = 63 - __builtin_clzll(value);
+	int shift = exponent - SUB_BUCKET_BITS;
+	int subBucket = (value >> shift) - SUB_BUCKET_COUNT;
+
+	return SUB_BUCKET_COUNT + shift * SUB_BUCKET_COUNT + subBucket;
+}
+
+
+//*************************************************************************************************
+int64_t LatencyHistogram::getBucketUpperValue(int index)
+{
+	if (index < SUB_BUCKET_COUNT)
+		return index;
+
+	int shift = (index - SUB_BUCKET_COUNT) / SUB_BUCKET_COUNT;
+	int subBucket = (index - SUB_BUCKET_COUNT) % SUB_BUCKET_COUNT;
+	int64_t lowerValue = (int64_t) (SUB_BUCKET_COUNT + subBucket) << shift;
+
+	return lowerValue + ((int64_t) 1 << shift) - 1;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/*
+This class is a log-linear latency histogram (in the style of HdrHistogram): values below 32 are counted exactly and larger values
+in 32 sub-buckets per power of two, so percentiles are accurate to about 3% with a fixed, small memory footprint
+Values are in microseconds
+*/
+class LatencyHistogram
+{
+public:
+	LatencyHistogram();
+
+	void record(int64_t valueUs);
+	void add(const LatencyHistogram& other);
+	void reset();
+
+	unsigned long long getCount() const { return m_count; }
+	int64_t getMin() const { return m_count > 0 ? m_min : 0; }
+	int64_t getMax() const { return m_max; }
+	double getMean() const { return m_count > 0 ? (double) m_sum / m_count : 0; }
+
+	//percentile: 0 to 100; returns the upper bound of the bucket containing the percentile (at most the maximum)
+	int64_t getPercentile(double percentile) const;
+
+	//"count, mean, p50, p99, p99.9, max" on one line
+	std::string getSummary() const;
+
+private:
+	static const int SUB_BUCKET_BITS = 5;
+	static const int SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+	static const int MAX_VALUE_BITS = 40;	//about 12 days
+
+	static int getBucketIndex(int64_t value);
+	static int64_t getBucketUpperValue(int index);
+
+	std::vector<unsigned long long> m_counts;
+	unsigned long long m_count;
+	int64_t m_sum;
+	int64_t m_min;
+	int64_t m_max;
+};
@@ -0,0 +1,705 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <time.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <algorithm>
+#include <cstdlib>
+
+#include <LoadGenerator.h>
+#include <ConfigurationHandler.h>
+
+//Records waiting for ACKs per connection (beyond this, the oldest are counted as unacknowledged)
+static const size_t MAX_PENDING_RECORDS = 1000000;
+
+//No. of pending records searched for the counter of a simple ACK
+static const size_t MAX_ACK_SEARCH_DEPTH = 1024;
+
+
+//*************************************************************************************************
+LoadGenerator::LoadGenerator():
+	m_deviceCount{0},
+	m_firstDeviceID{0},
+	m_firstCounter{1},
+	m_connectionCount{0},
+	m_threadCount{1},
+	m_recordsPerSecond{0},
+	m_recordsPerSend{1},
+	m_durationSeconds{0},
+	m_counterPosition{0},
+	m_deviceIDPosition{0},
+	m_dropPercentage{0},
+	m_reorderPercentage{0},
+	m_reorderDepth{1},
+	m_duplicatePercentage{0},
+	m_isResendingRequestedRecords{false},
+	m_maxResendPerRequest{0},
+	m_reconnectStormIntervalSeconds{0},
+	m_reconnectStormPercentage{0},
+	m_randomSeed{1},
+	m_isRunning{false},
+	m_openConnectionCount{0},
+	m_sentRecordCount{0},
+	m_sentByteCount{0},
+	m_receivedByteCount{0},
+	m_ACKCount{0},
+	m_unmatchedACKCount{0},
+	m_unacknowledgedRecordCount{0},
+	m_droppedRecordCount{0},
+	m_reorderedRecordCount{0},
+	m_duplicateRecordCount{0},
+	m_requestedRecordCount{0},
+	m_reconnectCount{0}
+{
+}
+
+
+//*************************************************************************************************
+LoadGenerator::~LoadGenerator()
+{
+	for (auto& connection: m_connections)
+		closeConnection(connection);
+}
+
+
+//*************************************************************************************************
+bool LoadGenerator::initialize()
+{
+	ConfigurationHandler& configHandler = ConfigurationHandler::getInstance();
+
+	m_serverIP = configHandler.getConfig("ServiceIP");
+	m_serverPort = configHandler.getConfig("ServicePort");
+
+	int frameSize;
+	try
+	{
+		frameSize = std::stoi(configHandler.getConfig("BinaryDataSize"));
+		m_deviceCount = std::stoi(configHandler.getConfig("LoadDeviceCount"));
+		m_firstDeviceID = std::stoi(configHandler.getConfig("LoadFirstDeviceID"));
+		m_firstCounter = std::stoi(configHandler.getConfig("LoadFirstCounter"));
+		m_connectionCount = std::stoi(configHandler.getConfig("LoadConnectionCount"));
+		m_threadCount = std::stoi(configHandler.getConfig("LoadSenderThreads"));
+		m_recordsPerSecond = std::stol(configHandler.getConfig("LoadRecordsPerSecond"));
+		m_recordsPerSend = std::stoi(configHandler.getConfig("LoadRecordsPerSend"));
+		m_durationSeconds = std::stoi(configHandler.getConfig("LoadDurationSeconds"));
+		m_counterPosition = std::stoi(configHandler.getConfig("CounterRecordPosition"));
+		m_deviceIDPosition = std::stoi(configHandler.getConfig("DeviceIDRecordPosition"));
+
+		m_dropPercentage = std::stod(configHandler.getConfig("LoadDropPercentage"));
+		m_reorderPercentage = std::stod(configHandler.getConfig("LoadReorderPercentage"));
+		m_reorderDepth = std::max(std::stoi(configHandler.getConfig("LoadReorderDepth")), 1);
+		m_duplicatePercentage = std::stod(configHandler.getConfig("LoadDuplicatePercentage"));
+		m_maxResendPerRequest = std::stoi(configHandler.getConfig("LoadMaxResendPerRequest"));
+		m_isResendingRequestedRecords = (m_maxResendPerRequest > 0);
+		m_reconnectStormIntervalSeconds = std::stoi(configHandler.getConfig("LoadReconnectStormIntervalSeconds"));
+		m_reconnectStormPercentage = std::stod(configHandler.getConfig("LoadReconnectStormPercentage"));
+		m_randomSeed = std::stoi(configHandler.getConfig("LoadRandomSeed"));
+	}
+	catch (std::exception &e)
+	{
+		std::cout << "Error reading load generator configs (LoadDeviceCount, LoadConnectionCount, ...): " << e.what() << std::endl;
+		return false;
+	}
+
+	if (m_deviceCount < 1 || m_connectionCount < 1 || m_threadCount < 1 || m_recordsPerSend < 1)
+	{
+		std::cout << "LoadDeviceCount, LoadConnectionCount, LoadSenderThreads and LoadRecordsPerSend must be positive" << std::endl;
+		return false;
+	}
+
+	//Every new record must eventually be sent (drops and reorders draw again)
+	if (m_dropPercentage + m_reorderPercentage >= 100)
+	{
+		std::cout << "LoadDropPercentage + LoadReorderPercentage must be less than 100" << std::endl;
+		return false;
+	}
+
+	if (!m_encoder.initialize(configHandler.getConfig("DataRecordType"), frameSize))
+	{
+		std::cout << "Invalid DataRecordType or BinaryDataSize config" << std::endl;
+		return false;
+	}
+
+	for (auto& field: m_encoder.getLayout().getFields())
+	{
+		if (field.m_type == FrameLayout::FIELD_DATE_TIME)
+			m_dateTimePositions.push_back(field.m_valuePosition);
+	}
+
+	m_connectionCount = std::min(m_connectionCount, m_deviceCount);
+	m_threadCount = std::min(m_threadCount, m_connectionCount);
+	m_connections.resize(m_connectionCount);
+
+	//Device i is sent on connection (i % connection count); fixed fields get plausible, device specific values
+	for (int i = 0; i < m_deviceCount; ++i)
+	{
+		SimulatedDevice device;
+		device.m_deviceID = m_firstDeviceID + i;
+		device.m_counter = m_firstCounter;
+		device.m_frame.resize(m_encoder.getFrameSize());
+
+		m_encoder.clearFrame(device.m_frame.data());
+
+		for (int position = 0; position < m_encoder.getValueCount(); ++position)
+			m_encoder.setValue(device.m_frame.data(), position, 200 + (i + position) % 50);
+
+		m_encoder.setValue(device.m_frame.data(), m_deviceIDPosition, device.m_deviceID);
+
+		m_connections[i % m_connectionCount].m_devices.push_back(device);
+	}
+
+	for (size_t i = 0; i < m_connections.size(); ++i)
+	{
+		Connection& connection = m_connections[i];
+		connection.m_nextDevice = 0;
+		connection.m_random.seed(m_randomSeed + i);
+		connection.m_latencyMutex.reset(new std::mutex());
+		connection.m_socketFD = connectToServer();
+
+		if (connection.m_socketFD == -1)
+			return false;
+	}
+
+	m_openConnectionCount = m_connectionCount;
+
+	std::cout << "Load generator: " << m_deviceCount << " devices (IDs " << m_firstDeviceID << " to " << m_firstDeviceID + m_deviceCount - 1
+				<< ") on " << m_connectionCount << " connections, " << m_threadCount << " sender threads, "
+				<< (m_recordsPerSecond > 0 ? std::to_string(m_recordsPerSecond) + " records/s" : std::string("maximum rate")) << std::endl;
+	return true;
+}
+
+
+//*************************************************************************************************
+void LoadGenerator::run()
+{
+	m_isRunning = true;
+
+	std::vector<std::thread> senderThreads;
+	for (int i = 0; i < m_threadCount; ++i)
+		senderThreads.push_back(std::thread(&LoadGenerator::senderThread, this, i));
+
+	unsigned long long previousRecordCount = 0;
+	unsigned long long previousByteCount = 0;
+	unsigned long long previousACKCount = 0;
+	int elapsedSeconds = 0;
+
+	LatencyHistogram intervalLatency;
+
+	//Print rates once a second (instead of printing every message)
+	while (m_openConnectionCount > 0 && (m_durationSeconds == 0 || elapsedSeconds < m_durationSeconds))
+	{
+		sleep(1);
+		++elapsedSeconds;
+
+		unsigned long long recordCount = m_sentRecordCount;
+		unsigned long long byteCount = m_sentByteCount;
+		unsigned long long ACKCount = m_ACKCount;
+
+		intervalLatency.reset();
+		for (auto& connection: m_connections)
+		{
+			std::lock_guard<std::mutex> lock(*connection.m_latencyMutex);
+			intervalLatency.add(connection.m_intervalLatency);
+			connection.m_intervalLatency.reset();
+		}
+
+		std::cout << elapsedSeconds << " s: " << recordCount - previousRecordCount << " records/s, "
+					<< (byteCount - previousByteCount) / 1024 << " KB/s, " << ACKCount - previousACKCount << " ACKs/s, total records: " << recordCount
+					<< ", open connections: " << m_openConnectionCount << std::endl;
+		std::cout << "\tACK latency: " << intervalLatency.getSummary() << std::endl;
+
+		previousRecordCount = recordCount;
+		previousByteCount = byteCount;
+		previousACKCount = ACKCount;
+	}
+
+	m_isRunning = false;
+
+	for (auto& thread: senderThreads)
+		thread.join();
+
+	std::cout << "Load generator finished: " << m_sentRecordCount << " records, " << m_sentByteCount << " bytes in " << elapsedSeconds << " s" << std::endl;
+
+	if (elapsedSeconds > 0)
+		std::cout << "Average: " << m_sentRecordCount / elapsedSeconds << " records/s, " << m_ACKCount / elapsedSeconds << " ACKs/s" << std::endl;
+
+	printLatencySummary();
+}
+
+
+//*************************************************************************************************
+void LoadGenerator::printLatencySummary()
+{
+	LatencyHistogram totalLatency;
+
+	std::cout << "ACK latency per connection:" << std::endl;
+
+	for (size_t i = 0; i < m_connections.size(); ++i)
+	{
+		std::lock_guard<std::mutex> lock(*m_connections[i].m_latencyMutex);
+		std::cout << "\tconnection " << i << ": " << m_connections[i].m_latency.getSummary() << std::endl;
+		totalLatency.add(m_connections[i].m_latency);
+	}
+
+	std::cout << "ACK latency (all connections): " << totalLatency.getSummary() << std::endl;
+	std::cout << "ACKs: " << m_ACKCount << ", unmatched ACKs: " << m_unmatchedACKCount
+				<< ", records without ACK: " << m_unacknowledgedRecordCount << std::endl;
+	std::cout << "Shaping: dropped records: " << m_droppedRecordCount << ", reordered: " << m_reorderedRecordCount
+				<< ", duplicated: " << m_duplicateRecordCount << ", resent on request: " << m_requestedRecordCount
+				<< ", reconnects: " << m_reconnectCount << std::endl;
+}
+
+
+//*************************************************************************************************
+void LoadGenerator::senderThread(int threadIndex)
+{
+	//This thread sends on connections threadIndex, threadIndex + thread count, ...
+	std::vector<Connection*> connections;
+	for (int i = threadIndex; i < m_connectionCount; i += m_threadCount)
+		connections.push_back(&m_connections[i]);
+
+	double ratePerSecond = (double) m_recordsPerSecond / m_threadCount;
+	double bucketCapacity = std::max((double) m_recordsPerSend, ratePerSecond / 100);	//at most 10 ms worth of records at once
+	double tokens = 0;
+	int64_t lastRefillTimeNs = getMonotonicTimeNs();
+
+	std::vector<unsigned char> sendBuffer(m_recordsPerSend * m_encoder.getFrameSize());
+	size_t connectionIndex = 0;
+
+	int64_t stormIntervalNs = (int64_t) m_reconnectStormIntervalSeconds * 1000000000;
+	int64_t nextStormTimeNs = lastRefillTimeNs + stormIntervalNs;
+	std::mt19937 stormRandom(m_randomSeed + m_connectionCount + threadIndex);
+
+	while (m_isRunning)
+	{
+		//Reconnect storm: a share of the connections drop and reconnect at the same time
+		if (stormIntervalNs > 0 && getMonotonicTimeNs() >= nextStormTimeNs)
+		{
+			for (auto connection: connections)
+			{
+				if (connection->m_socketFD != -1 && std::uniform_real_distribution<double>(0, 100)(stormRandom) < m_reconnectStormPercentage)
+					reconnect(*connection);
+			}
+
+			nextStormTimeNs += stormIntervalNs;
+		}
+
+		int frameCount = m_recordsPerSend;
+
+		if (ratePerSecond > 0)
+		{
+			int64_t nowNs = getMonotonicTimeNs();
+			tokens = std::min(bucketCapacity, tokens + (nowNs - lastRefillTimeNs) * ratePerSecond / 1e9);
+			lastRefillTimeNs = nowNs;
+
+			if (tokens < 1)
+			{
+				//Sleep until the next record is due
+				struct timespec waitTime;
+				int64_t waitNs = (int64_t) ((1 - tokens) * 1e9 / ratePerSecond);
+				waitTime.tv_sec = waitNs / 1000000000;
+				waitTime.tv_nsec = waitNs % 1000000000;
+				nanosleep(&waitTime, NULL);
+				continue;
+			}
+
+			frameCount = std::min(frameCount, (int) tokens);
+		}
+
+		//Next open connection of this thread (round robin)
+		Connection* connection = NULL;
+		for (size_t n = 0; n < connections.size() && connection == NULL; ++n)
+		{
+			Connection* candidate = connections[connectionIndex++ % connections.size()];
+
+			if (candidate->m_socketFD != -1)
+				connection = candidate;
+		}
+
+		if (connection == NULL)	//All connections of this thread are closed
+			break;
+
+		size_t length = encodeFrames(*connection, frameCount, sendBuffer.data(), getMonotonicTimeNs());
+
+		if (!sendAll(*connection, sendBuffer.data(), length))
+		{
+			std::cout << "Send failed, closing connection, errno: " << errno << ", error string: " << strerror(errno) << std::endl;
+			closeConnection(*connection);
+			continue;
+		}
+
+		tokens -= frameCount;
+		m_sentRecordCount += frameCount;
+		m_sentByteCount += length;
+
+		drainReceivedData(*connection);
+	}
+
+	//Collect ACKs of the last records (for up to a second)
+	for (int n = 0; n < 100; ++n)
+	{
+		bool isPending = false;
+
+		for (auto connection: connections)
+		{
+			if (connection->m_socketFD == -1)
+				continue;
+
+			drainReceivedData(*connection);
+			isPending = isPending || !connection->m_pendingRecords.empty();
+		}
+
+		if (!isPending)
+			break;
+
+		usleep(10000);
+	}
+}
+
+
+//*************************************************************************************************
+size_t LoadGenerator::encodeFrames(Connection& connection, int frameCount, unsigned char* buffer, int64_t sendTimeNs)
+{
+	int frameSize = m_encoder.getFrameSize();
+	time_t now = time(0);
+
+	//Devices of a connection take turns, each sending its records in counter order
+	for (int n = 0; n < frameCount; ++n)
+	{
+		ShapedRecord record = getNextRecord(connection);
+		SimulatedDevice& device = connection.m_devices[record.m_deviceIndex];
+
+		unsigned char* frame = buffer + n * frameSize;
+		memcpy(frame, device.m_frame.data(), frameSize);
+
+		m_encoder.setValue(frame, m_counterPosition, record.m_counter);
+		connection.m_pendingRecords.push_back(PendingRecord{record.m_deviceIndex, record.m_counter, sendTimeNs});
+
+		if (connection.m_pendingRecords.size() > MAX_PENDING_RECORDS)
+		{
+			connection.m_pendingRecords.pop_front();
+			++m_unacknowledgedRecordCount;
+		}
+
+		for (int position: m_dateTimePositions)
+			m_encoder.setValue(frame, position, now);
+
+		m_encoder.finalizeFrame(frame);
+	}
+
+	return frameCount * frameSize;
+}
+
+
+//*************************************************************************************************
+LoadGenerator::ShapedRecord LoadGenerator::getNextRecord(Connection& connection)
+{
+	//Resends (duplicates and requested records) go first
+	if (!connection.m_resendQueue.empty())
+	{
+		ShapedRecord record = connection.m_resendQueue.front();
+		connection.m_resendQueue.pop_front();
+		connection.m_devices[record.m_deviceIndex].m_queuedResends.erase(record.m_counter);
+		return record;
+	}
+
+	//Then held back records whose delay has passed
+	for (auto& record: connection.m_delayedRecords)
+		--record.m_delay;
+
+	for (auto iter = connection.m_delayedRecords.begin(); iter != connection.m_delayedRecords.end(); ++iter)
+	{
+		if (iter->m_delay <= 0)
+		{
+			ShapedRecord record = *iter;
+			connection.m_delayedRecords.erase(iter);
+			return record;
+		}
+	}
+
+	//Then a new record of the next device; dropped records are never sent unless requested, reordered ones are held back
+	while (true)
+	{
+		int deviceIndex = connection.m_nextDevice;
+		connection.m_nextDevice = (connection.m_nextDevice + 1) % connection.m_devices.size();
+
+		ShapedRecord record{deviceIndex, connection.m_devices[deviceIndex].m_counter++, 0};
+
+		if (isChosen(connection, m_dropPercentage))
+		{
+			++m_droppedRecordCount;
+			continue;
+		}
+
+		if (isChosen(connection, m_reorderPercentage))
+		{
+			record.m_delay = 1 + connection.m_random() % m_reorderDepth;
+			connection.m_delayedRecords.push_back(record);
+			++m_reorderedRecordCount;
+			continue;
+		}
+
+		if (isChosen(connection, m_duplicatePercentage))
+		{
+			connection.m_resendQueue.push_back(record);
+			++m_duplicateRecordCount;
+		}
+
+		return record;
+	}
+}
+
+
+//*************************************************************************************************
+bool LoadGenerator::isChosen(Connection& connection, double percentage)
+{
+	if (percentage <= 0)
+		return false;
+
+	return std::uniform_real_distribution<double>(0, 100)(connection.m_random) < percentage;
+}
+
+
+//*************************************************************************************************
+void LoadGenerator::queueRequestedRecords(Connection& connection, int deviceIndex, long firstCounter, long count)
+{
+	//Like a meter, resend the requested range (records already queued are not queued again)
+	SimulatedDevice& device = connection.m_devices[deviceIndex];
+	long lastCounter = std::min(firstCounter + std::min(count, (long) m_maxResendPerRequest), (long) device.m_counter);
+
+	for (long counter = firstCounter; counter < lastCounter; ++counter)
+	{
+		if (device.m_queuedResends.insert(counter).second)
+		{
+			connection.m_resendQueue.push_back(ShapedRecord{deviceIndex, (int) counter, 0});
+			++m_requestedRecordCount;
+		}
+	}
+}
+
+
+//*************************************************************************************************
+void LoadGenerator::reconnect(Connection& connection)
+{
+	closeConnection(connection);
+
+	//ACKs of records sent on the closed connection are lost
+	{
+		std::lock_guard<std::mutex> lock(*connection.m_latencyMutex);
+		m_unacknowledgedRecordCount += connection.m_pendingRecords.size();
+		connection.m_pendingRecords.clear();
+		connection.m_receivedData.clear();
+	}
+
+	connection.m_socketFD = connectToServer();
+
+	if (connection.m_socketFD != -1)
+	{
+		++m_openConnectionCount;
+		++m_reconnectCount;
+	}
+}
+
+
+//*************************************************************************************************
+bool LoadGenerator::sendAll(Connection& connection, const unsigned char* data, size_t length)
+{
+	size_t sentCount = 0;
+
+	while (sentCount < length && m_isRunning)
+	{
+		ssize_t result = send(connection.m_socketFD, data + sentCount, length - sentCount, MSG_NOSIGNAL);
+
+		if (result > 0)
+		{
+			sentCount += result;
+			continue;
+		}
+
+		if (result == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			//The service is not keeping up (or applies backpressure); keep reading ACKs so that it does not block on sending them
+			drainReceivedData(connection);
+
+			struct pollfd pollFD = {connection.m_socketFD, POLLOUT, 0};
+			poll(&pollFD, 1, 100);
+			continue;
+		}
+
+		return false;
+	}
+
+	return true;
+}
+
+
+//*************************************************************************************************
+void LoadGenerator::drainReceivedData(Connection& connection)
+{
+	char buffer[4096];
+	ssize_t result;
+
+	while ((result = recv(connection.m_socketFD, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0)
+	{
+		m_receivedByteCount += result;
+		connection.m_receivedData.append(buffer, result);
+	}
+
+	processACKs(connection);
+
+	if (result == 0)
+	{
+		std::cout << "Connection closed by service (unknown device IDs are rejected by closing the connection)" << std::endl;
+		closeConnection(connection);
+	}
+}
+
+
+//*************************************************************************************************
+void LoadGenerator::processACKs(Connection& connection)
+{
+	std::string& receivedData = connection.m_receivedData;
+	int64_t receiveTimeNs = getMonotonicTimeNs();
+	size_t lineStart = 0;
+	size_t lineEnd;
+
+	std::lock_guard<std::mutex> lock(*connection.m_latencyMutex);
+
+	//ACK format: "SERVER:<counter>,<no. of records requested from counter>\r\n"
+	while ((lineEnd = receivedData.find('\n', lineStart)) != std::string::npos)
+	{
+		const char* line = receivedData.c_str() + lineStart;
+
+		if (strncmp(line, "SERVER:", 7) == 0)
+		{
+			char* end;
+			long ackCounter = strtol(line + 7, &end, 10);
+			long requestCount = (*end == ',') ? strtol(end + 1, NULL, 10) : 0;
+
+			matchACK(connection, ackCounter, requestCount, receiveTimeNs);
+		}
+
+		lineStart = lineEnd + 1;
+	}
+
+	receivedData.erase(0, lineStart);
+}
+
+
+//*************************************************************************************************
+void LoadGenerator::matchACK(Connection& connection, long ackCounter, long requestCount, int64_t receiveTimeNs)
+{
+	std::deque<PendingRecord>& pendingRecords = connection.m_pendingRecords;
+
+	//A simple ACK carries the counter of the record it acknowledges; earlier records that were not ACKed (eg: rejected) are skipped
+	//ACKs requesting records carry the counter of the first requested record, so they are matched by order only
+	if (requestCount == 0)
+	{
+		size_t searchDepth = std::min(pendingRecords.size(), MAX_ACK_SEARCH_DEPTH);
+		size_t index = 0;
+
+		while (index < searchDepth && pendingRecords[index].m_counter != ackCounter)
+			++index;
+
+		if (index == searchDepth)
+		{
+			++m_unmatchedACKCount;
+			return;
+		}
+
+		m_unacknowledgedRecordCount += index;
+		pendingRecords.erase(pendingRecords.begin(), pendingRecords.begin() + index);
+	}
+
+	if (pendingRecords.empty())
+	{
+		++m_unmatchedACKCount;
+		return;
+	}
+
+	int64_t latencyUs = (receiveTimeNs - pendingRecords.front().m_sendTimeNs) / 1000;
+	int deviceIndex = pendingRecords.front().m_deviceIndex;
+	pendingRecords.pop_front();
+
+	if (requestCount > 0 && m_isResendingRequestedRecords)
+		queueRequestedRecords(connection, deviceIndex, ackCounter, requestCount);
+
+	connection.m_latency.record(latencyUs);
+	connection.m_intervalLatency.record(latencyUs);
+	++m_ACKCount;
+}
+
+
+//*************************************************************************************************
+void LoadGenerator::closeConnection(Connection& connection)
+{
+	if (connection.m_socketFD == -1)
+		return;
+
+	close(connection.m_socketFD);
+	connection.m_socketFD = -1;
+	--m_openConnectionCount;
+}
+
+
+//*************************************************************************************************
+int LoadGenerator::connectToServer()
+{
+	struct addrinfo hints;
+	struct addrinfo* serverInfo;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	int result = getaddrinfo(m_serverIP.c_str(), m_serverPort.c_str(), &hints, &serverInfo);
+
+	if (result != 0)
+	{
+		std::cout << "getaddrinfo() failed: " << gai_strerror(result) << std::endl;
+		return -1;
+	}
+
+	int socketFD = -1;
+
+	for (struct addrinfo* info = serverInfo; info != NULL; info = info->ai_next)
+	{
+		socketFD = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+
+		if (socketFD == -1)
+			continue;
+
+		if (connect(socketFD, info->ai_addr, info->ai_addrlen) == 0)
+			break;
+
+		close(socketFD);
+		socketFD = -1;
+	}
+
+	freeaddrinfo(serverInfo);
+
+	if (socketFD == -1)
+	{
+		std::cout << "Unable to connect to remote data recorder service, " << m_serverIP << ": " << m_serverPort
+					<< ", errno: " << errno << ", error string: " << strerror(errno) << std::endl;
+		return -1;
+	}
+
+	fcntl(socketFD, F_SETFL, fcntl(socketFD, F_GETFL) | O_NONBLOCK);
+	return socketFD;
+}
+
+
+//*************************************************************************************************
+int64_t LoadGenerator::getMonotonicTimeNs()
+{
+	struct timespec timeSpec;
+	clock_gettime(CLOCK_MONOTONIC, &timeSpec);
+	return (int64_t) timeSpec.tv_sec * 1000000000 + timeSpec.tv_nsec;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <set>
+#include <memory>
+#include <random>
+#include <mutex>
+#include <atomic>
+#include <stdint.h>
+
+#include <FrameEncoder.h>
+#include <LatencyHistogram.h>
+
+/*
+This class generates load on a data recorder service with binary frames (DataRecordType layout) of many simulated devices
+Devices are spread over connections and connections over sender threads; each thread paces its share of the total record rate
+with a token bucket (or sends as fast as the service accepts), and reads ACKs so that the service never blocks on sending them
+ACKs are matched to the send time of the records they acknowledge, giving per connection and aggregate ACK latency histograms
+Traffic can be shaped like misbehaving meters: dropped, reordered and duplicated records, resends of records requested in ACKs
+and reconnect storms (random decisions are seeded, so a scenario is repeatable)
+*/
+class LoadGenerator
+{
+public:
+	LoadGenerator();
+	~LoadGenerator();
+
+	bool initialize();
+
+	//Runs until the configured duration elapses (or until all connections are closed); prints rates every second
+	void run();
+
+private:
+	struct SimulatedDevice
+	{
+		int m_deviceID;
+		int m_counter;
+		std::vector<unsigned char> m_frame;	//template with the fixed fields filled in
+		std::set<int> m_queuedResends;	//counters queued for resending (not yet sent)
+	};
+
+	struct ShapedRecord
+	{
+		int m_deviceIndex;	//in the connection's devices
+		int m_counter;
+		int m_delay;	//for reordered records: no. of records to send before this one
+	};
+
+	struct PendingRecord
+	{
+		int m_deviceIndex;
+		int m_counter;
+		int64_t m_sendTimeNs;
+	};
+
+	struct Connection
+	{
+		int m_socketFD;
+		std::vector<SimulatedDevice> m_devices;
+		size_t m_nextDevice;
+
+		std::mt19937 m_random;
+		std::deque<ShapedRecord> m_resendQueue;	//duplicates and records requested in ACKs
+		std::vector<ShapedRecord> m_delayedRecords;	//held back to be sent out of order
+
+		//The service ACKs the accepted records of a connection in the order they were sent
+		std::deque<PendingRecord> m_pendingRecords;
+		std::string m_receivedData;
+
+		std::unique_ptr<std::mutex> m_latencyMutex;	//histograms are also read by the reporting (main) thread
+		LatencyHistogram m_latency;
+		LatencyHistogram m_intervalLatency;	//since the last report
+	};
+
+	void senderThread(int threadIndex);
+	size_t encodeFrames(Connection& connection, int frameCount, unsigned char* buffer, int64_t sendTimeNs);
+	ShapedRecord getNextRecord(Connection& connection);
+	bool isChosen(Connection& connection, double percentage);
+	void queueRequestedRecords(Connection& connection, int deviceIndex, long firstCounter, long count);
+	void reconnect(Connection& connection);
+	bool sendAll(Connection& connection, const unsigned char* data, size_t length);
+	void drainReceivedData(Connection& connection);
+	void processACKs(Connection& connection);
+	void matchACK(Connection& connection, long ackCounter, long requestCount, int64_t receiveTimeNs);
+	void printLatencySummary();
+	void closeConnection(Connection& connection);
+	int connectToServer();
+	static int64_t getMonotonicTimeNs();
+
+	FrameEncoder m_encoder;
+	std::vector<int> m_dateTimePositions;
+
+	std::string m_serverIP;
+	std::string m_serverPort;
+	int m_deviceCount;
+	int m_firstDeviceID;
+	int m_firstCounter;
+	int m_connectionCount;
+	int m_threadCount;
+	long m_recordsPerSecond;	//total over all threads; 0 = as fast as possible
+	int m_recordsPerSend;
+	int m_durationSeconds;	//0 = until stopped
+	int m_counterPosition;
+	int m_deviceIDPosition;
+
+	//Traffic shaping (percentages of records; 0 = disabled)
+	double m_dropPercentage;
+	double m_reorderPercentage;
+	int m_reorderDepth;
+	double m_duplicatePercentage;
+	bool m_isResendingRequestedRecords;
+	int m_maxResendPerRequest;
+	int m_reconnectStormIntervalSeconds;	//0 = no reconnect storms
+	double m_reconnectStormPercentage;	//of connections
+	int m_randomSeed;
+
+	std::vector<Connection> m_connections;
+
+	std::atomic<bool> m_isRunning;
+	std::atomic<int> m_openConnectionCount;
+	std::atomic<unsigned long long> m_sentRecordCount;
+	std::atomic<unsigned long long> m_sentByteCount;
+	std::atomic<unsigned long long> m_receivedByteCount;
+	std::atomic<unsigned long long> m_ACKCount;
+	std::atomic<unsigned long long> m_unmatchedACKCount;
+	std::atomic<unsigned long long> m_unacknowledgedRecordCount;	//records sent before an ACKed record that were not ACKed
+
+	std::atomic<unsigned long long> m_droppedRecordCount;
+	std::atomic<unsigned long long> m_reorderedRecordCount;
+	std::atomic<unsigned long long> m_duplicateRecordCount;
+	std::atomic<unsigned long long> m_requestedRecordCount;	//resent because requested in ACKs
+	std::atomic<unsigned long long> m_reconnectCount;
+};
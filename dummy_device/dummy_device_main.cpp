@@ -7,6 +7,7 @@
 //Project headers
 //#include <SocketCommunication.h>
 #include <DummyEproDevice.h>
+#include <LoadGenerator.h>
 #include <ConfigurationHandler.h>
 #include <Logger.h>
 
@@ -29,6 +30,7 @@ int main(int argc, char* argv[])
 	if (argc < 2)
 	{
 		std::cout << "Usage: dummy_ePRO <config_filename> [msg_interval(us): override] [custom_msg_sequence_on]" << std::endl;
+		std::cout << "       custom_msg_sequence_on: 1=message sequence, 2=custom message, 3=binary load generator (Load* configs)" << std::endl;
 		return -1;
 	}
 
@@ -52,6 +54,21 @@ int main(int argc, char* argv[])
 		return -1;
 	}
 
+	//Binary load generator: many simulated devices over many connections (does not use the single device below)
+	if (customMsgSequence == 3)
+	{
+		LoadGenerator loadGenerator;
+
+		if (loadGenerator.initialize() == false)
+		{
+			std::cout << "Error initializing load generator; exiting..." << std::endl;
+			return -1;
+		}
+
+		loadGenerator.run();
+		return 0;
+	}
+
 	DummyEproDevice* dummyDevice = new DummyEproDevice();
 
 	if (dummyDevice->initialize(messageInterval) == false)
@@ -0,0 +1,346 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <time.h>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+#include <StreamReplayer.h>
+#include <RawFrameCapture.h>
+
+static const char CAPTURE_FILE_MAGIC[8] = {'E', 'P', 'R', 'O', 'C', 'A', 'P', '2'};
+
+
+//*************************************************************************************************
+StreamReplayer::StreamReplayer():
+	m_streamCount{0},
+	m_copyCount{1},
+	m_connectionCount{0},
+	m_failedConnectionCount{0},
+	m_sentChunkCount{0},
+	m_sentByteCount{0},
+	m_receivedByteCount{0},
+	m_elapsedSeconds{0},
+	m_capturedSeconds{0}
+{
+}
+
+
+//*************************************************************************************************
+StreamReplayer::~StreamReplayer()
+{
+	for (size_t i = 0; i < m_connectionFDs.size(); ++i)
+		closeConnection(i);
+}
+
+
+//*************************************************************************************************
+bool StreamReplayer::loadCapture(const std::string& filename)
+{
+	std::ifstream captureFile(filename, std::ios::binary);
+
+	if (!captureFile.is_open())
+	{
+		std::cout << "Cannot open capture file: " << filename << std::endl;
+		return false;
+	}
+
+	RawFrameCapture::FileHeader fileHeader;
+
+	if (!captureFile.read(reinterpret_cast<char*>(&fileHeader), sizeof(fileHeader))
+		|| memcmp(fileHeader.m_magic, CAPTURE_FILE_MAGIC, sizeof(CAPTURE_FILE_MAGIC)) != 0 || fileHeader.m_slotCount == 0)
+	{
+		std::cout << "Not a raw capture file: " << filename << std::endl;
+		return false;
+	}
+
+	//Oldest slot first; once the ring has wrapped, the oldest slot is the next one to be overwritten
+	uint64_t slotCount = fileHeader.m_writeCount;
+	uint64_t firstSlot = 0;
+
+	if (fileHeader.m_writeCount > fileHeader.m_slotCount)
+	{
+		slotCount = fileHeader.m_slotCount;
+		firstSlot = fileHeader.m_writeCount % fileHeader.m_slotCount;
+	}
+
+	std::vector<char> slot(fileHeader.m_slotSize);
+	std::unordered_map<int, int> openStreams;	//key=captured FD, value=stream ID
+
+	for (uint64_t n = 0; n < slotCount; ++n)
+	{
+		uint64_t slotIndex = (firstSlot + n) % fileHeader.m_slotCount;
+		captureFile.seekg(sizeof(fileHeader) + slotIndex * fileHeader.m_slotSize);
+
+		if (!captureFile.read(slot.data(), slot.size()))
+		{
+			std::cout << "Capture file is truncated at slot " << slotIndex << std::endl;
+			return false;
+		}
+
+		RawFrameCapture::SlotHeader* slotHeader = reinterpret_cast<RawFrameCapture::SlotHeader*>(slot.data());
+
+		CapturedEvent event;
+		event.m_timestampNs = slotHeader->m_timestampNs;
+		event.m_type = slotHeader->m_type;
+
+		auto streamIter = openStreams.find(slotHeader->m_FD);
+
+		//A connection seen without its open event was opened before the oldest captured slot
+		if (event.m_type == RawFrameCapture::SLOT_CONNECTION_OPENED || streamIter == openStreams.end())
+		{
+			if (event.m_type == RawFrameCapture::SLOT_CONNECTION_CLOSED)
+				continue;
+
+			openStreams[slotHeader->m_FD] = m_streamCount;
+			event.m_streamID = m_streamCount++;
+		}
+		else
+		{
+			event.m_streamID = streamIter->second;
+		}
+
+		if (event.m_type == RawFrameCapture::SLOT_CONNECTION_CLOSED)
+			openStreams.erase(slotHeader->m_FD);
+
+		//Frame captures are replayed as stream data (one frame per send)
+		if (event.m_type == RawFrameCapture::SLOT_FRAME || event.m_type == RawFrameCapture::SLOT_STREAM_DATA)
+		{
+			uint32_t length = std::min(slotHeader->m_length, fileHeader.m_slotPayloadSize);
+			event.m_type = RawFrameCapture::SLOT_STREAM_DATA;
+			event.m_data.assign(slot.data() + sizeof(RawFrameCapture::SlotHeader), length);
+		}
+
+		m_events.push_back(event);
+	}
+
+	if (m_events.size() > 0)
+		m_capturedSeconds = (m_events.back().m_timestampNs - m_events.front().m_timestampNs) / 1e9;
+
+	std::cout << "Loaded " << m_events.size() << " events of " << m_streamCount << " connections spanning "
+				<< m_capturedSeconds << " s from " << filename << std::endl;
+	return true;
+}
+
+
+//*************************************************************************************************
+bool StreamReplayer::replay(const std::string& serverIP, const std::string& serverPort, double speed, int copyCount)
+{
+	if (m_events.size() == 0)
+	{
+		std::cout << "Nothing to replay" << std::endl;
+		return false;
+	}
+
+	m_serverIP = serverIP;
+	m_serverPort = serverPort;
+	m_copyCount = std::max(copyCount, 1);
+	m_connectionFDs.assign(m_streamCount * m_copyCount, -1);
+
+	int64_t firstEventTimeNs = m_events.front().m_timestampNs;
+	int64_t startTimeNs = getMonotonicTimeNs();
+
+	for (auto& event: m_events)
+	{
+		//Wait until the (scaled) captured time of this event, reading ACKs meanwhile
+		if (speed > 0)
+		{
+			int64_t eventTimeNs = startTimeNs + (int64_t) ((event.m_timestampNs - firstEventTimeNs) / speed);
+			int64_t nowNs;
+
+			while ((nowNs = getMonotonicTimeNs()) < eventTimeNs)
+			{
+				drainReceivedData();
+				usleep(std::min<int64_t>((eventTimeNs - nowNs) / 1000, 1000));
+			}
+		}
+
+		for (int copy = 0; copy < m_copyCount; ++copy)
+		{
+			int connectionIndex = event.m_streamID * m_copyCount + copy;
+
+			if (event.m_type == RawFrameCapture::SLOT_CONNECTION_CLOSED)
+			{
+				closeConnection(connectionIndex);
+				continue;
+			}
+
+			if (m_connectionFDs[connectionIndex] == -1)
+				m_connectionFDs[connectionIndex] = connectToServer();
+
+			if (m_connectionFDs[connectionIndex] == -1 || event.m_data.empty())
+				continue;
+
+			if (!sendAll(m_connectionFDs[connectionIndex], event.m_data))
+			{
+				std::cout << "Send failed on replayed connection " << connectionIndex << "; reconnecting at its next event" << std::endl;
+				closeConnection(connectionIndex);
+				continue;
+			}
+
+			++m_sentChunkCount;
+			m_sentByteCount += event.m_data.size();
+		}
+
+		if (speed <= 0)
+			drainReceivedData();
+	}
+
+	m_elapsedSeconds = (getMonotonicTimeNs() - startTimeNs) / 1e9;
+
+	//Give the service time to acknowledge the last records before closing
+	for (int i = 0; i < 100; ++i)
+	{
+		drainReceivedData();
+		usleep(10000);
+	}
+
+	for (size_t i = 0; i < m_connectionFDs.size(); ++i)
+		closeConnection(i);
+
+	return true;
+}
+
+
+//*************************************************************************************************
+void StreamReplayer::printSummary()
+{
+	std::cout << "Replayed connections: " << m_connectionCount << ", failed connection attempts: " << m_failedConnectionCount << std::endl;
+	std::cout << "Sent " << m_sentChunkCount << " chunks, " << m_sentByteCount << " bytes in " << m_elapsedSeconds << " s (captured: " << m_capturedSeconds << " s)" << std::endl;
+
+	if (m_elapsedSeconds > 0)
+		std::cout << "Throughput: " << m_sentByteCount / m_elapsedSeconds / 1024 << " KB/s, " << m_sentChunkCount / m_elapsedSeconds << " chunks/s" << std::endl;
+
+	std::cout << "Received (ACK) bytes: " << m_receivedByteCount << std::endl;
+}
+
+
+//*************************************************************************************************
+int StreamReplayer::connectToServer()
+{
+	struct addrinfo hints;
+	struct addrinfo* serverInfo;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	int result = getaddrinfo(m_serverIP.c_str(), m_serverPort.c_str(), &hints, &serverInfo);
+
+	if (result != 0)
+	{
+		std::cout << "getaddrinfo() failed: " << gai_strerror(result) << std::endl;
+		++m_failedConnectionCount;
+		return -1;
+	}
+
+	int socketFD = -1;
+
+	for (struct addrinfo* info = serverInfo; info != NULL; info = info->ai_next)
+	{
+		socketFD = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+
+		if (socketFD == -1)
+			continue;
+
+		if (connect(socketFD, info->ai_addr, info->ai_addrlen) == 0)
+			break;
+
+		close(socketFD);
+		socketFD = -1;
+	}
+
+	freeaddrinfo(serverInfo);
+
+	if (socketFD == -1)
+	{
+		std::cout << "Cannot connect to " << m_serverIP << ":" << m_serverPort << ", errno: " << errno << ", error string: " << strerror(errno) << std::endl;
+		++m_failedConnectionCount;
+		return -1;
+	}
+
+	//Sends wait in sendAll() so that ACKs on all connections keep being read
+	fcntl(socketFD, F_SETFL, fcntl(socketFD, F_GETFL) | O_NONBLOCK);
+
+	++m_connectionCount;
+	return socketFD;
+}
+
+
+//*************************************************************************************************
+bool StreamReplayer::sendAll(int socketFD, const std::string& data)
+{
+	size_t sentCount = 0;
+
+	while (sentCount < data.size())
+	{
+		ssize_t result = send(socketFD, data.data() + sentCount, data.size() - sentCount, MSG_NOSIGNAL);
+
+		if (result > 0)
+		{
+			sentCount += result;
+			continue;
+		}
+
+		if (result == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			//The service is not reading this connection (eg: backpressure); keep reading ACKs while waiting
+			drainReceivedData();
+
+			struct pollfd pollFD = {socketFD, POLLOUT, 0};
+			poll(&pollFD, 1, 100);
+			continue;
+		}
+
+		return false;
+	}
+
+	return true;
+}
+
+
+//*************************************************************************************************
+void StreamReplayer::drainReceivedData()
+{
+	char buffer[4096];
+
+	for (size_t i = 0; i < m_connectionFDs.size(); ++i)
+	{
+		if (m_connectionFDs[i] == -1)
+			continue;
+
+		ssize_t result;
+
+		while ((result = recv(m_connectionFDs[i], buffer, sizeof(buffer), MSG_DONTWAIT)) > 0)
+			m_receivedByteCount += result;
+
+		if (result == 0)	//Closed by the service
+			closeConnection(i);
+	}
+}
+
+
+//*************************************************************************************************
+void StreamReplayer::closeConnection(int connectionIndex)
+{
+	if (m_connectionFDs[connectionIndex] == -1)
+		return;
+
+	close(m_connectionFDs[connectionIndex]);
+	m_connectionFDs[connectionIndex] = -1;
+}
+
+
+//*************************************************************************************************
+int64_t StreamReplayer::getMonotonicTimeNs()
+{
+	struct timespec timeSpec;
+	clock_gettime(CLOCK_MONOTONIC, &timeSpec);
+	return (int64_t) timeSpec.tv_sec * 1000000000 + timeSpec.tv_nsec;
+}
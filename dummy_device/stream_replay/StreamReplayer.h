@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/*
+This class replays a stream capture of the data recorder (RawFrameCaptureMode = stream) against a data recorder service
+Each captured connection is reopened and its bytes are resent in the captured order and chunking, at the captured timing
+scaled by a speed factor (or as fast as possible); ACKs sent back by the service are read and discarded
+*/
+class StreamReplayer
+{
+public:
+	StreamReplayer();
+	~StreamReplayer();
+
+	bool loadCapture(const std::string& filename);
+
+	//speed: 1 = as captured, N = N times faster, 0 = as fast as possible
+	//copyCount: no. of connections each captured connection is replayed on (copies send the same device IDs)
+	bool replay(const std::string& serverIP, const std::string& serverPort, double speed, int copyCount);
+
+	void printSummary();
+
+private:
+	struct CapturedEvent
+	{
+		int64_t m_timestampNs;
+		int m_streamID;
+		int m_type;	//RawFrameCapture::SlotType
+		std::string m_data;
+	};
+
+	int connectToServer();
+	bool sendAll(int socketFD, const std::string& data);
+	void drainReceivedData();
+	void closeConnection(int connectionIndex);
+	static int64_t getMonotonicTimeNs();
+
+	std::vector<CapturedEvent> m_events;
+	int m_streamCount;
+
+	std::string m_serverIP;
+	std::string m_serverPort;
+
+	//index = stream ID * copy count + copy no., value = FD (-1 if not connected)
+	std::vector<int> m_connectionFDs;
+	int m_copyCount;
+
+	unsigned long m_connectionCount;
+	unsigned long m_failedConnectionCount;
+	unsigned long m_sentChunkCount;
+	unsigned long long m_sentByteCount;
+	unsigned long long m_receivedByteCount;
+	double m_elapsedSeconds;
+	double m_capturedSeconds;
+};
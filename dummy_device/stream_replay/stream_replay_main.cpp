@@ -0,0 +1,47 @@
+//Standard C++ headers
+#include <iostream>
+#include <string>
+
+//Project headers
+#include <StreamReplayer.h>
+
+
+int main(int argc, char* argv[])
+{
+	double speed = 1;
+	int copyCount = 1;
+
+	if (argc < 4)
+	{
+		std::cout << "Usage: stream_replay <capture_filename> <service_ip> <service_port> [speed: 1=as captured, N=N times faster, 0=maximum]"
+					<< " [connections_per_captured_connection]" << std::endl;
+		return -1;
+	}
+
+	if (argc > 4)
+	{
+		speed = std::stod(argv[4]);
+	}
+
+	if (argc > 5)
+	{
+		copyCount = std::stoi(argv[5]);
+	}
+
+	StreamReplayer replayer;
+
+	if (replayer.loadCapture(argv[1]) == false)
+	{
+		std::cout << "Error loading capture file; exiting..." << std::endl;
+		return -1;
+	}
+
+	if (replayer.replay(argv[2], argv[3], speed, copyCount) == false)
+	{
+		std::cout << "Error replaying capture; exiting..." << std::endl;
+		return -1;
+	}
+
+	replayer.printSummary();
+	return 0;
+}
@@ -1,6 +1,8 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netdb.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h> //SIOCOUTQ
 
 #include <cstring> //memset, stoi
 
@@ -49,3 +51,15 @@ bool ClientSocket::sendData(std::string data)
 	return true;
 }
 
+
+
+//*************************************************************************************************
+int ClientSocket::getSendQueueBytes()
+{
+	int queuedBytes = 0;
+
+	if (ioctl(m_socketFD, SIOCOUTQ, &queuedBytes) == -1)
+		return 0;
+
+	return queuedBytes;
+}
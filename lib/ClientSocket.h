@@ -25,6 +25,9 @@ public:
 
 	bool sendData(std::string data);
 
+	//Bytes written to the socket but not yet sent (held in the kernel send queue)
+	int getSendQueueBytes();
+
 private:
 	
 	int m_clientType; //1 = independently created client, 2 = peer client created by server
@@ -191,18 +191,63 @@ bool ConfigurationHandler::verifyConfigurations()
 	if (m_configMap.count("Password") == 0)
 		m_configMap["Password"] = "";
 
+	if (m_configMap.count("DatabaseConnectionPoolSize") == 0)
+		m_configMap["DatabaseConnectionPoolSize"] = "1";
+
+	if (m_configMap.count("StorageBackend") == 0)
+		m_configMap["StorageBackend"] = "mysql";
+
+	if (m_configMap.count("SQLiteDatabaseFilename") == 0)
+		m_configMap["SQLiteDatabaseFilename"] = "data_recorder.db";
+
+	if (m_configMap.count("SQLiteSynchronous") == 0)
+		m_configMap["SQLiteSynchronous"] = "NORMAL";
+
+	if (m_configMap.count("SQLiteRowsPerInsertStatement") == 0)
+		m_configMap["SQLiteRowsPerInsertStatement"] = "25";
+
+	if (m_configMap.count("InMemoryStorageFirstDeviceID") == 0)
+		m_configMap["InMemoryStorageFirstDeviceID"] = "100000";
+
+	if (m_configMap.count("InMemoryStorageDeviceCount") == 0)
+		m_configMap["InMemoryStorageDeviceCount"] = "1000";
+
+	if (m_configMap.count("InMemoryStorageOperationLatencyMicroseconds") == 0)
+		m_configMap["InMemoryStorageOperationLatencyMicroseconds"] = "0";
+
+	if (m_configMap.count("InMemoryStorageRowLatencyMicroseconds") == 0)
+		m_configMap["InMemoryStorageRowLatencyMicroseconds"] = "0";
+
+	if (m_configMap.count("InMemoryStorageFailurePercent") == 0)
+		m_configMap["InMemoryStorageFailurePercent"] = "0";
+
 	if (m_configMap.count("CacheWriteThreshold") == 0)
 		m_configMap["CacheWriteThreshold"] = "5";
 
 	if (m_configMap.count("CacheSizeHardLimit") == 0)
 		m_configMap["CacheSizeHardLimit"] = "100";
 
+	if (m_configMap.count("RecordWriterCount") == 0)
+		m_configMap["RecordWriterCount"] = "0";
+
+	if (m_configMap.count("RecordWriterMaxQueuedBatches") == 0)
+		m_configMap["RecordWriterMaxQueuedBatches"] = "4";
+
+	if (m_configMap.count("StorageUnitOfWorkEnabled") == 0)
+		m_configMap["StorageUnitOfWorkEnabled"] = "0";
+
 	if (m_configMap.count("NullWriteThreshold") == 0)
 		m_configMap["NullWriteThreshold"] = "50";
 
 	if (m_configMap.count("MaxNullRecordCountPerDevice") == 0)
 		m_configMap["MaxNullRecordCountPerDevice"] = "100";
 
+	if (m_configMap.count("NullRecordLoadDevicesPerQuery") == 0)
+		m_configMap["NullRecordLoadDevicesPerQuery"] = "200";
+
+	if (m_configMap.count("NullRecordLoadConnections") == 0)
+		m_configMap["NullRecordLoadConnections"] = "1";
+
 	if (m_configMap.count("UpdateCacheThreshold") == 0)
 		m_configMap["UpdateCacheThreshold"] = "5";
 
@@ -215,6 +260,36 @@ bool ConfigurationHandler::verifyConfigurations()
 	if (m_configMap.count("FilenamePrefix") == 0)
 		m_configMap["OutOfOrderRecordsHardLimit"] = "eProDataStore";
 
+	if (m_configMap.count("JournalEnabled") == 0)
+		m_configMap["JournalEnabled"] = "0";
+
+	if (m_configMap.count("JournalFilename") == 0)
+		m_configMap["JournalFilename"] = "eProDataJournal.wal";
+
+	if (m_configMap.count("JournalCompactionSizeMB") == 0)
+		m_configMap["JournalCompactionSizeMB"] = "64";
+
+	if (m_configMap.count("DeviceStateSnapshotEnabled") == 0)
+		m_configMap["DeviceStateSnapshotEnabled"] = "0";
+
+	if (m_configMap.count("DeviceStateSnapshotFilename") == 0)
+		m_configMap["DeviceStateSnapshotFilename"] = "eProDeviceState.snapshot";
+
+	if (m_configMap.count("LazyDeviceStateLoading") == 0)
+		m_configMap["LazyDeviceStateLoading"] = "0";
+
+	if (m_configMap.count("DeviceStateMemoryBudgetMB") == 0)
+		m_configMap["DeviceStateMemoryBudgetMB"] = "0";
+
+	if (m_configMap.count("BackpressureHighWatermark") == 0)
+		m_configMap["BackpressureHighWatermark"] = "0";
+
+	if (m_configMap.count("BackpressureLowWatermark") == 0)
+		m_configMap["BackpressureLowWatermark"] = "0";
+
+	if (m_configMap.count("MemoryBudgetMB") == 0)
+		m_configMap["MemoryBudgetMB"] = "0";
+
 	if (m_configMap.count("LogLevel") == 0)
 		m_configMap["LogLevel"] = "3";
 
@@ -231,11 +306,47 @@ bool ConfigurationHandler::verifyConfigurations()
 		m_configMap["ReceiveBufferSize"] = "1024";
 
 	if (m_configMap.count("BufferedMessageHardLimit") == 0)
-		m_configMap["BufferedMessageHardLimit"] = "2048";	//for about 20 messages (of size 128 bytes)
+		m_configMap["BufferedMessageHardLimit"] = "2048";	//about 16 frames (of size 128 bytes) without a valid one
+
+	if (m_configMap.count("BufferedMessageLimitPolicy") == 0)
+		m_configMap["BufferedMessageLimitPolicy"] = "resync";
+
+	if (m_configMap.count("ListenBacklog") == 0)
+		m_configMap["ListenBacklog"] = "128";
+
+	if (m_configMap.count("AcceptBatchSize") == 0)
+		m_configMap["AcceptBatchSize"] = "1";
+
+	if (m_configMap.count("ConnectionBytesPerSecondQuota") == 0)
+		m_configMap["ConnectionBytesPerSecondQuota"] = "0";
+
+	if (m_configMap.count("ConnectionRecordsPerSecondQuota") == 0)
+		m_configMap["ConnectionRecordsPerSecondQuota"] = "0";
+
+	if (m_configMap.count("ConnectionQuotaBurstSeconds") == 0)
+		m_configMap["ConnectionQuotaBurstSeconds"] = "5";
+
+	if (m_configMap.count("RawFrameCaptureEnabled") == 0)
+		m_configMap["RawFrameCaptureEnabled"] = "0";
+
+	if (m_configMap.count("RawFrameCaptureMode") == 0)
+		m_configMap["RawFrameCaptureMode"] = "frames";
+
+	if (m_configMap.count("RawFrameCaptureFilename") == 0)
+		m_configMap["RawFrameCaptureFilename"] = "eProRawFrames.capture";
+
+	if (m_configMap.count("RawFrameCaptureSizeMB") == 0)
+		m_configMap["RawFrameCaptureSizeMB"] = "64";
 
 	if (m_configMap.count("RecordTerminationCharacter") == 0)
 		m_configMap["RecordTerminationCharacter"] = "\n\r";
 
+	if (m_configMap.count("ServerHandoffEnabled") == 0)
+		m_configMap["ServerHandoffEnabled"] = "0";
+
+	if (m_configMap.count("ServerHandoffSocketPath") == 0)
+		m_configMap["ServerHandoffSocketPath"] = "eProDataRecorder.handoff";
+
 	if (m_configMap.count("HeartbeatTimerInterval") == 0)
 		m_configMap["HeartbeatTimerInterval"] = "180";
 
@@ -0,0 +1,85 @@
+#include <cstring>
+#include <stdint.h>
+
+#include <FrameEncoder.h>
+#include <FrameValidator.h>
+
+
+//*************************************************************************************************
+bool FrameEncoder::initialize(const std::string& dataRecordType, int frameSize)
+{
+	if (!m_layout.load(dataRecordType, frameSize))
+		return false;
+
+	m_valueFields.clear();
+
+	for (auto& field: m_layout.getFields())
+	{
+		if (field.m_valuePosition >= 0)
+			m_valueFields.push_back(field);
+	}
+
+	return true;
+}
+
+
+//*************************************************************************************************
+void FrameEncoder::clearFrame(unsigned char* frame)
+{
+	memset(frame, 0, m_layout.getFrameSize());
+}
+
+
+//*************************************************************************************************
+bool FrameEncoder::setValue(unsigned char* frame, int valuePosition, double value)
+{
+	if (valuePosition < 0 || valuePosition >= (int) m_valueFields.size())
+		return false;
+
+	FrameLayout::Field& field = m_valueFields[valuePosition];
+	unsigned char* fieldData = frame + field.m_offset;
+
+	int32_t intValue;
+	float floatValue;
+
+	switch (field.m_type)
+	{
+		case FrameLayout::FIELD_INT:
+			intValue = (int32_t) value;
+			memcpy(fieldData, &intValue, sizeof(intValue));
+			break;
+
+		case FrameLayout::FIELD_FLOAT:
+			floatValue = (float) value;
+			memcpy(fieldData, &floatValue, sizeof(floatValue));
+			break;
+
+		case FrameLayout::FIELD_DATE_TIME:
+			intValue = (int32_t) value + FrameLayout::DATE_TIME_OFFSET_SECONDS;
+			memcpy(fieldData, &intValue, sizeof(intValue));
+			break;
+
+		case FrameLayout::FIELD_CHAR:
+			fieldData[0] = (unsigned char) value;
+			break;
+
+		case FrameLayout::FIELD_SKIP:
+			return false;
+	}
+
+	return true;
+}
+
+
+//*************************************************************************************************
+void FrameEncoder::finalizeFrame(unsigned char* frame)
+{
+	int frameSize = m_layout.getFrameSize();
+	unsigned char checksum = 0;
+
+	for (int k = 0; k < frameSize - 2; ++k)
+		checksum ^= frame[k];
+
+	frame[frameSize - 2] = checksum;
+	frame[frameSize - 1] = FrameValidator::FRAME_END_MARKER;
+}
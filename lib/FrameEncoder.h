@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <FrameLayout.h>
+
+/*
+This class encodes binary device frames (the inverse of SocketManager's decoding) for load generation and benchmarks
+A frame is filled with setValue() calls (by value position, as in decoded records) and completed with finalizeFrame()
+*/
+class FrameEncoder
+{
+public:
+	bool initialize(const std::string& dataRecordType, int frameSize);
+
+	int getFrameSize() { return m_layout.getFrameSize(); }
+	int getValueCount() { return m_layout.getValueCount(); }
+	FrameLayout& getLayout() { return m_layout; }
+
+	//Zero all fields
+	void clearFrame(unsigned char* frame);
+
+	//ints and chars are truncated; date_time values are UNIX timestamps
+	bool setValue(unsigned char* frame, int valuePosition, double value);
+
+	//Write the checksum and end marker bytes
+	void finalizeFrame(unsigned char* frame);
+
+private:
+	FrameLayout m_layout;
+	std::vector<FrameLayout::Field> m_valueFields;	//index = value position
+};
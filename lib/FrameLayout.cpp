@@ -0,0 +1,81 @@
+#include <sstream>
+
+#include <FrameLayout.h>
+#include <Logger.h>
+
+
+//*************************************************************************************************
+FrameLayout::FrameLayout():
+	m_frameSize{0},
+	m_valueCount{0}
+{
+}
+
+
+//*************************************************************************************************
+bool FrameLayout::load(const std::string& dataRecordType, int frameSize)
+{
+	std::vector<Field> fields;
+	int offset = 0;
+	int valueCount = 0;
+
+	std::stringstream stringStream(dataRecordType);
+	std::string type;
+
+	while (std::getline(stringStream, type, ','))
+	{
+		type.erase(0, type.find_first_not_of(' '));	//Left trim
+		type.erase(type.find_last_not_of(' ') + 1);	//Right trim
+
+		if (type.empty())
+			continue;
+
+		Field field;
+
+		if (type == "int")
+			field = Field{FIELD_INT, 4, offset, valueCount++};
+		else if (type == "float")
+			field = Field{FIELD_FLOAT, 4, offset, valueCount++};
+		else if (type == "date_time")
+			field = Field{FIELD_DATE_TIME, 4, offset, valueCount++};
+		else if (type == "char")
+			field = Field{FIELD_CHAR, 1, offset, valueCount++};
+		else if (type == "esc")
+			field = Field{FIELD_SKIP, 4, offset, -1};
+		else if (type == "end")	//checksum and end marker bytes
+			field = Field{FIELD_SKIP, 1, offset, -1};
+		else
+		{
+			BOOST_LOG_TRIVIAL(error) << "Unknown type in config 'DataRecordType': " << type;
+			return false;
+		}
+
+		fields.push_back(field);
+		offset += field.m_size;
+	}
+
+	//The last two bytes of a frame are the checksum and the end marker
+	if (offset != frameSize || frameSize < 3)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Size of 'DataRecordType' (" << offset << " bytes) does not match 'BinaryDataSize' (" << frameSize << ")";
+		return false;
+	}
+
+	m_fields = fields;
+	m_frameSize = frameSize;
+	m_valueCount = valueCount;
+	return true;
+}
+
+
+//*************************************************************************************************
+const FrameLayout::Field* FrameLayout::getFieldAtValuePosition(int valuePosition)
+{
+	for (auto& field: m_fields)
+	{
+		if (field.m_valuePosition == valuePosition)
+			return &field;
+	}
+
+	return NULL;
+}
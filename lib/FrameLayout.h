@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/*
+This class holds the layout of binary device frames, as given by configs DataRecordType and BinaryDataSize
+Fields are little-endian; the last two bytes of a frame are an XOR checksum of the preceding bytes and the end marker (0xFF)
+Value positions are the positions of fields in decoded (comma separated) records; skipped fields have no value position
+*/
+class FrameLayout
+{
+public:
+	enum FieldType { FIELD_INT, FIELD_FLOAT, FIELD_DATE_TIME, FIELD_CHAR, FIELD_SKIP };
+
+	struct Field
+	{
+		FieldType m_type;
+		int m_size;
+		int m_offset;
+		int m_valuePosition;	//-1 for skipped fields
+	};
+
+	//Devices send date_time fields in local time (UTC+05:30)
+	static const int DATE_TIME_OFFSET_SECONDS = 5*3600 + 30*60;
+
+	FrameLayout();
+
+	//dataRecordType: comma separated field types (int, float, date_time, char, esc, end)
+	bool load(const std::string& dataRecordType, int frameSize);
+
+	bool isLoaded() { return m_frameSize > 0; }
+	int getFrameSize() { return m_frameSize; }	//0 until loaded
+	int getValueCount() { return m_valueCount; }
+	const std::vector<Field>& getFields() { return m_fields; }
+	const Field* getFieldAtValuePosition(int valuePosition);
+
+private:
+	std::vector<Field> m_fields;
+	int m_frameSize;
+	int m_valueCount;
+};
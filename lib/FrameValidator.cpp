@@ -0,0 +1,124 @@
+#include <FrameValidator.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FRAME_VALIDATOR_X86
+#include <immintrin.h>
+#endif
+
+
+//*************************************************************************************************
+static unsigned char xorBytesScalar(const unsigned char* data, size_t length)
+{
+	unsigned char result = 0;
+
+	for (size_t i = 0; i < length; ++i)
+		result ^= data[i];
+
+	return result;
+}
+
+
+#ifdef FRAME_VALIDATOR_X86
+
+//*************************************************************************************************
+__attribute__((target("sse2")))
+static unsigned char foldXor128(__m128i value)
+{
+	//XOR the 16 bytes of the register together
+	value = _mm_xor_si128(value, _mm_srli_si128(value, 8));
+	value = _mm_xor_si128(value, _mm_srli_si128(value, 4));
+	value = _mm_xor_si128(value, _mm_srli_si128(value, 2));
+	value = _mm_xor_si128(value, _mm_srli_si128(value, 1));
+	return (unsigned char) _mm_cvtsi128_si32(value);
+}
+
+
+//*************************************************************************************************
+__attribute__((target("sse2")))
+static unsigned char xorBytesSSE2(const unsigned char* data, size_t length)
+{
+	__m128i accumulator = _mm_setzero_si128();
+	size_t i = 0;
+
+	for (; i + 16 <= length; i += 16)
+		accumulator = _mm_xor_si128(accumulator, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+
+	return foldXor128(accumulator) ^ xorBytesScalar(data + i, length - i);
+}
+
+
+//*************************************************************************************************
+__attribute__((target("avx2")))
+static unsigned char xorBytesAVX2(const unsigned char* data, size_t length)
+{
+	__m256i accumulator = _mm256_setzero_si256();
+	size_t i = 0;
+
+	for (; i + 32 <= length; i += 32)
+		accumulator = _mm256_xor_si256(accumulator, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)));
+
+	__m128i folded = _mm_xor_si128(_mm256_castsi256_si128(accumulator), _mm256_extracti128_si256(accumulator, 1));
+
+	if (i + 16 <= length)
+	{
+		folded = _mm_xor_si128(folded, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+		i += 16;
+	}
+
+	return foldXor128(folded) ^ xorBytesScalar(data + i, length - i);
+}
+
+#endif
+
+
+//*************************************************************************************************
+FrameValidator::FrameValidator():
+	m_xorBytes{xorBytesScalar},
+	m_implementationName{"scalar"}
+{
+#ifdef FRAME_VALIDATOR_X86
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+	{
+		m_xorBytes = xorBytesAVX2;
+		m_implementationName = "AVX2";
+	}
+	else if (__builtin_cpu_supports("sse2"))
+	{
+		m_xorBytes = xorBytesSSE2;
+		m_implementationName = "SSE2";
+	}
+#endif
+}
+
+
+//*************************************************************************************************
+bool FrameValidator::isValidFrame(const unsigned char* frame, size_t frameSize)
+{
+	if (frame[frameSize - 1] != FRAME_END_MARKER)
+		return false;
+
+	return (m_xorBytes(frame, frameSize - 2) == frame[frameSize - 2]);
+}
+
+
+//*************************************************************************************************
+size_t FrameValidator::countValidFrames(const unsigned char* data, size_t frameSize, size_t frameCount)
+{
+	//End markers are checked for all frames first, so that a misaligned stream is rejected without computing checksums
+	size_t markedCount = 0;
+
+	while (markedCount < frameCount && data[(markedCount + 1) * frameSize - 1] == FRAME_END_MARKER)
+		++markedCount;
+
+	for (size_t n = 0; n < markedCount; ++n)
+	{
+		const unsigned char* frame = data + n * frameSize;
+
+		if (m_xorBytes(frame, frameSize - 2) != frame[frameSize - 2])
+			return n;
+	}
+
+	return markedCount;
+}
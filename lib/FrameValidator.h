@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/*
+This class validates binary frames: a frame is valid when its last byte is the end marker (0xFF) and the byte before it
+is the XOR of all preceding bytes of the frame
+The XOR is computed with AVX2 or SSE2 when available (selected at runtime from the CPU features), otherwise byte by byte
+*/
+class FrameValidator
+{
+public:
+	FrameValidator();
+
+	bool isValidFrame(const unsigned char* frame, size_t frameSize);
+
+	//Validates frameCount contiguous frames in one pass; returns the no. of leading valid frames (frameCount if all are valid)
+	size_t countValidFrames(const unsigned char* data, size_t frameSize, size_t frameCount);
+
+	std::string getImplementationName() { return m_implementationName; }
+
+	static const unsigned char FRAME_END_MARKER = 0xFF;
+
+private:
+	typedef unsigned char (*XorFunction)(const unsigned char* data, size_t length);
+
+	XorFunction m_xorBytes;
+	std::string m_implementationName;
+};
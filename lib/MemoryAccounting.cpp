@@ -0,0 +1,104 @@
+#include <MemoryAccounting.h>
+#include <Logger.h>
+
+//Pressure levels as percentages of the budget
+static const int SPILL_PERCENTAGE = 70;
+static const int THROTTLE_PERCENTAGE = 85;
+static const int SHED_PERCENTAGE = 100;
+
+
+//*************************************************************************************************
+MemoryAccounting::MemoryAccounting():
+	m_budgetBytes{0},
+	m_peakUsageBytes{0},
+	m_pressureLevel{PRESSURE_NONE},
+	m_pressureLevelChangeCount{0}
+{
+	for (int i = 0; i < SUBSYSTEM_COUNT; ++i)
+		m_usageBytes[i] = 0;
+}
+
+
+//*************************************************************************************************
+long MemoryAccounting::getTotalUsage()
+{
+	long totalBytes = 0;
+
+	for (int i = 0; i < SUBSYSTEM_COUNT; ++i)
+		totalBytes += m_usageBytes[i];
+
+	return totalBytes;
+}
+
+
+//*************************************************************************************************
+long MemoryAccounting::getOverageBytes()
+{
+	if (m_budgetBytes <= 0)
+		return 0;
+
+	long overageBytes = getTotalUsage() - m_budgetBytes;
+	return (overageBytes > 0) ? overageBytes : 0;
+}
+
+
+//*************************************************************************************************
+MemoryAccounting::PressureLevel MemoryAccounting::updatePressureLevel()
+{
+	long totalBytes = getTotalUsage();
+
+	if (totalBytes > m_peakUsageBytes)
+		m_peakUsageBytes = totalBytes;
+
+	if (m_budgetBytes <= 0)
+		return m_pressureLevel;
+
+	long usagePercentage = totalBytes * 100 / m_budgetBytes;
+	PressureLevel pressureLevel = PRESSURE_NONE;
+
+	if (usagePercentage >= SHED_PERCENTAGE)
+		pressureLevel = PRESSURE_SHED;
+	else if (usagePercentage >= THROTTLE_PERCENTAGE)
+		pressureLevel = PRESSURE_THROTTLE;
+	else if (usagePercentage >= SPILL_PERCENTAGE)
+		pressureLevel = PRESSURE_SPILL;
+
+	if (pressureLevel != m_pressureLevel)
+	{
+		BOOST_LOG_TRIVIAL(warning) << "Memory pressure level changed from " << m_pressureLevel << " to " << pressureLevel
+					<< "; usage: " << totalBytes << " bytes of budget: " << m_budgetBytes << " bytes";
+
+		m_pressureLevel = pressureLevel;
+		++m_pressureLevelChangeCount;
+	}
+
+	return m_pressureLevel;
+}
+
+
+//*************************************************************************************************
+std::string MemoryAccounting::getSubsystemName(int subsystem)
+{
+	switch (subsystem)
+	{
+		case CONNECTION_BUFFERS: return "connection buffers";
+		case RECORD_CACHE: return "record cache";
+		case OUT_OF_ORDER_STORE: return "out-of-order store";
+		case NULL_CACHES: return "null caches";
+		case FORWARD_QUEUE: return "forward queue";
+		default: return "unknown";
+	}
+}
+
+
+//*************************************************************************************************
+void MemoryAccounting::dumpMemoryInformation(std::ofstream& fileStream)
+{
+	fileStream << "------------- From class MemoryAccounting -------------\n" << std::endl;
+
+	for (int i = 0; i < SUBSYSTEM_COUNT; ++i)
+		fileStream << getSubsystemName(i) << " = " << m_usageBytes[i] << " bytes" << std::endl;
+
+	fileStream << "total = " << getTotalUsage() << " bytes, m_peakUsageBytes = " << m_peakUsageBytes << ", m_budgetBytes = " << m_budgetBytes << std::endl;
+	fileStream << "m_pressureLevel = " << m_pressureLevel << ", m_pressureLevelChangeCount = " << m_pressureLevelChangeCount << '\n' << std::endl;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+
+/*
+This singleton class keeps account of the bytes held by each ingest subsystem and compares their total against a global budget
+Subsystems report their usage; the resulting pressure level tells them how to degrade (spill to disk, slow down reads, shed connections)
+*/
+class MemoryAccounting
+{
+public:
+	enum Subsystem
+	{
+		CONNECTION_BUFFERS = 0,	//partially received messages per connection
+		RECORD_CACHE,
+		OUT_OF_ORDER_STORE,
+		NULL_CACHES,	//null update cache, null entry delete cache and in-memory null entries
+		FORWARD_QUEUE,	//data queued for sending to the forwarding server
+		SUBSYSTEM_COUNT
+	};
+
+	enum PressureLevel
+	{
+		PRESSURE_NONE = 0,
+		PRESSURE_SPILL,		//caches are written out (to file if the database fails) instead of being held
+		PRESSURE_THROTTLE,	//no reads from connections and no new connections
+		PRESSURE_SHED		//newest connections are closed
+	};
+
+	static MemoryAccounting& getInstance()
+	{
+		static MemoryAccounting instance;	// Instantiated on first use.
+		return instance;
+	}
+
+	void setBudget(long budgetBytes) { m_budgetBytes = budgetBytes; }	//0 = unlimited
+	long getBudget() { return m_budgetBytes; }
+
+	void add(Subsystem subsystem, long bytes) { m_usageBytes[subsystem] += bytes; }
+	void set(Subsystem subsystem, long bytes) { m_usageBytes[subsystem] = bytes; }
+	long getUsage(Subsystem subsystem) { return m_usageBytes[subsystem]; }
+	long getTotalUsage();
+	long getOverageBytes();	//usage above the budget (0 if within it, or unlimited)
+
+	//Re-evaluate the pressure level from current usage (logs level changes)
+	PressureLevel updatePressureLevel();
+	PressureLevel getPressureLevel() { return m_pressureLevel; }
+
+	void dumpMemoryInformation(std::ofstream& fileStream);
+
+private:
+	MemoryAccounting();
+
+	//Delete copy c'tor and assignment operator
+	MemoryAccounting(MemoryAccounting const&) = delete;
+	void operator=(MemoryAccounting const&) = delete;
+
+	static std::string getSubsystemName(int subsystem);
+
+	long m_budgetBytes;
+	long m_usageBytes[SUBSYSTEM_COUNT];
+	long m_peakUsageBytes;
+
+	PressureLevel m_pressureLevel;
+	unsigned long m_pressureLevelChangeCount;
+};
@@ -0,0 +1,186 @@
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <cstring>
+#include <cerrno>
+
+#include <RawFrameCapture.h>
+#include <Logger.h>
+
+volatile sig_atomic_t RawFrameCapture::s_isToggleRequested = 0;
+
+static const char CAPTURE_FILE_MAGIC[8] = {'E', 'P', 'R', 'O', 'C', 'A', 'P', '2'};
+
+
+//*************************************************************************************************
+RawFrameCapture::RawFrameCapture():
+	m_fileFD{-1},
+	m_mappingSize{0},
+	m_fileHeader{NULL},
+	m_slots{NULL},
+	m_isEnabled{false}
+{
+}
+
+
+//*************************************************************************************************
+RawFrameCapture::~RawFrameCapture()
+{
+	close();
+}
+
+
+//*************************************************************************************************
+bool RawFrameCapture::open(const std::string& filename, long fileSizeBytes, size_t slotPayloadSize)
+{
+	close();
+
+	//Slots are kept 8 byte aligned
+	size_t slotSize = (sizeof(SlotHeader) + slotPayloadSize + 7) / 8 * 8;
+	long slotCount = (fileSizeBytes - (long) sizeof(FileHeader)) / (long) slotSize;
+
+	if (slotCount < 1)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Raw frame capture file size (" << fileSizeBytes << " bytes) is too small for slots of " << slotSize << " bytes";
+		return false;
+	}
+
+	size_t mappingSize = sizeof(FileHeader) + slotCount * slotSize;
+
+	m_fileFD = ::open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+
+	if (m_fileFD == -1)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Cannot open raw frame capture file: " << filename;
+		BOOST_LOG_TRIVIAL(error) << "errno: " << errno << ", error string: " << strerror(errno);
+		return false;
+	}
+
+	//Allocate the whole file up front, so that capturing never extends it
+	int result = posix_fallocate(m_fileFD, 0, mappingSize);
+
+	if (result != 0 || ftruncate(m_fileFD, mappingSize) == -1)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Cannot allocate " << mappingSize << " bytes for raw frame capture file: " << filename;
+		BOOST_LOG_TRIVIAL(error) << "error string: " << strerror(result != 0 ? result : errno);
+		close();
+		return false;
+	}
+
+	void* mapping = mmap(NULL, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fileFD, 0);
+
+	if (mapping == MAP_FAILED)
+	{
+		BOOST_LOG_TRIVIAL(error) << "mmap() failed for raw frame capture file: " << filename;
+		BOOST_LOG_TRIVIAL(error) << "errno: " << errno << ", error string: " << strerror(errno);
+		close();
+		return false;
+	}
+
+	m_mappingSize = mappingSize;
+	m_fileHeader = static_cast<FileHeader*>(mapping);
+	m_slots = static_cast<unsigned char*>(mapping) + sizeof(FileHeader);
+
+	//Continue an existing ring with the same layout; otherwise start a new one
+	if (memcmp(m_fileHeader->m_magic, CAPTURE_FILE_MAGIC, sizeof(CAPTURE_FILE_MAGIC)) != 0 || m_fileHeader->m_slotSize != slotSize
+		|| m_fileHeader->m_slotPayloadSize != slotPayloadSize || m_fileHeader->m_slotCount != (uint64_t) slotCount)
+	{
+		memset(m_fileHeader, 0, sizeof(FileHeader));
+		memcpy(m_fileHeader->m_magic, CAPTURE_FILE_MAGIC, sizeof(CAPTURE_FILE_MAGIC));
+		m_fileHeader->m_slotSize = slotSize;
+		m_fileHeader->m_slotPayloadSize = slotPayloadSize;
+		m_fileHeader->m_slotCount = slotCount;
+		m_fileHeader->m_writeCount = 0;
+	}
+
+	BOOST_LOG_TRIVIAL(info) << "Raw frame capture file opened: " << filename << ", slot count: " << slotCount << ", slot payload size: " << slotPayloadSize;
+	return true;
+}
+
+
+//*************************************************************************************************
+void RawFrameCapture::close()
+{
+	m_isEnabled = false;
+
+	if (m_fileHeader != NULL)
+	{
+		munmap(m_fileHeader, m_mappingSize);
+		m_fileHeader = NULL;
+		m_slots = NULL;
+		m_mappingSize = 0;
+	}
+
+	if (m_fileFD != -1)
+	{
+		::close(m_fileFD);
+		m_fileFD = -1;
+	}
+}
+
+
+//*************************************************************************************************
+void RawFrameCapture::capture(int FD, SlotType slotType, const unsigned char* data, size_t length)
+{
+	if (!m_isEnabled)
+		return;
+
+	uint64_t writeCount = m_fileHeader->m_writeCount;
+	unsigned char* slot = m_slots + (writeCount % m_fileHeader->m_slotCount) * m_fileHeader->m_slotSize;
+
+	if (length > m_fileHeader->m_slotPayloadSize)
+		length = m_fileHeader->m_slotPayloadSize;
+
+	struct timespec timeSpec;
+	clock_gettime(CLOCK_REALTIME, &timeSpec);
+
+	SlotHeader* slotHeader = reinterpret_cast<SlotHeader*>(slot);
+	slotHeader->m_timestampNs = (int64_t) timeSpec.tv_sec * 1000000000 + timeSpec.tv_nsec;
+	slotHeader->m_FD = FD;
+	slotHeader->m_length = length;
+	slotHeader->m_type = slotType;
+	slotHeader->m_reserved = 0;
+
+	if (length > 0)
+		memcpy(slot + sizeof(SlotHeader), data, length);
+
+	m_fileHeader->m_writeCount = writeCount + 1;
+}
+
+
+//*************************************************************************************************
+bool RawFrameCapture::installToggleSignal(int signalNumber)
+{
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = onToggleSignal;
+	sigemptyset(&action.sa_mask);
+
+	if (sigaction(signalNumber, &action, NULL) == -1)
+	{
+		BOOST_LOG_TRIVIAL(error) << "sigaction() failed for raw frame capture toggle signal: " << signalNumber;
+		BOOST_LOG_TRIVIAL(error) << "errno: " << errno << ", error string: " << strerror(errno);
+		return false;
+	}
+
+	return true;
+}
+
+
+//*************************************************************************************************
+bool RawFrameCapture::isToggleRequested()
+{
+	if (s_isToggleRequested == 0)
+		return false;
+
+	s_isToggleRequested = 0;
+	return true;
+}
+
+
+//*************************************************************************************************
+void RawFrameCapture::onToggleSignal(int signalNumber)
+{
+	s_isToggleRequested = 1;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+#include <signal.h>
+
+/*
+This class captures received binary data into a preallocated ring file (memory mapped, fixed size slots; oldest slots are overwritten)
+Each slot holds the capture time, the connection FD, the slot type and up to the slot payload size of data
+Slots are either decoded frames or, for replaying traffic (see dummy_device/stream_replay), the raw bytes of each read and connection events
+Capturing is a copy into the mapping (no system calls); callers check isEnabled() so that a disabled capture costs only a branch
+*/
+class RawFrameCapture
+{
+public:
+	RawFrameCapture();
+	~RawFrameCapture();
+
+	//Create (or reuse) the ring file with as many slots as fit in fileSizeBytes
+	bool open(const std::string& filename, long fileSizeBytes, size_t slotPayloadSize);
+	void close();
+	bool isOpen() { return m_fileHeader != NULL; }
+
+	void setEnabled(bool isEnabled) { m_isEnabled = isEnabled && isOpen(); }
+	bool isEnabled() { return m_isEnabled; }
+
+	enum SlotType
+	{
+		SLOT_FRAME = 0,		//one frame at the start of a connection buffer (valid or invalid)
+		SLOT_STREAM_DATA,	//bytes of one read from a connection, as received
+		SLOT_CONNECTION_OPENED,
+		SLOT_CONNECTION_CLOSED
+	};
+
+	void capture(int FD, SlotType slotType, const unsigned char* data, size_t length);
+
+	//Runtime switch: the given signal sets a flag that the event loop consumes with isToggleRequested()
+	static bool installToggleSignal(int signalNumber);
+	static bool isToggleRequested();
+
+	//Ring file layout (native byte order)
+	struct FileHeader
+	{
+		char m_magic[8];	//"EPROCAP2"
+		uint32_t m_slotSize;	//bytes per slot including the slot header
+		uint32_t m_slotPayloadSize;
+		uint64_t m_slotCount;
+		uint64_t m_writeCount;	//total no. of slots written; the next slot is m_writeCount % m_slotCount
+		char m_reserved[32];
+	};
+
+	struct SlotHeader
+	{
+		int64_t m_timestampNs;	//CLOCK_REALTIME
+		int32_t m_FD;
+		uint32_t m_length;
+		uint32_t m_type;	//SlotType
+		uint32_t m_reserved;
+	};
+
+private:
+	static void onToggleSignal(int signalNumber);
+
+	static volatile sig_atomic_t s_isToggleRequested;
+
+	int m_fileFD;
+	size_t m_mappingSize;
+	FileHeader* m_fileHeader;
+	unsigned char* m_slots;
+	bool m_isEnabled;
+};
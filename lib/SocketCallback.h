@@ -18,6 +18,8 @@ public:
 	virtual void OnConnect(ServerSocket* server, ClientSocket* client) {} //client = which client socket connected
 	virtual void OnDisconnect(ServerSocket* server, ClientSocket* client) {}
 	virtual void OnData(ServerSocket* server, ClientSocket* client, std::string message) {}
+	virtual void OnPollCycleEnd(ServerSocket* server) {} //fired after all ready FDs of one select() call are handled
+	virtual void OnServerHandoff(ServerSocket* server) {} //fired just before the server socket is handed off to a new process
 
 	//Timer callback
 	virtual void OnTimer(Timer* timer) {}
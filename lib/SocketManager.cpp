@@ -1,11 +1,13 @@
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h> //sockaddr_un
 #include <netdb.h>
 #include <arpa/inet.h> //inet_ntop
 #include <sys/timerfd.h> //timerfd_create
 #include <time.h> //timerfd_create
 #include <ctime>
 #include <unistd.h>
+#include <fcntl.h>
 
 #include <cstring> //memset, stoi
 #include <sstream>
@@ -24,14 +26,41 @@
 #include <SocketCallback.h>
 #include <Logger.h>
 #include <ConfigurationHandler.h>
+#include <MemoryAccounting.h>
+
+//Connection shedding under memory pressure: at most one connection per interval, and a limited no. per pressure episode
+static const long SHED_INTERVAL_MS = 1000;
+static const int SHED_MAX_CONNECTIONS_PER_EPISODE = 10;
 
 
 //*************************************************************************************************
 SocketManager::SocketManager():
 	m_serverSocket{nullptr},
+	m_acceptCount{0},
+	m_listenBacklog{128},
+	m_acceptBatchSize{1},
+	m_shedConnectionCount{0},
+	m_fdLimitRejectCount{0},
+	m_episodeShedCount{0},
+	m_lastShedTimeMs{0},
+	m_isPeerReadingPaused{false},
+	m_isBufferLimitDisconnect{false},
+	m_bufferLimitExceededCount{0},
+	m_quotaBytesPerSecond{0},
+	m_quotaRecordsPerSecond{0},
+	m_quotaBurstSeconds{1},
+	m_quotaPauseCount{0},
+	m_invalidFrameCount{0},
+	m_resyncCount{0},
+	m_resyncDiscardedByteCount{0},
+	m_rawFrameCaptureFileSize{0},
+	m_isStreamCapture{false},
 	m_receiveBufferSize{512}, //default value if unset
 	m_bufferedMessageHardLimit{8192}, //default value if unset
-	m_msgTerminationCharacter{'\n'} //default value if unset
+	m_msgTerminationCharacter{'\n'}, //default value if unset
+	m_handoffSocketFD{-1},
+	m_isServerHandedOff{false},
+	m_isRunning{false}
 {
 }
 
@@ -41,6 +70,9 @@ SocketManager::~SocketManager()
 {
 	closeServerSocket();
 
+	if (m_handoffSocketFD != -1)
+		close(m_handoffSocketFD);
+
 	//Close all independent client sockets
 	auto iter = m_independantClientSockets.begin();
 	while (iter != m_independantClientSockets.end())
@@ -82,6 +114,66 @@ void SocketManager::setMsgTerminationCharacter(char character)
 }
 
 
+//*************************************************************************************************
+void SocketManager::setBufferedMessageLimitPolicy(bool isDisconnect)
+{
+	m_isBufferLimitDisconnect = isDisconnect;
+}
+
+
+//*************************************************************************************************
+void SocketManager::setConnectionQuotas(long bytesPerSecond, long recordsPerSecond, int burstSeconds)
+{
+	m_quotaBytesPerSecond = bytesPerSecond;
+	m_quotaRecordsPerSecond = recordsPerSecond;
+	m_quotaBurstSeconds = std::max(burstSeconds, 1);
+}
+
+
+//*************************************************************************************************
+void SocketManager::setAcceptParameters(int listenBacklog, int acceptBatchSize)
+{
+	m_listenBacklog = std::max(listenBacklog, 1);
+	m_acceptBatchSize = std::max(acceptBatchSize, 1);
+}
+
+
+//*************************************************************************************************
+void SocketManager::configureRawFrameCapture(const std::string& filename, long fileSizeBytes, bool isStreamCapture, bool isEnabled)
+{
+	m_rawFrameCaptureFilename = filename;
+	m_rawFrameCaptureFileSize = fileSizeBytes;
+	m_isStreamCapture = isStreamCapture;
+
+	RawFrameCapture::installToggleSignal(SIGUSR2);
+
+	if (isEnabled)
+		setRawFrameCaptureEnabled(true);
+}
+
+
+//*************************************************************************************************
+bool SocketManager::setRawFrameCaptureEnabled(bool isEnabled)
+{
+	if (isEnabled && !m_rawFrameCapture.isOpen())
+	{
+		//Slots hold one read (stream capture) or one frame, in which case the frame layout is needed first
+		if (!m_isStreamCapture && !m_frameLayout.isLoaded() && !loadFrameLayout())
+			return false;
+
+		size_t slotPayloadSize = (m_isStreamCapture ? m_receiveBufferSize : m_frameLayout.getFrameSize());
+
+		if (!m_rawFrameCapture.open(m_rawFrameCaptureFilename, m_rawFrameCaptureFileSize, slotPayloadSize))
+			return false;
+	}
+
+	m_rawFrameCapture.setEnabled(isEnabled);
+
+	BOOST_LOG_TRIVIAL(info) << "Raw frame capture " << (m_rawFrameCapture.isEnabled() ? "enabled" : "disabled");
+	return true;
+}
+
+
 //*************************************************************************************************
 ServerSocket* SocketManager::createServer(char* serverPort, SocketCallback* callback)
 {
@@ -112,6 +204,14 @@ ServerSocket* SocketManager::createServer(char* serverPort, SocketCallback* call
 		return nullptr;
 	}
 
+	//Allow re-binding immediately after a restart (while connections of the previous process are in TIME_WAIT)
+	int reuseAddress = 1;
+	if (setsockopt(socketFD, SOL_SOCKET, SO_REUSEADDR, &reuseAddress, sizeof(reuseAddress)) == -1)
+	{
+		BOOST_LOG_TRIVIAL(warning) << "Unable to set SO_REUSEADDR on server socket";
+		BOOST_LOG_TRIVIAL(warning) << "errno: " << errno << ", error string: " << strerror(errno);
+	}
+
 	if (bind(socketFD, info->ai_addr, info->ai_addrlen) == -1)
 	{
 		BOOST_LOG_TRIVIAL(error) << "Unable to bind socket at " << serverPort;
@@ -130,6 +230,97 @@ ServerSocket* SocketManager::createServer(char* serverPort, SocketCallback* call
 }
 
 
+//*************************************************************************************************
+ServerSocket* SocketManager::inheritServer(const char* handoffSocketPath, SocketCallback* callback)
+{
+	if (m_serverSocket != nullptr)
+	{
+		BOOST_LOG_TRIVIAL(error) << "One server has been already created. Application supports only one server";
+		return nullptr;
+	}
+
+	int unixSocketFD = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (unixSocketFD == -1)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Unable to create Unix socket for server socket handoff";
+		return nullptr;
+	}
+
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, handoffSocketPath, sizeof(address.sun_path) - 1);
+
+	if (::connect(unixSocketFD, (struct sockaddr*)&address, sizeof(address)) == -1)
+	{
+		BOOST_LOG_TRIVIAL(info) << "No running process to inherit server socket from (handoff socket: " << handoffSocketPath << ")";
+		close(unixSocketFD);
+		return nullptr;
+	}
+
+	BOOST_LOG_TRIVIAL(info) << "Requesting server socket from running process via handoff socket: " << handoffSocketPath;
+
+	//The running process flushes its state before handing off, so allow it some time
+	struct timeval tv;
+	tv.tv_sec = 120;
+	tv.tv_usec = 0;
+	setsockopt(unixSocketFD, SOL_SOCKET, SO_RCVTIMEO, (char *)&tv, sizeof(struct timeval));
+
+	int socketFD = receiveFileDescriptor(unixSocketFD);
+	close(unixSocketFD);
+
+	if (socketFD == -1)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed to receive server socket from running process";
+		return nullptr;
+	}
+
+	char serverIP[18];
+	getLocalIP(socketFD, serverIP);
+	int serverPort = getLocalClientPort(socketFD);
+
+	BOOST_LOG_TRIVIAL(info) << "Inherited listening server socket, FD: " << socketFD << ", port: " << serverPort;
+
+	m_serverSocket = new ServerSocket(socketFD, this, callback, serverIP, serverPort);
+
+	return m_serverSocket;
+}
+
+
+//*************************************************************************************************
+bool SocketManager::enableServerHandoff(const char* handoffSocketPath)
+{
+	int unixSocketFD = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (unixSocketFD == -1)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Unable to create Unix socket for server socket handoff";
+		return false;
+	}
+
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, handoffSocketPath, sizeof(address.sun_path) - 1);
+
+	unlink(handoffSocketPath);	//Stale path of a previous process
+
+	if (bind(unixSocketFD, (struct sockaddr*)&address, sizeof(address)) == -1 || listen(unixSocketFD, 1) == -1)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Unable to bind/listen on handoff socket: " << handoffSocketPath;
+		BOOST_LOG_TRIVIAL(error) << "errno: " << errno << ", error string: " << strerror(errno);
+		close(unixSocketFD);
+		return false;
+	}
+
+	m_handoffSocketFD = unixSocketFD;
+
+	BOOST_LOG_TRIVIAL(info) << "Server socket handoff enabled on: " << handoffSocketPath << ", FD: " << m_handoffSocketFD;
+	return true;
+}
+
+
 //*************************************************************************************************
 ClientSocket* SocketManager::createClient(char* remoteServerIP, char* remoteServerPort, SocketCallback* callback)
 {
@@ -187,10 +378,13 @@ Timer* SocketManager::createTimer(int intervalSeconds, std::string timerName, So
 	struct itimerspec itval;
 	int timerFD;
 
+	//The first fire is set as an absolute time, so that each expiration's due time is known exactly (to measure firing delays)
+	long long firstDueTimeNs = Timer::getMonotonicTimeNs() + (long long) intervalSeconds * 1000000000;
+
 	itval.it_interval.tv_sec = intervalSeconds;	//interval
 	itval.it_interval.tv_nsec = 0;
-	itval.it_value.tv_sec = intervalSeconds;	//time until first fire
-	itval.it_value.tv_nsec = 0;
+	itval.it_value.tv_sec = firstDueTimeNs / 1000000000;	//time of first fire
+	itval.it_value.tv_nsec = firstDueTimeNs % 1000000000;
 
 	timerFD = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);	//Create timer
 
@@ -201,7 +395,7 @@ Timer* SocketManager::createTimer(int intervalSeconds, std::string timerName, So
 		return nullptr;
 	}
 
-	if (timerfd_settime(timerFD, 0, &itval, NULL) == -1)	//Start timer
+	if (timerfd_settime(timerFD, TFD_TIMER_ABSTIME, &itval, NULL) == -1)	//Start timer
 	{
 		BOOST_LOG_TRIVIAL(error) << "Error starting timer (timerfd_settime())" << timerFD;
 		BOOST_LOG_TRIVIAL(error) << "errno: " << errno << ", error string: " << strerror(errno);
@@ -209,6 +403,7 @@ Timer* SocketManager::createTimer(int intervalSeconds, std::string timerName, So
 	}
 
 	Timer* timer = new Timer(timerFD, intervalSeconds, timerName, this, callback);
+	timer->setFirstDueTime(firstDueTimeNs);
 	m_timerMap[timerFD] = timer;
 
 	BOOST_LOG_TRIVIAL(info) << "Created timer, timer name: " << timerName << ", interval: " << intervalSeconds << " seconds, timer FD: " << timerFD;
@@ -267,7 +462,17 @@ void SocketManager::run()
 
 	if (m_serverSocket)  //valid only for server side application
 	{
-		if (listen(serverSocketFD, 128) == -1)
+		//Accepting stops at an empty accept queue instead of blocking (accepted sockets do not inherit O_NONBLOCK)
+		int flags = fcntl(serverSocketFD, F_GETFL, 0);
+		if (flags == -1 || fcntl(serverSocketFD, F_SETFL, flags | O_NONBLOCK) == -1)
+		{
+			BOOST_LOG_TRIVIAL(error) << "Unable to set server socket FD: " << serverSocketFD << " non-blocking";
+			BOOST_LOG_TRIVIAL(error) << "errno: " << errno << ", error string: " << strerror(errno);
+			return;
+		}
+
+		//An inherited server socket is already listening; listen() again only updates its backlog
+		if (listen(serverSocketFD, m_listenBacklog) == -1)
 		{
 			BOOST_LOG_TRIVIAL(error) << "Unable to listen on socket FD: " << serverSocketFD;
 			BOOST_LOG_TRIVIAL(error) << "errno: " << errno << ", error string: " << strerror(errno);
@@ -285,6 +490,12 @@ void SocketManager::run()
 		fdmax = std::max(clientSocketFD, fdmax);
 	}
 
+	if (m_handoffSocketFD != -1)
+	{
+		FD_SET(m_handoffSocketFD, &m_masterFDSet);
+		fdmax = std::max(m_handoffSocketFD, fdmax);
+	}
+
 	//Add timer FDs and find max timer FD
 	for(auto& entry : m_timerMap)
 	{
@@ -301,12 +512,59 @@ void SocketManager::run()
 
 	char garbageBuffer[m_receiveBufferSize*10];
 
-	while(true)
+	MemoryAccounting& memoryAccounting = MemoryAccounting::getInstance();
+
+	m_isRunning = true;
+
+	while(m_isRunning)
 	{
+		if (RawFrameCapture::isToggleRequested())
+			setRawFrameCaptureEnabled(!m_rawFrameCapture.isEnabled());
+
+		MemoryAccounting::PressureLevel pressureLevel = memoryAccounting.updatePressureLevel();
+
+		if (pressureLevel == MemoryAccounting::PRESSURE_SHED)
+			shedNewestConnection();
+		else
+			m_episodeShedCount = 0;	//Pressure episode ended
+
+		long quotaWaitMs = resumeQuotaPausedConnections();
+
 		m_readFDSet = m_masterFDSet;
 
-		if (select(fdmax+1, &m_readFDSet, NULL, NULL, NULL) == -1)
+		struct timeval* selectTimeout = NULL;
+		struct timeval throttleTimeout;
+
+		if (quotaWaitMs >= 0)	//Wake up to resume connections paused for exceeding a quota
+		{
+			throttleTimeout.tv_sec = quotaWaitMs / 1000;
+			throttleTimeout.tv_usec = (quotaWaitMs % 1000) * 1000;
+			selectTimeout = &throttleTimeout;
+		}
+
+		if (pressureLevel >= MemoryAccounting::PRESSURE_THROTTLE)
+		{
+			//Leave peer connections unread (TCP flow control holds back devices) and stop accepting new ones
+			for (auto& entry: m_peerClientSockets)
+				FD_CLR(entry.first, &m_readFDSet);
+
+			if (m_serverSocket)
+				FD_CLR(serverSocketFD, &m_readFDSet);
+
+			//Return periodically, so that the poll cycle end callback can relieve memory pressure
+			if (selectTimeout == NULL || throttleTimeout.tv_sec > 0 || throttleTimeout.tv_usec > 100000)
+			{
+				throttleTimeout.tv_sec = 0;
+				throttleTimeout.tv_usec = 100000;
+				selectTimeout = &throttleTimeout;
+			}
+		}
+
+		if (select(fdmax+1, &m_readFDSet, NULL, NULL, selectTimeout) == -1)
 		{
+			if (errno == EINTR)	//Interrupted by a signal (eg: raw frame capture toggle)
+				continue;
+
 			BOOST_LOG_TRIVIAL(error) << "select() failed. Application must be terminated\n";
 			BOOST_LOG_TRIVIAL(error) << "errno: " << errno << ", error string: " << strerror(errno);
 			break;
@@ -320,38 +578,18 @@ void SocketManager::run()
 			{
 				if (fdi == serverSocketFD) //fdi is the server's listening socket
 				{
-					struct sockaddr_storage peeraddr;
-					socklen_t addr_size = sizeof (peeraddr);
-					int peerSocketFD = accept(serverSocketFD, (struct sockaddr*)&peeraddr, &addr_size);
-
-					if (peerSocketFD == -1)
-					{
-						BOOST_LOG_TRIVIAL(error) << "Unable to accept on socket " << serverSocketFD;
-						BOOST_LOG_TRIVIAL(error) << "errno: " << errno << ", error string: " << strerror(errno);
-					}
-					else //accepted new client connection
+					//Take a burst of pending connections in one cycle, instead of one per (full FD scan) cycle
+					for (int i = 0; i < m_acceptBatchSize; ++i)
 					{
-						FD_SET(peerSocketFD, &m_masterFDSet);
-						if (peerSocketFD > fdmax)
-							fdmax = peerSocketFD;
-
-						//Get remote IP and remote and local client port
-						char remoteIP[18];
-						getRemoteIP(peerSocketFD, remoteIP);
-						int remoteClientPort = getRemoteClientPort(peerSocketFD);
-						int localClientPort = getLocalClientPort(peerSocketFD);
-
-						//create ClientSocket, add it to m_peerClientSockets and fire server side OnConnect
-
-						ClientSocket* peerClientSocket = new ClientSocket(2, peerSocketFD, this,
-												m_serverSocket->getCallback(), remoteIP, -1,
-												remoteClientPort, localClientPort, m_serverSocket);
-
-						m_peerClientSockets[peerSocketFD] = peerClientSocket;
-						m_serverSocket->getCallback()->OnConnect(m_serverSocket, peerClientSocket);
-
+						if (!acceptPeerConnection(serverSocketFD, fdmax))
+							break;
 					}
 				}
+				else if (fdi == m_handoffSocketFD) //a new process requests the server socket
+				{
+					if (handOffServerSocket())
+						break;	//Remaining ready FDs are left unread for the new process
+				}
 				else if (m_timerMap.count(fdi) > 0)	//fdi is a timer FD
 				{
 					unsigned long long queuedTimerFireCount;
@@ -380,6 +618,14 @@ void SocketManager::run()
 					else
 					{
 						Timer* timer = m_timerMap[fdi];
+						timer->recordExpirations(queuedTimerFireCount);
+
+						//The reactor thread was busy (eg: blocking database work) when the timer became due
+						long long delayMs = (Timer::getMonotonicTimeNs() - timer->getLastDueTime()) / 1000000;
+						if (delayMs >= 1000)
+							BOOST_LOG_TRIVIAL(warning) << "Timer fired late; name: " << timer->getTimerName() << ", delay: " << delayMs
+											<< " ms, missed expirations: " << queuedTimerFireCount - 1;
+
 						timer->getCallback()->OnTimer(timer);
 					}
 				}
@@ -424,6 +670,9 @@ void SocketManager::run()
 				}
 			} //End if (data available on any fdi)
 		} //End for (all fds upto fdmax)
+
+		if (m_serverSocket && m_isRunning)  //valid only for server side application
+			m_serverSocket->getCallback()->OnPollCycleEnd(m_serverSocket);
 	} //End while(true)
 
 	close(serverSocketFD);
@@ -432,6 +681,365 @@ void SocketManager::run()
 }
 
 
+//*************************************************************************************************
+void SocketManager::pausePeerReading()
+{
+	if (m_isPeerReadingPaused)
+		return;
+
+	for (auto& entry: m_peerClientSockets)
+		FD_CLR(entry.first, &m_masterFDSet);
+
+	m_isPeerReadingPaused = true;
+	BOOST_LOG_TRIVIAL(info) << "Paused reading from " << m_peerClientSockets.size() << " peer connections";
+}
+
+
+//*************************************************************************************************
+void SocketManager::resumePeerReading()
+{
+	if (!m_isPeerReadingPaused)
+		return;
+
+	for (auto& entry: m_peerClientSockets)
+	{
+		if (m_quotaPausedFDs.count(entry.first) == 0)	//Connections over quota are resumed when refilled
+			FD_SET(entry.first, &m_masterFDSet);
+	}
+
+	m_isPeerReadingPaused = false;
+	BOOST_LOG_TRIVIAL(info) << "Resumed reading from " << m_peerClientSockets.size() << " peer connections";
+}
+
+
+//*************************************************************************************************
+bool SocketManager::consumeQuota(int socketFD, long byteCount, long recordCount)
+{
+	auto quotaIter = m_connectionQuotas.find(socketFD);
+
+	if (quotaIter == m_connectionQuotas.end())	//Not a peer connection, quotas disabled or connection closed in a callback
+		return true;
+
+	ConnectionQuota& quota = quotaIter->second;
+
+	//Refill for the time elapsed since the last refill, up to the burst allowance
+	long nowMs = getMonotonicTimeMs();
+	double elapsedSeconds = (nowMs - quota.m_lastRefillTimeMs) / 1000.0;
+	quota.m_lastRefillTimeMs = nowMs;
+
+	quota.m_byteTokens = std::min(quota.m_byteTokens + elapsedSeconds * m_quotaBytesPerSecond, (double) m_quotaBytesPerSecond * m_quotaBurstSeconds);
+	quota.m_recordTokens = std::min(quota.m_recordTokens + elapsedSeconds * m_quotaRecordsPerSecond, (double) m_quotaRecordsPerSecond * m_quotaBurstSeconds);
+
+	long waitMs = 0;
+
+	if (m_quotaBytesPerSecond > 0)
+	{
+		quota.m_byteTokens -= byteCount;
+
+		if (quota.m_byteTokens < 0)
+			waitMs = std::max(waitMs, (long) (-quota.m_byteTokens * 1000 / m_quotaBytesPerSecond) + 1);
+	}
+
+	if (m_quotaRecordsPerSecond > 0)
+	{
+		quota.m_recordTokens -= recordCount;
+
+		if (quota.m_recordTokens < 0)
+			waitMs = std::max(waitMs, (long) (-quota.m_recordTokens * 1000 / m_quotaRecordsPerSecond) + 1);
+	}
+
+	if (waitMs == 0)
+		return true;
+
+	//Stop reading until the deficit is refilled
+	BOOST_LOG_TRIVIAL(debug) << "Connection exceeded input quota; pausing reading for " << waitMs << " ms, FD: " << socketFD;
+
+	FD_CLR(socketFD, &m_masterFDSet);
+	m_quotaPausedFDs[socketFD] = nowMs + waitMs;
+	++m_quotaPauseCount;
+	return false;
+}
+
+
+//*************************************************************************************************
+long SocketManager::resumeQuotaPausedConnections()
+{
+	if (m_quotaPausedFDs.size() == 0)
+		return -1;
+
+	long nowMs = getMonotonicTimeMs();
+	long waitMs = -1;
+
+	auto iter = m_quotaPausedFDs.begin();
+	while (iter != m_quotaPausedFDs.end())
+	{
+		if (iter->second <= nowMs)
+		{
+			if (!m_isPeerReadingPaused)
+				FD_SET(iter->first, &m_masterFDSet);
+
+			m_quotaPausedFDs.erase(iter++);
+		}
+		else
+		{
+			if (waitMs == -1 || iter->second - nowMs < waitMs)
+				waitMs = iter->second - nowMs;
+
+			++iter;
+		}
+	}
+
+	return waitMs;
+}
+
+
+//*************************************************************************************************
+long SocketManager::getMonotonicTimeMs()
+{
+	struct timespec timeSpec;
+	clock_gettime(CLOCK_MONOTONIC, &timeSpec);
+	return timeSpec.tv_sec * 1000 + timeSpec.tv_nsec / 1000000;
+}
+
+
+//*************************************************************************************************
+void SocketManager::dumpSocketInformation(std::ofstream& fileStream)
+{
+	fileStream << "------------- From class SocketManager -------------\n" << std::endl;
+	fileStream << "peer connection count = " << m_peerClientSockets.size() << ", m_isPeerReadingPaused = " << m_isPeerReadingPaused
+				<< ", m_shedConnectionCount = " << m_shedConnectionCount << std::endl;
+	fileStream << "m_bufferLimitExceededCount = " << m_bufferLimitExceededCount << ", m_fdLimitRejectCount = " << m_fdLimitRejectCount << std::endl;
+	fileStream << "m_invalidFrameCount = " << m_invalidFrameCount << ", m_resyncCount = " << m_resyncCount
+				<< ", m_resyncDiscardedByteCount = " << m_resyncDiscardedByteCount << std::endl;
+	fileStream << "raw frame capture enabled = " << m_rawFrameCapture.isEnabled() << std::endl;
+	fileStream << "m_quotaPauseCount = " << m_quotaPauseCount << ", currently paused for quota = " << m_quotaPausedFDs.size() << '\n' << std::endl;
+}
+
+
+//*************************************************************************************************
+void SocketManager::shedNewestConnection()
+{
+	//Closing a connection frees only its buffer; when the overage is held elsewhere (eg: caches of a stalled database),
+	//shedding would disconnect devices without relief, so throttling alone holds them back
+	MemoryAccounting& memoryAccounting = MemoryAccounting::getInstance();
+	long connectionBufferBytes = memoryAccounting.getUsage(MemoryAccounting::CONNECTION_BUFFERS);
+
+	if (connectionBufferBytes <= 0 || connectionBufferBytes * 2 < memoryAccounting.getOverageBytes())
+		return;
+
+	long nowMs = getMonotonicTimeMs();
+
+	if (m_episodeShedCount >= SHED_MAX_CONNECTIONS_PER_EPISODE || nowMs - m_lastShedTimeMs < SHED_INTERVAL_MS)
+		return;
+
+	int newestFD = -1;
+	unsigned long newestSequence = 0;
+
+	for (auto& entry: m_peerAcceptSequence)
+	{
+		if (entry.second > newestSequence)
+		{
+			newestFD = entry.first;
+			newestSequence = entry.second;
+		}
+	}
+
+	if (newestFD == -1)
+		return;
+
+	BOOST_LOG_TRIVIAL(warning) << "Closing newest connection under memory pressure; FD: " << newestFD;
+
+	ClientSocket* clientSocket = getClientSocket(newestFD);
+	clientSocket->getCallback()->OnDisconnect(m_serverSocket, clientSocket);
+
+	closeClientSocket(newestFD);
+	++m_shedConnectionCount;
+	++m_episodeShedCount;
+	m_lastShedTimeMs = nowMs;
+
+	if (m_episodeShedCount == SHED_MAX_CONNECTIONS_PER_EPISODE)
+		BOOST_LOG_TRIVIAL(warning) << "Connection shedding limit reached for this memory pressure episode; no more connections are closed until it ends";
+}
+
+
+//*************************************************************************************************
+bool SocketManager::acceptPeerConnection(int serverSocketFD, int& fdmax)
+{
+	struct sockaddr_storage peeraddr;
+	socklen_t addr_size = sizeof (peeraddr);
+	int peerSocketFD = accept(serverSocketFD, (struct sockaddr*)&peeraddr, &addr_size);
+
+	if (peerSocketFD == -1)
+	{
+		if (errno != EAGAIN && errno != EWOULDBLOCK)	//else accept queue is empty
+		{
+			BOOST_LOG_TRIVIAL(error) << "Unable to accept on socket " << serverSocketFD;
+			BOOST_LOG_TRIVIAL(error) << "errno: " << errno << ", error string: " << strerror(errno);
+		}
+		return false;
+	}
+
+	//select() cannot watch FDs >= FD_SETSIZE (FD_SET on them is undefined behaviour)
+	if (peerSocketFD >= FD_SETSIZE)
+	{
+		BOOST_LOG_TRIVIAL(warning) << "Rejecting connection; FD " << peerSocketFD << " exceeds the select() limit " << FD_SETSIZE;
+		close(peerSocketFD);
+		++m_fdLimitRejectCount;
+		return true;
+	}
+
+	//accepted new client connection
+	if (!m_isPeerReadingPaused)
+		FD_SET(peerSocketFD, &m_masterFDSet);
+
+	if (peerSocketFD > fdmax)
+		fdmax = peerSocketFD;
+
+	//Get remote IP and remote and local client port
+	char remoteIP[18];
+	getRemoteIP(peerSocketFD, remoteIP);
+	int remoteClientPort = getRemoteClientPort(peerSocketFD);
+	int localClientPort = getLocalClientPort(peerSocketFD);
+
+	//create ClientSocket, add it to m_peerClientSockets and fire server side OnConnect
+
+	ClientSocket* peerClientSocket = new ClientSocket(2, peerSocketFD, this,
+							m_serverSocket->getCallback(), remoteIP, -1,
+							remoteClientPort, localClientPort, m_serverSocket);
+
+	m_peerClientSockets[peerSocketFD] = peerClientSocket;
+	m_peerAcceptSequence[peerSocketFD] = ++m_acceptCount;
+
+	if (m_quotaBytesPerSecond > 0 || m_quotaRecordsPerSecond > 0)	//Start with a full burst allowance
+		m_connectionQuotas[peerSocketFD] = ConnectionQuota{(double) m_quotaBytesPerSecond * m_quotaBurstSeconds,
+							(double) m_quotaRecordsPerSecond * m_quotaBurstSeconds, getMonotonicTimeMs()};
+	if (m_isStreamCapture && m_rawFrameCapture.isEnabled())
+		m_rawFrameCapture.capture(peerSocketFD, RawFrameCapture::SLOT_CONNECTION_OPENED, NULL, 0);
+
+	m_serverSocket->getCallback()->OnConnect(m_serverSocket, peerClientSocket);
+
+	return true;
+}
+
+
+//*************************************************************************************************
+bool SocketManager::handOffServerSocket()
+{
+	int requestFD = accept(m_handoffSocketFD, NULL, NULL);
+
+	if (requestFD == -1)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Unable to accept on handoff socket " << m_handoffSocketFD;
+		BOOST_LOG_TRIVIAL(error) << "errno: " << errno << ", error string: " << strerror(errno);
+		return false;
+	}
+
+	if (m_serverSocket == nullptr)
+	{
+		close(requestFD);
+		return false;
+	}
+
+	BOOST_LOG_TRIVIAL(info) << "Server socket handoff requested by a new process";
+
+	//Let the application flush its state before the new process starts loading it
+	m_serverSocket->getCallback()->OnServerHandoff(m_serverSocket);
+
+	bool isSent = sendFileDescriptor(requestFD, m_serverSocket->getSocketFD());
+	close(requestFD);
+
+	if (isSent == false)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Failed to hand off server socket; continuing to serve";
+		return false;
+	}
+
+	BOOST_LOG_TRIVIAL(info) << "Server socket handed off to new process; stopping run loop";
+
+	FD_CLR(m_handoffSocketFD, &m_masterFDSet);
+	close(m_handoffSocketFD);
+	m_handoffSocketFD = -1;
+
+	m_isServerHandedOff = true;
+	m_isRunning = false;
+	return true;
+}
+
+
+//*************************************************************************************************
+bool SocketManager::sendFileDescriptor(int unixSocketFD, int FDToSend)
+{
+	char dataByte = 'F';	//At least one byte of normal data must accompany the ancillary data
+	struct iovec iov;
+	iov.iov_base = &dataByte;
+	iov.iov_len = sizeof(dataByte);
+
+	char controlBuffer[CMSG_SPACE(sizeof(int))];
+	memset(controlBuffer, 0, sizeof(controlBuffer));
+
+	struct msghdr message;
+	memset(&message, 0, sizeof(message));
+	message.msg_iov = &iov;
+	message.msg_iovlen = 1;
+	message.msg_control = controlBuffer;
+	message.msg_controllen = sizeof(controlBuffer);
+
+	struct cmsghdr* controlMessage = CMSG_FIRSTHDR(&message);
+	controlMessage->cmsg_level = SOL_SOCKET;
+	controlMessage->cmsg_type = SCM_RIGHTS;
+	controlMessage->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(controlMessage), &FDToSend, sizeof(int));
+
+	if (sendmsg(unixSocketFD, &message, 0) == -1)
+	{
+		BOOST_LOG_TRIVIAL(error) << "sendmsg() failed when sending FD: " << FDToSend;
+		BOOST_LOG_TRIVIAL(error) << "errno: " << errno << ", error string: " << strerror(errno);
+		return false;
+	}
+
+	return true;
+}
+
+
+//*************************************************************************************************
+int SocketManager::receiveFileDescriptor(int unixSocketFD)
+{
+	char dataByte;
+	struct iovec iov;
+	iov.iov_base = &dataByte;
+	iov.iov_len = sizeof(dataByte);
+
+	char controlBuffer[CMSG_SPACE(sizeof(int))];
+	memset(controlBuffer, 0, sizeof(controlBuffer));
+
+	struct msghdr message;
+	memset(&message, 0, sizeof(message));
+	message.msg_iov = &iov;
+	message.msg_iovlen = 1;
+	message.msg_control = controlBuffer;
+	message.msg_controllen = sizeof(controlBuffer);
+
+	if (recvmsg(unixSocketFD, &message, 0) <= 0)
+	{
+		BOOST_LOG_TRIVIAL(error) << "recvmsg() failed when receiving FD";
+		BOOST_LOG_TRIVIAL(error) << "errno: " << errno << ", error string: " << strerror(errno);
+		return -1;
+	}
+
+	struct cmsghdr* controlMessage = CMSG_FIRSTHDR(&message);
+
+	if (controlMessage == NULL || controlMessage->cmsg_level != SOL_SOCKET || controlMessage->cmsg_type != SCM_RIGHTS)
+	{
+		BOOST_LOG_TRIVIAL(error) << "No file descriptor was received";
+		return -1;
+	}
+
+	int receivedFD;
+	memcpy(&receivedFD, CMSG_DATA(controlMessage), sizeof(int));
+	return receivedFD;
+}
+
+
 //*************************************************************************************************
 int SocketManager::getLocalClientPort(int socketFD)
 {
@@ -492,6 +1100,9 @@ void SocketManager::removeClientSocket(int socketFD)
 	{
 		delete m_peerClientSockets.at(socketFD);
 		m_peerClientSockets.erase(socketFD);
+
+		if (m_isStreamCapture && m_rawFrameCapture.isEnabled())
+			m_rawFrameCapture.capture(socketFD, RawFrameCapture::SLOT_CONNECTION_CLOSED, NULL, 0);
 	}
 	//Remove from m_independantClientSockets if fdi was an independant client socket
 	else if (m_independantClientSockets.count(socketFD) > 0)
@@ -506,10 +1117,17 @@ void SocketManager::removeClientSocket(int socketFD)
 		m_timerMap.erase(socketFD);
 	}
 
+	m_peerAcceptSequence.erase(socketFD);
+	m_connectionQuotas.erase(socketFD);
+	m_quotaPausedFDs.erase(socketFD);
+	m_unsyncedDiscardedBytes.erase(socketFD);
+
 	//Remove from message map
-	if (m_messageMap.count(socketFD) > 0)
+	auto messageIter = m_messageMap.find(socketFD);
+	if (messageIter != m_messageMap.end())
 	{
-		m_messageMap.erase(socketFD);
+		MemoryAccounting::getInstance().add(MemoryAccounting::CONNECTION_BUFFERS, -(long) messageIter->second.size());
+		m_messageMap.erase(messageIter);
 	}
 }
 
@@ -584,178 +1202,167 @@ std::vector<std::string> SocketManager::splitString(std::string input, char deli
 
 //************************************************************************************************
 
-// !TODO the following content should be moved elsewhere
-#define SSTR( x ) dynamic_cast<std::ostringstream & >( \
-        ( std::ostringstream() << x ) ).str()
+//*************************************************************************************************
+bool SocketManager::loadFrameLayout()
+{
+	//Frame layout is read once from the configs (DataRecordType and BinaryDataSize)
+	ConfigurationHandler& configHandler = ConfigurationHandler::getInstance();
 
-std::string SocketManager::decodeMsg(std::vector<char>* buffer){ // retuns a general formatted string
+	int binaryRecordSize;
+	try
+	{
+		binaryRecordSize = std::stoi(configHandler.getConfig("BinaryDataSize"));
+	}
+	catch (std::exception &e)
+	{
+		BOOST_LOG_TRIVIAL(error) << "Exception thrown by std::stoi() in SocketManager::loadFrameLayout() when reading BinaryDataSize";
+		BOOST_LOG_TRIVIAL(error) << "Error: " << e.what();
+		return false;
+	}
 
-	union savedFloat{
-   		char buf[4];
-   		float number;
-	}savedFloat;
-	union savedLong{
-   		char buf[4];
-   		int32_t number;
-	}savedLong;
+	if (!m_frameLayout.load(configHandler.getConfig("DataRecordType"), binaryRecordSize))
+		return false;
 
-	ConfigurationHandler& configHandler = ConfigurationHandler::getInstance();
-	std::string dataRecordTypeString = configHandler.getConfig("DataRecordType");
-	std::vector<std::string> dataRecordType = splitString(dataRecordTypeString, ','); // should be loaded from the config file
-	std::string stringRecord="";
-	std::string stringVar=""; // variable extracted
-	int binaryRecordSize = std::stoi(configHandler.getConfig("BinaryDataSize"));//should be loaded from the config file
-	int counter=0;
-	int jump=0,jumpSum=0,i=0,j=0,k=0;
-	unsigned char check_sum;
-    std::vector<char>::iterator lastBreakingPosition=buffer->begin();
-	while(i<=buffer->size()){
-		if(jumpSum == binaryRecordSize)
-		{
-		    // binary data log
-
-		    std::ofstream binaryLog;
-            binaryLog.open ("binary.log",std::ios::app);
-
-            savedLong.buf[0] = (unsigned char)buffer->at(i-120);
-            savedLong.buf[1] = (unsigned char)buffer->at(i-119);
-            savedLong.buf[2] = (unsigned char)buffer->at(i-118);
-            savedLong.buf[3] = (unsigned char)buffer->at(i-117);
-
-            binaryLog << "Device Id: " << savedLong.number << " " << getCurrentDateTime() << "\n";
-
-            if(i-128 >= 0){
-                for(k=i-128;k<i;k++)
-                {
-                   savedLong.buf[0] = (unsigned char)buffer->at(k);
-                   savedLong.buf[1] = 0;
-                   savedLong.buf[2] = 0;
-                   savedLong.buf[3] = 0;
-                   binaryLog << savedLong.number;
-                   if((k-i+129)%4)
-                    binaryLog << " ";
-                   else
-                    binaryLog << " , ";
-                }
-            }
-
-            binaryLog << "\n";
-
-            binaryLog.close();
-
-		    // end binary data log
-
-			jumpSum=0;
-			j=0;
-			if((unsigned char)buffer->at(i-1) ==  255)
-			{
-			    check_sum = (unsigned char)0;
-			    for(k=i-3;k>=i-128 && k>=0;k--)
-                    check_sum = check_sum^(unsigned char)buffer->at(k);
-
-                if(check_sum == (unsigned char)buffer->at(i-2))
-                {
-                    stringRecord =  stringRecord + stringVar+"\n";
-                    lastBreakingPosition=buffer->begin()+i;
-                }
-			}
-			if(i==buffer->size())
-            {
-                buffer->erase(buffer->begin(),buffer->end());
-                return stringRecord;
-            }
+	BOOST_LOG_TRIVIAL(info) << "Binary frame size: " << m_frameLayout.getFrameSize() << " bytes, frame validation: " << m_frameValidator.getImplementationName();
+	return true;
+}
 
-			stringVar="";
-		}
-		if(dataRecordType[j] == "esc")
-		{
-				jump= 4;
-				if(i+jump>=buffer->size())
-				{
-				    buffer->erase(buffer->begin(),lastBreakingPosition);
-					return stringRecord;
-				}
 
-		}
-		else if(dataRecordType[j] == "int")
-		{
-				jump=4;
-				for(k=0;k<sizeof(savedLong.buf) && i+k<buffer->size();k++)
-                    savedLong.buf[k]=buffer->at(i+k);
-				if(i+jump>=buffer->size())
-				{
-				    buffer->erase(buffer->begin(),lastBreakingPosition);
-					return stringRecord;
-				}
-				if(!isnan(savedLong.number))
-					stringVar = stringVar + SSTR(savedLong.number)+",";
-				else
-					stringVar = stringVar + "NAN,";
-		}
-		else if(dataRecordType[j] == "float")
+//*************************************************************************************************
+std::string SocketManager::decodeFrame(const unsigned char* frame)
+{
+	std::ostringstream record;
+
+	for (auto& field: m_frameLayout.getFields())
+	{
+		const unsigned char* fieldData = frame + field.m_offset;
+		int32_t intValue;
+		float floatValue;
+
+		switch (field.m_type)
 		{
-				jump=4;
-			    for(k=0;k<sizeof(savedFloat.buf)&& i+k<buffer->size();k++)
-                    savedFloat.buf[k]=buffer->at(i+k);
-				if(i+jump>=buffer->size())
-				{
-				    buffer->erase(buffer->begin(),lastBreakingPosition);
-					return stringRecord;
-				}
-				if(!isnan(savedFloat.number))
-					stringVar = stringVar + SSTR(savedFloat.number)+",";
+			case FrameLayout::FIELD_INT:
+				memcpy(&intValue, fieldData, sizeof(intValue));
+				record << intValue << ",";
+				break;
+
+			case FrameLayout::FIELD_FLOAT:
+				memcpy(&floatValue, fieldData, sizeof(floatValue));
+
+				if (!isnan(floatValue))
+					record << floatValue << ",";
 				else
-					stringVar = stringVar + "NAN,";
+					record << "NAN,";
+				break;
+
+			case FrameLayout::FIELD_DATE_TIME:
+				memcpy(&intValue, fieldData, sizeof(intValue));
+				record << timeStampToHReadble(intValue - FrameLayout::DATE_TIME_OFFSET_SECONDS) << ",";
+				break;
+
+			case FrameLayout::FIELD_CHAR:
+				record << (int) fieldData[0] << ",";
+				break;
+
+			case FrameLayout::FIELD_SKIP:
+				break;
 		}
-		else if(dataRecordType[j] == "date_time")
+	}
+
+	return record.str();
+}
+
+
+//*************************************************************************************************
+std::string SocketManager::decodeMsg(int socketFD, std::vector<char>* buffer)
+{
+	//Returns newline separated records of comma separated values, decoded from complete frames at the start of the buffer
+	//When a frame fails validation, the buffer is scanned for the next position that ends in a valid frame (resynchronization),
+	//so that a corrupted or misaligned frame costs only the bytes up to the next valid frame
+	if (!m_frameLayout.isLoaded() && !loadFrameLayout())
+		return "";
+
+	const unsigned char* data = reinterpret_cast<const unsigned char*>(buffer->data());
+	size_t bufferSize = buffer->size();
+	size_t frameSize = m_frameLayout.getFrameSize();
+	size_t position = 0;
+
+	//Bytes discarded since the connection's last valid frame (data that never forms a valid frame is bounded by the hard limit)
+	long& unsyncedDiscardedBytes = m_unsyncedDiscardedBytes[socketFD];
+
+	std::string stringRecord;
+
+	while (bufferSize - position >= frameSize)
+	{
+		//Validate all complete frames in one pass, then decode the leading valid ones
+		size_t frameCount = (bufferSize - position) / frameSize;
+		size_t validCount = m_frameValidator.countValidFrames(data + position, frameSize, frameCount);
+
+		for (size_t n = 0; n < validCount; ++n)
 		{
-				jump=4;
-			    for(k=0;k<sizeof(savedLong.buf)&& i+k<buffer->size();k++)
-                    savedLong.buf[k]=buffer->at(i+k);
-				if(i+jump>=buffer->size())
-				{
-				    buffer->erase(buffer->begin(),lastBreakingPosition);
-					return stringRecord;
-				}
-				if(!isnan(savedLong.number))
-					stringVar = stringVar + timeStampToHReadble(savedLong.number-5*3600-30*60)+",";
-				else
-					stringVar = stringVar + "NAN,";
+			if (m_rawFrameCapture.isEnabled() && !m_isStreamCapture)
+				m_rawFrameCapture.capture(socketFD, RawFrameCapture::SLOT_FRAME, data + position, frameSize);
 
+			stringRecord += decodeFrame(data + position) + "\n";
+			position += frameSize;
 		}
-		else if(dataRecordType[j] == "char")
+
+		if (validCount > 0)
+			unsyncedDiscardedBytes = 0;
+
+		if (validCount == frameCount)
+			break;
+
+		if (m_rawFrameCapture.isEnabled() && !m_isStreamCapture)
+			m_rawFrameCapture.capture(socketFD, RawFrameCapture::SLOT_FRAME, data + position, frameSize);
+
+		++m_invalidFrameCount;
+
+		//Candidate frames start after the current position; only those ending in an end marker byte need to be validated
+		size_t searchPosition = position + frameSize;
+		size_t nextFramePosition = bufferSize - frameSize + 1;	//No complete valid frame: keep the last (frame size - 1) bytes
+
+		while (searchPosition < bufferSize)
 		{
-				jump=1;
-				if(i+jump>=buffer->size())
-				{
-				    buffer->erase(buffer->begin(),lastBreakingPosition);
-					return stringRecord;
-				}
-				savedLong.buf[0]=buffer->at(i);
-				savedLong.buf[1]=0;
-				savedLong.buf[2]=0;
-				savedLong.buf[3]=0;
-				stringVar = stringVar + SSTR(savedLong.number)+",";
+			const void* found = memchr(data + searchPosition, FrameValidator::FRAME_END_MARKER, bufferSize - searchPosition);
+
+			if (found == NULL)
+				break;
+
+			size_t endPosition = static_cast<const unsigned char*>(found) - data;
+			size_t candidatePosition = endPosition + 1 - frameSize;
+
+			if (m_frameValidator.isValidFrame(data + candidatePosition, frameSize))
+			{
+				nextFramePosition = candidatePosition;
+				break;
+			}
+
+			searchPosition = endPosition + 1;
 		}
-		else if(dataRecordType[j] == "end")
+
+		BOOST_LOG_TRIVIAL(debug) << "Invalid frame in received data; resynchronized by discarding " << nextFramePosition - position << " bytes";
+
+		++m_resyncCount;
+		m_resyncDiscardedByteCount += nextFramePosition - position;
+
+		bool wasWithinLimit = (unsyncedDiscardedBytes <= m_bufferedMessageHardLimit);
+		unsyncedDiscardedBytes += nextFramePosition - position;
+
+		if (wasWithinLimit && unsyncedDiscardedBytes > m_bufferedMessageHardLimit)
 		{
-				jump=1;
-				if(i+jump>=buffer->size())
-				{
-				    buffer->erase(buffer->begin(),lastBreakingPosition);
-					return stringRecord;
-				}
+			++m_bufferLimitExceededCount;
+			BOOST_LOG_TRIVIAL(warning) << "Discarded data without a valid frame exceeded hard limit (" << unsyncedDiscardedBytes << " bytes), FD: " << socketFD;
 		}
-		j++;
-		i+=jump;
-		jumpSum+=jump;
+
+		position = nextFramePosition;
 	}
-	buffer->erase(buffer->begin(),lastBreakingPosition);
+
+	buffer->erase(buffer->begin(), buffer->begin() + position);
 	return stringRecord;
 }
 
 
-
 //*************************************************************************************************
 void SocketManager::parseReceivedData(int socketFD, char* dataBuffer, int dataLength)
 {
@@ -763,13 +1370,23 @@ void SocketManager::parseReceivedData(int socketFD, char* dataBuffer, int dataLe
 	if (dataLength < 1)
 		return;
 
+	if (m_rawFrameCapture.isEnabled() && m_isStreamCapture && m_peerClientSockets.count(socketFD) > 0)
+		m_rawFrameCapture.capture(socketFD, RawFrameCapture::SLOT_STREAM_DATA, reinterpret_cast<unsigned char*>(dataBuffer), dataLength);
+
 	std::vector<char>* messageVec = &m_messageMap[socketFD];
+	long previousBufferSize = messageVec->size();
 	messageVec->insert(messageVec->end(), &dataBuffer[0], &dataBuffer[dataLength]);
 
-	// New code to convert from binary. !TODO this must be changed.
-	std::string binaryEncodedData(m_messageMap[socketFD].begin(),m_messageMap[socketFD].end());
 	BOOST_LOG_TRIVIAL(debug) << "Decoding";
-    std::string decodedData = decodeMsg(&m_messageMap[socketFD]);
+	std::string decodedData = decodeMsg(socketFD, messageVec);
+
+	//Resynchronization keeps less than a frame buffered; a connection sending only invalid data is closed under the disconnect policy
+	bool isBufferLimitExceeded = (m_isBufferLimitDisconnect && m_unsyncedDiscardedBytes[socketFD] > m_bufferedMessageHardLimit);
+
+	//Account the change in bytes held for this connection (before callbacks may remove it)
+	MemoryAccounting::getInstance().add(MemoryAccounting::CONNECTION_BUFFERS, (long) messageVec->size() - previousBufferSize);
+
+	int recordCount = 0;
 //	std::string decodedData = decodeMsg(binaryEncodedData);
     //***********************
 //	m_messageMap[socketFD].clear();
@@ -797,6 +1414,7 @@ void SocketManager::parseReceivedData(int socketFD, char* dataBuffer, int dataLe
 			//Construct a message from data up to the terminating character and erase that part from the vector
 			std::string fullMessage(decodedData.begin(), iter);
 			decodedData.erase(decodedData.begin(), ++iter);
+			++recordCount;
 			//Fire OnData callback with the message
 			ClientSocket* clientSocket = getClientSocket(socketFD);
 
@@ -816,5 +1434,30 @@ void SocketManager::parseReceivedData(int socketFD, char* dataBuffer, int dataLe
 			break;
 		}
 	}
+
+	//The connection may have been closed in a callback
+	if (m_messageMap.count(socketFD) == 0)
+		return;
+
+	if (isBufferLimitExceeded && m_isBufferLimitDisconnect)
+	{
+		BOOST_LOG_TRIVIAL(warning) << "Discarded data without a valid frame exceeded hard limit; closing connection, FD: " << socketFD;
+
+		ClientSocket* clientSocket = getClientSocket(socketFD);
+
+		if (clientSocket->getClientType() == 1) //client side client
+			clientSocket->getCallback()->OnDisconnect(clientSocket);
+
+		if (clientSocket->getClientType() == 2) //server side client
+			clientSocket->getCallback()->OnDisconnect(m_serverSocket, clientSocket);
+
+		//OnDisconnect may already have closed the connection
+		if (m_messageMap.count(socketFD) > 0)
+			closeClientSocket(socketFD);
+
+		return;
+	}
+
+	consumeQuota(socketFD, dataLength, recordCount);
 }
 
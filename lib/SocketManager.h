@@ -1,7 +1,13 @@
 #pragma once
 
 #include <unordered_map>
+#include <map>
 #include <vector>
+#include <fstream>
+
+#include <FrameLayout.h>
+#include <FrameValidator.h>
+#include <RawFrameCapture.h>
 
 class ServerSocket;
 class ClientSocket;
@@ -10,6 +16,8 @@ class SocketCallback;
 
 class SocketManager
 {
+	friend class IngestBenchmark;	//benchmarks frame decoding and reassembly without sockets
+
 public:
 	SocketManager();
 	~SocketManager();
@@ -18,7 +26,37 @@ public:
 	void setBufferedMessageHardLimit(int hardLimit);
 	void setMsgTerminationCharacter(char character);
 
+	//Invalid data is always discarded by resynchronization (see decodeMsg()); when a connection's data discarded since its last valid frame
+	//exceeds the buffered message hard limit, it is counted and (with isDisconnect) the connection is closed
+	void setBufferedMessageLimitPolicy(bool isDisconnect);
+
+	//Per peer connection input quotas (token buckets; 0 = unlimited); a connection exceeding a quota is not read until it is refilled
+	void setConnectionQuotas(long bytesPerSecond, long recordsPerSecond, int burstSeconds);
+
+	//Listen backlog (capped by the kernel at net.core.somaxconn) and max. no. of connections accepted per poll cycle;
+	//both decide how a burst of connections (eg: all devices reconnecting after a restart) is absorbed
+	void setAcceptParameters(int listenBacklog, int acceptBatchSize);
+
 	ServerSocket* createServer(char* serverPort, SocketCallback* callback);
+
+	//Zero-downtime restart: a new process takes over the listening socket of a running process via a Unix socket
+	ServerSocket* inheritServer(const char* handoffSocketPath, SocketCallback* callback);
+	bool enableServerHandoff(const char* handoffSocketPath);
+	bool isServerHandedOff() { return m_isServerHandedOff; }
+
+	//Read-side flow control: peer connections are not read while paused (TCP flow control holds back the remote ends)
+	//Connections accepted while paused start paused
+	void pausePeerReading();
+	void resumePeerReading();
+	bool isPeerReadingPaused() { return m_isPeerReadingPaused; }
+
+	void dumpSocketInformation(std::ofstream& fileStream);
+
+	//Received frames (valid and invalid) are written to a ring file while capture is enabled; SIGUSR2 toggles capture at runtime
+	//In stream mode, the bytes of each read from peer connections and connection open/close events are captured instead (for replay)
+	void configureRawFrameCapture(const std::string& filename, long fileSizeBytes, bool isStreamCapture, bool isEnabled);
+	bool setRawFrameCaptureEnabled(bool isEnabled);
+
 	ClientSocket* createClient(char* remoteServerIP, char* remoteServerPort, SocketCallback* callback);
 	Timer* createTimer(int intervalSeconds, std::string timerName, SocketCallback* callback);
 
@@ -34,6 +72,23 @@ private:
 	static void getLocalIP(int socketFD, char* returnIP);
 	static void getRemoteIP(int socketFD, char* returnIP);
 
+	static bool sendFileDescriptor(int unixSocketFD, int FDToSend);
+	static int receiveFileDescriptor(int unixSocketFD);
+
+	bool handOffServerSocket();
+
+	//Accept a pending connection on the (non-blocking) server socket; false if there is none
+	bool acceptPeerConnection(int serverSocketFD, int& fdmax);
+
+	//Close the most recently accepted peer connection (under memory pressure), only while connection buffers hold at least half of the
+	//overage of the memory budget; rate limited, and limited per pressure episode
+	void shedNewestConnection();
+
+	//Input quotas
+	bool consumeQuota(int socketFD, long byteCount, long recordCount);
+	long resumeQuotaPausedConnections();	//returns milliseconds until the next connection is resumed (-1 if none is paused)
+	static long getMonotonicTimeMs();
+
 	void removeClientSocket(int socketFD);
 	ClientSocket* getClientSocket(int socketFD);
 
@@ -48,7 +103,11 @@ private:
 	std::vector<std::string> splitString(std::string input, char delimeter);
 
 	// binary data decoding.!TODO this must be removed.
-	std::string decodeMsg(std::vector<char>* buffer);
+	std::string decodeMsg(int socketFD, std::vector<char>* buffer);
+
+	//Binary frames: fields as given by config DataRecordType, followed by an XOR checksum byte and an end marker byte
+	bool loadFrameLayout();
+	std::string decodeFrame(const unsigned char* frame);
 
 	//Form a valid message here and fire OnData callback
 	void parseReceivedData(int socketFD, char* dataBuffer, int dataLength);
@@ -60,6 +119,47 @@ private:
 	//map of peer client sockets created by above server --> to extend, list/map of such maps
 	std::unordered_map<int, ClientSocket*> m_peerClientSockets;
 
+	//Accept order of peer client sockets (key=FD, value=sequence no.)
+	std::unordered_map<int, unsigned long> m_peerAcceptSequence;
+	unsigned long m_acceptCount;
+	int m_listenBacklog;
+	int m_acceptBatchSize;
+	unsigned long m_shedConnectionCount;
+	unsigned long m_fdLimitRejectCount;	//connections closed at accept, as their FD cannot be used with select()
+	int m_episodeShedCount;	//connections shed in the current memory pressure episode
+	long m_lastShedTimeMs;
+
+	bool m_isPeerReadingPaused;
+
+	bool m_isBufferLimitDisconnect;
+	unsigned long m_bufferLimitExceededCount;
+	std::unordered_map<int, long> m_unsyncedDiscardedBytes;	//key=FD, value=bytes discarded since the connection's last valid frame
+
+	struct ConnectionQuota
+	{
+		double m_byteTokens;
+		double m_recordTokens;
+		long m_lastRefillTimeMs;
+	};
+
+	long m_quotaBytesPerSecond;
+	long m_quotaRecordsPerSecond;
+	int m_quotaBurstSeconds;
+	std::unordered_map<int, ConnectionQuota> m_connectionQuotas;
+	std::map<int, long> m_quotaPausedFDs;	//key=FD, value=time to resume (monotonic ms)
+	unsigned long m_quotaPauseCount;
+
+	FrameLayout m_frameLayout;
+	FrameValidator m_frameValidator;
+	unsigned long m_invalidFrameCount;
+	unsigned long m_resyncCount;
+	unsigned long m_resyncDiscardedByteCount;
+
+	RawFrameCapture m_rawFrameCapture;
+	std::string m_rawFrameCaptureFilename;
+	long m_rawFrameCaptureFileSize;
+	bool m_isStreamCapture;
+
 	//map of client sockets created independently by the application developer
 	//mostly used only in client side applications
 	std::unordered_map<int, ClientSocket*> m_independantClientSockets;
@@ -75,6 +175,12 @@ private:
 	int m_bufferedMessageHardLimit;
 	char m_msgTerminationCharacter;
 
+	//Listening Unix socket on which a new process requests the server socket (-1 if handoff is not enabled)
+	int m_handoffSocketFD;
+	bool m_isServerHandedOff;
+
+	bool m_isRunning;
+
 	//For socket communication
 	fd_set m_masterFDSet;
 	fd_set m_readFDSet;
@@ -1,3 +1,5 @@
+#include <time.h>
+
 #include <Timer.h>
 
 
@@ -6,6 +8,9 @@ Timer::Timer():
 	m_timerFD{-1},
 	m_timerIntervalSeconds{-1},
 	m_timerName{""},
+	m_firstDueTimeNs{0},
+	m_expirationCount{0},
+	m_missedExpirationCount{0},
 	m_socketMan{nullptr},
 	m_callback{nullptr}
 {
@@ -17,6 +22,9 @@ Timer::Timer(int FD, int intervalSeconds, std::string name,  SocketManager* sock
 		m_timerFD{FD},
 		m_timerIntervalSeconds{intervalSeconds},
 		m_timerName{name},
+		m_firstDueTimeNs{0},
+		m_expirationCount{0},
+		m_missedExpirationCount{0},
 		m_socketMan{socketMan},
 		m_callback{callback}
 {
@@ -55,3 +63,40 @@ SocketCallback* Timer::getCallback()
 {
 	return m_callback;
 }
+
+
+//*************************************************************************************************
+void Timer::setFirstDueTime(long long firstDueTimeNs)
+{
+	m_firstDueTimeNs = firstDueTimeNs;
+}
+
+
+//*************************************************************************************************
+void Timer::recordExpirations(unsigned long long expirationCount)
+{
+	if (expirationCount == 0)
+		return;
+
+	m_expirationCount += expirationCount;
+	m_missedExpirationCount += expirationCount - 1;
+}
+
+
+//*************************************************************************************************
+long long Timer::getLastDueTime()
+{
+	if (m_expirationCount == 0)
+		return m_firstDueTimeNs;
+
+	return m_firstDueTimeNs + (long long) (m_expirationCount - 1) * m_timerIntervalSeconds * 1000000000;
+}
+
+
+//*************************************************************************************************
+long long Timer::getMonotonicTimeNs()
+{
+	struct timespec timeSpec;
+	clock_gettime(CLOCK_MONOTONIC, &timeSpec);
+	return (long long) timeSpec.tv_sec * 1000000000 + timeSpec.tv_nsec;
+}
@@ -21,12 +21,26 @@ public:
 	void subscribe(SocketCallback* callback);
 	SocketCallback* getCallback();
 
+	//Expiration tracking (CLOCK_MONOTONIC, ns): the timer is due at first due time + n * interval
+	//Expirations that passed while the run loop was busy are reported together (missed = all but one of them)
+	void setFirstDueTime(long long firstDueTimeNs);
+	void recordExpirations(unsigned long long expirationCount);
+	long long getLastDueTime();	//due time of the latest expiration
+	unsigned long long getExpirationCount() { return m_expirationCount; }
+	unsigned long long getMissedExpirationCount() { return m_missedExpirationCount; }
+
+	static long long getMonotonicTimeNs();
+
 private:
 	
 	int m_timerFD;
 	std::string m_timerName;
 	int m_timerIntervalSeconds;
 
+	long long m_firstDueTimeNs;
+	unsigned long long m_expirationCount;
+	unsigned long long m_missedExpirationCount;
+
 	SocketManager* m_socketMan;
 	SocketCallback* m_callback;
 };
@@ -0,0 +1,283 @@
+//compile with CMake
+//Usage: ./timer_check_bench <config_filename>
+
+//Event loop timer benchmark: the data recorder's timers (heartbeat, cache flush, FD check) run in a SocketManager loop
+//that also receives synthetic device load (binary frames over many connections, sent by a thread of this program)
+//Blocking work on the reactor thread is simulated per record (eg: per record database work) and in the cache flush timer
+//(eg: a blocking batch write); for each timer, the delay between becoming due and OnTimer running is reported
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+
+#include <Logger.h>
+#include <SocketCommunication.h>
+#include <ConfigurationHandler.h>
+#include <FrameEncoder.h>
+
+
+//*************************************************************************************************
+static void busyWait(long long durationNs)
+{
+	long long endTimeNs = Timer::getMonotonicTimeNs() + durationNs;
+	while (Timer::getMonotonicTimeNs() < endTimeNs);
+}
+
+
+//*************************************************************************************************
+static std::string getPercentiles(std::vector<double> valuesMs)
+{
+	if (valuesMs.empty())
+		return "no samples";
+
+	std::sort(valuesMs.begin(), valuesMs.end());
+
+	auto percentile = [&valuesMs](double p) { return valuesMs[std::min(valuesMs.size() - 1, (size_t) (p / 100 * valuesMs.size()))]; };
+
+	std::ostringstream result;
+	result << "p50 = " << percentile(50) << ", p90 = " << percentile(90) << ", p99 = " << percentile(99) << ", max = " << valuesMs.back();
+	return result.str();
+}
+
+
+/*
+This class runs the benchmark: the SocketManager loop (server and timers) on the main thread and the load sender on another thread
+*/
+class TimerBenchApp: public SocketCallback
+{
+public:
+	TimerBenchApp() {}
+	~TimerBenchApp() {}
+
+	bool initialize()
+	{
+		ConfigurationHandler& configHandler = ConfigurationHandler::getInstance();
+
+		try
+		{
+			m_durationSeconds = std::stoi(configHandler.getConfig("BenchDurationSeconds"));
+			m_connectionCount = std::stoi(configHandler.getConfig("BenchConnectionCount"));
+			m_recordsPerSecond = std::stol(configHandler.getConfig("BenchRecordsPerSecond"));
+			m_recordWorkNs = std::stol(configHandler.getConfig("BenchRecordWorkMicroseconds")) * 1000;
+			m_flushStallNs = std::stol(configHandler.getConfig("BenchCacheFlushStallMilliseconds")) * 1000000;
+
+			if (!m_encoder.initialize(configHandler.getConfig("DataRecordType"), std::stoi(configHandler.getConfig("BinaryDataSize"))))
+				return false;
+
+			m_servicePort = configHandler.getConfig("BenchServicePort");
+
+			m_heartbeatTimer = m_socketMan.createTimer(std::stoi(configHandler.getConfig("HeartbeatTimerInterval")), "Heartbeat Timer", this);
+			m_cacheFlushTimer = m_socketMan.createTimer(std::stoi(configHandler.getConfig("CacheFlushTimerInterval")), "Cache Flush Timer", this);
+			m_FDCheckTimer = m_socketMan.createTimer(std::stoi(configHandler.getConfig("FDCheckTimerInterval")), "FD Check Timer", this);
+			m_endTimer = m_socketMan.createTimer(m_durationSeconds, "Benchmark End Timer", this);
+		}
+		catch (std::exception &e)
+		{
+			std::cout << "Error reading integer configs: " << e.what() << std::endl;
+			return false;
+		}
+
+		if (!m_heartbeatTimer || !m_cacheFlushTimer || !m_FDCheckTimer || !m_endTimer)
+			return false;
+
+		if (m_socketMan.createServer((char*) m_servicePort.c_str(), this) == nullptr)
+		{
+			std::cout << "Unable to create server on port " << m_servicePort << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	void run()
+	{
+		std::cout << "Running for " << m_durationSeconds << " s: " << m_connectionCount << " connections, " << m_recordsPerSecond
+					<< " records/s, " << m_recordWorkNs / 1000 << " us work per record, " << m_flushStallNs / 1000000
+					<< " ms stall in cache flush timer" << std::endl;
+
+		m_socketMan.run();
+	}
+
+	void OnData(ServerSocket* server, ClientSocket* client, std::string message) override
+	{
+		++m_receivedRecordCount;
+
+		if (m_recordWorkNs > 0)
+			busyWait(m_recordWorkNs);
+	}
+
+	void OnPollCycleEnd(ServerSocket* server) override
+	{
+		//Longest poll cycle (select() wait and handling of the ready FDs)
+		long long nowNs = Timer::getMonotonicTimeNs();
+
+		//The server socket listens once the loop runs
+		if (m_pollCycleCount == 0)
+			m_loadThread = std::thread(&TimerBenchApp::sendLoad, this);
+
+		if (m_lastPollCycleEndNs > 0)
+			m_maxPollCycleNs = std::max(m_maxPollCycleNs, nowNs - m_lastPollCycleEndNs);
+
+		m_lastPollCycleEndNs = nowNs;
+		++m_pollCycleCount;
+	}
+
+	void OnTimer(Timer* timer) override
+	{
+		//Delay between the (latest) expiration and this callback
+		double delayMs = (Timer::getMonotonicTimeNs() - timer->getLastDueTime()) / 1e6;
+
+		if (timer == m_endTimer)
+		{
+			printReport();
+			m_isStopping = true;
+			m_loadThread.join();
+			exit(0);
+		}
+
+		m_timerDelaysMs[timer].push_back(delayMs);
+
+		if (timer == m_cacheFlushTimer && m_flushStallNs > 0)
+		{
+			struct timespec stall = {(time_t) (m_flushStallNs / 1000000000), (long) (m_flushStallNs % 1000000000)};
+			nanosleep(&stall, NULL);
+		}
+	}
+
+private:
+	void sendLoad()
+	{
+		std::vector<int> socketFDs;
+
+		for (int i = 0; i < m_connectionCount; ++i)
+		{
+			int socketFD = socket(AF_INET, SOCK_STREAM, 0);
+
+			struct sockaddr_in address;
+			memset(&address, 0, sizeof(address));
+			address.sin_family = AF_INET;
+			address.sin_port = htons(std::stoi(m_servicePort));
+			address.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+			if (socketFD == -1 || connect(socketFD, (struct sockaddr*) &address, sizeof(address)) == -1)
+			{
+				std::cout << "Load sender unable to connect; errno: " << errno << ", error string: " << strerror(errno) << std::endl;
+				return;
+			}
+
+			socketFDs.push_back(socketFD);
+		}
+
+		std::vector<unsigned char> frame(m_encoder.getFrameSize());
+		m_encoder.clearFrame(frame.data());
+		m_encoder.finalizeFrame(frame.data());
+
+		//Records are sent in 1 ms slices, round robin over the connections
+		long long startTimeNs = Timer::getMonotonicTimeNs();
+		long sentCount = 0;
+		size_t connectionIndex = 0;
+
+		while (!m_isStopping)
+		{
+			long dueCount = (Timer::getMonotonicTimeNs() - startTimeNs) * m_recordsPerSecond / 1000000000;
+
+			for (; sentCount < dueCount; ++sentCount)
+			{
+				if (send(socketFDs[connectionIndex], frame.data(), frame.size(), MSG_NOSIGNAL) != (ssize_t) frame.size())
+					std::cout << "Load sender send() failed; errno: " << errno << ", error string: " << strerror(errno) << std::endl;
+
+				connectionIndex = (connectionIndex + 1) % socketFDs.size();
+			}
+
+			struct timespec slice = {0, 1000000};
+			nanosleep(&slice, NULL);
+		}
+
+		for (int socketFD: socketFDs)
+			close(socketFD);
+	}
+
+	void printReport()
+	{
+		std::cout << "\n***********************************************" << std::endl;
+		std::cout << "Records received: " << m_receivedRecordCount << " (" << m_receivedRecordCount / m_durationSeconds << "/s), poll cycles: "
+					<< m_pollCycleCount << ", longest poll cycle: " << m_maxPollCycleNs / 1e6 << " ms" << std::endl;
+
+		for (Timer* timer: {m_heartbeatTimer, m_cacheFlushTimer, m_FDCheckTimer})
+		{
+			std::cout << timer->getTimerName() << " (" << timer->getTimerInterval() << " s): fired " << m_timerDelaysMs[timer].size()
+						<< " times, missed expirations: " << timer->getMissedExpirationCount()
+						<< "; delay (ms): " << getPercentiles(m_timerDelaysMs[timer]) << std::endl;
+		}
+	}
+
+	SocketManager m_socketMan;
+	FrameEncoder m_encoder;
+	std::string m_servicePort;
+
+	int m_durationSeconds = 0;
+	int m_connectionCount = 0;
+	long m_recordsPerSecond = 0;
+	long m_recordWorkNs = 0;
+	long m_flushStallNs = 0;
+
+	Timer* m_heartbeatTimer = nullptr;
+	Timer* m_cacheFlushTimer = nullptr;
+	Timer* m_FDCheckTimer = nullptr;
+	Timer* m_endTimer = nullptr;
+
+	std::map<Timer*, std::vector<double>> m_timerDelaysMs;
+	long m_receivedRecordCount = 0;
+	long m_pollCycleCount = 0;
+	long long m_lastPollCycleEndNs = 0;
+	long long m_maxPollCycleNs = 0;
+
+	std::thread m_loadThread;
+	std::atomic<bool> m_isStopping{false};
+};
+
+
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		std::cout << "Usage: ./timer_check_bench <config_filename>" << std::endl;
+		return -1;
+	}
+
+	ConfigurationHandler& configHandler = ConfigurationHandler::getInstance();
+	if (configHandler.loadConfigurations(argv[1]) == false)
+	{
+		std::cout << "Error loading configurations; exiting..." << std::endl;
+		return -1;
+	}
+
+	//Warnings only (late timers are logged by SocketManager)
+	initializeLog(2, 10, 2, "timer_check_bench_log");
+
+	TimerBenchApp benchApp;
+
+	if (benchApp.initialize() == false)
+	{
+		std::cout << "Error initializing benchmark; exiting..." << std::endl;
+		return -1;
+	}
+
+	benchApp.run();
+
+	return 1;
+}